@@ -1,28 +1,130 @@
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "binary_tree.h"
+#include "memory_tags.h"
+#include "string_pool.h"
 
 #define CHECK_NULL(value, action) if (value == NULL) { action; }
 
+//-----------------------------------------------------------------------------
+// Nodes are allocated one by one, until relayoutTree copies all of them into
+// the arena. Nodes added after that are allocated one by one again. Values
+// are in the string pool, or in the packed blocks after packValues.
+//-----------------------------------------------------------------------------
 struct BinaryTree
 {
-    BTNode* root = NULL;
+    BTNode*     root       = NULL;
+    StringPool* strings    = NULL;
+    char*       arena      = NULL;
+    char*       packed     = NULL;
+    size_t      packedSize = 0;
 };
 
+static const uint32_t BT_NODE_NO_ID   = UINT32_MAX;
+static const uint32_t BT_MAX_COUNTER  = (1u << 30) - 1;
+
+static const uint64_t BT_OBJECT_SEED   = 14695981039346656037ull; // FNV offset basis
+static const uint64_t BT_QUESTION_SEED = BT_OBJECT_SEED ^ 0x5155455354494F4Eull;
+
+//-----------------------------------------------------------------------------
+// Value is stored together with its length and hash, so comparisons can be 
+// rejected without touching the string. Values of up to BT_INLINE_LENGTH 
+// characters are stored right in the node, longer ones are pointers to the 
+// tree's string pool (at data + 2 to be aligned).
+//
+// Packed values have BT_PACKED_TAG in data[0], the pointer is to their block 
+// and data[1] is their number in it. Blocks hold BT_PACKED_BLOCK sorted 
+// values, each of them is the length of the prefix shared with the previous
+// one, the length of the rest and the rest. So a value is unpacked from at
+// most BT_PACKED_BLOCK entries, into one of the thread's buffers.
+//-----------------------------------------------------------------------------
+static const size_t   BT_INLINE_LENGTH     = 9;
+static const uint16_t BT_HUGE_LENGTH       = UINT16_MAX;
+static const size_t   BT_PACKED_MAX_LENGTH = UINT8_MAX;
+static const size_t   BT_PACKED_BLOCK      = 16;
+static const size_t   BT_PACKED_BUFFERS    = 4;
+static const char     BT_PACKED_TAG        = 1;
+
+static thread_local char   unpackBuffers[BT_PACKED_BUFFERS][BT_PACKED_MAX_LENGTH + 1];
+static thread_local size_t unpackNext = 0;
+
+//-----------------------------------------------------------------------------
+// A value being packed or moved to the new pool. Values that are packed 
+// already are unpacked into a scratch pool, so that they can be sorted.
+//-----------------------------------------------------------------------------
+struct BTPackedValue
+{
+    const char* value;
+    BTNode*     node;
+};
+
+struct BTString
+{
+    uint32_t hash;
+    uint16_t length;
+    char     data[BT_INLINE_LENGTH + 1];
+};
+
+//-----------------------------------------------------------------------------
+// Objects never have children and questions always have two, so there are 
+// two node layouts. BTNode is the common part and the whole of an object 
+// node, BTQuestion extends it with the children. counter is the number of 
+// hits for objects and the number of leaves in the subtree for questions.
+// isInArena nodes are parts of the tree's arena and aren't freed separately.
+//
+// Questions also keep the structural (Merkle) hash of their subtree: it 
+// depends on the question and on the hashes of both children, so equal 
+// hashes mean equal subtrees. Objects' hashes depend only on their values
+// and are calculated when needed, so object nodes don't get bigger.
+//-----------------------------------------------------------------------------
 struct BTNode
 {
-    BTElem_t value;
+    BTString value;
+    BTNode*  parent;
+
+    uint32_t id;
+    uint32_t isQuestion : 1;
+    uint32_t isInArena  : 1;
+    uint32_t counter    : 30;
+};
+
+struct BTQuestion
+{
+    BTNode   node;
 
-    BTNode* parent = NULL;
-    BTNode* left   = NULL;
-    BTNode* right  = NULL;
+    BTNode*  left;
+    BTNode*  right;
+    uint64_t hash;
 };
 
+#define AS_QUESTION(node) ((BTQuestion*) (node))
+
 BinaryTree* construct  (BinaryTree* tree);
 void        destroy    (BinaryTree* tree);
 bool        deleteNode (BTNode* node, va_list args);
 
+BTString    makeString (BTElem_t value);
+const char* getString  (const BTString* str);
+const char* unpackString (const char* block, size_t number);
+bool        isEqual    (const BTString* str1, const BTString* str2);
+
+void        recountLeaves   (BTNode* node);
+bool        countLeavesStep (BTNode* node, va_list args);
+uint64_t    hashValue       (BTNode* node, uint64_t seed);
+uint64_t    mixHash         (uint64_t hash);
+
+size_t      measureSubtree (BTNode* node, size_t* nodesCount, size_t* bytes);
+void        layoutLevels   (BTNode* node, size_t height, BTNode** order, size_t* count);
+void        layoutBottoms  (BTNode* node, size_t depth, size_t height, BTNode** order, size_t* count);
+
+void        collectValues  (BTNode* node, BTPackedValue* packed, size_t* packedCount, BTPackedValue* pooled, size_t* pooledCount,
+                            bool (*isCold)(BTNode* node, va_list args), va_list args);
+int         compareValues  (const void* value1, const void* value2);
+size_t      packSorted     (BTPackedValue* values, size_t count, char* packed);
+
+bool visitNode         (bool (*function)(BTNode* node, va_list args), BTNode* node, va_list args);
 bool preOrderTraverse  (BTNode* subRoot, bool (*function)(BTNode* node, va_list args), va_list args);
 bool inOrderTraverse   (BTNode* subRoot, bool (*function)(BTNode* node, va_list args), va_list args);
 bool postOrderTraverse (BTNode* subRoot, bool (*function)(BTNode* node, va_list args), va_list args);
@@ -31,17 +133,21 @@ BinaryTree* construct(BinaryTree* tree)
 {
     CHECK_NULL(tree, return NULL);
 
-    tree->root = NULL;
+    tree->root    = NULL;
+    tree->strings = newStringPool();
+    CHECK_NULL(tree->strings, return NULL);
 
     return tree;
 }
 
 BinaryTree* newTree()
 {
-    BinaryTree* tree = (BinaryTree*) calloc(1, sizeof(BinaryTree));
+    BinaryTree* tree = (BinaryTree*) memAlloc(MEM_TREE, 1, sizeof(BinaryTree));
     CHECK_NULL(tree, return NULL);
 
-    return construct(tree);
+    CHECK_NULL(construct(tree), memFree(tree); return NULL);
+
+    return tree;
 }
 
 void destroy(BinaryTree* tree)
@@ -50,7 +156,11 @@ void destroy(BinaryTree* tree)
 
     postOrderTraverse(tree->root, &deleteNode);
 
-    tree->root = NULL;
+    deleteStringPool(tree->strings);
+    memFree(tree->arena);
+    memFree(tree->packed);
+
+    *tree = {};
 }
 
 void deleteTree(BinaryTree* tree)
@@ -58,14 +168,21 @@ void deleteTree(BinaryTree* tree)
     assert(tree != NULL);
 
     destroy(tree);
-    free(tree);
+    memFree(tree);
 }
 
+//-----------------------------------------------------------------------------
+//! Creates an object (leaf) node.
+//-----------------------------------------------------------------------------
 BTNode* newNode()
 {
-    BTNode* node = (BTNode*) calloc(1, sizeof(BTNode));
+    BTNode* node = (BTNode*) memAlloc(MEM_TREE, 1, sizeof(BTNode));
     CHECK_NULL(node, return NULL);
 
+    node->id         = BT_NODE_NO_ID;
+    node->isQuestion = false;
+    node->counter    = 0;
+
     return node;
 }
 
@@ -74,20 +191,111 @@ BTNode* newNode(BTElem_t value)
     BTNode* node = newNode();
     CHECK_NULL(node, return NULL);
 
-    node->value = value;
+    node->value = makeString(value);
 
     return node;
 }
 
+//-----------------------------------------------------------------------------
+//! Creates a question node, its children have to be set before the tree is
+//! used.
+//-----------------------------------------------------------------------------
+BTNode* newQuestion(BTElem_t value)
+{
+    BTQuestion* question = (BTQuestion*) memAlloc(MEM_TREE, 1, sizeof(BTQuestion));
+    CHECK_NULL(question, return NULL);
+
+    question->node.value      = makeString(value);
+    question->node.id         = BT_NODE_NO_ID;
+    question->node.isQuestion = true;
+    question->node.counter    = 0;
+    question->hash            = 0;
+
+    return &question->node;
+}
+
+//-----------------------------------------------------------------------------
+//! Memory of a node from the arena is reclaimed only by the next 
+//! relayoutTree or when the tree is deleted.
+//-----------------------------------------------------------------------------
 void deleteNode(BTNode* node)
 {
     assert(node != NULL);
 
     node->parent = NULL;
-    node->left   = NULL;
-    node->right  = NULL;
 
-    free(node);
+    if (node->isQuestion)
+    {
+        AS_QUESTION(node)->left  = NULL;
+        AS_QUESTION(node)->right = NULL;
+    }
+
+    if (!node->isInArena) { memFree(node); }
+}
+
+//-----------------------------------------------------------------------------
+//! Puts newNode in place of oldNode, oldNode is detached but not deleted.
+//!
+//! @param [in] tree
+//! @param [in] oldNode
+//! @param [in] newNode
+//-----------------------------------------------------------------------------
+void replaceNode(BinaryTree* tree, BTNode* oldNode, BTNode* newNode)
+{
+    assert(tree    != NULL);
+    assert(oldNode != NULL);
+    assert(newNode != NULL);
+
+    BTNode* parent = oldNode->parent;
+
+    if      (parent == NULL)  { tree->root = newNode; }
+    else if (isLeft(oldNode)) { AS_QUESTION(parent)->left  = newNode; }
+    else                      { AS_QUESTION(parent)->right = newNode; }
+
+    newNode->parent = parent;
+    oldNode->parent = NULL;
+}
+
+//-----------------------------------------------------------------------------
+//! Turns an object node without children into a question node with the same
+//! value and id. The old node is deleted.
+//!
+//! @return the new question node.
+//-----------------------------------------------------------------------------
+BTNode* makeQuestion(BinaryTree* tree, BTNode* node)
+{
+    assert(tree != NULL);
+    assert(node != NULL);
+
+    if (node->isQuestion) { return node; }
+
+    BTNode* question = newQuestion(NULL);
+    CHECK_NULL(question, return NULL);
+
+    question->value = node->value;
+    question->id    = node->id;
+
+    replaceNode(tree, node, question);
+    deleteNode(node);
+
+    return question;
+}
+
+bool isQuestion(BTNode* node)
+{
+    assert(node != NULL);
+
+    return node->isQuestion;
+}
+
+size_t getLeafNodeSize()
+{
+    return sizeof(BTNode);
+}
+
+size_t getQuestionNodeSize()
+{
+    return sizeof(BTQuestion);
 }
 
 bool deleteNode(BTNode* node, va_list args)
@@ -97,17 +305,34 @@ bool deleteNode(BTNode* node, va_list args)
     return BT_TRAVERSE_RUN;
 }
 
-#define TRAVERSE_SUBTREE(traverse, side) if (traverse(subRoot->side, function, args)  == !BT_TRAVERSE_RUN) \
-                                         {                                                                 \
-                                             return !BT_TRAVERSE_RUN;                                      \
-                                         }
+//-----------------------------------------------------------------------------
+// Every visit gets its own copy of the arguments. On some ABIs (e.g. x86-64
+// System V) va_list is passed by reference, so the arguments read by one 
+// visit would be gone for the next one.
+//-----------------------------------------------------------------------------
+bool visitNode(bool (*function)(BTNode* node, va_list args), BTNode* node, va_list args)
+{
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+
+    bool result = function(node, argsCopy);
+
+    va_end(argsCopy);
+
+    return result;
+}
+
+#define TRAVERSE_SUBTREE(traverse, getSide) if (traverse(getSide(subRoot), function, args)  == !BT_TRAVERSE_RUN) \
+                                            {                                                                    \
+                                                return !BT_TRAVERSE_RUN;                                         \
+                                            }
 
 void preOrderTraverse(BTNode* subRoot, bool (*function)(BTNode* node, va_list args), ...)
 {
     CHECK_NULL(subRoot, return);
 
     va_list args = {};
-    va_start(args, &function);
+    va_start(args, function);
 
     preOrderTraverse(subRoot, function, args);
 
@@ -118,10 +343,10 @@ bool preOrderTraverse(BTNode* subRoot, bool (*function)(BTNode* node, va_list ar
 {
     CHECK_NULL(subRoot, return BT_TRAVERSE_RUN);
 
-    if (function(subRoot, args) == !BT_TRAVERSE_RUN) { return !BT_TRAVERSE_RUN; };
+    if (visitNode(function, subRoot, args) == !BT_TRAVERSE_RUN) { return !BT_TRAVERSE_RUN; };
 
-    TRAVERSE_SUBTREE(preOrderTraverse, left);
-    TRAVERSE_SUBTREE(preOrderTraverse, right);
+    TRAVERSE_SUBTREE(preOrderTraverse, getLeft);
+    TRAVERSE_SUBTREE(preOrderTraverse, getRight);
 
     return BT_TRAVERSE_RUN;
 }
@@ -131,7 +356,7 @@ void inOrderTraverse(BTNode* subRoot, bool (*function)(BTNode* node, va_list arg
     CHECK_NULL(subRoot, return);
 
     va_list args = {};
-    va_start(args, &function);
+    va_start(args, function);
 
     inOrderTraverse(subRoot, function, args);
 
@@ -142,11 +367,11 @@ bool inOrderTraverse(BTNode* subRoot, bool (*function)(BTNode* node, va_list arg
 {
     CHECK_NULL(subRoot, return BT_TRAVERSE_RUN);
 
-    TRAVERSE_SUBTREE(inOrderTraverse, left);
+    TRAVERSE_SUBTREE(inOrderTraverse, getLeft);
 
-    if (function(subRoot, args) == !BT_TRAVERSE_RUN) { return !BT_TRAVERSE_RUN; };
+    if (visitNode(function, subRoot, args) == !BT_TRAVERSE_RUN) { return !BT_TRAVERSE_RUN; };
 
-    TRAVERSE_SUBTREE(inOrderTraverse, right);
+    TRAVERSE_SUBTREE(inOrderTraverse, getRight);
 
     return BT_TRAVERSE_RUN;
 }
@@ -156,7 +381,7 @@ void postOrderTraverse(BTNode* subRoot, bool (*function)(BTNode* node, va_list a
     CHECK_NULL(subRoot, return);
 
     va_list args = {};
-    va_start(args, &function);
+    va_start(args, function);
 
     postOrderTraverse(subRoot, function, args);
 
@@ -167,10 +392,10 @@ bool postOrderTraverse(BTNode* subRoot, bool (*function)(BTNode* node, va_list a
 {
     CHECK_NULL(subRoot, return BT_TRAVERSE_RUN);
 
-    TRAVERSE_SUBTREE(postOrderTraverse, left);
-    TRAVERSE_SUBTREE(postOrderTraverse, right);
+    TRAVERSE_SUBTREE(postOrderTraverse, getLeft);
+    TRAVERSE_SUBTREE(postOrderTraverse, getRight);
 
-    if (function(subRoot, args) == !BT_TRAVERSE_RUN) { return !BT_TRAVERSE_RUN; };
+    if (visitNode(function, subRoot, args) == !BT_TRAVERSE_RUN) { return !BT_TRAVERSE_RUN; };
 
     return BT_TRAVERSE_RUN;
 }
@@ -179,11 +404,10 @@ bool findNodeTraverseStep(BTNode* node, va_list args)
 {
     assert(node != NULL);
 
-    char*    str   = va_arg(args, char*);
-    BTNode** found = va_arg(args, BTNode**);
-    va_end(args);
+    BTString* key   = va_arg(args, BTString*);
+    BTNode**  found = va_arg(args, BTNode**);
 
-    if (strcmp(str, node->value) == 0)
+    if (isEqual(key, &node->value))
     {
         *found = node;
 
@@ -197,8 +421,9 @@ BTNode* findNode(BinaryTree* tree, BTElem_t value)
 {
     assert(tree != NULL);
 
-    BTNode* foundNode = NULL;
-    preOrderTraverse(tree->root, findNodeTraverseStep, value, &foundNode);
+    BTString key       = makeString(value);
+    BTNode*  foundNode = NULL;
+    preOrderTraverse(tree->root, findNodeTraverseStep, &key, &foundNode);
 
     return foundNode;
 }
@@ -217,11 +442,133 @@ void setRoot(BinaryTree* tree, BTNode* root)
     tree->root = root;
 }
 
+//-----------------------------------------------------------------------------
+//! Makes a copy of value owned by the tree to be passed to newNode, 
+//! newQuestion or setValue, so that the original can be freed right after.
+//! Long values are copied to the tree's string pool, short ones are returned 
+//! as is because nodes store them inline.
+//!
+//! @param [in] tree
+//! @param [in] value
+//!
+//! @return value to be passed to newNode/newQuestion/setValue.
+//-----------------------------------------------------------------------------
+BTElem_t internValue(BinaryTree* tree, const char* value)
+{
+    assert(tree  != NULL);
+    assert(value != NULL);
+
+    if (strlen(value) <= BT_INLINE_LENGTH) { return value; }
+
+    return poolIntern(tree->strings, value);
+}
+
+BTString makeString(BTElem_t value)
+{
+    BTString str = {};
+    CHECK_NULL(value, return str);
+
+    size_t length = strlen(value);
+
+    str.hash   = hashString(value, length);
+    str.length = length < BT_HUGE_LENGTH ? (uint16_t) length : BT_HUGE_LENGTH;
+
+    if (length <= BT_INLINE_LENGTH)
+    {
+        memcpy(str.data, value, length + 1);
+    }
+    else
+    {
+        memcpy(str.data + 2, &value, sizeof(value));
+    }
+
+    return str;
+}
+
+const char* getString(const BTString* str)
+{
+    assert(str != NULL);
+
+    if (str->length <= BT_INLINE_LENGTH) { return str->data; }
+
+    const char* value = NULL;
+    memcpy(&value, str->data + 2, sizeof(value));
+
+    if (str->data[0] == BT_PACKED_TAG) { return unpackString(value, (uint8_t) str->data[1]); }
+
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+//! @return the value in the next of the thread's buffers, so it's valid 
+//! until BT_PACKED_BUFFERS more values are unpacked on the thread.
+//-----------------------------------------------------------------------------
+const char* unpackString(const char* block, size_t number)
+{
+    assert(block != NULL);
+    assert(number < BT_PACKED_BLOCK);
+
+    char* buffer = unpackBuffers[unpackNext];
+    unpackNext = (unpackNext + 1) % BT_PACKED_BUFFERS;
+
+    const uint8_t* entry  = (const uint8_t*) block;
+    size_t         length = 0;
+
+    for (size_t i = 0; i <= number; i++)
+    {
+        memcpy(buffer + entry[0], entry + 2, entry[1]);
+        length = entry[0] + entry[1];
+        entry += 2 + entry[1];
+    }
+
+    buffer[length] = '\0';
+
+    return buffer;
+}
+
+bool isEqual(const BTString* str1, const BTString* str2)
+{
+    assert(str1 != NULL);
+    assert(str2 != NULL);
+
+    if (str1->hash != str2->hash || str1->length != str2->length) { return false; }
+
+    const char* value1 = getString(str1);
+    const char* value2 = getString(str2);
+
+    if (str1->length == BT_HUGE_LENGTH) { return strcmp(value1, value2) == 0; }
+
+    return value1 == value2 || memcmp(value1, value2, str1->length) == 0;
+}
+
+StringPool* getStringPool(BinaryTree* tree)
+{
+    assert(tree != NULL);
+
+    return tree->strings;
+}
+
 BTElem_t getValue(BTNode* node)
 {
     assert(node != NULL);
 
-    return node->value;
+    return getString(&node->value);
+}
+
+size_t getValueLength(BTNode* node)
+{
+    assert(node != NULL);
+
+    if (node->value.length == BT_HUGE_LENGTH) { return strlen(getString(&node->value)); }
+
+    return node->value.length;
+}
+
+uint32_t getValueHash(BTNode* node)
+{
+    assert(node != NULL);
+
+    return node->value.hash;
 }
 
 BTNode* getParent(BTNode* node)
@@ -235,14 +582,28 @@ BTNode* getLeft(BTNode* node)
 {
     assert(node != NULL);
 
-    return node->left;
+    return node->isQuestion ? AS_QUESTION(node)->left : NULL;
 }
 
 BTNode* getRight(BTNode* node)
 {
     assert(node != NULL);
 
-    return node->right;
+    return node->isQuestion ? AS_QUESTION(node)->right : NULL;
+}
+
+size_t getHits(BTNode* node)
+{
+    assert(node != NULL);
+
+    return node->isQuestion ? 0 : node->counter;
+}
+
+size_t getId(BTNode* node)
+{
+    assert(node != NULL);
+
+    return node->id == BT_NODE_NO_ID ? BT_NO_ID : node->id;
 }
 
 bool isLeft(BTNode* node)
@@ -250,14 +611,14 @@ bool isLeft(BTNode* node)
     assert(node != NULL);
     CHECK_NULL(node->parent, return false);
 
-    return node->parent->left == node;
+    return AS_QUESTION(node->parent)->left == node;
 }
 
 void setValue(BTNode* node, BTElem_t value)
 {
     assert(node != NULL);
 
-    node->value = value;
+    node->value = makeString(value);
 }
 
 void setParent(BTNode* node, BTNode* parent)
@@ -270,13 +631,488 @@ void setParent(BTNode* node, BTNode* parent)
 void setLeft(BTNode* node, BTNode* left)
 {
     assert(node != NULL);
+    assert(node->isQuestion);
 
-    node->left = left;
+    AS_QUESTION(node)->left = left;
 }
 
 void setRight(BTNode* node, BTNode* right)
 {
     assert(node != NULL);
+    assert(node->isQuestion);
+
+    AS_QUESTION(node)->right = right;
+}
+
+void setHits(BTNode* node, size_t hits)
+{
+    assert(node != NULL);
+    assert(!node->isQuestion);
+
+    node->counter = hits < BT_MAX_COUNTER ? hits : BT_MAX_COUNTER;
+}
+
+void setId(BTNode* node, size_t id)
+{
+    assert(node != NULL);
+    assert(id == BT_NO_ID || id < BT_NODE_NO_ID);
+
+    node->id = id == BT_NO_ID ? BT_NODE_NO_ID : (uint32_t) id;
+}
+
+size_t getLeavesCount(BTNode* node)
+{
+    assert(node != NULL);
+
+    return node->isQuestion ? node->counter : 1;
+}
+
+void recountLeaves(BTNode* node)
+{
+    assert(node != NULL);
+
+    if (!node->isQuestion) { return; }
+
+    BTNode* left  = AS_QUESTION(node)->left;
+    BTNode* right = AS_QUESTION(node)->right;
+
+    size_t count = (left  != NULL ? getLeavesCount(left)  : 0) + 
+                   (right != NULL ? getLeavesCount(right) : 0);
+
+    node->counter = count < BT_MAX_COUNTER ? count : BT_MAX_COUNTER;
+
+    uint64_t hash = hashValue(node, BT_QUESTION_SEED);
+    hash = mixHash(hash ^ (right != NULL ? getSubtreeHash(right) : 0));
+    hash = mixHash(hash ^ (left  != NULL ? getSubtreeHash(left)  : 0));
+
+    AS_QUESTION(node)->hash = hash;
+}
+
+bool countLeavesStep(BTNode* node, va_list args)
+{
+    recountLeaves(node);
+
+    return BT_TRAVERSE_RUN;
+}
+
+//-----------------------------------------------------------------------------
+// FNV-1a (64 bit) of the value started from seed, so that an object and a 
+// question with the same text get different hashes.
+//-----------------------------------------------------------------------------
+uint64_t hashValue(BTNode* node, uint64_t seed)
+{
+    assert(node != NULL);
+
+    uint64_t    hash  = seed;
+    const char* value = getValue(node);
+
+    for (size_t i = 0; value[i] != '\0'; i++)
+    {
+        hash ^= (unsigned char) value[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+//-----------------------------------------------------------------------------
+// Finalizer of splitmix64, spreads every bit of the children's hashes over
+// the whole parent's hash.
+//-----------------------------------------------------------------------------
+uint64_t mixHash(uint64_t hash)
+{
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+
+    return hash ^ (hash >> 31);
+}
+
+//-----------------------------------------------------------------------------
+//! @return structural hash of the subtree: equal subtrees (with the same 
+//! questions, objects and shape) have equal hashes. Hits aren't hashed.
+//-----------------------------------------------------------------------------
+uint64_t getSubtreeHash(BTNode* node)
+{
+    assert(node != NULL);
+
+    if (node->isQuestion) { return AS_QUESTION(node)->hash; }
+
+    return mixHash(hashValue(node, BT_OBJECT_SEED));
+}
+
+//-----------------------------------------------------------------------------
+//! Recalculates leaves count and subtree hash of every node in the subtree. 
+//! Should be called after the tree is constructed via raw setLeft/setRight 
+//! calls.
+//!
+//! @param [in] subRoot
+//-----------------------------------------------------------------------------
+void countLeaves(BTNode* subRoot)
+{
+    postOrderTraverse(subRoot, countLeavesStep);
+}
+
+//-----------------------------------------------------------------------------
+//! Recalculates leaves count and subtree hash of node and all of its 
+//! ancestors. Should be called after node's children have been changed.
+//!
+//! @param [in] node
+//-----------------------------------------------------------------------------
+void updateLeavesCountUp(BTNode* node)
+{
+    for (; node != NULL; node = node->parent)
+    {
+        recountLeaves(node);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Copies all nodes of the tree into one block in van Emde Boas order: the
+//! top half of the levels goes first (laid out the same way recursively)
+//! and the subtrees hanging from it go after it one by one. So a walk from
+//! the root down to a leaf, or back over the parents, touches few cache
+//! lines whatever their size is. The old nodes are freed, so pointers to
+//! the nodes kept outside of the tree are invalid afterwards.
+//!
+//! @param [in] tree
+//!
+//! @return false if out of memory, the tree isn't changed then.
+//-----------------------------------------------------------------------------
+bool relayoutTree(BinaryTree* tree)
+{
+    assert(tree != NULL);
+
+    if (tree->root == NULL) { return true; }
+
+    size_t nodesCount = 0;
+    size_t bytes      = 0;
+    size_t height     = measureSubtree(tree->root, &nodesCount, &bytes);
+
+    BTNode** order = (BTNode**) memAlloc(MEM_TREE, nodesCount, sizeof(BTNode*));
+    CHECK_NULL(order, return false);
+
+    char* arena = (char*) memAlloc(MEM_TREE, bytes, 1);
+    CHECK_NULL(arena, memFree(order); return false);
+
+    size_t count = 0;
+    layoutLevels(tree->root, height, order, &count);
+    assert(count == nodesCount);
+
+    // the old nodes' parents point to their copies until the links are fixed
+    size_t offset = 0;
+    for (size_t i = 0; i < nodesCount; i++)
+    {
+        size_t  size = order[i]->isQuestion ? sizeof(BTQuestion) : sizeof(BTNode);
+        BTNode* copy = (BTNode*) (arena + offset);
+
+        memcpy(copy, order[i], size);
+        copy->isInArena = true;
+
+        order[i]->parent = copy;
+        offset += size;
+    }
+
+    for (size_t i = 0; i < nodesCount; i++)
+    {
+        BTNode* copy = order[i]->parent;
+
+        if (copy->parent != NULL) { copy->parent = copy->parent->parent; }
+
+        if (copy->isQuestion)
+        {
+            BTQuestion* question = AS_QUESTION(copy);
+
+            if (question->left  != NULL) { question->left  = question->left->parent;  }
+            if (question->right != NULL) { question->right = question->right->parent; }
+        }
+    }
+
+    tree->root = tree->root->parent;
+
+    for (size_t i = 0; i < nodesCount; i++)
+    {
+        if (!order[i]->isInArena) { memFree(order[i]); }
+    }
+
+    memFree(tree->arena);
+    memFree(order);
+
+    tree->arena = arena;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Counts nodes of the subtree and bytes they take.
+//!
+//! @return height of the subtree.
+//-----------------------------------------------------------------------------
+size_t measureSubtree(BTNode* node, size_t* nodesCount, size_t* bytes)
+{
+    assert(nodesCount != NULL);
+    assert(bytes      != NULL);
+
+    if (node == NULL) { return 0; }
+
+    (*nodesCount)++;
+
+    if (!node->isQuestion)
+    {
+        *bytes += sizeof(BTNode);
+        return 1;
+    }
+
+    *bytes += sizeof(BTQuestion);
+
+    size_t rightHeight = measureSubtree(AS_QUESTION(node)->right, nodesCount, bytes);
+    size_t leftHeight  = measureSubtree(AS_QUESTION(node)->left,  nodesCount, bytes);
+
+    return 1 + (rightHeight > leftHeight ? rightHeight : leftHeight);
+}
+
+//-----------------------------------------------------------------------------
+//! Appends the nodes of the first height levels of the subtree to order.
+//-----------------------------------------------------------------------------
+void layoutLevels(BTNode* node, size_t height, BTNode** order, size_t* count)
+{
+    assert(order != NULL);
+    assert(count != NULL);
+
+    if (node == NULL) { return; }
+
+    if (height == 1 || !node->isQuestion)
+    {
+        order[(*count)++] = node;
+        return;
+    }
+
+    size_t top = height / 2;
+
+    layoutLevels(node, top, order, count);
+    layoutBottoms(node, top, height - top, order, count);
+}
+
+//-----------------------------------------------------------------------------
+//! Lays out the first height levels of every subtree that starts depth 
+//! levels below the node, yes-subtrees first.
+//-----------------------------------------------------------------------------
+void layoutBottoms(BTNode* node, size_t depth, size_t height, BTNode** order, size_t* count)
+{
+    if (node == NULL) { return; }
+
+    if (depth == 0)
+    {
+        layoutLevels(node, height, order, count);
+        return;
+    }
+
+    if (!node->isQuestion) { return; }
+
+    layoutBottoms(AS_QUESTION(node)->right, depth - 1, height, order, count);
+    layoutBottoms(AS_QUESTION(node)->left,  depth - 1, height, order, count);
+}
+
+//-----------------------------------------------------------------------------
+//! Packs the values for which isCold returns true: they are sorted and 
+//! front-coded in blocks (see BTString). The other values that don't fit 
+//! into the nodes are moved to a new string pool, so that the old pool with
+//! the packed values (and everything else that has been interned into it) 
+//! is freed. Values that are packed again are unpacked and packed anew.
+//!
+//! Unpacked values are kept in a few buffers of the thread only, so the
+//! values that are held for long (e.g. by indexes) shouldn't be packed.
+//!
+//! @param [in]  tree
+//! @param [out] packedCount number of packed values
+//! @param [in]  isCold      is called for the values longer than fit into a
+//!                          node and shorter than BT_PACKED_MAX_LENGTH
+//! @param [in]  ...         arguments of isCold
+//!
+//! @return false if out of memory, the tree isn't changed then.
+//-----------------------------------------------------------------------------
+bool packValues(BinaryTree* tree, size_t* packedCount, bool (*isCold)(BTNode* node, va_list args), ...)
+{
+    assert(tree        != NULL);
+    assert(packedCount != NULL);
+    assert(isCold      != NULL);
+
+    *packedCount = 0;
+
+    if (tree->root == NULL) { return true; }
+
+    size_t nodesCount = 0;
+    size_t bytes      = 0;
+    measureSubtree(tree->root, &nodesCount, &bytes);
+
+    BTPackedValue* packed  = (BTPackedValue*) memAlloc(MEM_TREE, nodesCount, sizeof(BTPackedValue));
+    BTPackedValue* pooled  = (BTPackedValue*) memAlloc(MEM_TREE, nodesCount, sizeof(BTPackedValue));
+    StringPool*    strings = newStringPool();
+    StringPool*    scratch = newStringPool();
+    char*          blocks  = NULL;
+    size_t         size    = 0;
+
+    bool   isPacked    = packed != NULL && pooled != NULL && strings != NULL && scratch != NULL;
+    size_t pooledCount = 0;
+
+    if (isPacked)
+    {
+        va_list args;
+        va_start(args, isCold);
+        collectValues(tree->root, packed, packedCount, pooled, &pooledCount, isCold, args);
+        va_end(args);
+    }
+
+    // the values are read from the old pool and blocks until all of them are moved
+    for (size_t i = 0; isPacked && i < *packedCount; i++)
+    {
+        packed[i].value = getValue(packed[i].node);
+        if (packed[i].node->value.data[0] == BT_PACKED_TAG) { packed[i].value = poolIntern(scratch, packed[i].value); }
+
+        isPacked = packed[i].value != NULL;
+    }
+
+    for (size_t i = 0; isPacked && i < pooledCount; i++)
+    {
+        pooled[i].value = poolIntern(strings, getValue(pooled[i].node));
+        isPacked        = pooled[i].value != NULL;
+    }
+
+    if (isPacked)
+    {
+        qsort(packed, *packedCount, sizeof(BTPackedValue), compareValues);
+
+        size   = packSorted(packed, *packedCount, NULL);
+        blocks = (char*) memAlloc(MEM_STRINGS, size + 1, 1);
+
+        isPacked = blocks != NULL;
+    }
+
+    if (isPacked)
+    {
+        packSorted(packed, *packedCount, blocks);
+
+        for (size_t i = 0; i < pooledCount; i++)
+        {
+            BTString* str = &pooled[i].node->value;
+
+            str->data[0] = 0;
+            memcpy(str->data + 2, &pooled[i].value, sizeof(pooled[i].value));
+        }
+
+        deleteStringPool(tree->strings);
+        memFree(tree->packed);
+
+        tree->strings    = strings;
+        tree->packed     = blocks;
+        tree->packedSize = size;
+    }
+    else
+    {
+        if (strings != NULL) { deleteStringPool(strings); }
+
+        *packedCount = 0;
+    }
+
+    if (scratch != NULL) { deleteStringPool(scratch); }
+    memFree(packed);
+    memFree(pooled);
+
+    return isPacked;
+}
+
+//-----------------------------------------------------------------------------
+//! @return memory taken by the packed values.
+//-----------------------------------------------------------------------------
+size_t getPackedSize(BinaryTree* tree)
+{
+    assert(tree != NULL);
+
+    return tree->packedSize;
+}
+
+//-----------------------------------------------------------------------------
+//! Splits the nodes whose values don't fit into them into the ones to pack
+//! and the ones to keep in the pool.
+//-----------------------------------------------------------------------------
+void collectValues(BTNode* node, BTPackedValue* packed, size_t* packedCount, BTPackedValue* pooled, size_t* pooledCount,
+                   bool (*isCold)(BTNode* node, va_list args), va_list args)
+{
+    if (node == NULL) { return; }
+
+    if (node->value.length > BT_INLINE_LENGTH)
+    {
+        if (node->value.length <= BT_PACKED_MAX_LENGTH && visitNode(isCold, node, args))
+        {
+            packed[(*packedCount)++].node = node;
+        }
+        else
+        {
+            pooled[(*pooledCount)++].node = node;
+        }
+    }
+
+    if (!node->isQuestion) { return; }
+
+    collectValues(AS_QUESTION(node)->right, packed, packedCount, pooled, pooledCount, isCold, args);
+    collectValues(AS_QUESTION(node)->left,  packed, packedCount, pooled, pooledCount, isCold, args);
+}
+
+int compareValues(const void* value1, const void* value2)
+{
+    return strcmp(((const BTPackedValue*) value1)->value, ((const BTPackedValue*) value2)->value);
+}
+
+//-----------------------------------------------------------------------------
+//! Front-codes the sorted values, equal values are packed once. Nodes are
+//! changed only if packed isn't NULL.
+//!
+//! @return size of the blocks.
+//-----------------------------------------------------------------------------
+size_t packSorted(BTPackedValue* values, size_t count, char* packed)
+{
+    assert(values != NULL);
+
+    size_t size       = 0;
+    size_t number     = 0;
+    size_t blockStart = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const char* value    = values[i].value;
+        size_t      length   = values[i].node->value.length;
+        const char* previous = i > 0 ? values[i - 1].value : NULL;
+
+        if (previous == NULL || strcmp(value, previous) != 0)
+        {
+            if (previous != NULL) { number++; }
+            if (number % BT_PACKED_BLOCK == 0) { blockStart = size; }
+
+            size_t shared = 0;
+            if (number % BT_PACKED_BLOCK != 0)
+            {
+                while (value[shared] != '\0' && value[shared] == previous[shared]) { shared++; }
+            }
+
+            if (packed != NULL)
+            {
+                packed[size]     = (char) shared;
+                packed[size + 1] = (char) (length - shared);
+                memcpy(packed + size + 2, value + shared, length - shared);
+            }
+
+            size += 2 + length - shared;
+        }
+
+        if (packed != NULL)
+        {
+            const char* block = packed + blockStart;
+            BTString*   str   = &values[i].node->value;
+
+            str->data[0] = BT_PACKED_TAG;
+            str->data[1] = (char) (number % BT_PACKED_BLOCK);
+            memcpy(str->data + 2, &block, sizeof(block));
+        }
+    }
 
-    node->right = right;
+    return size;
 }
@@ -1,20 +1,31 @@
 #pragma once
 
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 
-typedef char* BTElem_t;
+typedef const char* BTElem_t;
 
 struct BTNode;
 struct BinaryTree;
+struct StringPool;
 
-static const bool BT_TRAVERSE_RUN = true;
+static const bool   BT_TRAVERSE_RUN = true;
+static const size_t BT_NO_ID        = (size_t) -1;
 
 BinaryTree* newTree    ();
 void        deleteTree (BinaryTree* tree);
 
-BTNode*     newNode    ();
-BTNode*     newNode    (BTElem_t value);
-void        deleteNode (BTNode* node);
+BTNode*     newNode      ();
+BTNode*     newNode      (BTElem_t value);
+BTNode*     newQuestion  (BTElem_t value);
+void        deleteNode   (BTNode* node);
+void        replaceNode  (BinaryTree* tree, BTNode* oldNode, BTNode* newNode);
+BTNode*     makeQuestion (BinaryTree* tree, BTNode* node);
+bool        relayoutTree (BinaryTree* tree);
+
+size_t      getLeafNodeSize     ();
+size_t      getQuestionNodeSize ();
 
 void        preOrderTraverse  (BTNode* subRoot, bool (*function)(BTNode* node, va_list args), ...);
 void        inOrderTraverse   (BTNode* subRoot, bool (*function)(BTNode* node, va_list args), ...);
@@ -25,14 +36,31 @@ BTNode*     findNode (BinaryTree* tree, BTElem_t value);
 BTNode*     getRoot (BinaryTree* tree);
 void        setRoot (BinaryTree* tree, BTNode* root);
 
-BTElem_t    getValue  (BTNode* node);
-BTNode*     getParent (BTNode* node);
-BTNode*     getLeft   (BTNode* node);
-BTNode*     getRight  (BTNode* node);
-bool        isLeft    (BTNode* node);
+BTElem_t    internValue   (BinaryTree* tree, const char* value);
+StringPool* getStringPool (BinaryTree* tree);
+bool        packValues    (BinaryTree* tree, size_t* packedCount, bool (*isCold)(BTNode* node, va_list args), ...);
+size_t      getPackedSize (BinaryTree* tree);
+
+BTElem_t    getValue       (BTNode* node);
+BTNode*     getParent      (BTNode* node);
+BTNode*     getLeft        (BTNode* node);
+BTNode*     getRight       (BTNode* node);
+bool        isLeft         (BTNode* node);
+bool        isQuestion     (BTNode* node);
+size_t      getValueLength (BTNode* node);
+uint32_t    getValueHash   (BTNode* node);
+size_t      getLeavesCount (BTNode* node);
+uint64_t    getSubtreeHash (BTNode* node);
+size_t      getHits        (BTNode* node);
+size_t      getId          (BTNode* node);
 
 void        setValue  (BTNode* node, BTElem_t value);
 void        setParent (BTNode* node, BTNode* parent);
 void        setLeft   (BTNode* node, BTNode* left);
 void        setRight  (BTNode* node, BTNode* right);
+void        setHits   (BTNode* node, size_t hits);
+void        setId     (BTNode* node, size_t id);
+
+void        countLeaves          (BTNode* subRoot);
+void        updateLeavesCountUp  (BTNode* node);
 
@@ -0,0 +1,361 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "completion.h"
+#include "memory_tags.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+static const size_t COMPLETER_BEST_COUNT = COMPLETIONS_DEFAULT_COUNT;
+
+//-----------------------------------------------------------------------------
+// Objects are kept in a radix trie of their names. Every trie node holds the
+// part of the names on the edge from its parent and the best objects of its
+// subtree: the most guessed ones, objects guessed equally often by name. So
+// a prefix is completed by walking it down and taking the list of the node
+// it ends in, and an object is inserted (or its hits are updated) along its
+// own name only. Labels point into the names, which stay in the tree's
+// string pool.
+//-----------------------------------------------------------------------------
+struct TrieNode
+{
+    const char* label         = NULL;
+    size_t      labelLength   = 0;
+
+    TrieNode**  children      = NULL; // sorted by the first chars of their labels
+    size_t      childrenCount = 0;
+
+    BTNode**    best          = NULL; // up to COMPLETER_BEST_COUNT
+    size_t      bestCount     = 0;
+};
+
+struct Completer
+{
+    TrieNode root = {};
+    size_t   size = 0;
+};
+
+TrieNode* newTrieNode    (const char* label, size_t labelLength);
+void      deleteTrieNode (TrieNode* node);
+TrieNode* findChild      (TrieNode* node, char first, size_t* index);
+bool      insertChild    (TrieNode* node, TrieNode* child, size_t index);
+TrieNode* splitNode      (TrieNode* parent, size_t index, size_t length);
+bool      isBetter       (BTNode* object1, BTNode* object2);
+bool      addBest        (TrieNode* node, BTNode* object);
+
+Completer* newCompleter()
+{
+    Completer* completer = (Completer*) memAlloc(MEM_INDEXES, 1, sizeof(Completer));
+    CHECK_NULL(completer, return NULL);
+
+    *completer = {};
+
+    return completer;
+}
+
+void deleteCompleter(Completer* completer)
+{
+    assert(completer != NULL);
+
+    // names are short, so the recursion is shallow
+    for (size_t i = 0; i < completer->root.childrenCount; i++) { deleteTrieNode(completer->root.children[i]); }
+
+    memFree(completer->root.children);
+    memFree(completer->root.best);
+    memFree(completer);
+}
+
+TrieNode* newTrieNode(const char* label, size_t labelLength)
+{
+    assert(label != NULL);
+
+    TrieNode* node = (TrieNode*) memAlloc(MEM_INDEXES, 1, sizeof(TrieNode));
+    CHECK_NULL(node, return NULL);
+
+    *node = {};
+    node->label       = label;
+    node->labelLength = labelLength;
+
+    return node;
+}
+
+void deleteTrieNode(TrieNode* node)
+{
+    assert(node != NULL);
+
+    for (size_t i = 0; i < node->childrenCount; i++) { deleteTrieNode(node->children[i]); }
+
+    memFree(node->children);
+    memFree(node->best);
+    memFree(node);
+}
+
+//-----------------------------------------------------------------------------
+//! @return child whose label starts with first or NULL, index is set to its
+//!         place (where it would be inserted) in the children.
+//-----------------------------------------------------------------------------
+TrieNode* findChild(TrieNode* node, char first, size_t* index)
+{
+    assert(node  != NULL);
+    assert(index != NULL);
+
+    // there are few children, at most one per char
+    size_t i = 0;
+    while (i < node->childrenCount && (unsigned char) node->children[i]->label[0] < (unsigned char) first) { i++; }
+
+    *index = i;
+
+    return i < node->childrenCount && node->children[i]->label[0] == first ? node->children[i] : NULL;
+}
+
+bool insertChild(TrieNode* node, TrieNode* child, size_t index)
+{
+    assert(node  != NULL);
+    assert(child != NULL);
+    assert(index <= node->childrenCount);
+
+    TrieNode** children = (TrieNode**) memRealloc(MEM_INDEXES, node->children, (node->childrenCount + 1) * sizeof(TrieNode*));
+    CHECK_NULL(children, return false);
+
+    memmove(&children[index + 1], &children[index], (node->childrenCount - index) * sizeof(TrieNode*));
+    children[index] = child;
+
+    node->children = children;
+    node->childrenCount++;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Puts a new node for the first length chars of the child's label between
+//! the parent and the child. It has the same subtree, so the same best list.
+//!
+//! @return the new node or NULL if out of memory.
+//-----------------------------------------------------------------------------
+TrieNode* splitNode(TrieNode* parent, size_t index, size_t length)
+{
+    assert(parent != NULL);
+    assert(index < parent->childrenCount);
+
+    TrieNode* child = parent->children[index];
+    assert(0 < length && length < child->labelLength);
+
+    TrieNode*  middle   = newTrieNode(child->label, length);
+    TrieNode** children = (TrieNode**) memAlloc(MEM_INDEXES, 1, sizeof(TrieNode*));
+    BTNode**   best     = (BTNode**)   memAlloc(MEM_INDEXES, child->bestCount, sizeof(BTNode*));
+
+    if (middle == NULL || children == NULL || best == NULL)
+    {
+        memFree(middle);
+        memFree(children);
+        memFree(best);
+
+        return NULL;
+    }
+
+    memcpy(best, child->best, child->bestCount * sizeof(BTNode*));
+    children[0] = child;
+
+    middle->children      = children;
+    middle->childrenCount = 1;
+    middle->best          = best;
+    middle->bestCount     = child->bestCount;
+
+    child->label       += length;
+    child->labelLength -= length;
+
+    parent->children[index] = middle;
+
+    return middle;
+}
+
+bool isBetter(BTNode* object1, BTNode* object2)
+{
+    assert(object1 != NULL);
+    assert(object2 != NULL);
+
+    if (getHits(object1) != getHits(object2)) { return getHits(object1) > getHits(object2); }
+
+    return strcmp(getValue(object1), getValue(object2)) < 0;
+}
+
+//-----------------------------------------------------------------------------
+//! Puts the object to its place in the best list of the node (or moves it
+//! up there if it's in the list already and its hits have grown).
+//!
+//! @return false if out of memory.
+//-----------------------------------------------------------------------------
+bool addBest(TrieNode* node, BTNode* object)
+{
+    assert(node   != NULL);
+    assert(object != NULL);
+
+    size_t position = 0;
+    while (position < node->bestCount && node->best[position] != object) { position++; }
+
+    if (position == node->bestCount && node->bestCount == COMPLETER_BEST_COUNT)
+    {
+        if (!isBetter(object, node->best[position - 1])) { return true; }
+
+        position--;
+    }
+    else if (position == node->bestCount)
+    {
+        BTNode** best = (BTNode**) memRealloc(MEM_INDEXES, node->best, (node->bestCount + 1) * sizeof(BTNode*));
+        CHECK_NULL(best, return false);
+
+        node->best = best;
+        node->bestCount++;
+    }
+
+    for (; position > 0 && isBetter(object, node->best[position - 1]); position--)
+    {
+        node->best[position] = node->best[position - 1];
+    }
+
+    node->best[position] = object;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Adds an object. The completer keeps the node, so the node has to outlive
+//! the completer.
+//!
+//! @param [in] completer
+//! @param [in] object
+//!
+//! @return false if out of memory.
+//-----------------------------------------------------------------------------
+bool completerInsert(Completer* completer, BTNode* object)
+{
+    assert(completer != NULL);
+    assert(object    != NULL);
+
+    const char* name    = getValue(object);
+    size_t      length  = getValueLength(object);
+    size_t      matched = 0;
+    TrieNode*   node    = &completer->root;
+
+    if (!addBest(node, object)) { return false; }
+
+    while (matched < length)
+    {
+        size_t    index = 0;
+        TrieNode* child = findChild(node, name[matched], &index);
+
+        if (child == NULL)
+        {
+            child = newTrieNode(name + matched, length - matched);
+            CHECK_NULL(child, return false);
+
+            if (!insertChild(node, child, index))
+            {
+                memFree(child);
+                return false;
+            }
+        }
+
+        size_t common = 1;
+        while (common < child->labelLength && matched + common < length && child->label[common] == name[matched + common])
+        {
+            common++;
+        }
+
+        if (common < child->labelLength)
+        {
+            child = splitNode(node, index, common);
+            CHECK_NULL(child, return false);
+        }
+
+        matched += common;
+        node     = child;
+
+        if (!addBest(node, object)) { return false; }
+    }
+
+    completer->size++;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Moves the object up in the lists of the prefixes of its name after its
+//! hits have grown.
+//!
+//! @return false if out of memory.
+//-----------------------------------------------------------------------------
+bool completerUpdate(Completer* completer, BTNode* object)
+{
+    assert(completer != NULL);
+    assert(object    != NULL);
+
+    const char* name    = getValue(object);
+    size_t      length  = getValueLength(object);
+    size_t      matched = 0;
+    TrieNode*   node    = &completer->root;
+
+    bool isUpdated = addBest(node, object);
+    while (isUpdated && matched < length)
+    {
+        size_t index = 0;
+
+        // the object has been inserted, so its whole name is in the trie
+        node = findChild(node, name[matched], &index);
+        CHECK_NULL(node, return false);
+
+        matched  += node->labelLength;
+        isUpdated = addBest(node, object);
+    }
+
+    return isUpdated;
+}
+
+//-----------------------------------------------------------------------------
+//! Finds objects whose names start with prefix. The most guessed objects come
+//! first, objects guessed equally often are ordered by name.
+//!
+//! @param [in]  completer
+//! @param [in]  prefix
+//! @param [out] completions
+//! @param [in]  maxCompletions size of completions, no more than 
+//!                             COMPLETIONS_DEFAULT_COUNT objects are found
+//!
+//! @return number of objects found.
+//-----------------------------------------------------------------------------
+size_t completePrefix(Completer* completer, const char* prefix, BTNode** completions, size_t maxCompletions)
+{
+    assert(completer   != NULL);
+    assert(prefix      != NULL);
+    assert(completions != NULL);
+
+    size_t    prefixLength = strlen(prefix);
+    size_t    matched      = 0;
+    TrieNode* node         = &completer->root;
+
+    // the prefix may end in the middle of a label
+    while (matched < prefixLength)
+    {
+        size_t index = 0;
+
+        node = findChild(node, prefix[matched], &index);
+        CHECK_NULL(node, return 0);
+
+        size_t common = node->labelLength < prefixLength - matched ? node->labelLength : prefixLength - matched;
+        if (strncmp(node->label, prefix + matched, common) != 0) { return 0; }
+
+        matched += common;
+    }
+
+    size_t count = node->bestCount < maxCompletions ? node->bestCount : maxCompletions;
+    memcpy(completions, node->best, count * sizeof(BTNode*));
+
+    return count;
+}
+
+size_t completerSize(Completer* completer)
+{
+    assert(completer != NULL);
+
+    return completer->size;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "binary_tree.h"
+
+struct Completer;
+
+static const size_t COMPLETIONS_DEFAULT_COUNT = 9;
+
+Completer* newCompleter    ();
+void       deleteCompleter (Completer* completer);
+
+bool       completerInsert (Completer* completer, BTNode* object);
+bool       completerUpdate (Completer* completer, BTNode* object);
+size_t     completePrefix  (Completer* completer, const char* prefix, BTNode** completions, size_t maxCompletions);
+size_t     completerSize   (Completer* completer);
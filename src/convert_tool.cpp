@@ -0,0 +1,56 @@
+//-----------------------------------------------------------------------------
+// Converts a database between the text and the paged formats, e.g.
+//     convert.exe res/database.txt res/database.db
+// A text database is written as a paged one and the other way round. 
+// Statistics are kept by node ids, which differ between the formats, so 
+// they aren't converted. Exit code is 0 if the database has been converted 
+// and 2 if it couldn't be.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include "oracle.h"
+#include "ui.h"
+#include "../libs/log_generator.h"
+
+const size_t MAX_STR_SIZE = 256;
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        printf("Usage: %s <database> <converted database>\n", argv[0]);
+        return 2;
+    }
+
+    LG_Init();
+
+    Oracle* oracle = summonOracle(argv[1], UI_NewSpeaker(MAX_STR_SIZE, false), false);
+
+    int exitCode = 2;
+
+    if (oracle == NULL)
+    {
+        printf("Couldn't read '%s'\n", argv[1]);
+    }
+    else
+    {
+        bool isPaged = !isPagedOracle(oracle);
+
+        if (exportDatabase(oracle, argv[2], isPaged))
+        {
+            printf("'%s' has been written as a %s database\n", argv[2], isPaged ? "paged" : "text");
+            exitCode = 0;
+        }
+        else
+        {
+            printf("Couldn't write '%s'\n", argv[2]);
+        }
+
+        banishOracle(oracle);
+    }
+
+    UI_Close();
+    LG_Close();
+
+    return exitCode;
+}
@@ -0,0 +1,311 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "definition_cache.h"
+#include "memory_tags.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+static const size_t CACHE_NO_ENTRY = (size_t) -1;
+
+//-----------------------------------------------------------------------------
+// Fixed number of entries. Used ones are linked into a list from the most to
+// the least recently used and into hash buckets by the object's address, 
+// free ones are linked into the free list. When there are no free entries 
+// the least recently used one is reused. Entries keep their text buffers, 
+// so once they have grown storing doesn't allocate.
+//-----------------------------------------------------------------------------
+struct CacheEntry
+{
+    BTNode* object       = NULL;
+    char*   text         = NULL;
+    size_t  length       = 0;
+    size_t  bufferSize   = 0;
+
+    size_t  prev         = CACHE_NO_ENTRY;
+    size_t  next         = CACHE_NO_ENTRY;
+    size_t  nextInBucket = CACHE_NO_ENTRY;
+};
+
+struct DefinitionCache
+{
+    CacheEntry* entries      = NULL;
+    size_t      capacity     = 0;
+
+    size_t*     buckets      = NULL;
+    size_t      bucketsCount = 0;
+
+    size_t      first        = CACHE_NO_ENTRY;
+    size_t      last         = CACHE_NO_ENTRY;
+    size_t      free         = CACHE_NO_ENTRY;
+
+    size_t      hits         = 0;
+    size_t      misses       = 0;
+    size_t      evictions    = 0;
+};
+
+size_t bucketOf    (DefinitionCache* cache, BTNode* object);
+size_t findEntry   (DefinitionCache* cache, BTNode* object);
+void   unlinkEntry (DefinitionCache* cache, size_t entry);
+void   pushFront   (DefinitionCache* cache, size_t entry);
+void   releaseEntry (DefinitionCache* cache, size_t entry);
+
+DefinitionCache* newDefinitionCache(size_t capacity)
+{
+    assert(capacity > 0);
+
+    DefinitionCache* cache = (DefinitionCache*) memAlloc(MEM_INDEXES, 1, sizeof(DefinitionCache));
+    CHECK_NULL(cache, return NULL);
+
+    *cache = {};
+
+    cache->bucketsCount = 1;
+    while (cache->bucketsCount < capacity) { cache->bucketsCount *= 2; }
+
+    cache->entries = (CacheEntry*) memAlloc(MEM_INDEXES, capacity, sizeof(CacheEntry));
+    cache->buckets = (size_t*) memAlloc(MEM_INDEXES, cache->bucketsCount, sizeof(size_t));
+    if (cache->entries == NULL || cache->buckets == NULL)
+    {
+        memFree(cache->entries);
+        memFree(cache->buckets);
+        memFree(cache);
+
+        return NULL;
+    }
+
+    cache->capacity = capacity;
+
+    for (size_t i = 0; i < capacity; i++) { cache->entries[i] = {}; }
+    cacheClear(cache);
+
+    return cache;
+}
+
+void deleteDefinitionCache(DefinitionCache* cache)
+{
+    assert(cache != NULL);
+
+    for (size_t i = 0; i < cache->capacity; i++) { memFree(cache->entries[i].text); }
+
+    memFree(cache->entries);
+    memFree(cache->buckets);
+    memFree(cache);
+}
+
+size_t bucketOf(DefinitionCache* cache, BTNode* object)
+{
+    assert(cache != NULL);
+
+    // nodes are at least 16 bytes aligned, the lowest bits are always the same
+    uintptr_t address = (uintptr_t) object >> 4;
+
+    return (address ^ (address >> 16)) & (cache->bucketsCount - 1);
+}
+
+size_t findEntry(DefinitionCache* cache, BTNode* object)
+{
+    assert(cache != NULL);
+
+    size_t entry = cache->buckets[bucketOf(cache, object)];
+    while (entry != CACHE_NO_ENTRY && cache->entries[entry].object != object)
+    {
+        entry = cache->entries[entry].nextInBucket;
+    }
+
+    return entry;
+}
+
+void unlinkEntry(DefinitionCache* cache, size_t entry)
+{
+    assert(cache != NULL);
+
+    CacheEntry* current = &cache->entries[entry];
+
+    if (current->prev != CACHE_NO_ENTRY) { cache->entries[current->prev].next = current->next; }
+    else                                 { cache->first = current->next; }
+
+    if (current->next != CACHE_NO_ENTRY) { cache->entries[current->next].prev = current->prev; }
+    else                                 { cache->last = current->prev; }
+
+    current->prev = CACHE_NO_ENTRY;
+    current->next = CACHE_NO_ENTRY;
+}
+
+void pushFront(DefinitionCache* cache, size_t entry)
+{
+    assert(cache != NULL);
+
+    CacheEntry* current = &cache->entries[entry];
+
+    current->prev = CACHE_NO_ENTRY;
+    current->next = cache->first;
+
+    if (cache->first != CACHE_NO_ENTRY) { cache->entries[cache->first].prev = entry; }
+    else                                { cache->last = entry; }
+
+    cache->first = entry;
+}
+
+//-----------------------------------------------------------------------------
+//! Takes a used entry out of its bucket and the list and puts it into the 
+//! free list.
+//-----------------------------------------------------------------------------
+void releaseEntry(DefinitionCache* cache, size_t entry)
+{
+    assert(cache != NULL);
+
+    CacheEntry* current = &cache->entries[entry];
+
+    size_t* link = &cache->buckets[bucketOf(cache, current->object)];
+    while (*link != entry) { link = &cache->entries[*link].nextInBucket; }
+
+    *link = current->nextInBucket;
+
+    unlinkEntry(cache, entry);
+
+    current->object       = NULL;
+    current->nextInBucket = CACHE_NO_ENTRY;
+    current->next         = cache->free;
+    cache->free           = entry;
+}
+
+//-----------------------------------------------------------------------------
+//! Finds the definition of object and marks it as the most recently used.
+//!
+//! @param [in]  cache
+//! @param [in]  object
+//! @param [out] length length of the definition
+//!
+//! @return definition valid until the next store or NULL if there is none.
+//-----------------------------------------------------------------------------
+const char* cacheFind(DefinitionCache* cache, BTNode* object, size_t* length)
+{
+    assert(cache  != NULL);
+    assert(object != NULL);
+    assert(length != NULL);
+
+    size_t entry = findEntry(cache, object);
+    if (entry == CACHE_NO_ENTRY)
+    {
+        cache->misses++;
+        return NULL;
+    }
+
+    cache->hits++;
+
+    unlinkEntry(cache, entry);
+    pushFront(cache, entry);
+
+    *length = cache->entries[entry].length;
+
+    return cache->entries[entry].text;
+}
+
+//-----------------------------------------------------------------------------
+//! Stores the definition of object replacing the least recently used one if
+//! the cache is full.
+//!
+//! @return false if out of memory.
+//-----------------------------------------------------------------------------
+bool cacheStore(DefinitionCache* cache, BTNode* object, const char* text, size_t length)
+{
+    assert(cache  != NULL);
+    assert(object != NULL);
+    assert(text   != NULL);
+
+    size_t entry = findEntry(cache, object);
+
+    if (entry == CACHE_NO_ENTRY)
+    {
+        if (cache->free == CACHE_NO_ENTRY)
+        {
+            releaseEntry(cache, cache->last);
+            cache->evictions++;
+        }
+
+        entry       = cache->free;
+        cache->free = cache->entries[entry].next;
+
+        size_t bucket = bucketOf(cache, object);
+
+        cache->entries[entry].object       = object;
+        cache->entries[entry].nextInBucket = cache->buckets[bucket];
+        cache->buckets[bucket]             = entry;
+    }
+    else
+    {
+        unlinkEntry(cache, entry);
+    }
+
+    pushFront(cache, entry);
+
+    CacheEntry* current = &cache->entries[entry];
+
+    if (current->bufferSize < length + 1)
+    {
+        char* buffer = (char*) memRealloc(MEM_INDEXES, current->text, length + 1);
+        CHECK_NULL(buffer, releaseEntry(cache, entry); return false);
+
+        current->text       = buffer;
+        current->bufferSize = length + 1;
+    }
+
+    memcpy(current->text, text, length);
+    current->text[length] = '\0';
+    current->length       = length;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Forgets the definition of object, e.g. when a question has been put in
+//! its place.
+//-----------------------------------------------------------------------------
+void cacheInvalidate(DefinitionCache* cache, BTNode* object)
+{
+    assert(cache  != NULL);
+    assert(object != NULL);
+
+    size_t entry = findEntry(cache, object);
+    if (entry != CACHE_NO_ENTRY) { releaseEntry(cache, entry); }
+}
+
+void cacheClear(DefinitionCache* cache)
+{
+    assert(cache != NULL);
+
+    for (size_t i = 0; i < cache->bucketsCount; i++) { cache->buckets[i] = CACHE_NO_ENTRY; }
+
+    for (size_t i = 0; i < cache->capacity; i++)
+    {
+        CacheEntry* entry = &cache->entries[i];
+
+        entry->object       = NULL;
+        entry->prev         = CACHE_NO_ENTRY;
+        entry->next         = i + 1 < cache->capacity ? i + 1 : CACHE_NO_ENTRY;
+        entry->nextInBucket = CACHE_NO_ENTRY;
+    }
+
+    cache->first = CACHE_NO_ENTRY;
+    cache->last  = CACHE_NO_ENTRY;
+    cache->free  = 0;
+}
+
+size_t cacheHits(DefinitionCache* cache)
+{
+    assert(cache != NULL);
+    return cache->hits;
+}
+
+size_t cacheMisses(DefinitionCache* cache)
+{
+    assert(cache != NULL);
+    return cache->misses;
+}
+
+size_t cacheEvictions(DefinitionCache* cache)
+{
+    assert(cache != NULL);
+    return cache->evictions;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "binary_tree.h"
+
+struct DefinitionCache;
+
+static const size_t DEFINITION_CACHE_DEFAULT_SIZE = 128;
+
+DefinitionCache* newDefinitionCache    (size_t capacity);
+void             deleteDefinitionCache (DefinitionCache* cache);
+
+const char*      cacheFind             (DefinitionCache* cache, BTNode* object, size_t* length);
+bool             cacheStore            (DefinitionCache* cache, BTNode* object, const char* text, size_t length);
+void             cacheInvalidate       (DefinitionCache* cache, BTNode* object);
+void             cacheClear            (DefinitionCache* cache);
+
+size_t           cacheHits             (DefinitionCache* cache);
+size_t           cacheMisses           (DefinitionCache* cache);
+size_t           cacheEvictions        (DefinitionCache* cache);
@@ -0,0 +1,67 @@
+//-----------------------------------------------------------------------------
+// Compares two databases, e.g.
+//     diff.exe res/database.txt backup/database.txt
+// Only subtrees with different hashes are descended, so two copies with a 
+// few changes are compared in about (changes x depth) steps. Exit code is 
+// 0 if the databases are equal, 1 if they differ and 2 if they couldn't be 
+// compared.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include "oracle.h"
+#include "tree_diff.h"
+#include "ui.h"
+#include "../libs/log_generator.h"
+
+const size_t MAX_STR_SIZE = 256;
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        printf("Usage: %s <old database> <new database>\n", argv[0]);
+        return 2;
+    }
+
+    LG_Init();
+
+    Oracle* oldOracle = summonOracle(argv[1], UI_NewSpeaker(MAX_STR_SIZE, false), false);
+    Oracle* newOracle = summonOracle(argv[2], UI_NewSpeaker(MAX_STR_SIZE, false), false);
+
+    int exitCode = 2;
+
+    if (oldOracle == NULL || newOracle == NULL)
+    {
+        printf("Couldn't read '%s'\n", oldOracle == NULL ? argv[1] : argv[2]);
+    }
+    else
+    {
+        BTNode*  oldRoot = getRoot(getTree(oldOracle));
+        BTNode*  newRoot = getRoot(getTree(newOracle));
+        TreeDiff diff    = {};
+
+        if (diffTrees(oldRoot, newRoot, stdout, &diff))
+        {
+            printf("%lu changed subtrees, %lu objects added, %lu removed (%lu of %lu node pairs compared)\n",
+                   (unsigned long) diff.changes,
+                   (unsigned long) diff.added,
+                   (unsigned long) diff.removed,
+                   (unsigned long) diff.pairsCompared,
+                   (unsigned long) (getLeavesCount(oldRoot) * 2 - 1));
+
+            exitCode = diff.changes == 0 ? 0 : 1;
+        }
+        else
+        {
+            printf("Not enough memory to compare the databases\n");
+        }
+    }
+
+    if (oldOracle != NULL) { banishOracle(oldOracle); }
+    if (newOracle != NULL) { banishOracle(newOracle); }
+
+    UI_Close();
+    LG_Close();
+
+    return exitCode;
+}
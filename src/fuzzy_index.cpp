@@ -0,0 +1,282 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fuzzy_index.h"
+#include "memory_tags.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+static const size_t FUZZY_NO_NODE          = (size_t) -1;
+static const size_t FUZZY_DEFAULT_CAPACITY = 64;
+
+//-----------------------------------------------------------------------------
+// BK-tree over object names with Levenshtein distance. Every child is at a
+// distance from its parent equal to its edge's label, so by the triangle
+// inequality a search for strings within k from the query only has to visit
+// children with labels in [d - k, d + k], where d is the distance from the
+// query to the parent. Nodes are kept in one array, children are linked as
+// lists.
+//-----------------------------------------------------------------------------
+struct FuzzyNode
+{
+    BTNode* object      = NULL;
+    size_t  distance    = 0;
+    size_t  firstChild  = FUZZY_NO_NODE;
+    size_t  nextSibling = FUZZY_NO_NODE;
+};
+
+struct FuzzyIndex
+{
+    FuzzyNode* nodes    = NULL;
+    size_t     size     = 0;
+    size_t     capacity = 0;
+
+    size_t*    row      = NULL;
+    size_t     rowSize  = 0;
+
+    size_t*    stack    = NULL;
+};
+
+bool   reserveNodes (FuzzyIndex* index, size_t capacity);
+bool   reserveRow   (FuzzyIndex* index, size_t length);
+size_t editDistance (FuzzyIndex* index, const char* str1, size_t length1, const char* str2, size_t length2);
+
+FuzzyIndex* newFuzzyIndex()
+{
+    FuzzyIndex* index = (FuzzyIndex*) memAlloc(MEM_INDEXES, 1, sizeof(FuzzyIndex));
+    CHECK_NULL(index, return NULL);
+
+    *index = {};
+
+    if (!reserveNodes(index, FUZZY_DEFAULT_CAPACITY))
+    {
+        deleteFuzzyIndex(index);
+        return NULL;
+    }
+
+    return index;
+}
+
+void deleteFuzzyIndex(FuzzyIndex* index)
+{
+    assert(index != NULL);
+
+    memFree(index->nodes);
+    memFree(index->row);
+    memFree(index->stack);
+    memFree(index);
+}
+
+bool reserveNodes(FuzzyIndex* index, size_t capacity)
+{
+    assert(index != NULL);
+
+    if (capacity <= index->capacity) { return true; }
+
+    FuzzyNode* nodes = (FuzzyNode*) memRealloc(MEM_INDEXES, index->nodes, capacity * sizeof(FuzzyNode));
+    CHECK_NULL(nodes, return false);
+
+    // the search stack never holds more than all of the nodes
+    size_t* stack = (size_t*) memRealloc(MEM_INDEXES, index->stack, capacity * sizeof(size_t));
+    CHECK_NULL(stack, index->nodes = nodes; return false);
+
+    index->nodes    = nodes;
+    index->stack    = stack;
+    index->capacity = capacity;
+
+    return true;
+}
+
+bool reserveRow(FuzzyIndex* index, size_t length)
+{
+    assert(index != NULL);
+
+    if (length + 1 <= index->rowSize) { return true; }
+
+    size_t* row = (size_t*) memRealloc(MEM_INDEXES, index->row, (length + 1) * sizeof(size_t));
+    CHECK_NULL(row, return false);
+
+    index->row     = row;
+    index->rowSize = length + 1;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Levenshtein distance computed with a single row of the table.
+//-----------------------------------------------------------------------------
+size_t editDistance(FuzzyIndex* index, const char* str1, size_t length1, const char* str2, size_t length2)
+{
+    assert(index != NULL);
+    assert(str1  != NULL);
+    assert(str2  != NULL);
+    assert(index->rowSize > length2);
+
+    size_t* row = index->row;
+
+    for (size_t j = 0; j <= length2; j++) { row[j] = j; }
+
+    for (size_t i = 1; i <= length1; i++)
+    {
+        size_t diagonal = row[0];
+        row[0] = i;
+
+        for (size_t j = 1; j <= length2; j++)
+        {
+            size_t above   = row[j];
+            size_t replace = diagonal + (str1[i - 1] != str2[j - 1]);
+            size_t remove  = above + 1;
+            size_t insert  = row[j - 1] + 1;
+
+            row[j]   = replace < remove ? replace : remove;
+            row[j]   = row[j]  < insert ? row[j]  : insert;
+            diagonal = above;
+        }
+    }
+
+    return row[length2];
+}
+
+//-----------------------------------------------------------------------------
+//! Adds an object to the index. The index keeps the node, not a copy of its
+//! value, so the node has to outlive the index.
+//!
+//! @param [in] index
+//! @param [in] object
+//!
+//! @return false if out of memory.
+//-----------------------------------------------------------------------------
+bool fuzzyInsert(FuzzyIndex* index, BTNode* object)
+{
+    assert(index  != NULL);
+    assert(object != NULL);
+
+    if (index->size == index->capacity && !reserveNodes(index, index->capacity * 2)) { return false; }
+
+    const char* value  = getValue(object);
+    size_t      length = getValueLength(object);
+
+    size_t newIndex = index->size++;
+    index->nodes[newIndex]        = {};
+    index->nodes[newIndex].object = object;
+
+    if (newIndex == 0) { return true; }
+
+    size_t current = 0;
+    while (true)
+    {
+        BTNode* other       = index->nodes[current].object;
+        size_t  otherLength = getValueLength(other);
+
+        if (!reserveRow(index, otherLength)) { index->size--; return false; }
+
+        size_t distance = editDistance(index, value, length, getValue(other), otherLength);
+
+        size_t child = index->nodes[current].firstChild;
+        while (child != FUZZY_NO_NODE && index->nodes[child].distance != distance)
+        {
+            child = index->nodes[child].nextSibling;
+        }
+
+        if (child == FUZZY_NO_NODE)
+        {
+            index->nodes[newIndex].distance    = distance;
+            index->nodes[newIndex].nextSibling = index->nodes[current].firstChild;
+            index->nodes[current].firstChild   = newIndex;
+
+            return true;
+        }
+
+        current = child;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Finds objects whose values are within maxDistance edits from query.
+//!
+//! @param [in]  index
+//! @param [in]  query
+//! @param [in]  maxDistance
+//! @param [out] matches     found objects, closest first
+//! @param [in]  maxMatches  size of matches
+//!
+//! @return number of objects found.
+//-----------------------------------------------------------------------------
+size_t fuzzyFind(FuzzyIndex* index, const char* query, size_t maxDistance, BTNode** matches, size_t maxMatches)
+{
+    assert(index   != NULL);
+    assert(query   != NULL);
+    assert(matches != NULL);
+
+    if (index->size == 0 || maxMatches == 0) { return 0; }
+
+    size_t  queryLength    = strlen(query);
+    size_t  matchesCount   = 0;
+    size_t  radius         = maxDistance;
+    size_t* distances      = (size_t*) memAlloc(MEM_INDEXES, maxMatches, sizeof(size_t));
+    CHECK_NULL(distances, return 0);
+
+    if (!reserveRow(index, queryLength)) { memFree(distances); return 0; }
+
+    size_t stackSize = 0;
+    index->stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        FuzzyNode* node     = &index->nodes[index->stack[--stackSize]];
+        size_t     distance = editDistance(index, getValue(node->object), getValueLength(node->object), 
+                                           query, queryLength);
+
+        if (distance <= radius)
+        {
+            // insertion into the sorted list of matches
+            bool   isFull   = matchesCount == maxMatches;
+            size_t position = isFull ? maxMatches - 1 : matchesCount++;
+            if (!isFull || distance < distances[position])
+            {
+                for (; position > 0 && distances[position - 1] > distance; position--)
+                {
+                    matches[position]   = matches[position - 1];
+                    distances[position] = distances[position - 1];
+                }
+
+                matches[position]   = node->object;
+                distances[position] = distance;
+            }
+
+            // no need to look for anything further than the worst of the best
+            if (matchesCount == maxMatches) { radius = distances[maxMatches - 1]; }
+        }
+
+        for (size_t child = node->firstChild; child != FUZZY_NO_NODE; child = index->nodes[child].nextSibling)
+        {
+            size_t childDistance = index->nodes[child].distance;
+            if (childDistance + radius >= distance && childDistance <= distance + radius)
+            {
+                index->stack[stackSize++] = child;
+            }
+        }
+    }
+
+    memFree(distances);
+
+    return matchesCount;
+}
+
+BTNode* fuzzyFindBest(FuzzyIndex* index, const char* query, size_t maxDistance)
+{
+    assert(index != NULL);
+    assert(query != NULL);
+
+    BTNode* best = NULL;
+    fuzzyFind(index, query, maxDistance, &best, 1);
+
+    return best;
+}
+
+size_t fuzzySize(FuzzyIndex* index)
+{
+    assert(index != NULL);
+
+    return index->size;
+}
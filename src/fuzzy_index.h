@@ -0,0 +1,16 @@
+#pragma once
+
+#include "binary_tree.h"
+
+struct FuzzyIndex;
+
+static const size_t FUZZY_DEFAULT_DISTANCE = 2;
+
+FuzzyIndex* newFuzzyIndex    ();
+void        deleteFuzzyIndex (FuzzyIndex* index);
+
+bool        fuzzyInsert      (FuzzyIndex* index, BTNode* object);
+size_t      fuzzyFind        (FuzzyIndex* index, const char* query, size_t maxDistance,
+                              BTNode** matches, size_t maxMatches);
+BTNode*     fuzzyFindBest    (FuzzyIndex* index, const char* query, size_t maxDistance);
+size_t      fuzzySize        (FuzzyIndex* index);
@@ -0,0 +1,283 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lookup_index.h"
+#include "memory_tags.h"
+#include "string_pool.h"
+#include "../libs/file_manager.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+static const size_t LOOKUP_MIN_CAPACITY = 64;
+static const char*  LOOKUP_WHITESPACE   = " \t\r\n";
+
+//-----------------------------------------------------------------------------
+// Hash table from normalized values (lower case, single spaces between words,
+// no leading or trailing spaces) to nodes. Keys are normalized once when a
+// node is added and kept in the tree's string pool, so a lookup normalizes
+// only the query and compares keys by hash and length first. Keys equal to
+// their nodes' values aren't copied (key is NULL then), so packed values
+// don't get back into the pool.
+//-----------------------------------------------------------------------------
+struct LookupEntry
+{
+    uint32_t    hash   = 0;
+    uint32_t    length = 0;
+    const char* key    = NULL;
+    BTNode*     node   = NULL;
+};
+
+struct LookupIndex
+{
+    BinaryTree*  tree       = NULL;
+
+    LookupEntry* table      = NULL;
+    size_t       capacity   = 0;
+    size_t       size       = 0;
+
+    char*        buffer     = NULL;
+    size_t       bufferSize = 0;
+};
+
+bool         growLookupTable (LookupIndex* index);
+LookupEntry* findEntry       (LookupIndex* index, const char* key, size_t length, uint32_t hash);
+const char*  normalizeQuery  (LookupIndex* index, const char* value, size_t* length);
+
+LookupIndex* newLookupIndex(BinaryTree* tree)
+{
+    assert(tree != NULL);
+
+    LookupIndex* index = (LookupIndex*) memAlloc(MEM_INDEXES, 1, sizeof(LookupIndex));
+    CHECK_NULL(index, return NULL);
+
+    *index = {};
+
+    index->table = (LookupEntry*) memAlloc(MEM_INDEXES, LOOKUP_MIN_CAPACITY, sizeof(LookupEntry));
+    CHECK_NULL(index->table, memFree(index); return NULL);
+
+    index->tree     = tree;
+    index->capacity = LOOKUP_MIN_CAPACITY;
+
+    return index;
+}
+
+void deleteLookupIndex(LookupIndex* index)
+{
+    assert(index != NULL);
+
+    memFree(index->table);
+    memFree(index->buffer);
+    memFree(index);
+}
+
+//-----------------------------------------------------------------------------
+//! Copies str to dst in lower case with whitespace sequences replaced by
+//! single spaces and without leading and trailing whitespace.
+//!
+//! @param [in]  str
+//! @param [out] dst at least strlen(str) + 1 characters, can be str itself
+//!
+//! @return length of the normalized string.
+//-----------------------------------------------------------------------------
+size_t normalizeKey(const char* str, char* dst)
+{
+    assert(str != NULL);
+    assert(dst != NULL);
+
+    size_t length = 0;
+
+    str += strspn(str, LOOKUP_WHITESPACE);
+    while (*str != '\0')
+    {
+        size_t wordLength = strcspn(str, LOOKUP_WHITESPACE);
+
+        if (length > 0) { dst[length++] = ' '; }
+
+        memmove(dst + length, str, wordLength);
+        length += wordLength;
+
+        str += wordLength;
+        str += strspn(str, LOOKUP_WHITESPACE);
+    }
+
+    dst[length] = '\0';
+    strToLower(dst);
+
+    return length;
+}
+
+const char* normalizeQuery(LookupIndex* index, const char* value, size_t* length)
+{
+    assert(index  != NULL);
+    assert(value  != NULL);
+    assert(length != NULL);
+
+    size_t valueLength = strlen(value);
+    if (valueLength + 1 > index->bufferSize)
+    {
+        char* buffer = (char*) memRealloc(MEM_INDEXES, index->buffer, valueLength + 1);
+        CHECK_NULL(buffer, return NULL);
+
+        index->buffer     = buffer;
+        index->bufferSize = valueLength + 1;
+    }
+
+    *length = normalizeKey(value, index->buffer);
+
+    return index->buffer;
+}
+
+//-----------------------------------------------------------------------------
+//! @return entry with the key or the empty entry where it should be put.
+//-----------------------------------------------------------------------------
+LookupEntry* findEntry(LookupIndex* index, const char* key, size_t length, uint32_t hash)
+{
+    assert(index != NULL);
+    assert(key   != NULL);
+
+    size_t position = hash & (index->capacity - 1);
+    while (index->table[position].node != NULL)
+    {
+        LookupEntry* entry = &index->table[position];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(entry->key != NULL ? entry->key : getValue(entry->node), key, length) == 0)
+        {
+            return entry;
+        }
+
+        position = (position + 1) & (index->capacity - 1);
+    }
+
+    return &index->table[position];
+}
+
+bool growLookupTable(LookupIndex* index)
+{
+    assert(index != NULL);
+
+    size_t       newCapacity = index->capacity * 2;
+    LookupEntry* newTable    = (LookupEntry*) memAlloc(MEM_INDEXES, newCapacity, sizeof(LookupEntry));
+    CHECK_NULL(newTable, return false);
+
+    for (size_t i = 0; i < index->capacity; i++)
+    {
+        LookupEntry* entry = &index->table[i];
+        if (entry->node == NULL) { continue; }
+
+        size_t position = entry->hash & (newCapacity - 1);
+        while (newTable[position].node != NULL) { position = (position + 1) & (newCapacity - 1); }
+
+        newTable[position] = *entry;
+    }
+
+    memFree(index->table);
+
+    index->table    = newTable;
+    index->capacity = newCapacity;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Adds node under its normalized value. If another node already has the
+//! same key, the first one is kept.
+//!
+//! @param [in] index
+//! @param [in] node
+//!
+//! @return false if out of memory.
+//-----------------------------------------------------------------------------
+bool lookupInsert(LookupIndex* index, BTNode* node)
+{
+    assert(index != NULL);
+    assert(node  != NULL);
+
+    size_t      length = 0;
+    const char* key    = normalizeQuery(index, getValue(node), &length);
+    CHECK_NULL(key, return false);
+
+    uint32_t     hash  = hashString(key, length);
+    LookupEntry* entry = findEntry(index, key, length, hash);
+    if (entry->node != NULL) { return true; }
+
+    // keep load factor under 3/4, the table is grown before it's overfilled
+    if (4 * (index->size + 1) > 3 * index->capacity)
+    {
+        if (!growLookupTable(index)) { return false; }
+
+        entry = findEntry(index, key, length, hash);
+    }
+
+    if (length != getValueLength(node) || memcmp(key, getValue(node), length) != 0)
+    {
+        key = poolIntern(getStringPool(index->tree), key);
+        CHECK_NULL(key, return false);
+    }
+    else
+    {
+        key = NULL;
+    }
+
+    entry->hash   = hash;
+    entry->length = (uint32_t) length;
+    entry->key    = key;
+    entry->node   = node;
+    index->size++;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Adds all nodes of the subtree in pre-order, so that for equal keys the
+//! node closer to the root wins like in findNode.
+//-----------------------------------------------------------------------------
+bool lookupInsertTree(LookupIndex* index, BTNode* subRoot)
+{
+    assert(index   != NULL);
+    assert(subRoot != NULL);
+
+    if (!lookupInsert(index, subRoot)) { return false; }
+
+    // children of a lazily loaded question may be still on disk, they are added when they are loaded
+    if (isQuestion(subRoot) && getLeft(subRoot) != NULL)
+    {
+        return lookupInsertTree(index, getLeft(subRoot)) && lookupInsertTree(index, getRight(subRoot));
+    }
+
+    return true;
+}
+
+void lookupClear(LookupIndex* index)
+{
+    assert(index != NULL);
+
+    for (size_t i = 0; i < index->capacity; i++) { index->table[i] = {}; }
+    index->size = 0;
+}
+
+//-----------------------------------------------------------------------------
+//! Finds a node whose value matches value ignoring case and extra whitespace.
+//!
+//! @param [in] index
+//! @param [in] value
+//!
+//! @return node or NULL if there is none.
+//-----------------------------------------------------------------------------
+BTNode* lookupFind(LookupIndex* index, const char* value)
+{
+    assert(index != NULL);
+    assert(value != NULL);
+
+    size_t      length = 0;
+    const char* key    = normalizeQuery(index, value, &length);
+    CHECK_NULL(key, return NULL);
+
+    return findEntry(index, key, length, hashString(key, length))->node;
+}
+
+size_t lookupSize(LookupIndex* index)
+{
+    assert(index != NULL);
+
+    return index->size;
+}
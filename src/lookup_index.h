@@ -0,0 +1,16 @@
+#pragma once
+
+#include "binary_tree.h"
+
+struct LookupIndex;
+
+LookupIndex* newLookupIndex    (BinaryTree* tree);
+void         deleteLookupIndex (LookupIndex* index);
+
+bool         lookupInsert      (LookupIndex* index, BTNode* node);
+bool         lookupInsertTree  (LookupIndex* index, BTNode* subRoot);
+void         lookupClear       (LookupIndex* index);
+BTNode*      lookupFind        (LookupIndex* index, const char* value);
+size_t       lookupSize        (LookupIndex* index);
+
+size_t       normalizeKey      (const char* str, char* dst);
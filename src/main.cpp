@@ -27,25 +27,46 @@
 */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include "ui.h"
 #include "oracle.h"
+#include "perf_counters.h"
+#include "transcript.h"
 #include "../libs/log_generator.h"
 
 const int    DIVIDER_SIZE = 50;
 const char   DIVIDER_SYMB = '=';
 const size_t MAX_STR_SIZE = 256;
 const char*  DEFAULT_DB   = "res/database.txt";
+const size_t MAX_NAME_TRY = 100; // transcripts of sessions closed within the same second
 
 bool running = true;
 
-void dialogMain(char* databaseFileName, bool* speak);
+//-----------------------------------------------------------------------------
+// A session lasts while the same database is used. Answers given during the
+// session are recorded to a transcript that is written next to the database
+// when the session is over, so the session can be replayed later.
+//-----------------------------------------------------------------------------
+struct Session
+{
+    Oracle*     oracle     = NULL;
+    Transcript* transcript = NULL;
+    uint64_t    startHash  = 0;
+};
+
+void dialogMain   (Session* session, char* databaseFileName, bool* speak);
+bool openSession  (Session* session, const char* databaseFileName, bool speak);
+void closeSession (Session* session, const char* databaseFileName);
+void recordDialog (Session* session, TranscriptDialog dialog, void (*function)(Oracle* oracle));
 
 int main()
 {
     LG_Init();
+    perfOpen();
 
     bool speak = true;
 
@@ -53,62 +74,79 @@ int main()
     assert(dbFileName != NULL);
     strncpy(dbFileName, DEFAULT_DB, MAX_STR_SIZE);
 
+    Session session = {};
+
     while (running)
     {
-        dialogMain(dbFileName, &speak);
+        dialogMain(&session, dbFileName, &speak);
     }
 
+    if (session.oracle != NULL) { closeSession(&session, dbFileName); }
+
+    perfReport();
+    perfClose();
+
+    UI_Close();
     LG_Close();
 
     return 0;
 }
 
-void dialogMain(char* databaseFileName, bool* speak)
+//-----------------------------------------------------------------------------
+//! The oracle is summoned once per database and lives between the menu 
+//! actions, so its indexes and caches aren't rebuilt every time.
+//-----------------------------------------------------------------------------
+void dialogMain(Session* session, char* databaseFileName, bool* speak)
 {
+    assert(session != NULL);
     assert(databaseFileName != NULL);
     assert(speak != NULL);
 
-    Oracle* oracle = summonOracle(databaseFileName, UI_NewSpeaker(MAX_STR_SIZE, *speak));
-    if (oracle == NULL)
+    if (session->oracle == NULL && !openSession(session, databaseFileName, *speak))
     {
         running = false;
         return;
     }
 
+    Oracle* oracle = session->oracle;
+
     UI_PrintDivider(DIVIDER_SIZE, DIVIDER_SYMB);
 
     UI_PrintCentered(DIVIDER_SIZE, "Main menu");
     UI_PrintCentered(DIVIDER_SIZE, databaseFileName);
-    UI_PrintOptions("012345x", 
+    UI_PrintOptions("012345678x", 
                     "Game", 
                     "Definition", 
                     "Comparison",
                     "Tree diagram",
                     "Change database",
                     *speak ? "Disable voice" : "Enable voice",
+                    "Optimize tree",
+                    "Similarity matrix",
+                    "Tree statistics",
                     "EXIT");
 
     UI_PrintDivider(DIVIDER_SIZE, DIVIDER_SYMB);
 
-    const char option = UI_GetOption('0', '5', "x");
+    const char option = UI_GetOption('0', '8', "x");
 
     switch (option)
     {
         case '0':
         {
-            game(oracle);
+            recordDialog(session, TRANSCRIPT_GAME, game);
             break;
         }
 
         case '1':
         {
-            definitionDialog(oracle);
+            recordDialog(session, TRANSCRIPT_DEFINITION, definitionDialog);
             break;
         }
 
         case '2':
         {
-            comparisonDialog(oracle);
+            recordDialog(session, TRANSCRIPT_COMPARISON, comparisonDialog);
             break;
         }
 
@@ -120,19 +158,47 @@ void dialogMain(char* databaseFileName, bool* speak)
 
         case '4':
         {
-            UI_SAskStr(getSpeaker(oracle), 
+            // the oracle saves to the file it has been summoned with
+            closeSession(session, databaseFileName);
+
+            UI_Speaker* speaker = UI_NewSpeaker(MAX_STR_SIZE, *speak);
+            assert(speaker != NULL);
+
+            UI_SAskStr(speaker, 
                        databaseFileName, 
                        MAX_STR_SIZE, 
                        "Enter the filename: ");
+
+            UI_DeleteSpeaker(speaker);
             break;
         }
 
         case '5':
         {
             *speak = !*speak;
+            UI_SetSpeak(getSpeaker(oracle), *speak);
+            break;
+        }
+
+        case '6':
+        {
+            recordDialog(session, TRANSCRIPT_OPTIMIZATION, optimizationDialog);
             break;
         }
 
+        case '7':
+        {
+            similarityDialog(oracle);
+            break;
+        }
+
+        case '8':
+        {
+            statisticsDialog(oracle);
+            break;
+        }
+
+        case '\0': // no more input
         case 'x':
         {
             running = false;
@@ -140,7 +206,99 @@ void dialogMain(char* databaseFileName, bool* speak)
         }
     }
 
-    banishOracle(oracle);
+    if (session->oracle != NULL) { saveOracle(session->oracle); }
+
+    UI_Print("\n\n");
+}
+
+bool openSession(Session* session, const char* databaseFileName, bool speak)
+{
+    assert(session != NULL);
+    assert(databaseFileName != NULL);
+
+    session->oracle = summonOracle(databaseFileName, UI_NewSpeaker(MAX_STR_SIZE, speak), true);
+    if (session->oracle == NULL) { return false; }
+
+    // hashing a lazily loaded tree would load all of it
+    session->startHash  = isTreeLoaded(session->oracle) ? hashTree(getRoot(getTree(session->oracle))) : TRANSCRIPT_NO_HASH;
+    session->transcript = newTranscript();
+    if (session->transcript == NULL)
+    {
+        LG_Write("Couldn't create session transcript, the session won't be recorded\n", LG_STYLE_CLASS_DEFAULT);
+        return true;
+    }
+
+    UI_SetInput(transcriptInput(session->transcript, UI_TerminalInput()));
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the transcript (if anything has been recorded) to 
+//! "<database>.<date>-<time>.transcript", or "<...>-<n>.transcript" if that
+//! one exists already, and banishes the oracle.
+//-----------------------------------------------------------------------------
+void closeSession(Session* session, const char* databaseFileName)
+{
+    assert(session != NULL);
+    assert(session->oracle != NULL);
+    assert(databaseFileName != NULL);
+
+    saveOracle(session->oracle);
+
+    if (session->transcript != NULL && getDialogsCount(session->transcript) != 0)
+    {
+        uint64_t finalHash = session->startHash != TRANSCRIPT_NO_HASH ? hashTree(getRoot(getTree(session->oracle))) : TRANSCRIPT_NO_HASH;
+        setTreeHashes(session->transcript, session->startHash, finalHash);
+
+        char   timeStr[MAX_STR_SIZE] = "";
+        time_t now                   = time(NULL);
+        strftime(timeStr, sizeof(timeStr), "%Y%m%d-%H%M%S", localtime(&now));
+
+        char fileName[2 * MAX_STR_SIZE] = "";
+        bool isSaved                    = false;
+
+        // the name is taken by another session closed in the same second, the next free suffix is used
+        for (size_t i = 1; i <= MAX_NAME_TRY; i++)
+        {
+            if (i == 1) { snprintf(fileName, sizeof(fileName), "%s.%s.transcript", databaseFileName, timeStr); }
+            else        { snprintf(fileName, sizeof(fileName), "%s.%s-%lu.transcript", databaseFileName, timeStr, (unsigned long) i); }
+
+            errno   = 0;
+            isSaved = saveTranscript(session->transcript, fileName);
+            if (isSaved || errno != EEXIST) { break; }
+        }
+
+        if (isSaved)
+        {
+            LG_Write("Session transcript is written to '%s'\n", LG_STYLE_CLASS_GOOD, fileName);
+        }
+        else
+        {
+            LG_Write("ERROR: Couldn't write session transcript '%s'\n", LG_STYLE_CLASS_ERROR, fileName);
+        }
+    }
+
+    if (session->transcript != NULL)
+    {
+        UI_SetInput(UI_TerminalInput());
+        deleteTranscript(session->transcript);
+    }
+
+    banishOracle(session->oracle);
+
+    *session = {};
+}
+
+void recordDialog(Session* session, TranscriptDialog dialog, void (*function)(Oracle* oracle))
+{
+    assert(session != NULL);
+    assert(session->oracle != NULL);
+    assert(function != NULL);
+
+    if (session->transcript != NULL) { beginDialog(session->transcript, dialog); }
+
+    function(session->oracle);
 
-    printf("\n\n");
+    if (session->transcript != NULL) { endDialog(session->transcript); }
 }
\ No newline at end of file
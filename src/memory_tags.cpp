@@ -0,0 +1,177 @@
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include "memory_tags.h"
+
+//-----------------------------------------------------------------------------
+// Every block starts with a header keeping its size and tag, so that blocks
+// can be freed without them. The header is as big as malloc's alignment, so
+// the memory after it stays aligned. Counters are atomic, since several 
+// threads allocate (e.g. when transcripts are replayed).
+//-----------------------------------------------------------------------------
+struct alignas(max_align_t) MemoryHeader
+{
+    size_t    size = 0;
+    MemoryTag tag  = MEM_TREE;
+};
+
+static const char* MEMORY_TAG_NAMES[MEM_TAGS_COUNT] = 
+{
+    "tree",
+    "strings",
+    "stacks",
+    "text",
+    "UI",
+    "indexes",
+    "reports",
+};
+
+static MemoryStats memoryStats[MEM_TAGS_COUNT] = {};
+
+static const size_t MEM_MIN_CAPACITY = 64;
+
+#ifdef MEMORY_PROFILING
+
+void trackBytes (MemoryTag tag, size_t size, bool isAllocation);
+
+void trackBytes(MemoryTag tag, size_t size, bool isAllocation)
+{
+    assert(tag < MEM_TAGS_COUNT);
+
+    MemoryStats* stats = &memoryStats[tag];
+
+    if (isAllocation) { __atomic_fetch_add(&stats->allocations, 1, __ATOMIC_RELAXED); }
+
+    size_t live = __atomic_add_fetch(&stats->live, size, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&stats->peak, __ATOMIC_RELAXED);
+
+    while (live > peak && 
+           !__atomic_compare_exchange_n(&stats->peak, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+void* memAlloc(MemoryTag tag, size_t count, size_t size)
+{
+    assert(tag < MEM_TAGS_COUNT);
+
+    if (size != 0 && count > (SIZE_MAX - sizeof(MemoryHeader)) / size) { return NULL; }
+
+    MemoryHeader* header = (MemoryHeader*) calloc(1, sizeof(MemoryHeader) + count * size);
+    if (header == NULL) { return NULL; }
+
+    header->size = count * size;
+    header->tag  = tag;
+
+    trackBytes(tag, header->size, true);
+
+    return header + 1;
+}
+
+//-----------------------------------------------------------------------------
+//! Works as realloc, the tag is only used if memory is NULL.
+//-----------------------------------------------------------------------------
+void* memRealloc(MemoryTag tag, void* memory, size_t size)
+{
+    if (memory == NULL) { return memAlloc(tag, 1, size); }
+
+    MemoryHeader* header  = (MemoryHeader*) memory - 1;
+    size_t        oldSize = header->size;
+
+    MemoryHeader* newHeader = (MemoryHeader*) realloc(header, sizeof(MemoryHeader) + size);
+    if (newHeader == NULL) { return NULL; }
+
+    newHeader->size = size;
+
+    memUntrack(newHeader->tag, oldSize);
+    trackBytes(newHeader->tag, size, true);
+
+    return newHeader + 1;
+}
+
+void memFree(void* memory)
+{
+    if (memory == NULL) { return; }
+
+    MemoryHeader* header = (MemoryHeader*) memory - 1;
+
+    memUntrack(header->tag, header->size);
+    free(header);
+}
+
+//-----------------------------------------------------------------------------
+//! Accounts for memory allocated by libraries (e.g. texts read from files).
+//-----------------------------------------------------------------------------
+void memTrack(MemoryTag tag, size_t size)
+{
+    trackBytes(tag, size, true);
+}
+
+void memUntrack(MemoryTag tag, size_t size)
+{
+    assert(tag < MEM_TAGS_COUNT);
+
+    __atomic_fetch_sub(&memoryStats[tag].live, size, __ATOMIC_RELAXED);
+}
+
+bool memIsProfiling()
+{
+    return true;
+}
+
+#else
+
+bool memIsProfiling()
+{
+    return false;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+//! Makes the array at least minCapacity elements long, new elements are 
+//! zeroed. Capacity is doubled, so that appending is amortized O(1).
+//!
+//! @return false if out of memory, the array is left as it is then.
+//-----------------------------------------------------------------------------
+bool memReserve(MemoryTag tag, void** array, size_t* capacity, size_t minCapacity, size_t elementSize)
+{
+    assert(array    != NULL);
+    assert(capacity != NULL);
+
+    if (minCapacity <= *capacity) { return true; }
+
+    size_t newCapacity = *capacity != 0 ? *capacity : MEM_MIN_CAPACITY;
+    while (newCapacity < minCapacity) { newCapacity *= 2; }
+
+    void* newArray = memRealloc(tag, *array, newCapacity * elementSize);
+    if (newArray == NULL) { return false; }
+
+    memset((char*) newArray + *capacity * elementSize, 0, (newCapacity - *capacity) * elementSize);
+
+    *array    = newArray;
+    *capacity = newCapacity;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! @return counters of the tag, all zeros if profiling is disabled.
+//-----------------------------------------------------------------------------
+MemoryStats memGetStats(MemoryTag tag)
+{
+    assert(tag < MEM_TAGS_COUNT);
+
+    MemoryStats stats = {};
+
+    stats.live        = __atomic_load_n(&memoryStats[tag].live,        __ATOMIC_RELAXED);
+    stats.peak        = __atomic_load_n(&memoryStats[tag].peak,        __ATOMIC_RELAXED);
+    stats.allocations = __atomic_load_n(&memoryStats[tag].allocations, __ATOMIC_RELAXED);
+
+    return stats;
+}
+
+const char* memTagName(MemoryTag tag)
+{
+    assert(tag < MEM_TAGS_COUNT);
+
+    return MEMORY_TAG_NAMES[tag];
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+
+//-----------------------------------------------------------------------------
+// Allocations are tagged with the subsystem they belong to. With 
+// MEMORY_PROFILING defined every tag counts live bytes, peak live bytes and 
+// allocations (every block gets a small header for that), without it the 
+// wrappers are plain calloc, realloc and free.
+//-----------------------------------------------------------------------------
+enum MemoryTag
+{
+    MEM_TREE,
+    MEM_STRINGS,
+    MEM_STACKS,
+    MEM_TEXT,
+    MEM_UI,
+    MEM_INDEXES,
+    MEM_REPORTS,
+
+    MEM_TAGS_COUNT
+};
+
+struct MemoryStats
+{
+    size_t live        = 0;
+    size_t peak        = 0;
+    size_t allocations = 0;
+};
+
+#ifdef MEMORY_PROFILING
+
+void*       memAlloc     (MemoryTag tag, size_t count, size_t size);
+void*       memRealloc   (MemoryTag tag, void* memory, size_t size);
+void        memFree      (void* memory);
+
+void        memTrack     (MemoryTag tag, size_t size);
+void        memUntrack   (MemoryTag tag, size_t size);
+
+#else
+
+inline void* memAlloc   (MemoryTag, size_t count, size_t size) { return calloc(count, size); }
+inline void* memRealloc (MemoryTag, void* memory, size_t size) { return realloc(memory, size); }
+inline void  memFree    (void* memory)                         { free(memory); }
+
+inline void  memTrack   (MemoryTag, size_t) {}
+inline void  memUntrack (MemoryTag, size_t) {}
+
+#endif
+
+bool        memReserve     (MemoryTag tag, void** array, size_t* capacity, size_t minCapacity, size_t elementSize);
+
+bool        memIsProfiling ();
+MemoryStats memGetStats    (MemoryTag tag);
+const char* memTagName     (MemoryTag tag);
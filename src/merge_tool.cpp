@@ -0,0 +1,69 @@
+//-----------------------------------------------------------------------------
+// Merges another database into a database, e.g.
+//     merge.exe res/database.txt -j 8 other/database.txt
+// Objects learned by the other copy are grafted where it asks more questions,
+// places where its objects can't be put are listed as conflicts. The first
+// database is saved with its statistics, the other one isn't changed. Exit 
+// code is 0 if there are no conflicts, 1 if there are and 2 if the databases
+// couldn't be merged.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "oracle.h"
+#include "ui.h"
+#include "../libs/log_generator.h"
+
+const size_t MAX_STR_SIZE = 256;
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3 && !(argc == 5 && strcmp(argv[2], "-j") == 0))
+    {
+        printf("Usage: %s <database> [-j <threads>] <other database>\n", argv[0]);
+        return 2;
+    }
+
+    LG_Init();
+
+    size_t      threadsCount = argc == 5 ? strtoul(argv[3], NULL, 10) : 0;
+    const char* other   = argv[argc - 1];
+
+    Oracle* oracle = summonOracle(argv[1], UI_NewSpeaker(MAX_STR_SIZE, false), true);
+
+    int exitCode = 2;
+
+    if (oracle == NULL)
+    {
+        printf("Couldn't read '%s'\n", argv[1]);
+    }
+    else
+    {
+        MergeReport report = {};
+
+        if (mergeDatabase(oracle, other, threadsCount, stdout, &report))
+        {
+            printf("%lu subtrees grafted, %lu objects added, %lu already known, %lu conflicts (%lu threads, %.3lf ms)\n",
+                   (unsigned long) report.grafted,
+                   (unsigned long) report.added,
+                   (unsigned long) report.duplicates,
+                   (unsigned long) report.conflicts,
+                   (unsigned long) report.threadsUsed,
+                   report.milliseconds);
+
+            exitCode = report.conflicts == 0 ? 0 : 1;
+        }
+        else
+        {
+            printf("Couldn't merge '%s'\n", other);
+        }
+
+        banishOracle(oracle);
+    }
+
+    UI_Close();
+    LG_Close();
+
+    return exitCode;
+}
@@ -0,0 +1,485 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimizer.h"
+#include "memory_tags.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+//-----------------------------------------------------------------------------
+// The optimizer only knows the attributes of an object that were asked on the
+// way to it, so a question can be used to split a group of objects only if
+// every object of the group has an answer to it. Such a question always
+// exists (the one in the lowest common ancestor of the group), so the tree
+// can be rebuilt top-down choosing among the valid questions the one that
+// splits the weight of the group most evenly.
+//-----------------------------------------------------------------------------
+
+struct OptAnswer
+{
+    size_t question = 0;
+    bool   yes      = false;
+};
+
+struct OptLeaf
+{
+    BTNode* node         = NULL;
+    size_t  weight       = 0;
+    size_t  answersStart = 0;
+    size_t  answersCount = 0;
+};
+
+//-----------------------------------------------------------------------------
+// Children of a plan node are leaf indices if less than leavesCount and plan
+// node indices + leavesCount otherwise.
+//-----------------------------------------------------------------------------
+struct OptPlanNode
+{
+    size_t question = 0;
+    size_t yes      = 0;
+    size_t no       = 0;
+};
+
+struct Optimizer
+{
+    const char** questions         = NULL;
+    size_t       questionsCount    = 0;
+
+    BTNode**     oldQuestions      = NULL;
+    size_t       oldQuestionsCount = 0;
+
+    OptLeaf*     leaves            = NULL;
+    size_t       leavesCount       = 0;
+
+    OptAnswer*   answers           = NULL;
+    size_t       answersCount      = 0;
+
+    OptAnswer*   path              = NULL;
+    size_t       maxDepth          = 0;
+
+    size_t*      order             = NULL;
+
+    OptPlanNode* plan              = NULL;
+    size_t       planCount         = 0;
+};
+
+void       collectNodes     (Optimizer* opt, BTNode* node, size_t depth);
+void       collectAnswers   (Optimizer* opt, BTNode* node, size_t depth);
+int        compareStrings   (const void* first, const void* second);
+int        compareAnswers   (const void* first, const void* second);
+size_t     findQuestion     (Optimizer* opt, const char* question);
+OptAnswer* findAnswer       (Optimizer* opt, OptLeaf* leaf, size_t question);
+size_t     planSubtree      (Optimizer* opt, size_t begin, size_t end, size_t depth, double* cost);
+size_t     originalSplit    (Optimizer* opt, size_t begin, size_t end, size_t* middle);
+BTNode*    buildSubtree     (Optimizer* opt, size_t index);
+void       deleteOptimizer  (Optimizer* opt);
+
+double     weightedDepth    (BTNode* node, size_t depth, double* totalWeight);
+
+//-----------------------------------------------------------------------------
+//! Reorders questions of the tree so that the expected number of questions
+//! per game, weighted by objects' hits, is minimized. Objects that have never
+//! been guessed are given a weight of 1 hit so that they aren't pushed to the
+//! bottom indefinitely.
+//!
+//! @param [in]  tree
+//! @param [out] depthBefore average questions per game before (can be NULL)
+//! @param [out] depthAfter  average questions per game after (can be NULL)
+//!
+//! @note The tree is left untouched if the reordering isn't an improvement.
+//!
+//! @return whether or not the tree has been changed.
+//-----------------------------------------------------------------------------
+bool optimizeTree(BinaryTree* tree, double* depthBefore, double* depthAfter)
+{
+    assert(tree != NULL);
+
+    double before = averageGameDepth(tree);
+    if (depthBefore != NULL) { *depthBefore = before; }
+    if (depthAfter  != NULL) { *depthAfter  = before; }
+
+    BTNode* root = getRoot(tree);
+    if (root == NULL || getLeft(root) == NULL) { return false; }
+
+    Optimizer opt = {};
+
+    collectNodes(&opt, root, 0);
+
+    opt.questions    = (const char**) memAlloc(MEM_TREE, opt.oldQuestionsCount, sizeof(const char*));
+    opt.oldQuestions = (BTNode**)     memAlloc(MEM_TREE, opt.oldQuestionsCount, sizeof(BTNode*));
+    opt.leaves       = (OptLeaf*)     memAlloc(MEM_TREE, opt.leavesCount,       sizeof(OptLeaf));
+    opt.answers      = (OptAnswer*)   memAlloc(MEM_TREE, opt.answersCount,      sizeof(OptAnswer));
+    opt.path         = (OptAnswer*)   memAlloc(MEM_TREE, opt.maxDepth + 1,      sizeof(OptAnswer));
+    opt.order        = (size_t*)      memAlloc(MEM_TREE, opt.leavesCount,       sizeof(size_t));
+    opt.plan         = (OptPlanNode*) memAlloc(MEM_TREE, opt.leavesCount,       sizeof(OptPlanNode));
+
+    if (opt.questions == NULL || opt.oldQuestions == NULL || opt.leaves  == NULL ||
+        opt.answers   == NULL || opt.path         == NULL || opt.order   == NULL || opt.plan == NULL)
+    {
+        deleteOptimizer(&opt);
+        return false;
+    }
+
+    opt.oldQuestionsCount = 0;
+    opt.leavesCount       = 0;
+    opt.answersCount      = 0;
+    collectAnswers(&opt, root, 0);
+
+    // packed values are unpacked into short-lived buffers, so the questions are interned
+    for (size_t i = 0; i < opt.oldQuestionsCount; i++)
+    {
+        opt.questions[i] = internValue(tree, getValue(opt.oldQuestions[i]));
+        if (opt.questions[i] == NULL)
+        {
+            deleteOptimizer(&opt);
+            return false;
+        }
+    }
+
+    qsort(opt.questions, opt.oldQuestionsCount, sizeof(const char*), compareStrings);
+
+    opt.questionsCount = 0;
+    for (size_t i = 0; i < opt.oldQuestionsCount; i++)
+    {
+        if (opt.questionsCount == 0 || strcmp(opt.questions[opt.questionsCount - 1], opt.questions[i]) != 0)
+        {
+            opt.questions[opt.questionsCount++] = opt.questions[i];
+        }
+    }
+
+    // path answers were collected as node indices, now they are turned into question ids
+    for (size_t i = 0; i < opt.answersCount; i++)
+    {
+        opt.answers[i].question = findQuestion(&opt, getValue(opt.oldQuestions[opt.answers[i].question]));
+    }
+
+    double totalWeight = 0;
+    for (size_t i = 0; i < opt.leavesCount; i++)
+    {
+        OptLeaf* leaf = &opt.leaves[i];
+        qsort(opt.answers + leaf->answersStart, leaf->answersCount, sizeof(OptAnswer), compareAnswers);
+
+        opt.order[i] = i;
+        totalWeight += leaf->weight;
+    }
+
+    double cost = 0;
+    size_t planRoot = planSubtree(&opt, 0, opt.leavesCount, 0, &cost);
+    double after = cost / totalWeight;
+
+    if (after >= before)
+    {
+        deleteOptimizer(&opt);
+        return false;
+    }
+
+    // questions' values may be stored inline in the old nodes, so they are deleted after the new ones are built
+    BTNode* newRoot = buildSubtree(&opt, planRoot);
+    setParent(newRoot, NULL);
+
+    for (size_t i = 0; i < opt.oldQuestionsCount; i++)
+    {
+        deleteNode(opt.oldQuestions[i]);
+    }
+
+    setRoot(tree, newRoot);
+    countLeaves(newRoot);
+
+    if (depthAfter != NULL) { *depthAfter = after; }
+
+    deleteOptimizer(&opt);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! @return average number of questions per game weighted by objects' hits.
+//-----------------------------------------------------------------------------
+double averageGameDepth(BinaryTree* tree)
+{
+    assert(tree != NULL);
+
+    CHECK_NULL(getRoot(tree), return 0);
+
+    double totalWeight = 0;
+    double depthSum    = weightedDepth(getRoot(tree), 0, &totalWeight);
+
+    return depthSum / totalWeight;
+}
+
+double weightedDepth(BTNode* node, size_t depth, double* totalWeight)
+{
+    assert(node        != NULL);
+    assert(totalWeight != NULL);
+
+    if (getLeft(node) == NULL)
+    {
+        double weight = getHits(node) + 1;
+        *totalWeight += weight;
+
+        return weight * depth;
+    }
+
+    return weightedDepth(getRight(node), depth + 1, totalWeight) +
+           weightedDepth(getLeft(node),  depth + 1, totalWeight);
+}
+
+void collectNodes(Optimizer* opt, BTNode* node, size_t depth)
+{
+    assert(opt  != NULL);
+    assert(node != NULL);
+
+    if (depth > opt->maxDepth) { opt->maxDepth = depth; }
+
+    if (getLeft(node) == NULL)
+    {
+        opt->leavesCount++;
+        opt->answersCount += depth;
+
+        return;
+    }
+
+    opt->oldQuestionsCount++;
+
+    collectNodes(opt, getRight(node), depth + 1);
+    collectNodes(opt, getLeft(node),  depth + 1);
+}
+
+void collectAnswers(Optimizer* opt, BTNode* node, size_t depth)
+{
+    assert(opt  != NULL);
+    assert(node != NULL);
+
+    if (getLeft(node) == NULL)
+    {
+        OptLeaf* leaf = &opt->leaves[opt->leavesCount++];
+
+        leaf->node         = node;
+        leaf->weight       = getHits(node) + 1;
+        leaf->answersStart = opt->answersCount;
+        leaf->answersCount = depth;
+
+        memcpy(opt->answers + opt->answersCount, opt->path, depth * sizeof(OptAnswer));
+        opt->answersCount += depth;
+
+        return;
+    }
+
+    opt->path[depth].question = opt->oldQuestionsCount;
+    opt->oldQuestions[opt->oldQuestionsCount++] = node;
+
+    opt->path[depth].yes = true;
+    collectAnswers(opt, getRight(node), depth + 1);
+
+    opt->path[depth].yes = false;
+    collectAnswers(opt, getLeft(node), depth + 1);
+}
+
+int compareStrings(const void* first, const void* second)
+{
+    return strcmp(*(const char* const*) first, *(const char* const*) second);
+}
+
+int compareAnswers(const void* first, const void* second)
+{
+    size_t question1 = ((const OptAnswer*) first)->question;
+    size_t question2 = ((const OptAnswer*) second)->question;
+
+    return (question1 > question2) - (question1 < question2);
+}
+
+size_t findQuestion(Optimizer* opt, const char* question)
+{
+    assert(opt      != NULL);
+    assert(question != NULL);
+
+    const char** found = (const char**) bsearch(&question, opt->questions, opt->questionsCount,
+                                                sizeof(const char*), compareStrings);
+    assert(found != NULL);
+
+    return found - opt->questions;
+}
+
+OptAnswer* findAnswer(Optimizer* opt, OptLeaf* leaf, size_t question)
+{
+    assert(opt  != NULL);
+    assert(leaf != NULL);
+
+    OptAnswer key = { question, false };
+
+    return (OptAnswer*) bsearch(&key, opt->answers + leaf->answersStart, leaf->answersCount,
+                                sizeof(OptAnswer), compareAnswers);
+}
+
+//-----------------------------------------------------------------------------
+//! Plans the subtree for leaves order[begin, end).
+//!
+//! @return leaf index or plan node index + leavesCount.
+//-----------------------------------------------------------------------------
+size_t planSubtree(Optimizer* opt, size_t begin, size_t end, size_t depth, double* cost)
+{
+    assert(opt  != NULL);
+    assert(cost != NULL);
+    assert(begin < end);
+
+    if (end - begin == 1)
+    {
+        *cost += (double) opt->leaves[opt->order[begin]].weight * depth;
+
+        return opt->order[begin];
+    }
+
+    OptLeaf* first        = &opt->leaves[opt->order[begin]];
+    size_t   bestQuestion = opt->questionsCount;
+    size_t   bestScore    = 0;
+
+    for (size_t i = 0; i < first->answersCount; i++)
+    {
+        size_t question = opt->answers[first->answersStart + i].question;
+        if (i > 0 && opt->answers[first->answersStart + i - 1].question == question) { continue; }
+
+        size_t yesWeight = 0;
+        size_t noWeight  = 0;
+        size_t yesCount  = 0;
+        bool   isValid   = true;
+
+        for (size_t j = begin; j < end && isValid; j++)
+        {
+            OptLeaf*   leaf   = &opt->leaves[opt->order[j]];
+            OptAnswer* answer = findAnswer(opt, leaf, question);
+
+            if      (answer == NULL) { isValid = false; }
+            else if (answer->yes)    { yesWeight += leaf->weight; yesCount++; }
+            else                     { noWeight  += leaf->weight; }
+        }
+
+        if (!isValid || yesCount == 0 || yesCount == end - begin) { continue; }
+
+        size_t score = yesWeight > noWeight ? yesWeight - noWeight : noWeight - yesWeight;
+        if (bestQuestion == opt->questionsCount || score < bestScore)
+        {
+            bestQuestion = question;
+            bestScore    = score;
+        }
+    }
+
+    size_t middle = begin;
+    if (bestQuestion == opt->questionsCount)
+    {
+        // only possible if some objects have contradicting answers to a question asked twice
+        bestQuestion = originalSplit(opt, begin, end, &middle);
+    }
+    else
+    {
+        for (size_t j = begin; j < end; j++)
+        {
+            if (findAnswer(opt, &opt->leaves[opt->order[j]], bestQuestion)->yes)
+            {
+                size_t temp        = opt->order[middle];
+                opt->order[middle] = opt->order[j];
+                opt->order[j]      = temp;
+                middle++;
+            }
+        }
+    }
+
+    size_t planIndex = opt->planCount++;
+
+    opt->plan[planIndex].question = bestQuestion;
+
+    size_t yes = planSubtree(opt, begin,  middle, depth + 1, cost);
+    size_t no  = planSubtree(opt, middle, end,    depth + 1, cost);
+
+    opt->plan[planIndex].yes = yes;
+    opt->plan[planIndex].no  = no;
+
+    return planIndex + opt->leavesCount;
+}
+
+//-----------------------------------------------------------------------------
+//! Splits leaves order[begin, end) the same way as their lowest common 
+//! ancestor in the original tree does.
+//!
+//! @return question of the lowest common ancestor.
+//-----------------------------------------------------------------------------
+size_t originalSplit(Optimizer* opt, size_t begin, size_t end, size_t* middle)
+{
+    assert(opt    != NULL);
+    assert(middle != NULL);
+
+    BTNode* ancestor      = opt->leaves[opt->order[begin]].node;
+    size_t  ancestorDepth = opt->leaves[opt->order[begin]].answersCount;
+
+    for (size_t j = begin + 1; j < end; j++)
+    {
+        BTNode* node      = opt->leaves[opt->order[j]].node;
+        size_t  nodeDepth = opt->leaves[opt->order[j]].answersCount;
+
+        for (; nodeDepth > ancestorDepth; nodeDepth--) { node = getParent(node); }
+        for (; ancestorDepth > nodeDepth; ancestorDepth--) { ancestor = getParent(ancestor); }
+
+        while (node != ancestor)
+        {
+            node     = getParent(node);
+            ancestor = getParent(ancestor);
+            ancestorDepth--;
+        }
+    }
+
+    *middle = begin;
+    for (size_t j = begin; j < end; j++)
+    {
+        BTNode* node = opt->leaves[opt->order[j]].node;
+        while (getParent(node) != ancestor) { node = getParent(node); }
+
+        if (!isLeft(node))
+        {
+            size_t temp         = opt->order[*middle];
+            opt->order[*middle] = opt->order[j];
+            opt->order[j]       = temp;
+            (*middle)++;
+        }
+    }
+
+    return findQuestion(opt, getValue(ancestor));
+}
+
+BTNode* buildSubtree(Optimizer* opt, size_t index)
+{
+    assert(opt != NULL);
+
+    if (index < opt->leavesCount)
+    {
+        return opt->leaves[index].node;
+    }
+
+    OptPlanNode* planNode = &opt->plan[index - opt->leavesCount];
+
+    BTNode* node  = newQuestion(opt->questions[planNode->question]);
+    assert(node != NULL);
+
+    BTNode* right = buildSubtree(opt, planNode->yes);
+    BTNode* left  = buildSubtree(opt, planNode->no);
+
+    setRight(node, right);
+    setLeft(node, left);
+    setParent(right, node);
+    setParent(left, node);
+
+    return node;
+}
+
+void deleteOptimizer(Optimizer* opt)
+{
+    assert(opt != NULL);
+
+    memFree(opt->questions);
+    memFree(opt->oldQuestions);
+    memFree(opt->leaves);
+    memFree(opt->answers);
+    memFree(opt->path);
+    memFree(opt->order);
+    memFree(opt->plan);
+
+    *opt = {};
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "binary_tree.h"
+
+bool   optimizeTree         (BinaryTree* tree, double* depthBefore, double* depthAfter);
+double averageGameDepth     (BinaryTree* tree);
@@ -1,31 +1,97 @@
 #include <assert.h>
+#include <chrono>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "oracle.h"
 #include "binary_tree.h"
+#include "completion.h"
+#include "definition_cache.h"
+#include "fuzzy_index.h"
+#include "lookup_index.h"
+#include "memory_tags.h"
+#include "optimizer.h"
+#include "paged_database.h"
+#include "perf_counters.h"
+#include "similarity.h"
+#include "stats.h"
+#include "string_builder.h"
+#include "string_pool.h"
+#include "tree_merge.h"
+#include "tree_report.h"
 #include "../libs/file_manager.h"
 #include "../libs/log_generator.h"
 
-typedef BTNode* elem_t;
-#include "../libs/stack.h"
-
 #define CHECK_NULL(value, action) if (value == NULL) { action; }
 
 struct Oracle
 {
-    BinaryTree* tree     = NULL;
-    const char* fileName = NULL;
-    Text*       database = NULL;
-    UI_Speaker* speaker  = NULL;
+    BinaryTree*  tree       = NULL;
+    const char*  fileName   = NULL;
+    UI_Speaker*  speaker    = NULL;
+    StatsFile*   stats      = NULL;
+    LookupIndex* lookup     = NULL;
+    FuzzyIndex*  objects    = NULL;
+    Completer*   completer  = NULL;
+    bool         modified   = false;
+    bool         persistent = true;
+
+    PagedDatabase* paged           = NULL; // NULL for text databases
+
+    StringBuilder* text            = NULL;
+    BTNode**       path            = NULL;
+    size_t         pathCapacity    = 0;
+    size_t         pathAllocations = 0;
+    size_t         rendered        = 0;
+    size_t         sayAllocations  = 0; // all tags, counted only with MEMORY_PROFILING
+
+    DefinitionCache* definitions   = NULL;
 };
 
-static const size_t MAX_STRING_LENGTH = 128;
+static const size_t MAX_STRING_LENGTH    = 128;
+static const char*  STATS_EXTENSION      = ".stats";
+static const char*  SIMILARITY_EXTENSION = ".similarity";
+static const size_t LAZY_LOAD_DEPTH      = 12;
+static const size_t MAX_SIMILAR_OBJECTS  = 4096; // the matrix grows as the square of the objects
+static const size_t BENCHMARK_WALKS      = 10000; // when profiling
+static const size_t COLD_MIN_GAMES       = 100; // statistics of fewer games can't tell cold questions
+static const size_t COLD_VISITS          = 1;   // questions asked fewer times are packed
 
 bool   loadDatabase     (Oracle* oracle);
+bool   readTextTree     (Oracle* oracle);
+bool   readPagedTree    (Oracle* oracle);
+bool   loadSubtree      (Oracle* oracle, BTNode* node, size_t depthLimit);
+bool   loadWholeTree    (Oracle* oracle);
+bool   loadStubs        (Oracle* oracle);
+bool   loadStubStep     (BTNode* node, va_list args);
+BTNode* loadValuePath   (Oracle* oracle, const char* value);
 void   saveDatabase     (Oracle* oracle);
+void   savePagedTree    (Oracle* oracle);
+void   markModified     (Oracle* oracle, BTNode* node);
 void   saveNode         (BTNode* node, FILE* file);
+size_t numberNodes      (BTNode* node, size_t id, size_t* oldIds);
+void   relayoutNodes    (Oracle* oracle);
+double measureWalks     (BTNode* root);
+void   packColdValues   (Oracle* oracle);
+bool   isColdValue      (BTNode* node, va_list args);
+double measureValues    (BTNode* root);
+bool   readValueStep    (BTNode* node, va_list args);
+bool   openOracleStats  (Oracle* oracle);
+bool   indexObjects     (Oracle* oracle, BTNode* node);
+void   buildIndexes     (Oracle* oracle);
+void   deleteIndexes    (Oracle* oracle);
+void   updateCompletions(Oracle* oracle, BTNode* object);
+void   buildLookup      (Oracle* oracle);
+BTNode* findValue       (Oracle* oracle, const char* value);
+BTNode* findObject      (Oracle* oracle, const char* value);
+char*  askObjectName    (Oracle* oracle, const char* message);
+size_t askSimilarObjects(Oracle* oracle, BTNode** objects);
                             
-void   subtreeConstruct (BTNode* node, Text* text);
+void   subtreeConstruct (BinaryTree* tree, BTNode* node, Text* text);
+void   logStringsUsage  (BinaryTree* tree, size_t textSize);
+void   logTreeFootprint (BinaryTree* tree);
+void   logTreeReport    (TreeReport* report);
+void   logMemoryUsage   ();
 bool   isTreeCorrect    (BinaryTree* tree);
 bool   isNodeCorrect    (BTNode* node, va_list args);
                           
@@ -36,11 +102,27 @@ void   defeat           (Oracle* oracle, BTNode* node);
                           
 void   definition       (Oracle* oracle, BTNode* object, BTNode* start);
 void   comparison       (Oracle* oracle, BTNode* object1, BTNode* object2);
-Stack* getPathFromRoot  (BinaryTree* tree, BTNode* node);
-
-void   subtreeDiagram   (FILE* file, BTNode* node);
+size_t collectPath      (Oracle* oracle, BTNode* start, BTNode* node);
+void   renderPath       (Oracle* oracle, size_t length);
+void   sayRendered      (Oracle* oracle, size_t allocations);
+size_t countAllocations ();
+size_t getDepth         (BTNode* node);
+BTNode* commonAncestor  (BTNode* node1, BTNode* node2);
+
+bool   loadDiagramStubs (Oracle* oracle, BTNode* node, size_t depthLimit);
+void   subtreeDiagram   (FILE* file, BTNode* node, size_t depthLimit, bool isCounted);
+void   diagramNode      (FILE* file, BTNode* node);
+void   diagramEdge      (FILE* file, BTNode* parent, BTNode* child, bool isLeftChild);
 
-Oracle* summonOracle(const char* knowledgeBaseFileName, UI_Speaker* speaker)
+//-----------------------------------------------------------------------------
+//! @param [in] knowledgeBaseFileName
+//! @param [in] speaker               is deleted with the oracle
+//! @param [in] isPersistent          a non-persistent oracle never writes the
+//!                                   database and statistics and doesn't log
+//!                                   load reports, so that many of them can
+//!                                   play in parallel on the same database
+//-----------------------------------------------------------------------------
+Oracle* summonOracle(const char* knowledgeBaseFileName, UI_Speaker* speaker, bool isPersistent)
 {
     assert(knowledgeBaseFileName != NULL);
     assert(speaker != NULL);
@@ -48,15 +130,23 @@ Oracle* summonOracle(const char* knowledgeBaseFileName, UI_Speaker* speaker)
     Oracle* oracle = (Oracle*) calloc(1, sizeof(Oracle));
     CHECK_NULL(oracle, return NULL);
 
+    *oracle = {};
+    oracle->persistent = isPersistent;
+
     oracle->tree = newTree();
     CHECK_NULL(oracle->tree, return NULL);
 
     oracle->fileName = knowledgeBaseFileName;
-    oracle->database = NULL;
     oracle->speaker  = speaker;
 
+    oracle->text = newStringBuilder(MAX_STRING_LENGTH);
+    CHECK_NULL(oracle->text, deleteTree(oracle->tree); free(oracle); return NULL);
+
     if (loadDatabase(oracle) == false)
     {
+        if (oracle->paged != NULL) { closePagedDatabase(oracle->paged); }
+
+        deleteStringBuilder(oracle->text);
         deleteTree(oracle->tree);
         free(oracle);
 
@@ -73,33 +163,94 @@ void banishOracle(Oracle* oracle)
     assert(oracle != NULL);
     assert(oracle->tree != NULL);
 
+    if (oracle->modified) { saveDatabase(oracle); }
+
+    // before anything is freed, so that live bytes show what the oracle holds
+    if (oracle->persistent) { logMemoryUsage(); }
+
+    if (oracle->stats  != NULL) { closeStats(oracle->stats); }
+    if (oracle->lookup != NULL) { deleteLookupIndex(oracle->lookup); }
+    if (oracle->paged  != NULL) { closePagedDatabase(oracle->paged); }
+
+    deleteIndexes(oracle);
+
+    if (oracle->definitions != NULL && oracle->persistent)
+    {
+        size_t hits    = cacheHits(oracle->definitions);
+        size_t lookups = hits + cacheMisses(oracle->definitions);
+
+        if (lookups != 0)
+        {
+            LG_Write("Definition cache: %lu hits out of %lu lookups (%.1lf%%), %lu evictions\n",
+                     LG_STYLE_CLASS_DEFAULT,
+                     (unsigned long) hits,
+                     (unsigned long) lookups,
+                     100.0 * hits / lookups,
+                     (unsigned long) cacheEvictions(oracle->definitions));
+        }
+    }
+
+    if (oracle->definitions != NULL) { deleteDefinitionCache(oracle->definitions); }
+
+    if (oracle->rendered != 0 && oracle->persistent)
+    {
+        LG_Write("Rendering: %lu definitions, %lu text buffer and %lu path buffer allocations\n",
+                 LG_STYLE_CLASS_DEFAULT,
+                 (unsigned long) oracle->rendered,
+                 (unsigned long) builderAllocations(oracle->text),
+                 (unsigned long) oracle->pathAllocations);
+    }
+
+    deleteStringBuilder(oracle->text);
+    memFree(oracle->path);
+
     deleteTree(oracle->tree);
     oracle->tree = NULL;
 
     UI_DeleteSpeaker(oracle->speaker);
 
-    if (oracle->database != NULL) { deleteText(oracle->database); }
-
     free(oracle);
 }
 
+//-----------------------------------------------------------------------------
+//! Saves the database if it has been changed since the last save.
+//-----------------------------------------------------------------------------
+void saveOracle(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    if (oracle->modified) { saveDatabase(oracle); }
+}
+
 UI_Speaker* getSpeaker(Oracle* oracle)
 {
     assert(oracle != NULL);
     return oracle->speaker;
 }
 
+//-----------------------------------------------------------------------------
+//! @return the whole tree, subtrees left on disk are loaded first.
+//-----------------------------------------------------------------------------
+BinaryTree* getTree(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    loadWholeTree(oracle);
+
+    return oracle->tree;
+}
+
 bool loadDatabase(Oracle* oracle)
 {
     assert(oracle != NULL);
     assert(oracle->fileName != NULL);
 
-    oracle->database = readTextFromFile(oracle->fileName);
-    CHECK_NULL(oracle->database, LG_Write("ERROR: Couldn't read file '%s'\n", LG_STYLE_CLASS_ERROR, oracle->fileName); return false);
+    perfBegin(PERF_LOAD);
 
-    setRoot(oracle->tree, newNode());
+    bool isPaged = isPagedDatabase(oracle->fileName);
+    if (!(isPaged ? readPagedTree(oracle) : readTextTree(oracle))) { return false; }
 
-    subtreeConstruct(getRoot(oracle->tree), oracle->database);
+    perfBegin(PERF_TRAVERSAL);
 
     if (!isTreeCorrect(oracle->tree))
     {
@@ -108,340 +259,1742 @@ bool loadDatabase(Oracle* oracle)
         return false;
     }
 
+    countLeaves(getRoot(oracle->tree));
+
+    // nodes of a paged database already have the ids of their records
+    size_t nodesCount = isPaged ? pagedNodesLoaded(oracle->paged) : numberNodes(getRoot(oracle->tree), 0, NULL);
+
+    // three (or two) traversals, each of them visits every node
+    perfEnd(PERF_TRAVERSAL, (isPaged ? 2 : 3) * nodesCount);
+    perfEnd(PERF_LOAD,      nodesCount);
+
+    // reports of a partly loaded tree would only describe its top
+    if (oracle->persistent && isTreeLoaded(oracle))
+    {
+        logTreeFootprint(oracle->tree);
+
+        TreeReport* report = newTreeReport(getRoot(oracle->tree), 0);
+        if (report != NULL)
+        {
+            logTreeReport(report);
+            deleteTreeReport(report);
+        }
+    }
+
+    if (oracle->persistent)
+    {
+        if (!openOracleStats(oracle))
+        {
+            LG_Write("Statistics are disabled\n", LG_STYLE_CLASS_DEFAULT);
+        }
+    }
+
+    // the nodes and the values are moved before anything points to them
+    relayoutNodes(oracle);
+    packColdValues(oracle);
+
+    oracle->lookup = newLookupIndex(oracle->tree);
+    buildLookup(oracle);
+
+    buildIndexes(oracle);
+
+    oracle->definitions = newDefinitionCache(DEFINITION_CACHE_DEFAULT_SIZE);
+    if (oracle->definitions == NULL)
+    {
+        LG_Write("Couldn't create definition cache, definitions will be rendered every time\n", LG_STYLE_CLASS_DEFAULT);
+    }
+
     return true;
 }
 
-void saveDatabase(Oracle* oracle)
+bool readTextTree(Oracle* oracle)
 {
     assert(oracle != NULL);
 
-    FILE* file = fopen(oracle->fileName, "w");
-    CHECK_NULL(file, LG_Write("ERROR: Couldn't open file '%s'\n", LG_STYLE_CLASS_ERROR, oracle->fileName); return);
+    Text* database = readTextFromFile(oracle->fileName);
+    CHECK_NULL(database, LG_Write("ERROR: Couldn't read file '%s'\n", LG_STYLE_CLASS_ERROR, oracle->fileName); return false);
 
-    saveNode(getRoot(oracle->tree), file);
+    // the text is allocated by the library, its buffer is about as big as the file
+    size_t textSize = getFileSize(oracle->fileName);
+    memTrack(MEM_TEXT, textSize);
 
-    fclose(file);
+    setRoot(oracle->tree, newNode());
+
+    subtreeConstruct(oracle->tree, getRoot(oracle->tree), database);
+
+    // all values are copied to the tree's string pool
+    deleteText(database);
+    memUntrack(MEM_TEXT, textSize);
+
+    if (oracle->persistent) { logStringsUsage(oracle->tree, textSize); }
+
+    return true;
 }
 
-#define SAVE_SUBTREE(getSide) if (getSide(node) != NULL)         \
-                              {                                  \
-                                  fprintf(file, "{\n");          \
-                                  saveNode(getSide(node), file); \
-                                  fprintf(file, "}\n");          \
-                              }
+//-----------------------------------------------------------------------------
+//! Reads a paged database, it stays open to write the changes in place. A
+//! non-persistent oracle opens it read-only.
+//!
+//! A persistent oracle loads only the top LAZY_LOAD_DEPTH levels of the 
+//! tree, deeper subtrees are loaded when a game, a lookup or a definition
+//! gets to them. Non-persistent oracles are used by tools that go through 
+//! the whole tree, so they load it at once.
+//-----------------------------------------------------------------------------
+bool readPagedTree(Oracle* oracle)
+{
+    assert(oracle != NULL);
 
-void saveNode(BTNode* node, FILE* file)
+    oracle->paged = openPagedDatabase(oracle->fileName, oracle->persistent);
+    CHECK_NULL(oracle->paged, return false);
+
+    size_t depthLimit = oracle->persistent ? LAZY_LOAD_DEPTH : PAGED_ALL_LEVELS;
+    if (loadPagedTree(oracle->paged, oracle->tree, depthLimit) == NULL) { return false; }
+
+    if (oracle->persistent)
+    {
+        LG_Write("Paged database: %lu pages, %lu nodes loaded, %lu subtrees left on disk\n",
+                 LG_STYLE_CLASS_DEFAULT,
+                 (unsigned long) pagedPagesCount(oracle->paged),
+                 (unsigned long) pagedNodesLoaded(oracle->paged),
+                 (unsigned long) pagedStubsCount(oracle->paged));
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Loads the subtree of a stub (a question whose children are still on disk)
+//! and adds its nodes to the indexes. Other nodes are left as they are.
+//!
+//! @param [in] oracle
+//! @param [in] node
+//! @param [in] depthLimit number of levels to load below the stub, usually
+//!                        LAZY_LOAD_DEPTH
+//!
+//! @return false if the subtree couldn't be loaded.
+//-----------------------------------------------------------------------------
+bool loadSubtree(Oracle* oracle, BTNode* node, size_t depthLimit)
 {
-    assert(node != NULL);
-    assert(file != NULL);
+    assert(oracle != NULL);
+    assert(node   != NULL);
 
-    fprintf(file, "\"%s\"\n", getValue(node));
+    if (oracle->paged == NULL || !isPagedStub(node)) { return true; }
 
-    SAVE_SUBTREE(getRight);
-    SAVE_SUBTREE(getLeft);
+    if (!loadPagedSubtree(oracle->paged, oracle->tree, node, depthLimit)) { return false; }
+
+    countLeaves(getRight(node));
+    countLeaves(getLeft(node));
+    updateLeavesCountUp(node);
+
+    if (oracle->lookup != NULL && !(lookupInsertTree(oracle->lookup, getRight(node)) && lookupInsertTree(oracle->lookup, getLeft(node))))
+    {
+        buildLookup(oracle);
+    }
+
+    if (oracle->objects != NULL && !(indexObjects(oracle, getRight(node)) && indexObjects(oracle, getLeft(node))))
+    {
+        LG_Write("ERROR: Couldn't add loaded objects to objects index, the index is disabled\n", LG_STYLE_CLASS_ERROR);
+
+        deleteIndexes(oracle);
+    }
+
+    return true;
 }
 
-#define TREE_CONSTRUCT_ERROR(message) LG_Write(message, LG_STYLE_CLASS_ERROR); \
-                                      printCurrentLine(text);                  \
-                                      return;
+//-----------------------------------------------------------------------------
+//! Loads all the subtrees left on disk, e.g. before the whole tree is 
+//! traversed. The nodes loaded stub by stub are scattered, so they are 
+//! packed together as after a load at once: all the nodes are moved, the
+//! caller mustn't keep any of them over the call.
+//!
+//! @return false if some of them couldn't be loaded.
+//-----------------------------------------------------------------------------
+bool loadWholeTree(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    if (isTreeLoaded(oracle)) { return true; }
+
+    bool isLoaded = loadStubs(oracle);
+
+    // the database keeps the touched nodes by pointers, so they are written before they move
+    if (oracle->paged != NULL && oracle->modified) { saveDatabase(oracle); }
+
+    if (oracle->paged == NULL || !oracle->modified)
+    {
+        relayoutNodes(oracle);
+        packColdValues(oracle);
+        if (oracle->definitions != NULL) { cacheClear(oracle->definitions); }
+    }
+
+    // even a partly loaded tree has to be indexed
+    buildLookup(oracle);
+    buildIndexes(oracle);
+
+    return isLoaded;
+}
+
+//-----------------------------------------------------------------------------
+//! Loads all the subtrees left on disk without moving the nodes already
+//! loaded. They are counted, but not indexed.
+//!
+//! @return false if some of them couldn't be loaded.
+//-----------------------------------------------------------------------------
+bool loadStubs(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    bool isLoaded = true;
+    preOrderTraverse(getRoot(oracle->tree), loadStubStep, oracle, &isLoaded);
+
+    // even a partly loaded tree has to be counted
+    countLeaves(getRoot(oracle->tree));
+
+    if (!isLoaded)
+    {
+        LG_Write("ERROR: Couldn't load the whole tree from the database\n", LG_STYLE_CLASS_ERROR);
+    }
+
+    return isLoaded;
+}
 
-void subtreeConstruct(BTNode* node, Text* text)
+bool loadStubStep(BTNode* node, va_list args)
 {
     assert(node != NULL);
-    assert(text != NULL);
-
-    char* currLine = nextTextLine(text);
-    CHECK_NULL(currLine, return);
 
-    const char* openingBracket = strchr(currLine, '{');
-    const char* closingBracket = strchr(currLine, '}');
+    Oracle* oracle   = va_arg(args, Oracle*);
+    bool*   isLoaded = va_arg(args, bool*);
 
-    if (openingBracket != NULL && closingBracket != NULL)
+    // the subtree is loaded whole, so its nodes are visited only to go through them
+    if (isPagedStub(node) && !loadPagedSubtree(oracle->paged, oracle->tree, node, PAGED_ALL_LEVELS))
     {
-        TREE_CONSTRUCT_ERROR("ERROR: database syntax error, '{' and '}' on the same line: ");
+        *isLoaded = false;
+        return !BT_TRAVERSE_RUN;
     }
-    else if (openingBracket != NULL)
+
+    return BT_TRAVERSE_RUN;
+}
+
+//-----------------------------------------------------------------------------
+//! Looks for the value in the subtrees left on disk by the value index of
+//! the database. Only the stubs on the path to the found node are loaded,
+//! a miss reads just a few pages.
+//!
+//! @return node or NULL if there is no such value or it couldn't be loaded.
+//-----------------------------------------------------------------------------
+BTNode* loadValuePath(Oracle* oracle, const char* value)
+{
+    assert(oracle != NULL);
+    assert(value  != NULL);
+
+    // older databases have no index until they are saved, the caller may keep nodes, so none are moved
+    if (!pagedHasIndex(oracle->paged))
     {
-        if (getRight(node) == NULL)
-        {
-            setRight(node, newNode());
-            setParent(getRight(node), node);
-            subtreeConstruct(getRight(node), text);
-        }
-        else if (getLeft(node) == NULL)
-        {
-            setLeft(node, newNode());
-            setParent(getLeft(node), node);
-            subtreeConstruct(getLeft(node), text);
-        }
-        else
-        {   
-            TREE_CONSTRUCT_ERROR("ERROR: database syntax error, opening block after definition of both options: ");  
-        }
+        bool isLoaded = loadStubs(oracle);
+        buildLookup(oracle);
+        buildIndexes(oracle);
+
+        if (!isLoaded) { return NULL; }
+
+        return oracle->lookup != NULL ? lookupFind(oracle->lookup, value) : findNode(oracle->tree, value);
     }
-    else if (closingBracket != NULL)
+
+    uint32_t* path       = NULL;
+    size_t    pathLength = 0;
+    if (!findPagedValue(oracle->paged, value, &path, &pathLength)) { return NULL; }
+
+    BTNode* node = pathLength > 0 ? getRoot(oracle->tree) : NULL;
+    size_t  i    = 0; // path[i] is the next record on the way down
+
+    while (node != NULL)
     {
-        subtreeConstruct(getParent(node), text);      
+        bool isOnPath = (uint32_t) getId(node) == path[i];
+        if (isOnPath && ++i == pathLength) { break; }
+
+        // the path on disk goes past the new questions that aren't saved yet
+        if (!isQuestion(node) || (!isOnPath && getId(node) != BT_NO_ID)) { node = NULL; break; }
+
+        if (isPagedStub(node) && !loadSubtree(oracle, node, LAZY_LOAD_DEPTH)) { node = NULL; break; }
+
+        BTNode* right = getRight(node);
+        BTNode* left  = getLeft(node);
+
+        bool isLeft = (uint32_t) getId(left) == path[i] ||
+                      ((uint32_t) getId(right) != path[i] && getId(left) == BT_NO_ID && isQuestion(left));
+
+        node = isLeft ? left : right;
     }
-    else
+
+    memFree(path);
+
+    return node;
+}
+
+//-----------------------------------------------------------------------------
+//! @return false if some subtrees of the tree are still on disk.
+//-----------------------------------------------------------------------------
+bool isTreeLoaded(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    return oracle->paged == NULL || pagedStubsCount(oracle->paged) == 0;
+}
+
+bool openOracleStats(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    size_t fileNameLength  = strlen(oracle->fileName);
+    char*  statsFileName   = (char*) memAlloc(MEM_TEXT, fileNameLength + strlen(STATS_EXTENSION) + 1, sizeof(char));
+    CHECK_NULL(statsFileName, return false);
+
+    strcpy(statsFileName, oracle->fileName);
+    strcpy(statsFileName + fileNameLength, STATS_EXTENSION);
+
+    // ids of a paged database are the addresses of the records, so there are gaps between them
+    size_t idsCount = oracle->paged != NULL ? pagedIdsCount(oracle->paged) : getLeavesCount(getRoot(oracle->tree)) * 2 - 1;
+
+    oracle->stats = openStats(statsFileName, idsCount, oracle->paged != NULL);
+
+    memFree(statsFileName);
+
+    return oracle->stats != NULL;
+}
+
+//-----------------------------------------------------------------------------
+//! (Re)builds the lookup index from the whole tree. If it can't be built,
+//! values are searched for by the tree traversal.
+//-----------------------------------------------------------------------------
+void buildLookup(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    if (oracle->lookup == NULL) { return; }
+
+    lookupClear(oracle->lookup);
+    if (!lookupInsertTree(oracle->lookup, getRoot(oracle->tree)))
     {
-        char* openingQuote = strchr(currLine, '\"');
+        LG_Write("Couldn't build lookup index, names have to be typed exactly\n", LG_STYLE_CLASS_DEFAULT);
 
-        if (openingQuote == NULL)
-        {
-            subtreeConstruct(node, text);
-            return;      
-        }
+        deleteLookupIndex(oracle->lookup);
+        oracle->lookup = NULL;
+    }
+}
 
-        char* closingQuote = strchr(openingQuote + 1, '\"');
+//-----------------------------------------------------------------------------
+//! Finds a question or an object ignoring case and extra whitespace.
+//-----------------------------------------------------------------------------
+BTNode* findValue(Oracle* oracle, const char* value)
+{
+    assert(oracle != NULL);
+    assert(value  != NULL);
 
-        if (closingQuote == NULL)
-        {
-            TREE_CONSTRUCT_ERROR("ERROR: database syntax error, no closing \" is found: ");
-        }
+    perfBegin(PERF_LOOKUP);
 
-        if (closingQuote - openingQuote <= 1)
-        {
-            TREE_CONSTRUCT_ERROR("ERROR: database syntax error, no string token is found: ");
-        }
+    BTNode* node = oracle->lookup != NULL ? lookupFind(oracle->lookup, value) : findNode(oracle->tree, value);
 
-        closingQuote[0] = '\0';
+    // the value may be in a subtree that is still on disk
+    if (node == NULL && !isTreeLoaded(oracle)) { node = loadValuePath(oracle, value); }
+
+    perfEnd(PERF_LOOKUP, 1);
+
+    if (node != NULL && !loadSubtree(oracle, node, LAZY_LOAD_DEPTH)) { return NULL; }
+
+    return node;
+}
+
+//-----------------------------------------------------------------------------
+//! Adds all objects of the subtree to the fuzzy index and the completer.
+//!
+//! @return false if the indexes are disabled or out of memory.
+//-----------------------------------------------------------------------------
+bool indexObjects(Oracle* oracle, BTNode* node)
+{
+    assert(oracle != NULL);
+    assert(node   != NULL);
+
+    if (oracle->objects == NULL || oracle->completer == NULL) { return false; }
+
+    if (!isQuestion(node)) { return fuzzyInsert(oracle->objects, node) && completerInsert(oracle->completer, node); }
+
+    // objects below a stub are indexed when its subtree is loaded
+    if (getLeft(node) == NULL) { return true; }
+
+    return indexObjects(oracle, getRight(node)) && indexObjects(oracle, getLeft(node));
+}
+
+//-----------------------------------------------------------------------------
+//! (Re)builds the fuzzy index and the completer from the whole tree.
+//-----------------------------------------------------------------------------
+void buildIndexes(Oracle* oracle)
+{
+    assert(oracle != NULL);
 
-        setValue(node, openingQuote + 1);
+    deleteIndexes(oracle);
+
+    oracle->objects   = newFuzzyIndex();
+    oracle->completer = newCompleter();
+    if (!indexObjects(oracle, getRoot(oracle->tree)))
+    {
+        LG_Write("Couldn't build objects index, misspelled names won't be recognized and "
+                 "names won't be completed\n", LG_STYLE_CLASS_DEFAULT);
 
-        subtreeConstruct(node, text);     
+        deleteIndexes(oracle);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Moves the object up in the completions after its hits have grown.
+//-----------------------------------------------------------------------------
+void updateCompletions(Oracle* oracle, BTNode* object)
+{
+    assert(oracle != NULL);
+    assert(object != NULL);
+
+    if (oracle->completer != NULL && !completerUpdate(oracle->completer, object))
+    {
+        LG_Write("ERROR: Couldn't update '%s' in objects index, the index is disabled\n", LG_STYLE_CLASS_ERROR, getValue(object));
+
+        deleteIndexes(oracle);
+    }
+}
+
+void deleteIndexes(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    if (oracle->objects   != NULL) { deleteFuzzyIndex(oracle->objects); }
+    if (oracle->completer != NULL) { deleteCompleter(oracle->completer); }
+
+    oracle->objects   = NULL;
+    oracle->completer = NULL;
+}
+
+//-----------------------------------------------------------------------------
+//! Asks for an object name. If the answer ends with a tab (or '*'), it's
+//! taken as a prefix and the most guessed objects starting with it are 
+//! offered to choose from by number.
+//!
+//! @param [in] oracle
+//! @param [in] message
+//!
+//! @return name that has to be freed or NULL if out of memory.
+//-----------------------------------------------------------------------------
+char* askObjectName(Oracle* oracle, const char* message)
+{
+    assert(oracle  != NULL);
+    assert(message != NULL);
+
+    char* name = UI_AskStr(getSpeaker(oracle), MAX_STRING_LENGTH, "%s", message);
+    CHECK_NULL(name, return NULL);
+
+    size_t length = strlen(name);
+    while (oracle->completer != NULL && length > 0 && (name[length - 1] == '\t' || name[length - 1] == '*'))
+    {
+        name[length - 1] = '\0';
+
+        BTNode* completions[COMPLETIONS_DEFAULT_COUNT] = {};
+        size_t  count = completePrefix(oracle->completer, name, completions, COMPLETIONS_DEFAULT_COUNT);
+
+        if (count == 0)
+        {
+            UI_Say(oracle->speaker, "\n  -I don't know anything starting with '%s'.\n", name);
+        }
+        else
+        {
+            UI_Print("\n");
+            for (size_t i = 0; i < count; i++)
+            {
+                UI_Print("  [%lu] %s\n", (unsigned long) i + 1, getValue(completions[i]));
+            }
+        }
+
+        memFree(name);
+        name = UI_AskStr(getSpeaker(oracle), MAX_STRING_LENGTH, "%s", count != 0 ? "  -Number or name: " : message);
+        CHECK_NULL(name, return NULL);
+
+        char*  numberEnd = NULL;
+        size_t number    = strtoul(name, &numberEnd, 10);
+        if (count != 0 && numberEnd != name && *numberEnd == '\0' && number >= 1 && number <= count)
+        {
+            memFree(name);
+
+            size_t valueLength = getValueLength(completions[number - 1]);
+
+            name = (char*) memAlloc(MEM_UI, valueLength + 1, sizeof(char));
+            CHECK_NULL(name, return NULL);
+
+            memcpy(name, getValue(completions[number - 1]), valueLength);
+        }
+
+        length = strlen(name);
+    }
+
+    return name;
+}
+
+//-----------------------------------------------------------------------------
+//! Looks for a node with the value. If there is none, the closest object name
+//! is suggested in case the user has made a typo.
+//!
+//! @param [in] oracle
+//! @param [in] value
+//!
+//! @return node or NULL if it isn't found and the suggestion is declined.
+//-----------------------------------------------------------------------------
+BTNode* findObject(Oracle* oracle, const char* value)
+{
+    assert(oracle != NULL);
+    assert(value  != NULL);
+
+    BTNode* node = findValue(oracle, value);
+    if (node != NULL || oracle->objects == NULL) { return node; }
+
+    // a name can't be all typos
+    size_t length      = strlen(value);
+    size_t maxDistance = length > FUZZY_DEFAULT_DISTANCE ? FUZZY_DEFAULT_DISTANCE : length / 2;
+
+    node = fuzzyFindBest(oracle->objects, value, maxDistance);
+    CHECK_NULL(node, return NULL);
+
+    UI_Say(oracle->speaker, "\n  -Did you mean '%s'?\n", getValue(node));
+    if (UI_GetOption("yn") == 'y') { return node; }
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+//! Numbers nodes in the order they are saved to the database, so that ids are
+//! the same after the database is loaded again.
+//!
+//! @param [in]  node
+//! @param [in]  id     id to give to node
+//! @param [out] oldIds if not NULL, oldIds[newId] is set to the previous id
+//!
+//! @return next free id.
+//-----------------------------------------------------------------------------
+size_t numberNodes(BTNode* node, size_t id, size_t* oldIds)
+{
+    assert(node != NULL);
+
+    if (oldIds != NULL) { oldIds[id] = getId(node); }
+    setId(node, id++);
+
+    if (getRight(node) != NULL) { id = numberNodes(getRight(node), id, oldIds); }
+    if (getLeft(node)  != NULL) { id = numberNodes(getLeft(node),  id, oldIds); }
+
+    return id;
+}
+
+void saveDatabase(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    if (!oracle->persistent)
+    {
+        oracle->modified = false;
+        return;
+    }
+
+    if (oracle->paged != NULL)
+    {
+        savePagedTree(oracle);
+        return;
+    }
+
+    size_t nodesCount = getLeavesCount(getRoot(oracle->tree)) * 2 - 1;
+
+    perfBegin(PERF_SAVE);
+
+    FILE* file = fopen(oracle->fileName, "w");
+    CHECK_NULL(file, LG_Write("ERROR: Couldn't open file '%s'\n", LG_STYLE_CLASS_ERROR, oracle->fileName); return);
+
+    saveNode(getRoot(oracle->tree), file);
+
+    fclose(file);
+
+    perfEnd(PERF_SAVE, nodesCount);
+
+    oracle->modified = false;
+
+    size_t* oldIds = (size_t*) memAlloc(MEM_TREE, nodesCount, sizeof(size_t));
+    CHECK_NULL(oldIds, return);
+
+    perfBegin(PERF_TRAVERSAL);
+    numberNodes(getRoot(oracle->tree), 0, oldIds);
+    perfEnd(PERF_TRAVERSAL, nodesCount);
+
+    if (oracle->stats != NULL && !remapStats(oracle->stats, oldIds, nodesCount))
+    {
+        LG_Write("ERROR: Couldn't update statistics file, statistics are disabled\n", LG_STYLE_CLASS_ERROR);
+
+        closeStats(oracle->stats);
+        oracle->stats = NULL;
+    }
+
+    memFree(oldIds);
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the touched nodes in place. Ids of the old nodes stay the same,
+//! unless the whole database has been rewritten, so statistics are only
+//! grown for the new pages.
+//-----------------------------------------------------------------------------
+void savePagedTree(Oracle* oracle)
+{
+    assert(oracle        != NULL);
+    assert(oracle->paged != NULL);
+
+    size_t* oldIds = NULL;
+
+    // the nodes aren't moved in the middle of a save
+    if (pagedNeedsRewrite(oracle->paged) && !isTreeLoaded(oracle))
+    {
+        loadStubs(oracle);
+        buildLookup(oracle);
+        buildIndexes(oracle);
+    }
+
+    perfBegin(PERF_SAVE);
+    bool isSaved = pagedSave(oracle->paged, oracle->tree, &oldIds);
+
+    // a save costs pages written, not nodes
+    perfEnd(PERF_SAVE, pagedPagesWritten(oracle->paged));
+
+    // the database stays modified, so that the next save tries again
+    if (!isSaved)
+    {
+        LG_Write("ERROR: Couldn't save '%s'\n", LG_STYLE_CLASS_ERROR, oracle->fileName);
+        return;
+    }
+
+    oracle->modified = false;
+
+    CHECK_NULL(oracle->stats, memFree(oldIds); return);
+
+    size_t idsCount = pagedIdsCount(oracle->paged);
+
+    // another session may have grown the counters further already
+    if (oldIds == NULL && statsCount(oracle->stats) < idsCount)
+    {
+        oldIds = (size_t*) memAlloc(MEM_TREE, idsCount, sizeof(size_t));
+        CHECK_NULL(oldIds, return);
+
+        for (size_t i = 0; i < idsCount; i++) { oldIds[i] = i; }
+    }
+
+    if (oldIds != NULL && !remapStats(oracle->stats, oldIds, idsCount))
+    {
+        LG_Write("ERROR: Couldn't update statistics file, statistics are disabled\n", LG_STYLE_CLASS_ERROR);
+
+        closeStats(oracle->stats);
+        oracle->stats = NULL;
+    }
+
+    memFree(oldIds);
+}
+
+//-----------------------------------------------------------------------------
+//! Packs the nodes together (see relayoutTree) after the tree has been 
+//! loaded or rebuilt in bulk. The old nodes are freed, so the indexes and
+//! the caches have to be rebuilt after that.
+//-----------------------------------------------------------------------------
+void relayoutNodes(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    BTNode* root = getRoot(oracle->tree);
+    CHECK_NULL(root, return);
+
+#ifdef PERF_PROFILING
+    double walkBefore = oracle->persistent ? measureWalks(root) : 0;
+#endif
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (!relayoutTree(oracle->tree))
+    {
+        LG_Write("Couldn't relayout the tree, its nodes are left where they are\n", LG_STYLE_CLASS_DEFAULT);
+        return;
+    }
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (!oracle->persistent) { return; }
+
+#ifdef PERF_PROFILING
+    LG_Write("Tree relayout: %.3lf ms, random walks %.1lf ns -> %.1lf ns per step\n",
+             LG_STYLE_CLASS_DEFAULT,
+             milliseconds,
+             walkBefore,
+             measureWalks(getRoot(oracle->tree)));
+#else
+    LG_Write("Tree relayout: %.3lf ms\n", LG_STYLE_CLASS_DEFAULT, milliseconds);
+#endif
+}
+
+#ifdef PERF_PROFILING
+
+//-----------------------------------------------------------------------------
+//! Times random walks from the root down to an object and back up over the
+//! parents, the way games and definitions go through the tree. It takes
+//! longer than the relayout itself, so it's only done when profiling.
+//!
+//! @return nanoseconds per step.
+//-----------------------------------------------------------------------------
+double measureWalks(BTNode* root)
+{
+    assert(root != NULL);
+
+    uint64_t random = 0x9E3779B97F4A7C15ull;
+    size_t   steps  = 0;
+    size_t   hits   = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t walk = 0; walk < BENCHMARK_WALKS; walk++)
+    {
+        BTNode* node = root;
+
+        // stubs of a lazily loaded tree have no children yet
+        while (isQuestion(node) && getRight(node) != NULL)
+        {
+            random = random * 6364136223846793005ull + 1442695040888963407ull;
+            node   = (random >> 63) ? getRight(node) : getLeft(node);
+            steps++;
+        }
+
+        hits += getHits(node);
+
+        for (; getParent(node) != NULL; node = getParent(node)) { steps++; }
+    }
+
+    double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    // the hits are used, so the walks can't be thrown away by the compiler
+    return hits == SIZE_MAX || steps == 0 ? 0 : nanoseconds / steps;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+//! Packs the values of the questions that are rarely asked (see packValues),
+//! the statistics tell which ones. Nothing is packed until COLD_MIN_GAMES
+//! games have been played, every question is cold by fresh statistics.
+//! Objects' values aren't packed, the indexes keep them. The pool is 
+//! rebuilt, so the lookup index has to be rebuilt after that.
+//-----------------------------------------------------------------------------
+void packColdValues(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    // only persistent oracles have statistics
+    BTNode* root = getRoot(oracle->tree);
+    if (oracle->stats == NULL || root == NULL) { return; }
+
+    // every game starts at the root
+    if (getId(root) >= statsCount(oracle->stats) || getStats(oracle->stats, getId(root)).visits < COLD_MIN_GAMES) { return; }
+
+    size_t bytesBefore = poolAllocated(getStringPool(oracle->tree)) + getPackedSize(oracle->tree);
+    size_t packedCount = 0;
+
+#ifdef PERF_PROFILING
+    double readBefore  = measureValues(root);
+#endif
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (!packValues(oracle->tree, &packedCount, isColdValue, oracle))
+    {
+        LG_Write("Couldn't pack cold values, they are left in the pool\n", LG_STYLE_CLASS_DEFAULT);
+        return;
+    }
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (packedCount == 0) { return; }
+
+#ifdef PERF_PROFILING
+    LG_Write("Value packing: %lu cold questions packed into %lu bytes, strings take %lu -> %lu bytes (%.3lf ms), "
+             "reading a question %.1lf ns -> %.1lf ns\n",
+             LG_STYLE_CLASS_DEFAULT,
+             (unsigned long) packedCount,
+             (unsigned long) getPackedSize(oracle->tree),
+             (unsigned long) bytesBefore,
+             (unsigned long) (poolAllocated(getStringPool(oracle->tree)) + getPackedSize(oracle->tree)),
+             milliseconds,
+             readBefore,
+             measureValues(getRoot(oracle->tree)));
+#else
+    LG_Write("Value packing: %lu cold questions packed into %lu bytes, strings take %lu -> %lu bytes (%.3lf ms)\n",
+             LG_STYLE_CLASS_DEFAULT,
+             (unsigned long) packedCount,
+             (unsigned long) getPackedSize(oracle->tree),
+             (unsigned long) bytesBefore,
+             (unsigned long) (poolAllocated(getStringPool(oracle->tree)) + getPackedSize(oracle->tree)),
+             milliseconds);
+#endif
+}
+
+bool isColdValue(BTNode* node, va_list args)
+{
+    assert(node != NULL);
+
+    Oracle* oracle = va_arg(args, Oracle*);
+
+    if (!isQuestion(node)) { return false; }
+
+    size_t id = getId(node);
+
+    // new questions haven't got statistics yet
+    return id < statsCount(oracle->stats) && getStats(oracle->stats, id).visits < COLD_VISITS;
+}
+
+#ifdef PERF_PROFILING
+
+//-----------------------------------------------------------------------------
+//! Times reading of the values of all the questions, the way games and
+//! definitions read them. It goes through the whole tree, so it's only done
+//! when profiling.
+//!
+//! @return nanoseconds per value.
+//-----------------------------------------------------------------------------
+double measureValues(BTNode* root)
+{
+    assert(root != NULL);
+
+    size_t count    = 0;
+    size_t checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    preOrderTraverse(root, readValueStep, &count, &checksum);
+
+    double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    // the values are used, so the reads can't be thrown away by the compiler
+    return checksum == SIZE_MAX || count == 0 ? 0 : nanoseconds / count;
+}
+
+bool readValueStep(BTNode* node, va_list args)
+{
+    assert(node != NULL);
+
+    size_t* count    = va_arg(args, size_t*);
+    size_t* checksum = va_arg(args, size_t*);
+
+    if (isQuestion(node))
+    {
+        *checksum += (unsigned char) getValue(node)[0];
+        (*count)++;
+    }
+
+    return BT_TRAVERSE_RUN;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+//! The node is written at the next save, a paged database writes only it.
+//-----------------------------------------------------------------------------
+void markModified(Oracle* oracle, BTNode* node)
+{
+    assert(oracle != NULL);
+    assert(node   != NULL);
+
+    if (oracle->paged != NULL) { pagedTouch(oracle->paged, node); }
+
+    oracle->modified = true;
+}
+
+#define SAVE_SUBTREE(getSide) if (getSide(node) != NULL)         \
+                              {                                  \
+                                  fprintf(file, "{\n");          \
+                                  saveNode(getSide(node), file); \
+                                  fprintf(file, "}\n");          \
+                              }
+
+void saveNode(BTNode* node, FILE* file)
+{
+    assert(node != NULL);
+    assert(file != NULL);
+
+    fputc('\"', file);
+    fwrite(getValue(node), sizeof(char), getValueLength(node), file);
+    fputc('\"', file);
+
+    if (getHits(node) != 0) { fprintf(file, " %lu", (unsigned long) getHits(node)); }
+
+    fputc('\n', file);
+
+    SAVE_SUBTREE(getRight);
+    SAVE_SUBTREE(getLeft);
+}
+
+#define TREE_CONSTRUCT_ERROR(message) LG_Write(message, LG_STYLE_CLASS_ERROR); \
+                                      printCurrentLine(text);                  \
+                                      return;
+
+void subtreeConstruct(BinaryTree* tree, BTNode* node, Text* text)
+{
+    assert(tree != NULL);
+    assert(node != NULL);
+    assert(text != NULL);
+
+    char* currLine = nextTextLine(text);
+    CHECK_NULL(currLine, return);
+
+    const char* openingBracket = strchr(currLine, '{');
+    const char* closingBracket = strchr(currLine, '}');
+
+    if (openingBracket != NULL && closingBracket != NULL)
+    {
+        TREE_CONSTRUCT_ERROR("ERROR: database syntax error, '{' and '}' on the same line: ");
+    }
+    else if (openingBracket != NULL)
+    {
+        node = makeQuestion(tree, node);
+        assert(node != NULL);
+
+        if (getRight(node) == NULL)
+        {
+            setRight(node, newNode());
+            setParent(getRight(node), node);
+            subtreeConstruct(tree, getRight(node), text);
+        }
+        else if (getLeft(node) == NULL)
+        {
+            setLeft(node, newNode());
+            setParent(getLeft(node), node);
+            subtreeConstruct(tree, getLeft(node), text);
+        }
+        else
+        {   
+            TREE_CONSTRUCT_ERROR("ERROR: database syntax error, opening block after definition of both options: ");  
+        }
+    }
+    else if (closingBracket != NULL)
+    {
+        subtreeConstruct(tree, getParent(node), text);      
+    }
+    else
+    {
+        char* openingQuote = strchr(currLine, '\"');
+
+        if (openingQuote == NULL)
+        {
+            subtreeConstruct(tree, node, text);
+            return;      
+        }
+
+        char* closingQuote = strchr(openingQuote + 1, '\"');
+
+        if (closingQuote == NULL)
+        {
+            TREE_CONSTRUCT_ERROR("ERROR: database syntax error, no closing \" is found: ");
+        }
+
+        if (closingQuote - openingQuote <= 1)
+        {
+            TREE_CONSTRUCT_ERROR("ERROR: database syntax error, no string token is found: ");
+        }
+
+        closingQuote[0] = '\0';
+
+        setValue(node, internValue(tree, openingQuote + 1));
+        setHits(node, strtoul(closingQuote + 1, NULL, 10));
+
+        subtreeConstruct(tree, node, text);     
+    }
+}
+
+void logStringsUsage(BinaryTree* tree, size_t textSize)
+{
+    assert(tree != NULL);
+
+    StringPool* pool = getStringPool(tree);
+
+    size_t requested = poolRequested(pool);
+    size_t stored    = poolStored(pool);
+
+    LG_Write("String pool: %lu values, %lu unique, %lu bytes stored (%lu bytes saved by interning), "
+             "%lu bytes allocated in total; %lu bytes of database text freed\n", 
+             LG_STYLE_CLASS_DEFAULT, 
+             (unsigned long) poolInternCalls(pool), 
+             (unsigned long) poolUniqueCount(pool),
+             (unsigned long) stored,
+             (unsigned long) (requested - stored),
+             (unsigned long) poolAllocated(pool),
+             (unsigned long) textSize);
+}
+
+void logTreeFootprint(BinaryTree* tree)
+{
+    assert(tree != NULL);
+    assert(getRoot(tree) != NULL);
+
+    size_t objects   = getLeavesCount(getRoot(tree));
+    size_t questions = objects - 1;
+    size_t bytes     = objects * getLeafNodeSize() + questions * getQuestionNodeSize();
+
+    LG_Write("Tree: %lu objects x %lu bytes + %lu questions x %lu bytes = %lu bytes, %.1lf bytes per node "
+             "(%lu bytes with a single node layout)\n", 
+             LG_STYLE_CLASS_DEFAULT,
+             (unsigned long) objects,   (unsigned long) getLeafNodeSize(),
+             (unsigned long) questions, (unsigned long) getQuestionNodeSize(),
+             (unsigned long) bytes,
+             (double) bytes / (objects + questions),
+             (unsigned long) ((objects + questions) * getQuestionNodeSize()));
+}
+
+void logTreeReport(TreeReport* report)
+{
+    assert(report != NULL);
+
+    LG_Write("Tree report: %lu objects, %lu questions, depth up to %lu, %.2lf questions per object, "
+             "%.2lf per game, %lu bytes of values, %lu duplicate objects (%lu threads, %.1lf ms)\n",
+             LG_STYLE_CLASS_DEFAULT,
+             (unsigned long) report->objects,
+             (unsigned long) report->questions,
+             (unsigned long) report->maxDepth,
+             report->averageDepth,
+             report->averageGame,
+             (unsigned long) report->valueBytes,
+             (unsigned long) report->duplicates,
+             (unsigned long) report->threadsUsed,
+             report->milliseconds);
+}
+
+void logMemoryUsage()
+{
+    if (!memIsProfiling()) { return; }
+
+    for (size_t tag = 0; tag < MEM_TAGS_COUNT; tag++)
+    {
+        MemoryStats stats = memGetStats((MemoryTag) tag);
+
+        LG_Write("Memory (%s): %lu bytes live, %lu bytes at peak, %lu allocations\n",
+                 LG_STYLE_CLASS_DEFAULT,
+                 memTagName((MemoryTag) tag),
+                 (unsigned long) stats.live,
+                 (unsigned long) stats.peak,
+                 (unsigned long) stats.allocations);
+    }
+}
+
+bool isTreeCorrect(BinaryTree* tree)
+{
+    assert(tree != NULL);
+    
+    if (getRoot(tree) == NULL) { return false; }
+
+    bool isCorrect = true;
+    preOrderTraverse(getRoot(tree), &isNodeCorrect, &isCorrect);
+
+    return isCorrect;
+}
+
+bool isNodeCorrect(BTNode* node, va_list args)
+{
+    assert(node != NULL);
+
+    bool* isCorrect = va_arg(args, bool*);
+
+    if ((getLeft(node) == NULL && getRight(node) != NULL) || (getLeft(node) != NULL && getRight(node) == NULL))
+    {
+        *isCorrect = false;
+
+        return !BT_TRAVERSE_RUN;
+    }
+
+    return BT_TRAVERSE_RUN;
+}
+
+void printCurrentLine(Text* text)
+{
+    assert(text != NULL);
+
+    size_t currLineNumber = getCurrentLineNumber(text);
+    LG_Write("line %u\n%5u | %s\n", LG_STYLE_CLASS_ERROR, 
+             currLineNumber + 1, 
+             currLineNumber + 1, 
+             getLine(text, currLineNumber));
+}
+
+void game(Oracle* oracle)
+{
+    assert(oracle != NULL);
+    assert(getRoot(oracle->tree) != NULL);
+
+    BTNode* currNode = getRoot(oracle->tree);
+    char    answer   = 0;
+    while (true)
+    {
+        if (!loadSubtree(oracle, currNode, LAZY_LOAD_DEPTH))
+        {
+            LG_Write("ERROR: Couldn't load the subtree of '%s' from the database\n", LG_STYLE_CLASS_ERROR, getValue(currNode));
+
+            return;
+        }
+
+        if (getLeft(currNode) == NULL)
+        {
+            finishGame(oracle, currNode);
+
+            break;
+        }
+
+        UI_Say(oracle->speaker, "  -Is it %s?\n", getValue(currNode));
+        answer = UI_GetOption("yn");
+        UI_Print("\n");
+
+        // the input has ended, the game is abandoned
+        if (answer == '\0') { return; }
+
+        if (oracle->stats != NULL) { recordVisit(oracle->stats, getId(currNode), answer == 'y'); }
+
+        if (answer == 'y')
+        {
+            currNode = getRight(currNode);
+        }
+        else
+        {
+            currNode = getLeft(currNode);
+        }
+    }
+}
+
+void finishGame(Oracle* oracle, BTNode* node)
+{
+    assert(oracle         != NULL);
+    assert(node           != NULL);
+    assert(getLeft(node)  == NULL);
+    assert(getRight(node) == NULL);
+
+    UI_Say(oracle->speaker, "  -I know! You are thinking about... %s! Am I right?\n", getValue(node));
+    char answer = UI_GetOption("yn");
+    if (answer == '\0') { return; }
+
+    if (oracle->stats != NULL) { recordVisit(oracle->stats, getId(node), answer == 'y'); }
+
+    if (answer == 'y')
+    {
+        UI_Say(oracle->speaker, "  -I have won, as always!)\n");
+
+        setHits(node, getHits(node) + 1);
+        markModified(oracle, node);
+        updateCompletions(oracle, node);
+    }
+    else
+    {
+        defeat(oracle, node);
+    } 
+}
+
+void defeat(Oracle* oracle, BTNode* node)
+{
+    assert(oracle != NULL);
+    assert(node != NULL);
+
+    char* newObject = askObjectName(oracle, "\n  -You got me :( What/whom are you thinking about? ");
+    CHECK_NULL(newObject, return);
+
+    // nothing is learnt if the input has ended
+    if (newObject[strspn(newObject, " \t")] == '\0')
+    {
+        memFree(newObject);
+        return;
+    }
+
+    BTNode* existingObject = findObject(oracle, newObject);
+    if (existingObject != NULL)
+    {
+        UI_Say(oracle->speaker, "\n  -Oh... I actually knew this one.\n");
+
+        size_t allocations = countAllocations();
+        builderClear(oracle->text);
+        definition(oracle, existingObject, NULL);
+        sayRendered(oracle, allocations);
+
+        if (!isQuestion(existingObject))
+        {
+            setHits(existingObject, getHits(existingObject) + 1);
+            markModified(oracle, existingObject);
+            updateCompletions(oracle, existingObject);
+        }
+
+        memFree(newObject);
+
+        return;
+    }
+
+    char* questionText = UI_AskStr(getSpeaker(oracle), MAX_STRING_LENGTH, "\n  -How %s differs from %s? ", newObject, getValue(node));
+    if (questionText == NULL || questionText[strspn(questionText, " \t")] == '\0')
+    {
+        memFree(newObject);
+        memFree(questionText);
+        return;
+    }
+
+    char* questionStart  = questionText;
+    char* notStart       = strstr(questionText, "not");
+    int   notLength      = strlen("not");
+    int   questionLength = strlen(questionText);
+    if (notStart != NULL)
+    {
+        int symbolsCountBeforeNot = strspn(questionText, " \t");
+        int symbolsCountAfterNot  = strspn(notStart + notLength, " \t");
+
+        // check if 'not' is the first word in the question 
+        if (symbolsCountBeforeNot == notStart - questionText) 
+        { 
+            questionStart = notStart + notLength + symbolsCountAfterNot;
+
+            if (questionStart >= questionText + questionLength) { questionStart = questionText; }
+        }
+    }
+
+    bool isNot = questionStart != questionText;
+
+    // the guessed object keeps its node (and so its hits and statistics), the question is put in its place
+    BTNode* question   = newQuestion(internValue(oracle->tree, questionStart));
+    BTNode* objectNode = newNode(internValue(oracle->tree, newObject));
+    assert(question   != NULL);
+    assert(objectNode != NULL);
+
+    setHits(objectNode, 1);
+
+    replaceNode(oracle->tree, node, question);
+
+    setParent(node,       question);
+    setParent(objectNode, question);
+
+    setLeft(question,  !isNot ? node       : objectNode);
+    setRight(question, !isNot ? objectNode : node);
+
+    updateLeavesCountUp(question);
+
+    // the only definition that has changed is the one of the guessed object, it's one question longer now
+    if (oracle->definitions != NULL) { cacheInvalidate(oracle->definitions, node); }
+
+    if (oracle->lookup != NULL && !(lookupInsert(oracle->lookup, question) && lookupInsert(oracle->lookup, objectNode)))
+    {
+        buildLookup(oracle);
+    }
+
+    if (oracle->objects != NULL && !indexObjects(oracle, objectNode))
+    {
+        LG_Write("ERROR: Couldn't add '%s' to objects index, the index is disabled\n", LG_STYLE_CLASS_ERROR, getValue(objectNode));
+
+        deleteIndexes(oracle);
+    }
+
+    UI_Say(oracle->speaker, "\n  -From now on you won't be able to outplay me!\n");  
+
+    // the new object gets written with the question
+    markModified(oracle, question);
+    saveDatabase(oracle);
+
+    memFree(newObject);
+    memFree(questionText);
+}
+
+void definitionDialog(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    char* object = askObjectName(oracle, "\n  -What object do you want the definition of? ");
+
+    BTNode* node = findObject(oracle, object);
+
+    if (node == NULL)
+    {
+        UI_Say(oracle->speaker, "\n  -I don't know what/who '%s' is.\n", object);
+        memFree(object);
+        return;
+    }
+
+    if (getLeft(node) == NULL)
+    {
+        size_t allocations = countAllocations();
+
+        builderClear(oracle->text);
+        builderAppendStr(oracle->text, "  -");
+        definition(oracle, node, NULL);
+        builderAppendStr(oracle->text, "\n");
+
+        sayRendered(oracle, allocations);
+    }
+    else
+    {
+        UI_Say(oracle->speaker, "\n  -It's not an object, are you trying to trick me?..\n");
+    }
+
+    memFree(object);
+}
+
+//-----------------------------------------------------------------------------
+//! Appends "<object> is <question>, not <question>, ..." to oracle's text
+//! with the questions on the path from start to object.
+//! Full definitions (from the root) are taken from the cache when possible.
+//!
+//! @param [in] oracle
+//! @param [in] object
+//! @param [in] start  NULL for the root
+//-----------------------------------------------------------------------------
+void definition(Oracle* oracle, BTNode* object, BTNode* start)
+{
+    assert(oracle != NULL);
+    assert(object != NULL);
+
+    if (start == getRoot(oracle->tree)) { start = NULL; }
+
+    bool isCached = start == NULL && oracle->definitions != NULL;
+    if (isCached)
+    {
+        size_t      cachedLength = 0;
+        const char* cached       = cacheFind(oracle->definitions, object, &cachedLength);
+        if (cached != NULL)
+        {
+            builderAppend(oracle->text, cached, cachedLength);
+            return;
+        }
+    }
+
+    size_t offset = builderLength(oracle->text);
+    size_t length = collectPath(oracle, start, object);
+
+    builderAppend(oracle->text, getValue(object), getValueLength(object));
+    builderAppendStr(oracle->text, " is ");
+    renderPath(oracle, length);
+
+    oracle->rendered++;
+
+    if (isCached)
+    {
+        cacheStore(oracle->definitions, object, builderData(oracle->text) + offset, builderLength(oracle->text) - offset);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Appends questions of the collected path with "not" for the ones answered
+//! "no" separated by commas.
+//-----------------------------------------------------------------------------
+void renderPath(Oracle* oracle, size_t length)
+{
+    assert(oracle != NULL);
+
+    for (size_t i = 0; i + 1 < length; i++)
+    {
+        if (i > 0) { builderAppendStr(oracle->text, ", "); }
+
+        if (isLeft(oracle->path[i + 1])) { builderAppendStr(oracle->text, "not "); }
+
+        builderAppend(oracle->text, getValue(oracle->path[i]), getValueLength(oracle->path[i]));
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! @return number of allocations made while definitions and comparisons have
+//! been rendered and said. Only with MEMORY_PROFILING all of them are seen,
+//! including the output's, otherwise it's the number of times the buffers 
+//! they are rendered into have been allocated or grown.
+//-----------------------------------------------------------------------------
+size_t renderAllocations(Oracle* oracle)
+{
+    assert(oracle != NULL);
+
+    if (memIsProfiling()) { return oracle->sayAllocations; }
+
+    return builderAllocations(oracle->text) + oracle->pathAllocations;
+}
+
+//-----------------------------------------------------------------------------
+//! Says the text rendered into oracle's text buffer.
+//!
+//! @param [in] oracle
+//! @param [in] allocations countAllocations() before the rendering started
+//-----------------------------------------------------------------------------
+void sayRendered(Oracle* oracle, size_t allocations)
+{
+    assert(oracle != NULL);
+
+    UI_SayText(oracle->speaker, builderData(oracle->text), builderLength(oracle->text));
+
+    oracle->sayAllocations += countAllocations() - allocations;
+}
+
+//-----------------------------------------------------------------------------
+//! @return allocations of all tags made so far by the whole process, 0 
+//!         without MEMORY_PROFILING.
+//-----------------------------------------------------------------------------
+size_t countAllocations()
+{
+    size_t allocations = 0;
+    for (size_t tag = 0; tag < MEM_TAGS_COUNT; tag++)
+    {
+        allocations += memGetStats((MemoryTag) tag).allocations;
     }
+
+    return allocations;
 }
 
-bool isTreeCorrect(BinaryTree* tree)
+//-----------------------------------------------------------------------------
+//! Puts the path from start down to node into oracle's path buffer, which
+//! is reused between calls.
+//!
+//! @param [in] oracle
+//! @param [in] start  ancestor of node or NULL for the root
+//! @param [in] node
+//!
+//! @return number of nodes in the path or 0 if out of memory.
+//-----------------------------------------------------------------------------
+size_t collectPath(Oracle* oracle, BTNode* start, BTNode* node)
 {
-    assert(tree != NULL);
-    
-    if (getRoot(tree) == NULL) { return false; }
+    assert(oracle != NULL);
+    assert(node   != NULL);
 
-    bool isCorrect = true;
-    preOrderTraverse(getRoot(tree), &isNodeCorrect, &isCorrect);
+    size_t length = 1;
+    for (BTNode* currNode = node; currNode != start && getParent(currNode) != NULL; currNode = getParent(currNode))
+    {
+        length++;
+    }
 
-    return isCorrect;
-}
+    if (length > oracle->pathCapacity)
+    {
+        size_t   newCapacity = oracle->pathCapacity != 0 ? oracle->pathCapacity : 16;
+        while (newCapacity < length) { newCapacity *= 2; }
 
-bool isNodeCorrect(BTNode* node, va_list args)
-{
-    assert(node != NULL);
+        BTNode** path = (BTNode**) memRealloc(MEM_STACKS, oracle->path, newCapacity * sizeof(BTNode*));
+        CHECK_NULL(path, return 0);
 
-    bool* isCorrect = va_arg(args, bool*);
-    va_end(args);
+        oracle->path         = path;
+        oracle->pathCapacity = newCapacity;
+        oracle->pathAllocations++;
+    }
 
-    if ((getLeft(node) == NULL && getRight(node) != NULL) || (getLeft(node) != NULL && getRight(node) == NULL))
+    BTNode* currNode = node;
+    for (size_t i = length; i > 0; i--)
     {
-        *isCorrect = false;
-
-        return !BT_TRAVERSE_RUN;
+        oracle->path[i - 1] = currNode;
+        currNode = getParent(currNode);
     }
 
-    return BT_TRAVERSE_RUN;
+    return length;
 }
 
-void printCurrentLine(Text* text)
+size_t getDepth(BTNode* node)
 {
-    assert(text != NULL);
+    assert(node != NULL);
 
-    size_t currLineNumber = getCurrentLineNumber(text);
-    LG_Write("line %u\n%5u | %s\n", LG_STYLE_CLASS_ERROR, 
-             currLineNumber + 1, 
-             currLineNumber + 1, 
-             getLine(text, currLineNumber));
+    size_t depth = 0;
+    for (; getParent(node) != NULL; node = getParent(node)) { depth++; }
+
+    return depth;
 }
 
-void game(Oracle* oracle)
+BTNode* commonAncestor(BTNode* node1, BTNode* node2)
 {
-    assert(oracle != NULL);
-    assert(getRoot(oracle->tree) != NULL);
-
-    BTNode* currNode = getRoot(oracle->tree);
-    char    answer   = 0;
-    while (true)
-    {
-        if (getLeft(currNode) == NULL)
-        {
-            finishGame(oracle, currNode);
+    assert(node1 != NULL);
+    assert(node2 != NULL);
 
-            break;
-        }
+    size_t depth1 = getDepth(node1);
+    size_t depth2 = getDepth(node2);
 
-        UI_Say(oracle->speaker, "  -Is it %s?\n", getValue(currNode));
-        answer = UI_GetOption("yn");
-        printf("\n");
+    for (; depth1 > depth2; depth1--) { node1 = getParent(node1); }
+    for (; depth2 > depth1; depth2--) { node2 = getParent(node2); }
 
-        if (answer == 'y')
-        {
-            currNode = getRight(currNode);
-        }
-        else
-        {
-            currNode = getLeft(currNode);
-        }
+    while (node1 != node2)
+    {
+        node1 = getParent(node1);
+        node2 = getParent(node2);
     }
+
+    return node1;
 }
 
-void finishGame(Oracle* oracle, BTNode* node)
+void optimizationDialog(Oracle* oracle)
 {
-    assert(oracle         != NULL);
-    assert(node           != NULL);
-    assert(getLeft(node)  == NULL);
-    assert(getRight(node) == NULL);
+    assert(oracle != NULL);
 
-    UI_Say(oracle->speaker, "  -I know! You are thinking about... %s! Am I right?\n", getValue(node));
-    char answer = UI_GetOption("yn");
+    double depthBefore = 0;
+    double depthAfter  = 0;
 
-    if (answer == 'y')
+    if (!loadWholeTree(oracle)) { return; }
+
+    if (optimizeTree(oracle->tree, &depthBefore, &depthAfter))
     {
-        UI_Say(oracle->speaker, "  -I have won, as always!)\n");
+        // questions are rebuilt and all the nodes are moved, so are the indexes and the definitions
+        relayoutNodes(oracle);
+        packColdValues(oracle);
+        buildLookup(oracle);
+        buildIndexes(oracle);
+        if (oracle->definitions != NULL) { cacheClear(oracle->definitions); }
+        if (oracle->paged       != NULL) { pagedTouchAll(oracle->paged); }
+        saveDatabase(oracle);
     }
-    else
+
+    UI_Say(oracle->speaker, "\n  -On average I needed %.2lf questions per game, now I need %.2lf.\n", depthBefore, depthAfter);
+    if (oracle->persistent)
     {
-        defeat(oracle, node);
-    } 
+        LG_Write("Tree optimization: average questions per game %.3lf -> %.3lf\n", LG_STYLE_CLASS_GOOD, depthBefore, depthAfter);
+    }
 }
 
-void defeat(Oracle* oracle, BTNode* node)
+//-----------------------------------------------------------------------------
+//! Merges another database into the oracle's one and saves it.
+//!
+//! @param [in]  oracle
+//! @param [in]  fileName     database to merge, it isn't changed
+//! @param [in]  threadsCount 0 for the number of hardware threads
+//! @param [in]  output       added objects and conflicts are written here
+//! @param [out] report
+//!
+//! @return false if the database couldn't be read or out of memory.
+//-----------------------------------------------------------------------------
+bool mergeDatabase(Oracle* oracle, const char* fileName, size_t threadsCount, FILE* output, MergeReport* report)
 {
-    assert(oracle != NULL);
-    assert(node != NULL);
+    assert(oracle   != NULL);
+    assert(fileName != NULL);
+    assert(report   != NULL);
 
-    char* newObject = UI_AskStr(getSpeaker(oracle), MAX_STRING_LENGTH, "\n  -You got me :( What/whom are you thinking about? ");
+    if (!loadWholeTree(oracle)) { return false; }
 
-    BTNode* existingObject = findNode(oracle->tree, newObject);
-    if (existingObject != NULL)
-    {
-        UI_Say(oracle->speaker, "\n  -Oh... I actually knew this one.\n");
-        definition(oracle, existingObject, NULL);
+    Oracle* other = summonOracle(fileName, UI_NewSpeaker(MAX_STRING_LENGTH, false), false);
+    CHECK_NULL(other, return false);
 
-        return;
-    }
+    bool isMerged = mergeTrees(oracle->tree, getRoot(other->tree), threadsCount, output, report);
 
-    char* newQuestion = UI_AskStr(getSpeaker(oracle), MAX_STRING_LENGTH, "\n  -How %s differs from %s? ", newObject, getValue(node));
+    banishOracle(other);
 
-    char* questionStart  = newQuestion;
-    char* notStart       = strstr(newQuestion, "not");
-    int   notLength      = strlen("not");
-    int   questionLength = strlen(newQuestion);
-    if (notStart != NULL)
+    if (!isMerged) { return false; }
+
+    if (oracle->persistent)
     {
-        int symbolsCountBeforeNot = strspn(newQuestion, " \t");
-        int symbolsCountAfterNot  = strspn(notStart + notLength, " \t");
+        LG_Write("Merged '%s': %lu subtrees grafted, %lu objects added, %lu duplicates, %lu conflicts (%lu threads, %.3lf ms)\n",
+                 LG_STYLE_CLASS_GOOD,
+                 fileName,
+                 (unsigned long) report->grafted,
+                 (unsigned long) report->added,
+                 (unsigned long) report->duplicates,
+                 (unsigned long) report->conflicts,
+                 (unsigned long) report->threadsUsed,
+                 report->milliseconds);
+    }
 
-        // check if 'not' is the first word in the question 
-        if (symbolsCountBeforeNot == notStart - newQuestion) 
-        { 
-            questionStart = notStart + notLength + symbolsCountAfterNot;
+    if (report->grafted == 0) { return true; }
 
-            if (questionStart >= newQuestion + questionLength) { questionStart = newQuestion; }
-        }
-    }
+    // objects have been added all over the tree, so it's packed again and the indexes are rebuilt
+    relayoutNodes(oracle);
+    packColdValues(oracle);
+    buildLookup(oracle);
+    buildIndexes(oracle);
+    if (oracle->definitions != NULL) { cacheClear(oracle->definitions); }
+    if (oracle->paged       != NULL) { pagedTouchAll(oracle->paged); }
 
-    bool isNot = questionStart != newQuestion;
+    saveDatabase(oracle);
 
-    BTNode* newNode1 = newNode(getValue(node));
-    BTNode* newNode2 = newNode(newObject);
+    return true;
+}
 
-    setParent(newNode1, node);
-    setParent(newNode2, node);
+//-----------------------------------------------------------------------------
+//! Writes the database to another file, e.g. to convert it. The oracle keeps
+//! working with its own file.
+//!
+//! @param [in] oracle
+//! @param [in] fileName
+//! @param [in] isPaged  whether to write a paged or a text database
+//!
+//! @return false if the file couldn't be written.
+//-----------------------------------------------------------------------------
+bool exportDatabase(Oracle* oracle, const char* fileName, bool isPaged)
+{
+    assert(oracle   != NULL);
+    assert(fileName != NULL);
 
-    setLeft(node, !isNot ? newNode1 : newNode2);
-    setRight(node, !isNot ? newNode2 : newNode1);
+    if (!loadWholeTree(oracle)) { return false; }
 
-    setValue(node, questionStart);  
+    if (isPaged) { return writePagedDatabase(fileName, getRoot(oracle->tree)); }
 
-    UI_Say(oracle->speaker, "\n  -From now on you won't be able to outplay me!\n");  
+    FILE* file = fopen(fileName, "w");
+    CHECK_NULL(file, LG_Write("ERROR: Couldn't open file '%s'\n", LG_STYLE_CLASS_ERROR, fileName); return false);
 
-    saveDatabase(oracle);
+    saveNode(getRoot(oracle->tree), file);
 
-    free(newObject);
-    free(newQuestion);
+    return fclose(file) == 0;
 }
 
-void definitionDialog(Oracle* oracle)
+bool isPagedOracle(Oracle* oracle)
 {
     assert(oracle != NULL);
+    return oracle->paged != NULL;
+}
 
-    char* object = UI_AskStr(getSpeaker(oracle), MAX_STRING_LENGTH, "\n  -What object do you want the definition of? ");
+void statisticsDialog(Oracle* oracle)
+{
+    assert(oracle != NULL);
 
-    BTNode* node = findNode(oracle->tree, object);
+    if (!loadWholeTree(oracle)) { return; }
 
-    if (node == NULL)
+    TreeReport* report = newTreeReport(getRoot(oracle->tree), 0);
+    if (report == NULL)
     {
-        UI_Say(oracle->speaker, "\n  -I don't know what/who '%s' is.\n", object);
+        LG_Write("ERROR: Not enough memory for the tree report\n", LG_STYLE_CLASS_ERROR);
         return;
     }
 
-    if (getLeft(node) == NULL)
+    logTreeReport(report);
+
+    UI_Say(oracle->speaker, "\n  -I know %lu objects and %lu questions, on average I need %.2lf questions per game.\n",
+           (unsigned long) report->objects, (unsigned long) report->questions, report->averageGame);
+
+    if (report->duplicates != 0)
     {
-        printf("  -");
-        definition(oracle, node, NULL);
-        printf("\n");
+        UI_Say(oracle->speaker, "  -%lu of the objects have the same names as others.\n", (unsigned long) report->duplicates);
     }
-    else
+
+    UI_Print("\n   Questions | Objects\n");
+    for (size_t depth = 0; depth <= report->maxDepth; depth++)
     {
-        UI_Say(oracle->speaker, "\n  -It's not an object, are you trying to trick me?..\n");
+        if (report->depthHistogram[depth] == 0) { continue; }
+
+        UI_Print("   %9lu | %lu\n", (unsigned long) depth, (unsigned long) report->depthHistogram[depth]);
     }
 
-    free(object);
+    deleteTreeReport(report);
 }
 
-void definition(Oracle* oracle, BTNode* object, BTNode* start)
+//-----------------------------------------------------------------------------
+//! Writes shared depths of all pairs of objects next to the database, so 
+//! that objects can be clustered without comparing them one by one.
+//-----------------------------------------------------------------------------
+void similarityDialog(Oracle* oracle)
 {
     assert(oracle != NULL);
-    assert(object != NULL);
 
-    Stack* stack = getPathFromRoot(oracle->tree, object);
+    if (!loadWholeTree(oracle)) { return; }
 
-    if (start != NULL)
+    // too many objects are compared only by the ones the user chooses
+    BTNode** objects      = NULL;
+    size_t   objectsCount = 0;
+    size_t   leavesCount  = getLeavesCount(getRoot(oracle->tree));
+    if (leavesCount > MAX_SIMILAR_OBJECTS)
     {
-        while (stackTop(stack) != start)
+        UI_Say(oracle->speaker, "\n  -I know %lu objects, that's too many to compare them all. I can compare up to %lu of them.\n",
+               (unsigned long) leavesCount, (unsigned long) MAX_SIMILAR_OBJECTS);
+
+        objects = (BTNode**) memAlloc(MEM_REPORTS, MAX_SIMILAR_OBJECTS, sizeof(BTNode*));
+        CHECK_NULL(objects, return);
+
+        objectsCount = askSimilarObjects(oracle, objects);
+        if (objectsCount == 0)
         {
-            stackPop(stack);
+            memFree(objects);
+            return;
         }
     }
 
-    UI_Say(oracle->speaker, "%s is ", getValue(object));
+    size_t fileNameLength     = strlen(oracle->fileName);
+    char*  similarityFileName = (char*) memAlloc(MEM_TEXT, fileNameLength + strlen(SIMILARITY_EXTENSION) + 1, sizeof(char));
+    CHECK_NULL(similarityFileName, memFree(objects); return);
+
+    strcpy(similarityFileName, oracle->fileName);
+    strcpy(similarityFileName + fileNameLength, SIMILARITY_EXTENSION);
+
+    auto start = std::chrono::steady_clock::now();
+
+    SimilarityMatrix* matrix = newSimilarityMatrix(getRoot(oracle->tree), objects, objectsCount, 0);
+    memFree(objects);
+
+    if (matrix == NULL)
+    {
+        LG_Write("ERROR: Not enough memory for the similarity matrix\n", LG_STYLE_CLASS_ERROR);
+        UI_Say(oracle->speaker, "\n  -There are too many objects to compare them all.\n");
+        memFree(similarityFileName);
+        return;
+    }
+
+    double computeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 
-    BTNode* currNode = NULL;
-    while (stackSize(stack) > 1)
+    if (saveSimilarityMatrix(matrix, similarityFileName))
     {
-        currNode = stackPop(stack);
+        UI_Say(oracle->speaker, "\n  -I've compared %lu objects with each other, see '%s'.\n",
+               (unsigned long) similarityCount(matrix), similarityFileName);
+        LG_Write("Similarity matrix: %lu objects, %lu bytes, computed in %.1lf ms\n", LG_STYLE_CLASS_GOOD,
+                 (unsigned long) similarityCount(matrix), (unsigned long) similarityBytes(matrix), computeTime);
+    }
+    else
+    {
+        LG_Write("ERROR: Couldn't write file '%s'\n", LG_STYLE_CLASS_ERROR, similarityFileName);
+    }
+
+    deleteSimilarityMatrix(matrix);
+    memFree(similarityFileName);
+}
+
+//-----------------------------------------------------------------------------
+//! Asks for objects to compare until an empty name, at most
+//! MAX_SIMILAR_OBJECTS of them.
+//!
+//! @param [in]  oracle
+//! @param [out] objects
+//!
+//! @return number of the objects.
+//-----------------------------------------------------------------------------
+size_t askSimilarObjects(Oracle* oracle, BTNode** objects)
+{
+    assert(oracle  != NULL);
+    assert(objects != NULL);
 
-        if (isLeft(stackTop(stack)))
+    size_t count = 0;
+    while (count < MAX_SIMILAR_OBJECTS)
+    {
+        char* name = askObjectName(oracle, "  -Which object to compare (empty to finish)? ");
+        CHECK_NULL(name, break);
+
+        if (name[0] == '\0')
         {
-            UI_Say(oracle->speaker, "not ");
+            memFree(name);
+            break;
         }
 
-        UI_Say(oracle->speaker, "%s", getValue(currNode));
-
-        if (stackSize(stack) > 1)
+        BTNode* object = findObject(oracle, name);
+        if (object == NULL)
         {
-            printf(", ");
+            UI_Say(oracle->speaker, "\n  -I don't know what/who '%s' is.\n", name);
         }
+        else if (isQuestion(object))
+        {
+            UI_Say(oracle->speaker, "\n  -'%s' isn't an object.\n", name);
+        }
+        else
+        {
+            objects[count++] = object;
+        }
+
+        memFree(name);
     }
 
-    deleteStack(stack);
+    return count;
 }
 
 void comparisonDialog(Oracle* oracle)
 {
     assert(oracle != NULL);
 
-    char* str1 = UI_AskStr(getSpeaker(oracle), MAX_STRING_LENGTH, "\n  -What objects do you want the definition of?\n"
-                                                                  "   Object1: ");
+    char* str1 = askObjectName(oracle, "\n  -What objects do you want the definition of?\n"
+                                       "   Object1: ");
 
-    char* str2 = UI_AskStr(getSpeaker(oracle), MAX_STRING_LENGTH, "   Object2: ");
+    char* str2 = askObjectName(oracle, "   Object2: ");
 
-    BTNode* object1 = findNode(oracle->tree, str1);
-    BTNode* object2 = findNode(oracle->tree, str2);
+    BTNode* object1 = findObject(oracle, str1);
+    BTNode* object2 = findObject(oracle, str2);
 
     if (object1 == NULL || object2 == NULL)
     {
         UI_Say(oracle->speaker, "\n  -I don't know these objects.\n");
+        memFree(str1);
+        memFree(str2);
         return;
     }
 
@@ -454,99 +2007,79 @@ void comparisonDialog(Oracle* oracle)
         comparison(oracle, object1, object2);
     }
 
-    free(str1);
-    free(str2);
+    memFree(str1);
+    memFree(str2);
 }
 
+//-----------------------------------------------------------------------------
+//! Says what two objects have in common and how they differ. The whole text
+//! is built in oracle's text buffer and said at once.
+//-----------------------------------------------------------------------------
 void comparison(Oracle* oracle, BTNode* object1, BTNode* object2)
 {
-    assert(oracle != NULL);
+    assert(oracle  != NULL);
     assert(object1 != NULL);
     assert(object2 != NULL);
 
-    Stack* stack1 = getPathFromRoot(oracle->tree, object1);
-    Stack* stack2 = getPathFromRoot(oracle->tree, object2);
-    stackPop(stack1);
-    stackPop(stack2);
+    size_t  allocations = countAllocations();
+    BTNode* ancestor    = commonAncestor(object1, object2);
 
-    BTNode* currNode = getRoot(oracle->tree);
-    while (stackSize(stack1) > 1 && stackSize(stack2) > 1 && stackTop(stack1) == stackTop(stack2))
+    builderClear(oracle->text);
+
+    if (ancestor != getRoot(oracle->tree))
     {
-        if (currNode == getRoot(oracle->tree))
-        {
-            UI_Say(oracle->speaker, "   They both are ");
-        }
+        builderAppendStr(oracle->text, "   They both are ");
+        renderPath(oracle, collectPath(oracle, NULL, ancestor));
+        builderAppendStr(oracle->text, "\n   But ");
+    }
 
-        if (isLeft(stackTop(stack1))) { UI_Say(oracle->speaker, "not "); }
+    definition(oracle, object1, ancestor);
+    builderAppendStr(oracle->text, " and\n   ");
+    definition(oracle, object2, ancestor);
+
+    sayRendered(oracle, allocations);
+}
 
-        UI_Say(oracle->speaker, "%s", getValue(currNode));
+void treeDiagram(Oracle* oracle)
+{
+    assert(oracle != NULL);
+    assert(oracle->tree != NULL);
 
-        currNode = stackTop(stack1);
-        stackPop(stack1);
-        stackPop(stack2);
+    char* startValue = UI_AskStr(getSpeaker(oracle), MAX_STRING_LENGTH, "\n  -Which question or object to start from (empty for the whole tree)? ");
+    CHECK_NULL(startValue, return);
 
-        if (stackTop(stack1) == stackTop(stack2))
+    BTNode* start = getRoot(oracle->tree);
+    if (startValue[0] != '\0' && start != NULL)
+    {
+        start = findValue(oracle, startValue);
+        if (start == NULL)
         {
-            printf(", ");
+            UI_Say(oracle->speaker, "\n  -I don't know what/who '%s' is.\n", startValue);
+            memFree(startValue);
+            return;
         }
     }
 
-    if (currNode != getRoot(oracle->tree))
-    {
-        UI_Say(oracle->speaker, "\n   But ");
-    }
-
-    if (currNode != getRoot(oracle->tree))
-    {
-        definition(oracle, object1, currNode);
-        UI_Say(oracle->speaker, " and\n   ");
-        definition(oracle, object2, currNode);
-    }
-    else
-    {
-        definition(oracle, object1, NULL);
-        UI_Say(oracle->speaker, " and\n   ");
-        definition(oracle, object2, NULL);
-    }
+    char* depthStr = UI_AskStr(getSpeaker(oracle), MAX_STRING_LENGTH, "  -How many levels to show (0 for all)? ");
+    CHECK_NULL(depthStr, memFree(startValue); return);
 
-    deleteStack(stack1);
-    deleteStack(stack2);
-}
+    size_t depthLimit = strtoul(depthStr, NULL, 10);
+    memFree(depthStr);
 
-//-----------------------------------------------------------------------------
-//! Creates a stack with the path from node to the root of tree.
-//!
-//! @param [in] tree
-//! @param [in] node
-//!
-//! @warning Undefined behavior if node isn't in the tree.
-//!
-//! @return stack with top element being the root and bottom being node.
-//-----------------------------------------------------------------------------
-Stack* getPathFromRoot(BinaryTree* tree, BTNode* node)
-{
-    assert(tree != NULL);
-    assert(node != NULL);
+    if (depthLimit == 0) { depthLimit = SIZE_MAX; }
 
-    Stack* stack = newStack();
-    assert(stack != NULL);
+    // only the shown levels are loaded, unless the whole tree is shown
+    bool isLoaded = depthLimit == SIZE_MAX ? loadWholeTree(oracle) : loadDiagramStubs(oracle, start, depthLimit);
 
-    BTNode* currNode = node;
-    while (getParent(currNode) != NULL)
+    // loading the whole tree moves the nodes
+    if (isLoaded && depthLimit == SIZE_MAX)
     {
-        stackPush(stack, currNode);
-        currNode = getParent(currNode);
+        start = startValue[0] != '\0' ? findValue(oracle, startValue) : getRoot(oracle->tree);
     }
 
-    stackPush(stack, currNode); // root
-
-    return stack;
-}
+    memFree(startValue);
 
-void treeDiagram(Oracle* oracle)
-{
-    assert(oracle != NULL);
-    assert(oracle->tree != NULL);
+    if (!isLoaded || start == NULL) { return; }
     
     FILE* file = fopen("tree_diagram.txt", "w");
     assert(file != NULL);
@@ -555,14 +2088,14 @@ void treeDiagram(Oracle* oracle)
             "digraph structs {\n"
             "\tnode [shape=\"rectangle\", style=\"filled\", fontcolor=\"#DCDCDC\", fillcolor=\"#2F4F4F\"];\n\n");
 
-    if (getRoot(oracle->tree) == NULL)
+    if (start == NULL)
     {
         fprintf(file,
                 "\t\"ROOT\" [label = \"Empty database\"];\n");
     }
     else
     {
-        subtreeDiagram(file, getRoot(oracle->tree));
+        subtreeDiagram(file, start, depthLimit, isTreeLoaded(oracle));
     }
 
     fprintf(file, "}");
@@ -573,15 +2106,80 @@ void treeDiagram(Oracle* oracle)
     system("start tree_diagram.svg");    
 }
 
-void subtreeDiagram(FILE* file, BTNode* node)
+//-----------------------------------------------------------------------------
+//! Loads the stubs among the first depthLimit - 1 levels of the subtree, so
+//! that all the nodes to be shown are there. Deeper subtrees stay on disk.
+//!
+//! @return false if some of them couldn't be loaded.
+//-----------------------------------------------------------------------------
+bool loadDiagramStubs(Oracle* oracle, BTNode* node, size_t depthLimit)
+{
+    assert(oracle != NULL);
+
+    if (node == NULL || depthLimit <= 1) { return true; }
+
+    // the last shown level is loaded as stubs
+    if (!loadSubtree(oracle, node, depthLimit - 1)) { return false; }
+
+    return loadDiagramStubs(oracle, getLeft(node),  depthLimit - 1) &&
+           loadDiagramStubs(oracle, getRight(node), depthLimit - 1);
+}
+
+//-----------------------------------------------------------------------------
+//! Writes node and depthLimit levels of its subtree in dot format. Subtrees 
+//! deeper than depthLimit are collapsed into a single "N more objects" node, 
+//! so only the shown part of the tree is visited.
+//!
+//! @param [in] file
+//! @param [in] node
+//! @param [in] depthLimit number of levels to show, including node itself
+//! @param [in] isCounted  whether or not the leaves counts are known, they
+//!                        aren't while some subtrees are on disk
+//-----------------------------------------------------------------------------
+void subtreeDiagram(FILE* file, BTNode* node, size_t depthLimit, bool isCounted)
 {
     assert(file != NULL);
     
-    if (node == NULL) { return; }
+    if (node == NULL || depthLimit == 0) { return; }
 
-    fprintf(file, "\t\"%p\" [label=\"%s", node, getValue(node));
+    diagramNode(file, node);
 
-    if (getLeft(node) == NULL)
+    // a stub is a question too, its children are just on disk
+    if (!isQuestion(node)) { return; }
+
+    if (depthLimit == 1)
+    {
+        if (isCounted)
+        {
+            fprintf(file, "\t\"%p_more\" [label=\"%lu more objects\", shape=\"folder\", fillcolor=\"#696969\"];\n", 
+                    (void*) node, (unsigned long) getLeavesCount(node));
+        }
+        else
+        {
+            fprintf(file, "\t\"%p_more\" [label=\"more objects\", shape=\"folder\", fillcolor=\"#696969\"];\n", 
+                    (void*) node);
+        }
+
+        fprintf(file, "\t\"%p\":s->\"%p_more\" [style=\"dashed\"];\n", (void*) node, (void*) node);
+
+        return;
+    }
+
+    diagramEdge(file, node, getLeft(node),  true);
+    diagramEdge(file, node, getRight(node), false);
+
+    subtreeDiagram(file, getLeft(node),  depthLimit - 1, isCounted);
+    subtreeDiagram(file, getRight(node), depthLimit - 1, isCounted);
+}
+
+void diagramNode(FILE* file, BTNode* node)
+{
+    assert(file != NULL);
+    assert(node != NULL);
+
+    fprintf(file, "\t\"%p\" [label=\"%s", (void*) node, getValue(node));
+
+    if (!isQuestion(node))
     {
         fprintf(file, "\", shape=\"hexagon\", peripheries = 2, fillcolor=\"#5F9EA0\", fontcolor=\"#F0FFFF\"");
     }
@@ -591,19 +2189,20 @@ void subtreeDiagram(FILE* file, BTNode* node)
     }
 
     fprintf(file, "];\n");
+}
 
-    if (getParent(node) != NULL)
-    {
-        if (isLeft(node))
-        {
-            fprintf(file, "\t\"%p\":sw->\"%p\" [label=\"No\"];\n", getParent(node), node);
-        }
-        else
-        {
-            fprintf(file, "\t\"%p\":se->\"%p\" [label=\"Yes\"];\n", getParent(node), node);
-        }
-    }   
+void diagramEdge(FILE* file, BTNode* parent, BTNode* child, bool isLeftChild)
+{
+    assert(file   != NULL);
+    assert(parent != NULL);
+    assert(child  != NULL);
 
-    subtreeDiagram(file, getLeft(node));
-    subtreeDiagram(file, getRight(node));
-}
\ No newline at end of file
+    if (isLeftChild)
+    {
+        fprintf(file, "\t\"%p\":sw->\"%p\" [label=\"No\"];\n", (void*) parent, (void*) child);
+    }
+    else
+    {
+        fprintf(file, "\t\"%p\":se->\"%p\" [label=\"Yes\"];\n", (void*) parent, (void*) child);
+    }
+}
@@ -1,15 +1,26 @@
 #pragma once
 
 #include "binary_tree.h"
+#include "tree_merge.h"
 #include "ui.h"
 
 struct Oracle;
 
-Oracle*     summonOracle (const char* knowledgeBaseFileName, UI_Speaker* speaker);
-void        banishOracle (Oracle* oracle);
-UI_Speaker* getSpeaker   (Oracle* oracle);
+Oracle*     summonOracle      (const char* knowledgeBaseFileName, UI_Speaker* speaker, bool isPersistent);
+void        banishOracle      (Oracle* oracle);
+void        saveOracle        (Oracle* oracle);
+UI_Speaker* getSpeaker        (Oracle* oracle);
+BinaryTree* getTree           (Oracle* oracle);
+bool        mergeDatabase     (Oracle* oracle, const char* fileName, size_t threadsCount, FILE* output, MergeReport* report);
+bool        exportDatabase    (Oracle* oracle, const char* fileName, bool isPaged);
+bool        isPagedOracle     (Oracle* oracle);
+bool        isTreeLoaded      (Oracle* oracle);
+size_t      renderAllocations (Oracle* oracle);
                           
-void game             (Oracle* oracle);
-void definitionDialog (Oracle* oracle);
-void comparisonDialog (Oracle* oracle);
-void treeDiagram      (Oracle* oracle);
+void game               (Oracle* oracle);
+void definitionDialog   (Oracle* oracle);
+void comparisonDialog   (Oracle* oracle);
+void treeDiagram        (Oracle* oracle);
+void optimizationDialog (Oracle* oracle);
+void similarityDialog   (Oracle* oracle);
+void statisticsDialog   (Oracle* oracle);
@@ -0,0 +1,1983 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "paged_database.h"
+#include "memory_tags.h"
+#include "lookup_index.h"
+#include "string_pool.h"
+#include "../libs/file_manager.h"
+#include "../libs/log_generator.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+static const short    PAGED_SIGNATURE   = 0x4450; // "PD"
+static const short    JOURNAL_SIGNATURE = 0x4A50; // "PJ"
+static const short    PAGED_VERSION     = 2;
+static const short    PAGED_OLD_VERSION = 1; // without the value index
+
+static const size_t   PAGED_PAGE_SIZE    = 4096;
+static const size_t   PAGED_SLOTS        = 256;
+static const size_t   PAGED_FREE_UNIT    = 16;
+static const uint32_t PAGED_HEADER_PAGE  = 0;
+static const size_t   INDEX_FILL_PERCENT = 75; // of the bucket pages written by a rewrite, the rest is for new values
+
+static const char*    JOURNAL_EXTENSION  = ".journal";
+static const char*    TEMP_EXTENSION     = ".tmp";
+
+//-----------------------------------------------------------------------------
+// Every page starts with a header, the first page holds the file header
+// right after it. Data pages are slotted: slot offsets follow the header and
+// records are put from the end of the page down. A node's id is the address
+// of its record (page * PAGED_SLOTS + slot).
+//
+// Records never change their size: a question always refers to two children
+// and values never change. So a record is rewritten in place, and when an
+// object is split by a new question, the question gets a new record and
+// only its parent's record is rewritten to refer to it.
+//
+// Free space of every page is kept in map pages, one byte per page in
+// PAGED_FREE_UNITs. The first map page is page 1 and the others follow
+// every PAGED_MAP_ENTRIES data pages, so the map of a page is found without
+// any lookups. New records go to the parent's page if they fit, otherwise to
+// the first page the map says they fit in.
+//
+// The changed pages are first written to the journal next to the database
+// and only then in place. If the program stops while the pages are written
+// in place, they are written again from the journal the next time the
+// database is opened; if it stops while the journal is written, the
+// database hasn't been touched yet. Every page has a checksum, so torn
+// pages are found either way.
+//
+// Values that aren't loaded are found by the value index: a hash table of
+// bucket pages from the lookup keys of the values (see normalizeKey) to
+// the records. Bucket pages follow the data pages written by a rewrite, a
+// full bucket page goes on in an overflow page appended like a data page.
+// Index pages have no slots and no free space, so records never go there.
+// Entries keep the parents of the records, so the path to a found record
+// is followed up to the root without reading any other subtrees.
+//-----------------------------------------------------------------------------
+struct PageHeader
+{
+    uint32_t checksum   = 0;
+    uint32_t number     = 0;
+    uint16_t slotsCount = 0;
+    uint16_t freeEnd    = 0;
+    uint32_t next       = 0; // overflow page of an index bucket or 0
+};
+
+struct FileHeader
+{
+    BinFileHeader binHeader    = {};
+    uint32_t      pageSize     = 0;
+    uint32_t      pagesCount   = 0;
+    uint32_t      root         = 0;
+    uint32_t      indexStart   = 0;
+    uint32_t      bucketsCount = 0; // 0 if there is no value index
+};
+
+struct JournalHeader
+{
+    BinFileHeader binHeader  = {};
+    uint32_t      pagesCount = 0;
+};
+
+//-----------------------------------------------------------------------------
+// Objects are followed by their hits, questions by the ids of the right
+// ("yes") and the left ("no") children. The value with its terminator is
+// the last, records are padded to 4 bytes.
+//-----------------------------------------------------------------------------
+struct RecordHeader
+{
+    uint8_t  isQuestion = 0;
+    uint8_t  reserved   = 0;
+    uint16_t length     = 0;
+};
+
+struct IndexEntry
+{
+    uint32_t hash   = 0;
+    uint32_t id     = 0; // 0 (the header page) for the free entries
+    uint32_t parent = 0; // 0 for the root
+};
+
+struct CachedPage
+{
+    uint32_t number  = 0;
+    bool     isDirty = false;
+    uint8_t* data    = NULL;
+};
+
+struct PagedDatabase
+{
+    const char* fileName        = NULL;
+    FILE*       file            = NULL;
+    bool        isWritable      = false;
+
+    uint32_t    pagesCount      = 0;
+    uint32_t    root            = 0;
+    uint32_t    indexStart      = 0;
+    uint32_t    bucketsCount    = 0;
+
+    uint8_t*    freeSpace       = NULL;
+    size_t      freeCapacity    = 0;
+
+    // pages changed by the current save (or recovered from the journal of a read-only database)
+    CachedPage* cache           = NULL;
+    size_t      cacheCount      = 0;
+    size_t      cacheCapacity   = 0;
+
+    BTNode**    touched         = NULL;
+    size_t      touchedCount    = 0;
+    size_t      touchedCapacity = 0;
+    bool        isRewriteNeeded = false;
+
+    size_t      pagesWritten    = 0;
+
+    size_t      nodesLoaded     = 0;
+    size_t      stubsCount      = 0;
+};
+
+//-----------------------------------------------------------------------------
+// A record to be loaded: node is set only for the stub the loading starts
+// from, other nodes are created.
+//-----------------------------------------------------------------------------
+struct LoadStep
+{
+    uint32_t id;
+    uint32_t depth;
+    BTNode*  parent;
+    BTNode*  node;
+    bool     isLeft;
+};
+
+struct LoadStack
+{
+    LoadStep* steps    = NULL;
+    size_t    size     = 0;
+    size_t    capacity = 0;
+};
+
+static const size_t PAGED_MAP_ENTRIES   = PAGED_PAGE_SIZE - sizeof(PageHeader);
+static const size_t PAGED_INDEX_ENTRIES = (PAGED_PAGE_SIZE - sizeof(PageHeader)) / sizeof(IndexEntry);
+
+char*       makeFileName   (const char* fileName, const char* extension);
+bool        seekPage       (FILE* file, size_t number);
+bool        syncFile       (FILE* file);
+bool        replaceFile    (const char* from, const char* to);
+
+PageHeader* pageHeader     (uint8_t* page);
+uint16_t*   pageSlots      (uint8_t* page);
+void        initPage       (uint8_t* page, size_t number);
+size_t      pageFree       (uint8_t* page);
+uint32_t    pageChecksum   (const uint8_t* page);
+bool        isPageCorrect  (const uint8_t* page, size_t number);
+bool        isMapPage      (size_t number);
+size_t      mapPageOf      (size_t number);
+size_t      dataPageAfter  (size_t start, size_t count);
+
+bool        readPage       (PagedDatabase* db, size_t number, uint8_t* page);
+uint8_t*    getPage        (PagedDatabase* db, size_t number, bool isNew);
+CachedPage* findCached     (PagedDatabase* db, size_t number);
+void        clearCache     (PagedDatabase* db);
+bool        readFileHeader (PagedDatabase* db);
+bool        readFreeSpace  (PagedDatabase* db);
+bool        recoverJournal (PagedDatabase* db);
+bool        commitPages    (PagedDatabase* db);
+bool        writeJournal   (PagedDatabase* db, const char* journalName);
+
+size_t      recordSize     (BTNode* node);
+void        writeRecord    (uint8_t* page, size_t slot, BTNode* node);
+bool        parseRecord    (uint8_t* page, size_t slot, RecordHeader* header, const char** value, uint32_t* fields);
+BTNode*     newRecordNode  (BinaryTree* tree, const RecordHeader* header, const char* value, uint32_t hits);
+bool        placeNode      (PagedDatabase* db, BTNode* node);
+size_t      freeInPage     (PagedDatabase* db, size_t number);
+size_t      appendPage     (PagedDatabase* db);
+bool        addTouched     (PagedDatabase* db, BTNode* node);
+bool        saveTouched    (PagedDatabase* db, BinaryTree* tree);
+bool        rewritePages   (PagedDatabase* db, BinaryTree* tree, size_t** oldIds);
+
+bool        loadNodes      (PagedDatabase* db, BinaryTree* tree, BTNode* stub, size_t depthLimit);
+bool        pushStep       (LoadStack* stack, LoadStep step);
+bool        unloadStep     (BTNode* node, va_list args);
+void        unloadChildren (BTNode* stub);
+
+bool        writePages     (const char* fileName, BTNode* root, size_t** oldIds, size_t* idsCount);
+bool        layoutPages    (BTNode* root, BTNode*** order, size_t* orderCount, size_t* pagesCount);
+
+uint32_t    valueHash      (const char* value, char* key);
+IndexEntry* indexEntries   (uint8_t* page);
+size_t      bucketPage     (PagedDatabase* db, uint32_t hash);
+bool        readRecordKey  (PagedDatabase* db, uint32_t id, char* key);
+bool        findIndexEntry (PagedDatabase* db, const char* key, uint32_t id, IndexEntry* entry);
+bool        indexRecord    (PagedDatabase* db, BTNode* node, uint32_t parent);
+size_t      appendIndexPage(PagedDatabase* db);
+IndexEntry* sortIndex      (BTNode** order, size_t orderCount, size_t bucketsCount, size_t* bucketStarts);
+size_t      indexPagesCount(const size_t* bucketStarts, size_t bucketsCount);
+bool        writeIndex     (FILE* file, const IndexEntry* entries, const size_t* bucketStarts, size_t bucketsCount,
+                            size_t indexStart, uint8_t* page);
+
+//-----------------------------------------------------------------------------
+//! @return whether or not the file starts as a paged database.
+//-----------------------------------------------------------------------------
+bool isPagedDatabase(const char* fileName)
+{
+    assert(fileName != NULL);
+
+    FILE* file = fopen(fileName, "rb");
+    CHECK_NULL(file, return false);
+
+    PageHeader page   = {};
+    FileHeader header = {};
+    bool       isRead = fread(&page, sizeof(page), 1, file) == 1 && fread(&header, sizeof(header), 1, file) == 1;
+
+    fclose(file);
+
+    return isRead && header.binHeader.signature == PAGED_SIGNATURE;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the whole tree to a new paged database, e.g. to convert a text
+//! one. Ids of the nodes aren't changed. The file is replaced only when the
+//! new one has been written.
+//!
+//! @return false if the file couldn't be written, it isn't changed then.
+//-----------------------------------------------------------------------------
+bool writePagedDatabase(const char* fileName, BTNode* root)
+{
+    assert(fileName != NULL);
+    assert(root     != NULL);
+
+    return writePages(fileName, root, NULL, NULL);
+}
+
+//-----------------------------------------------------------------------------
+//! Opens a paged database, an unfinished save is completed from the journal.
+//!
+//! @param [in] fileName   is used while the database is open
+//! @param [in] isWritable a read-only database isn't changed even by the
+//!                        recovery, the journal is read instead
+//!
+//! @return database or NULL if it can't be opened or is corrupted.
+//-----------------------------------------------------------------------------
+PagedDatabase* openPagedDatabase(const char* fileName, bool isWritable)
+{
+    assert(fileName != NULL);
+
+    PagedDatabase* db = (PagedDatabase*) memAlloc(MEM_TREE, 1, sizeof(PagedDatabase));
+    CHECK_NULL(db, return NULL);
+
+    *db = {};
+    db->fileName   = fileName;
+    db->isWritable = isWritable;
+
+    db->file = fopen(fileName, isWritable ? "r+b" : "rb");
+    if (db->file == NULL)
+    {
+        LG_Write("ERROR: Couldn't open file '%s'\n", LG_STYLE_CLASS_ERROR, fileName);
+        memFree(db);
+
+        return NULL;
+    }
+
+    if (!recoverJournal(db) || !readFileHeader(db) || !readFreeSpace(db))
+    {
+        LG_Write("ERROR: '%s' is corrupted\n", LG_STYLE_CLASS_ERROR, fileName);
+        closePagedDatabase(db);
+
+        return NULL;
+    }
+
+    // older databases get the value index when they are saved
+    if (db->bucketsCount == 0 && isWritable) { db->isRewriteNeeded = true; }
+
+    return db;
+}
+
+void closePagedDatabase(PagedDatabase* db)
+{
+    assert(db != NULL);
+
+    if (db->file != NULL) { fclose(db->file); }
+
+    clearCache(db);
+
+    memFree(db->cache);
+    memFree(db->freeSpace);
+    memFree(db->touched);
+    memFree(db);
+}
+
+//-----------------------------------------------------------------------------
+//! Builds the tree from the database and makes it the tree's one.
+//!
+//! @param [in] db
+//! @param [in] tree
+//! @param [in] depthLimit questions at this depth are left as stubs (without
+//!                        children) to be loaded by loadPagedSubtree, 
+//!                        PAGED_ALL_LEVELS to load the whole tree
+//!
+//! @return root or NULL if the records are corrupted or out of memory.
+//-----------------------------------------------------------------------------
+BTNode* loadPagedTree(PagedDatabase* db, BinaryTree* tree, size_t depthLimit)
+{
+    assert(db   != NULL);
+    assert(tree != NULL);
+
+    if (!loadNodes(db, tree, NULL, depthLimit)) { return NULL; }
+
+    return getRoot(tree);
+}
+
+//-----------------------------------------------------------------------------
+//! Builds the subtree of a stub, questions depthLimit levels below it
+//! become stubs in turn. If the subtree can't be loaded, the stub is left
+//! as it is.
+//!
+//! @return false if the records are corrupted or out of memory.
+//-----------------------------------------------------------------------------
+bool loadPagedSubtree(PagedDatabase* db, BinaryTree* tree, BTNode* stub, size_t depthLimit)
+{
+    assert(db   != NULL);
+    assert(tree != NULL);
+    assert(stub != NULL);
+    assert(isPagedStub(stub));
+
+    return loadNodes(db, tree, stub, depthLimit);
+}
+
+//-----------------------------------------------------------------------------
+//! Looks for a value in the value index without loading anything, values
+//! are compared by their lookup keys (ignoring case and extra whitespace).
+//!
+//! @param [in]  db         has to have the value index (see pagedHasIndex)
+//! @param [in]  value
+//! @param [out] path       ids of the records from the root down to the
+//!                         found one, has to be freed by memFree
+//! @param [out] pathLength 0 if there is no such value
+//!
+//! @return false if the records are corrupted or out of memory.
+//-----------------------------------------------------------------------------
+bool findPagedValue(PagedDatabase* db, const char* value, uint32_t** path, size_t* pathLength)
+{
+    assert(db         != NULL);
+    assert(value      != NULL);
+    assert(path       != NULL);
+    assert(pathLength != NULL);
+    assert(pagedHasIndex(db));
+
+    *path       = NULL;
+    *pathLength = 0;
+
+    // a longer value doesn't fit in any page
+    if (strlen(value) >= PAGED_PAGE_SIZE) { return true; }
+
+    char       key[PAGED_PAGE_SIZE] = {};
+    IndexEntry entry                = {};
+    uint32_t*  ids                  = NULL;
+    size_t     idsCount             = 0;
+    size_t     idsCapacity          = 0;
+    size_t     stepsLeft            = pagedIdsCount(db); // no more steps than ids, so cycles are found
+
+    normalizeKey(value, key);
+    bool isRead = findIndexEntry(db, key, 0, &entry);
+
+    // the path is followed up by the parents and turned over then
+    while (isRead && entry.id != 0)
+    {
+        isRead = stepsLeft-- > 0 && memReserve(MEM_STACKS, (void**) &ids, &idsCapacity, idsCount + 1, sizeof(uint32_t));
+        if (!isRead || entry.parent == 0) { break; }
+
+        ids[idsCount++] = entry.id;
+
+        uint32_t parent = entry.parent;
+        isRead = readRecordKey(db, parent, key) && findIndexEntry(db, key, parent, &entry) && entry.id == parent;
+    }
+
+    if (isRead && entry.id != 0) { ids[idsCount++] = entry.id; }
+
+    if (!isRead || (idsCount > 0 && ids[idsCount - 1] != db->root))
+    {
+        LG_Write("ERROR: Records of '%s' are corrupted\n", LG_STYLE_CLASS_ERROR, db->fileName);
+        memFree(ids);
+
+        return false;
+    }
+
+    for (size_t i = 0; i < idsCount / 2; i++)
+    {
+        uint32_t id = ids[i];
+        ids[i] = ids[idsCount - 1 - i];
+        ids[idsCount - 1 - i] = id;
+    }
+
+    *path       = ids;
+    *pathLength = idsCount;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! @return whether or not values can be found by findPagedValue, databases
+//! written by older versions have no value index until they are saved.
+//-----------------------------------------------------------------------------
+bool pagedHasIndex(PagedDatabase* db)
+{
+    assert(db != NULL);
+    return db->bucketsCount != 0;
+}
+
+//-----------------------------------------------------------------------------
+//! @return whether or not the node is a question whose children haven't been
+//! loaded yet.
+//-----------------------------------------------------------------------------
+bool isPagedStub(BTNode* node)
+{
+    assert(node != NULL);
+    return isQuestion(node) && getLeft(node) == NULL;
+}
+
+//-----------------------------------------------------------------------------
+//! @return number of stubs left in the loaded tree.
+//-----------------------------------------------------------------------------
+size_t pagedStubsCount(PagedDatabase* db)
+{
+    assert(db != NULL);
+    return db->stubsCount;
+}
+
+size_t pagedNodesLoaded(PagedDatabase* db)
+{
+    assert(db != NULL);
+    return db->nodesLoaded;
+}
+
+//-----------------------------------------------------------------------------
+//! Creates the nodes of the records from the stub (or from the root if the
+//! stub is NULL) down. Records of the current page are loaded before going
+//! to other pages, so that every page is read about once.
+//-----------------------------------------------------------------------------
+bool loadNodes(PagedDatabase* db, BinaryTree* tree, BTNode* stub, size_t depthLimit)
+{
+    assert(db   != NULL);
+    assert(tree != NULL);
+
+    LoadStack local      = {};
+    LoadStack other      = {};
+    uint8_t*  page       = (uint8_t*) memAlloc(MEM_TEXT, 1, PAGED_PAGE_SIZE);
+    size_t    pageNumber = PAGED_HEADER_PAGE;
+    size_t    nodesLeft  = pagedIdsCount(db); // no more nodes than ids, so cycles are found
+    size_t    newNodes   = 0;
+    size_t    newStubs   = 0;
+    BTNode*   root       = NULL;
+
+    bool isLoaded = page != NULL && pushStep(&other, { stub != NULL ? (uint32_t) getId(stub) : db->root, 0, NULL, stub, false });
+
+    while (isLoaded && (local.size > 0 || other.size > 0))
+    {
+        LoadStep step = local.size > 0 ? local.steps[--local.size] : other.steps[--other.size];
+        size_t   slot = step.id % PAGED_SLOTS;
+
+        if (step.id / PAGED_SLOTS != pageNumber)
+        {
+            pageNumber = step.id / PAGED_SLOTS;
+            isLoaded   = pageNumber < db->pagesCount && !isMapPage(pageNumber) &&
+                         pageNumber != PAGED_HEADER_PAGE && readPage(db, pageNumber, page);
+        }
+
+        RecordHeader header    = {};
+        const char*  value     = NULL;
+        uint32_t     fields[2] = {};
+
+        isLoaded = isLoaded && nodesLeft-- > 0 && slot < pageHeader(page)->slotsCount &&
+                   parseRecord(page, slot, &header, &value, fields);
+        if (!isLoaded) { break; }
+
+        BTNode* node = step.node;
+        if (node == NULL)
+        {
+            node = newRecordNode(tree, &header, value, fields[0]);
+            CHECK_NULL(node, isLoaded = false; break);
+
+            setId(node, step.id);
+            setParent(node, step.parent);
+
+            if      (step.parent == NULL) { root = node; }
+            else if (step.isLeft)         { setLeft(step.parent, node); }
+            else                          { setRight(step.parent, node); }
+
+            newNodes++;
+        }
+
+        // the stub's record has to be a question too
+        if (node == stub && !header.isQuestion)
+        {
+            isLoaded = false;
+            break;
+        }
+
+        if (!header.isQuestion) { continue; }
+
+        if (step.depth >= depthLimit && node != stub)
+        {
+            newStubs++;
+            continue;
+        }
+
+        uint32_t children[2] = { fields[1], fields[0] };
+        for (size_t i = 0; i < 2 && isLoaded; i++)
+        {
+            LoadStack* stack = children[i] / PAGED_SLOTS == pageNumber ? &local : &other;
+            isLoaded = pushStep(stack, { children[i], step.depth + 1, node, NULL, i == 0 });
+        }
+    }
+
+    memFree(local.steps);
+    memFree(other.steps);
+    memFree(page);
+
+    if (stub == NULL && root != NULL)
+    {
+        // a partly built tree is deleted with the tree, missing children are just skipped then
+        setRoot(tree, root);
+    }
+
+    if (!isLoaded)
+    {
+        LG_Write("ERROR: Records of '%s' are corrupted\n", LG_STYLE_CLASS_ERROR, db->fileName);
+
+        if (stub != NULL) { unloadChildren(stub); }
+
+        return false;
+    }
+
+    db->nodesLoaded += newNodes;
+    db->stubsCount  += newStubs;
+    if (stub != NULL) { db->stubsCount--; }
+
+    return true;
+}
+
+bool pushStep(LoadStack* stack, LoadStep step)
+{
+    assert(stack != NULL);
+
+    if (!memReserve(MEM_STACKS, (void**) &stack->steps, &stack->capacity, stack->size + 1, sizeof(LoadStep)))
+    {
+        return false;
+    }
+
+    stack->steps[stack->size++] = step;
+
+    return true;
+}
+
+bool unloadStep(BTNode* node, va_list args)
+{
+    assert(node != NULL);
+
+    deleteNode(node);
+
+    return BT_TRAVERSE_RUN;
+}
+
+//-----------------------------------------------------------------------------
+//! Deletes the partly loaded subtree of a stub, so it's a stub again.
+//-----------------------------------------------------------------------------
+void unloadChildren(BTNode* stub)
+{
+    assert(stub != NULL);
+
+    BTNode* right = getRight(stub);
+    BTNode* left  = getLeft(stub);
+
+    setRight(stub, NULL);
+    setLeft(stub,  NULL);
+
+    postOrderTraverse(right, unloadStep);
+    postOrderTraverse(left,  unloadStep);
+}
+
+//-----------------------------------------------------------------------------
+//! @return upper bound of the ids of the nodes, e.g. to size the statistics.
+//-----------------------------------------------------------------------------
+size_t pagedIdsCount(PagedDatabase* db)
+{
+    assert(db != NULL);
+    return (size_t) db->pagesCount * PAGED_SLOTS;
+}
+
+size_t pagedPagesCount(PagedDatabase* db)
+{
+    assert(db != NULL);
+    return db->pagesCount;
+}
+
+//-----------------------------------------------------------------------------
+//! @return number of pages written in place by the last save.
+//-----------------------------------------------------------------------------
+size_t pagedPagesWritten(PagedDatabase* db)
+{
+    assert(db != NULL);
+    return db->pagesWritten;
+}
+
+//-----------------------------------------------------------------------------
+//! Marks the node to be written at the next save. New nodes (without ids)
+//! get their records then, their parents are rewritten to refer to them.
+//-----------------------------------------------------------------------------
+void pagedTouch(PagedDatabase* db, BTNode* node)
+{
+    assert(db   != NULL);
+    assert(node != NULL);
+
+    // changes of a read-only database are never saved
+    if (db->isRewriteNeeded || !db->isWritable) { return; }
+
+    if (!addTouched(db, node)) { db->isRewriteNeeded = true; }
+}
+
+//-----------------------------------------------------------------------------
+//! Makes the next save rewrite the whole database, e.g. after the tree has
+//! been rebuilt. Nodes get new ids then.
+//-----------------------------------------------------------------------------
+void pagedTouchAll(PagedDatabase* db)
+{
+    assert(db != NULL);
+
+    db->isRewriteNeeded = true;
+    db->touchedCount    = 0;
+}
+
+//-----------------------------------------------------------------------------
+//! @return whether or not the next save rewrites the whole database, it 
+//! needs the whole tree loaded then.
+//-----------------------------------------------------------------------------
+bool pagedNeedsRewrite(PagedDatabase* db)
+{
+    assert(db != NULL);
+    return db->isRewriteNeeded;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the touched nodes (or the whole tree).
+//!
+//! @param [in]  db
+//! @param [in]  tree
+//! @param [out] oldIds oldIds[newId] is the previous id of the node or
+//!                     BT_NO_ID, it's set (and has to be freed with memFree)
+//!                     only if the ids have changed, otherwise it's NULL
+//!
+//! @return false if the database couldn't be written.
+//-----------------------------------------------------------------------------
+bool pagedSave(PagedDatabase* db, BinaryTree* tree, size_t** oldIds)
+{
+    assert(db     != NULL);
+    assert(tree   != NULL);
+    assert(oldIds != NULL);
+    assert(db->isWritable);
+
+    *oldIds = NULL;
+    db->pagesWritten = 0;
+
+    if (db->isRewriteNeeded)
+    {
+        // records of the subtrees left on disk would be lost
+        if (db->stubsCount != 0) { return false; }
+
+        return rewritePages(db, tree, oldIds);
+    }
+
+    bool isSaved = saveTouched(db, tree);
+
+    // the pages may be half changed, so the next save starts from scratch
+    if (!isSaved) { db->isRewriteNeeded = true; }
+
+    db->touchedCount = 0;
+    clearCache(db);
+
+    return isSaved;
+}
+
+//-----------------------------------------------------------------------------
+//! Gives the new nodes their records and writes all the touched records.
+//-----------------------------------------------------------------------------
+bool saveTouched(PagedDatabase* db, BinaryTree* tree)
+{
+    assert(db   != NULL);
+    assert(tree != NULL);
+
+    uint32_t oldRoot       = db->root;
+    uint32_t oldPagesCount = db->pagesCount;
+
+    // the list grows while new nodes are placed: their parents and new children are added
+    for (size_t i = 0; i < db->touchedCount; i++)
+    {
+        BTNode* node = db->touched[i];
+        if (getId(node) != BT_NO_ID) { continue; }
+
+        if (!placeNode(db, node)) { return false; }
+
+        BTNode* parent = getParent(node);
+        if (parent == NULL) { db->root = (uint32_t) getId(node); }
+
+        if ((parent != NULL && !addTouched(db, parent)) ||
+            (isQuestion(node) && getId(getRight(node)) == BT_NO_ID && !addTouched(db, getRight(node))) ||
+            (isQuestion(node) && getId(getLeft(node))  == BT_NO_ID && !addTouched(db, getLeft(node))))
+        {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < db->touchedCount; i++)
+    {
+        BTNode*  node = db->touched[i];
+        uint8_t* page = getPage(db, getId(node) / PAGED_SLOTS, false);
+        CHECK_NULL(page, return false);
+
+        writeRecord(page, getId(node) % PAGED_SLOTS, node);
+    }
+
+    // new records are indexed, and old ones may have got new parents: a new question takes the place of its child
+    for (size_t i = 0; i < db->touchedCount && pagedHasIndex(db); i++)
+    {
+        BTNode*  node   = db->touched[i];
+        BTNode*  parent = getParent(node);
+        uint32_t id     = (uint32_t) getId(node);
+
+        if (!indexRecord(db, node, parent != NULL ? (uint32_t) getId(parent) : 0) ||
+            (isQuestion(node) && (!indexRecord(db, getRight(node), id) || !indexRecord(db, getLeft(node), id))))
+        {
+            return false;
+        }
+    }
+
+    if (db->root != oldRoot || db->pagesCount != oldPagesCount)
+    {
+        uint8_t* page = getPage(db, PAGED_HEADER_PAGE, false);
+        CHECK_NULL(page, return false);
+
+        FileHeader* header = (FileHeader*) (pageHeader(page) + 1);
+        header->pagesCount = db->pagesCount;
+        header->root       = db->root;
+    }
+
+    // free space of the changed data pages goes to their map pages
+    for (size_t i = 0, count = db->cacheCount; i < count; i++)
+    {
+        size_t number = db->cache[i].number;
+        if (number == PAGED_HEADER_PAGE || isMapPage(number)) { continue; }
+
+        size_t free = pageFree(db->cache[i].data) / PAGED_FREE_UNIT;
+        if (pageHeader(db->cache[i].data)->slotsCount == PAGED_SLOTS) { free = 0; }
+
+        db->freeSpace[number] = (uint8_t) (free < UINT8_MAX ? free : UINT8_MAX);
+
+        size_t   mapNumber = mapPageOf(number);
+        uint8_t* map       = getPage(db, mapNumber, mapNumber >= oldPagesCount);
+        CHECK_NULL(map, return false);
+
+        map[sizeof(PageHeader) + number - mapNumber - 1] = db->freeSpace[number];
+    }
+
+    return commitPages(db);
+}
+
+//-----------------------------------------------------------------------------
+//! Rewrites the whole database and opens it again.
+//-----------------------------------------------------------------------------
+bool rewritePages(PagedDatabase* db, BinaryTree* tree, size_t** oldIds)
+{
+    assert(db     != NULL);
+    assert(tree   != NULL);
+    assert(oldIds != NULL);
+
+    size_t idsCount = 0;
+
+    clearCache(db);
+    fclose(db->file);
+    db->file = NULL;
+
+    // a journal left by a failed save belongs to the old file and must not be applied to the new one
+    char* journalName = makeFileName(db->fileName, JOURNAL_EXTENSION);
+    CHECK_NULL(journalName, return false);
+
+    remove(journalName);
+    memFree(journalName);
+
+    bool isWritten = writePages(db->fileName, getRoot(tree), oldIds, &idsCount);
+
+    db->file = fopen(db->fileName, "r+b");
+    CHECK_NULL(db->file, memFree(*oldIds); *oldIds = NULL; return false);
+
+    if (!readFileHeader(db) || !readFreeSpace(db))
+    {
+        memFree(*oldIds);
+        *oldIds = NULL;
+
+        return false;
+    }
+
+    if (isWritten)
+    {
+        db->isRewriteNeeded = false;
+        db->touchedCount    = 0;
+        db->pagesWritten    = db->pagesCount;
+    }
+
+    return isWritten;
+}
+
+//-----------------------------------------------------------------------------
+//! Finds a page for a new node's record and reserves its slot there. The
+//! record itself is written later, when the children have their ids.
+//-----------------------------------------------------------------------------
+bool placeNode(PagedDatabase* db, BTNode* node)
+{
+    assert(db   != NULL);
+    assert(node != NULL);
+
+    size_t size   = recordSize(node) + sizeof(uint16_t);
+    size_t number = 0;
+
+    if (size > PAGED_PAGE_SIZE - sizeof(PageHeader))
+    {
+        LG_Write("ERROR: '%s' is too long for a paged database\n", LG_STYLE_CLASS_ERROR, getValue(node));
+        return false;
+    }
+
+    // the parent's page keeps the subtree together
+    BTNode* parent = getParent(node);
+    if (parent != NULL && getId(parent) != BT_NO_ID && freeInPage(db, getId(parent) / PAGED_SLOTS) >= size)
+    {
+        number = getId(parent) / PAGED_SLOTS;
+    }
+
+    for (size_t i = 0; i < db->pagesCount && number == 0; i++)
+    {
+        if (freeInPage(db, i) >= size) { number = i; }
+    }
+
+    if (number == 0)
+    {
+        number = appendPage(db);
+        if (number == 0) { return false; }
+    }
+
+    uint8_t* page = getPage(db, number, false);
+    CHECK_NULL(page, return false);
+
+    PageHeader* header = pageHeader(page);
+
+    size_t slot = header->slotsCount++;
+    header->freeEnd       = (uint16_t) (header->freeEnd - recordSize(node));
+    pageSlots(page)[slot] = header->freeEnd;
+
+    setId(node, number * PAGED_SLOTS + slot);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! @return free space of a data page including the slot of a new record.
+//-----------------------------------------------------------------------------
+size_t freeInPage(PagedDatabase* db, size_t number)
+{
+    assert(db != NULL);
+    assert(number < db->pagesCount);
+
+    if (number == PAGED_HEADER_PAGE || isMapPage(number)) { return 0; }
+
+    // the map is behind the pages changed by the current save
+    CachedPage* cached = findCached(db, number);
+    CHECK_NULL(cached, return db->freeSpace[number] * PAGED_FREE_UNIT);
+
+    return pageHeader(cached->data)->slotsCount < PAGED_SLOTS ? pageFree(cached->data) : 0;
+}
+
+//-----------------------------------------------------------------------------
+//! Adds an empty data page (and a map page before it if its place has come).
+//!
+//! @return number of the page or 0 if out of memory.
+//-----------------------------------------------------------------------------
+size_t appendPage(PagedDatabase* db)
+{
+    assert(db != NULL);
+
+    if (isMapPage(db->pagesCount))
+    {
+        CHECK_NULL(getPage(db, db->pagesCount, true), return 0);
+        db->pagesCount++;
+    }
+
+    if (!memReserve(MEM_TREE, (void**) &db->freeSpace, &db->freeCapacity, db->pagesCount + 1, sizeof(uint8_t)))
+    {
+        return 0;
+    }
+
+    CHECK_NULL(getPage(db, db->pagesCount, true), return 0);
+    db->freeSpace[db->pagesCount] = 0;
+
+    return db->pagesCount++;
+}
+
+bool addTouched(PagedDatabase* db, BTNode* node)
+{
+    assert(db   != NULL);
+    assert(node != NULL);
+
+    if (!memReserve(MEM_TREE, (void**) &db->touched, &db->touchedCapacity, db->touchedCount + 1, sizeof(BTNode*)))
+    {
+        return false;
+    }
+
+    db->touched[db->touchedCount++] = node;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the changed pages to the journal, then in place, then deletes the
+//! journal.
+//-----------------------------------------------------------------------------
+bool commitPages(PagedDatabase* db)
+{
+    assert(db != NULL);
+
+    for (size_t i = 0; i < db->cacheCount; i++)
+    {
+        PageHeader* header = pageHeader(db->cache[i].data);
+
+        header->number   = db->cache[i].number;
+        header->checksum = pageChecksum(db->cache[i].data);
+    }
+
+    char* journalName = makeFileName(db->fileName, JOURNAL_EXTENSION);
+    CHECK_NULL(journalName, return false);
+
+    bool isCommitted = writeJournal(db, journalName);
+
+    for (size_t i = 0; i < db->cacheCount && isCommitted; i++)
+    {
+        if (!db->cache[i].isDirty) { continue; }
+
+        isCommitted = seekPage(db->file, db->cache[i].number) &&
+                      fwrite(db->cache[i].data, PAGED_PAGE_SIZE, 1, db->file) == 1;
+
+        db->pagesWritten++;
+    }
+
+    isCommitted = isCommitted && syncFile(db->file);
+
+    // a failed write in place is finished from the journal when the database is opened
+    if (isCommitted) { remove(journalName); }
+
+    memFree(journalName);
+
+    return isCommitted;
+}
+
+bool writeJournal(PagedDatabase* db, const char* journalName)
+{
+    assert(db          != NULL);
+    assert(journalName != NULL);
+
+    FILE* journal = fopen(journalName, "wb");
+    CHECK_NULL(journal, return false);
+
+    JournalHeader header = {};
+    header.binHeader.signature = JOURNAL_SIGNATURE;
+    header.binHeader.version   = PAGED_VERSION;
+
+    // the number of pages is written the last, a journal without it is ignored
+    bool isWritten = fwrite(&header, sizeof(header), 1, journal) == 1;
+
+    for (size_t i = 0; i < db->cacheCount && isWritten; i++)
+    {
+        if (!db->cache[i].isDirty) { continue; }
+
+        isWritten = fwrite(db->cache[i].data, PAGED_PAGE_SIZE, 1, journal) == 1;
+        header.pagesCount++;
+    }
+
+    isWritten = isWritten && syncFile(journal) && fseek(journal, 0, SEEK_SET) == 0 &&
+                fwrite(&header, sizeof(header), 1, journal) == 1 && syncFile(journal);
+
+    fclose(journal);
+
+    return isWritten;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the pages of a complete journal in place (or keeps them in the
+//! cache if the database is read-only). Incomplete journals are deleted.
+//-----------------------------------------------------------------------------
+bool recoverJournal(PagedDatabase* db)
+{
+    assert(db != NULL);
+
+    char* journalName = makeFileName(db->fileName, JOURNAL_EXTENSION);
+    CHECK_NULL(journalName, return false);
+
+    FILE* journal = fopen(journalName, "rb");
+    if (journal == NULL)
+    {
+        memFree(journalName);
+        return true;
+    }
+
+    JournalHeader header    = {};
+    bool          isRead    = fread(&header, sizeof(header), 1, journal) == 1 &&
+                              header.binHeader.signature == JOURNAL_SIGNATURE &&
+                              (header.binHeader.version  == PAGED_VERSION ||
+                               header.binHeader.version  == PAGED_OLD_VERSION);
+    bool          isApplied = true;
+
+    for (size_t i = 0; i < header.pagesCount && isRead && isApplied; i++)
+    {
+        uint8_t* page = (uint8_t*) memAlloc(MEM_TEXT, 1, PAGED_PAGE_SIZE);
+        CHECK_NULL(page, isApplied = false; break);
+
+        isRead = fread(page, PAGED_PAGE_SIZE, 1, journal) == 1 && isPageCorrect(page, pageHeader(page)->number);
+
+        if (isRead && db->isWritable)
+        {
+            isApplied = seekPage(db->file, pageHeader(page)->number) && fwrite(page, PAGED_PAGE_SIZE, 1, db->file) == 1;
+        }
+
+        if (isRead && !db->isWritable && memReserve(MEM_TEXT, (void**) &db->cache, &db->cacheCapacity,
+                                                    db->cacheCount + 1, sizeof(CachedPage)))
+        {
+            db->cache[db->cacheCount++] = { pageHeader(page)->number, false, page };
+            page = NULL;
+        }
+
+        memFree(page);
+    }
+
+    fclose(journal);
+
+    // a broken journal means the database itself hasn't been touched
+    isApplied = isApplied && (!db->isWritable || syncFile(db->file));
+    if (isApplied && db->isWritable)
+    {
+        if (isRead && header.pagesCount > 0)
+        {
+            LG_Write("'%s' has been recovered from the journal\n", LG_STYLE_CLASS_DEFAULT, db->fileName);
+        }
+
+        remove(journalName);
+    }
+
+    memFree(journalName);
+
+    return isApplied;
+}
+
+bool readFileHeader(PagedDatabase* db)
+{
+    assert(db != NULL);
+
+    uint8_t page[PAGED_PAGE_SIZE] = {};
+    if (!readPage(db, PAGED_HEADER_PAGE, page)) { return false; }
+
+    FileHeader* header = (FileHeader*) (pageHeader(page) + 1);
+    if (header->binHeader.signature != PAGED_SIGNATURE ||
+        (header->binHeader.version  != PAGED_VERSION && header->binHeader.version != PAGED_OLD_VERSION) ||
+        header->pageSize            != PAGED_PAGE_SIZE ||
+        header->pagesCount          <  2)
+    {
+        return false;
+    }
+
+    // older versions have zeros after the header, so no index
+    if (header->bucketsCount != 0 &&
+        (header->indexStart <= PAGED_HEADER_PAGE || header->indexStart >= header->pagesCount || isMapPage(header->indexStart)))
+    {
+        return false;
+    }
+
+    db->pagesCount   = header->pagesCount;
+    db->root         = header->root;
+    db->indexStart   = header->indexStart;
+    db->bucketsCount = header->bucketsCount;
+
+    return true;
+}
+
+bool readFreeSpace(PagedDatabase* db)
+{
+    assert(db != NULL);
+
+    db->freeCapacity = 0;
+    memFree(db->freeSpace);
+    db->freeSpace = NULL;
+
+    if (!memReserve(MEM_TREE, (void**) &db->freeSpace, &db->freeCapacity, db->pagesCount, sizeof(uint8_t)))
+    {
+        return false;
+    }
+
+    uint8_t page[PAGED_PAGE_SIZE] = {};
+    for (size_t number = 1; number < db->pagesCount; number += PAGED_MAP_ENTRIES + 1)
+    {
+        if (!readPage(db, number, page)) { return false; }
+
+        size_t count = db->pagesCount - number - 1;
+        if (count > PAGED_MAP_ENTRIES) { count = PAGED_MAP_ENTRIES; }
+
+        memcpy(&db->freeSpace[number + 1], page + sizeof(PageHeader), count);
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Reads a page checking its checksum. Pages recovered from the journal of
+//! a read-only database are taken from the cache.
+//-----------------------------------------------------------------------------
+bool readPage(PagedDatabase* db, size_t number, uint8_t* page)
+{
+    assert(db   != NULL);
+    assert(page != NULL);
+
+    CachedPage* cached = findCached(db, number);
+    if (cached != NULL)
+    {
+        memcpy(page, cached->data, PAGED_PAGE_SIZE);
+        return true;
+    }
+
+    return seekPage(db->file, number) && fread(page, PAGED_PAGE_SIZE, 1, db->file) == 1 && isPageCorrect(page, number);
+}
+
+//-----------------------------------------------------------------------------
+//! @return the page to be changed and written by the current save.
+//-----------------------------------------------------------------------------
+uint8_t* getPage(PagedDatabase* db, size_t number, bool isNew)
+{
+    assert(db != NULL);
+
+    CachedPage* cached = findCached(db, number);
+    if (cached != NULL)
+    {
+        cached->isDirty = true;
+        return cached->data;
+    }
+
+    if (!memReserve(MEM_TEXT, (void**) &db->cache, &db->cacheCapacity, db->cacheCount + 1, sizeof(CachedPage)))
+    {
+        return NULL;
+    }
+
+    uint8_t* page = (uint8_t*) memAlloc(MEM_TEXT, 1, PAGED_PAGE_SIZE);
+    CHECK_NULL(page, return NULL);
+
+    if (isNew) { initPage(page, number); }
+
+    if (!isNew && !readPage(db, number, page))
+    {
+        memFree(page);
+        return NULL;
+    }
+
+    db->cache[db->cacheCount++] = { (uint32_t) number, true, page };
+
+    return page;
+}
+
+CachedPage* findCached(PagedDatabase* db, size_t number)
+{
+    assert(db != NULL);
+
+    // a save changes a few pages, so they are just searched through
+    for (size_t i = 0; i < db->cacheCount; i++)
+    {
+        if (db->cache[i].number == number) { return &db->cache[i]; }
+    }
+
+    return NULL;
+}
+
+void clearCache(PagedDatabase* db)
+{
+    assert(db != NULL);
+
+    for (size_t i = 0; i < db->cacheCount; i++)
+    {
+        memFree(db->cache[i].data);
+    }
+
+    db->cacheCount = 0;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes all the nodes to a temporary file and puts it in place of the
+//! database. Subtrees are packed into pages breadth first, so a page holds
+//! the top levels of some subtree and a game reads few pages.
+//!
+//! @param [in]  fileName
+//! @param [in]  root
+//! @param [out] oldIds   if not NULL, nodes get the new ids and
+//!                       oldIds[newId] is set to the previous id of every
+//!                       node (BT_NO_ID for the others)
+//! @param [out] idsCount size of oldIds
+//-----------------------------------------------------------------------------
+bool writePages(const char* fileName, BTNode* root, size_t** oldIds, size_t* idsCount)
+{
+    assert(fileName != NULL);
+    assert(root     != NULL);
+
+    BTNode** order      = NULL;
+    size_t   orderCount = 0;
+    size_t   pagesCount = 0;
+    size_t*  previous   = NULL;
+
+    if (oldIds != NULL) { *oldIds = NULL; }
+
+    previous = (size_t*) memAlloc(MEM_TREE, getLeavesCount(root) * 2 - 1, sizeof(size_t));
+    CHECK_NULL(previous, return false);
+
+    if (!layoutPages(root, &order, &orderCount, &pagesCount))
+    {
+        memFree(previous);
+        memFree(order);
+
+        return false;
+    }
+
+    // the value index follows the data pages
+    size_t      indexStart   = isMapPage(pagesCount) ? pagesCount + 1 : pagesCount;
+    size_t      bucketsCount = orderCount * 100 / (PAGED_INDEX_ENTRIES * INDEX_FILL_PERCENT) + 1;
+    size_t*     bucketStarts = (size_t*) memAlloc(MEM_TREE, bucketsCount + 1, sizeof(size_t));
+    IndexEntry* entries      = bucketStarts != NULL ? sortIndex(order, orderCount, bucketsCount, bucketStarts) : NULL;
+
+    if (entries != NULL)
+    {
+        pagesCount = dataPageAfter(indexStart, indexPagesCount(bucketStarts, bucketsCount) - 1) + 1;
+    }
+
+    char*    tempName = makeFileName(fileName, TEMP_EXTENSION);
+    FILE*    file     = tempName != NULL ? fopen(tempName, "wb") : NULL;
+    uint8_t* page     = (uint8_t*) memAlloc(MEM_TEXT, 1, PAGED_PAGE_SIZE);
+    uint8_t* maps     = (uint8_t*) memAlloc(MEM_TREE, pagesCount, sizeof(uint8_t));
+    bool     isWritten = file != NULL && page != NULL && maps != NULL && entries != NULL;
+
+    for (size_t i = 0; i < orderCount; i++) { previous[i] = getId(order[i]); }
+
+    size_t slot = 0;
+    for (size_t i = 0; i < orderCount && isWritten; i++)
+    {
+        // layoutPages has left the place of every node in its id
+        size_t number = getId(order[i]) / PAGED_SLOTS;
+
+        if (slot == 0) { initPage(page, number); }
+
+        PageHeader* header = pageHeader(page);
+        header->slotsCount++;
+        header->freeEnd = (uint16_t) (header->freeEnd - recordSize(order[i]));
+        pageSlots(page)[slot] = header->freeEnd;
+
+        writeRecord(page, slot++, order[i]);
+
+        bool isLast = i + 1 == orderCount || getId(order[i + 1]) / PAGED_SLOTS != number;
+        if (!isLast) { continue; }
+
+        size_t free = pageHeader(page)->slotsCount == PAGED_SLOTS ? 0 : pageFree(page) / PAGED_FREE_UNIT;
+        maps[number] = (uint8_t) (free < UINT8_MAX ? free : UINT8_MAX);
+
+        header->checksum = pageChecksum(page);
+        isWritten = seekPage(file, number) && fwrite(page, PAGED_PAGE_SIZE, 1, file) == 1;
+        slot      = 0;
+    }
+
+    // index pages are left full in the maps
+    isWritten = isWritten && writeIndex(file, entries, bucketStarts, bucketsCount, indexStart, page);
+
+    for (size_t number = 1; number < pagesCount && isWritten; number += PAGED_MAP_ENTRIES + 1)
+    {
+        initPage(page, number);
+
+        size_t count = pagesCount - number - 1;
+        if (count > PAGED_MAP_ENTRIES) { count = PAGED_MAP_ENTRIES; }
+
+        memcpy(page + sizeof(PageHeader), &maps[number + 1], count);
+
+        pageHeader(page)->checksum = pageChecksum(page);
+        isWritten = seekPage(file, number) && fwrite(page, PAGED_PAGE_SIZE, 1, file) == 1;
+    }
+
+    if (isWritten)
+    {
+        initPage(page, PAGED_HEADER_PAGE);
+
+        FileHeader* header = (FileHeader*) (pageHeader(page) + 1);
+        *header = {};
+        header->binHeader.signature = PAGED_SIGNATURE;
+        header->binHeader.version   = PAGED_VERSION;
+        header->pageSize            = PAGED_PAGE_SIZE;
+        header->pagesCount          = (uint32_t) pagesCount;
+        header->root                = (uint32_t) getId(root);
+        header->indexStart          = (uint32_t) indexStart;
+        header->bucketsCount        = (uint32_t) bucketsCount;
+
+        pageHeader(page)->checksum = pageChecksum(page);
+        isWritten = seekPage(file, PAGED_HEADER_PAGE) && fwrite(page, PAGED_PAGE_SIZE, 1, file) == 1;
+    }
+
+    isWritten = isWritten && syncFile(file);
+    if (file != NULL) { fclose(file); }
+
+    isWritten = isWritten && replaceFile(tempName, fileName);
+    if (!isWritten && tempName != NULL) { remove(tempName); }
+
+    // the nodes keep their old ids unless the caller takes the new ones
+    for (size_t i = 0; i < orderCount && (oldIds == NULL || !isWritten); i++) { setId(order[i], previous[i]); }
+
+    if (isWritten && oldIds != NULL)
+    {
+        *idsCount = pagesCount * PAGED_SLOTS;
+        *oldIds   = (size_t*) memAlloc(MEM_TREE, *idsCount, sizeof(size_t));
+
+        for (size_t i = 0; i < *idsCount && *oldIds != NULL; i++) { (*oldIds)[i] = BT_NO_ID; }
+        for (size_t i = 0; i < orderCount && *oldIds != NULL; i++) { (*oldIds)[getId(order[i])] = previous[i]; }
+    }
+
+    if (!isWritten)
+    {
+        LG_Write("ERROR: Couldn't write file '%s'\n", LG_STYLE_CLASS_ERROR, fileName);
+    }
+
+    memFree(tempName);
+    memFree(page);
+    memFree(maps);
+    memFree(entries);
+    memFree(bucketStarts);
+    memFree(order);
+    memFree(previous);
+
+    return isWritten;
+}
+
+//-----------------------------------------------------------------------------
+//! Places every node on a page and sets its id to the place. Pages are
+//! filled one by one: a page takes the nodes of a subtree breadth first,
+//! the subtrees of the nodes that don't fit are placed later the same way.
+//!
+//! @param [in]  root
+//! @param [out] order      nodes in the order of their places
+//! @param [out] orderCount
+//! @param [out] pagesCount including the header and map pages
+//-----------------------------------------------------------------------------
+bool layoutPages(BTNode* root, BTNode*** order, size_t* orderCount, size_t* pagesCount)
+{
+    assert(root       != NULL);
+    assert(order      != NULL);
+    assert(orderCount != NULL);
+    assert(pagesCount != NULL);
+
+    size_t   nodesCount  = getLeavesCount(root) * 2 - 1;
+    BTNode** pending     = (BTNode**) memAlloc(MEM_STACKS, nodesCount, sizeof(BTNode*));
+    BTNode** level       = (BTNode**) memAlloc(MEM_STACKS, nodesCount, sizeof(BTNode*));
+    size_t   pendingHead = 0;
+    size_t   pendingTail = 0;
+
+    *order      = (BTNode**) memAlloc(MEM_TREE, nodesCount, sizeof(BTNode*));
+    *orderCount = 0;
+    *pagesCount = PAGED_HEADER_PAGE + 1;
+
+    if (pending == NULL || level == NULL || *order == NULL)
+    {
+        memFree(pending);
+        memFree(level);
+
+        return false;
+    }
+
+    pending[pendingTail++] = root;
+
+    bool isPlaced = true;
+    while (pendingHead < pendingTail && isPlaced)
+    {
+        if (isMapPage(*pagesCount)) { (*pagesCount)++; }
+
+        size_t number = (*pagesCount)++;
+        size_t free   = PAGED_PAGE_SIZE - sizeof(PageHeader);
+        size_t slots  = 0;
+
+        size_t levelHead = 0;
+        size_t levelTail = 0;
+
+        // when a subtree has been placed completely, the page takes the next one, so small subtrees share pages
+        while (levelHead < levelTail || pendingHead < pendingTail)
+        {
+            bool    isPending = levelHead == levelTail;
+            BTNode* node      = isPending ? pending[pendingHead] : level[levelHead];
+            size_t  size      = recordSize(node) + sizeof(uint16_t);
+
+            if (size > free || slots == PAGED_SLOTS)
+            {
+                // a node that doesn't fit an empty page never will
+                if (slots == 0)
+                {
+                    LG_Write("ERROR: '%s' is too long for a paged database\n", LG_STYLE_CLASS_ERROR, getValue(node));
+                    isPlaced = false;
+                }
+
+                // the rest of the page's subtrees start the next pages
+                while (levelHead < levelTail) { pending[pendingTail++] = level[levelHead++]; }
+                break;
+            }
+
+            if (isPending) { pendingHead++; }
+            else           { levelHead++;   }
+
+            free -= size;
+            setId(node, number * PAGED_SLOTS + slots++);
+            (*order)[(*orderCount)++] = node;
+
+            if (!isQuestion(node)) { continue; }
+
+            level[levelTail++] = getRight(node);
+            level[levelTail++] = getLeft(node);
+        }
+    }
+
+    memFree(pending);
+    memFree(level);
+
+    return isPlaced;
+}
+
+uint32_t valueHash(const char* value, char* key)
+{
+    assert(value != NULL);
+    assert(key   != NULL);
+
+    size_t length = normalizeKey(value, key);
+
+    return hashString(key, length);
+}
+
+IndexEntry* indexEntries(uint8_t* page)
+{
+    assert(page != NULL);
+    return (IndexEntry*) (page + sizeof(PageHeader));
+}
+
+size_t bucketPage(PagedDatabase* db, uint32_t hash)
+{
+    assert(db != NULL);
+    assert(pagedHasIndex(db));
+
+    return dataPageAfter(db->indexStart, hash % db->bucketsCount);
+}
+
+//-----------------------------------------------------------------------------
+//! Reads the value of a record as its lookup key.
+//!
+//! @param [in]  db
+//! @param [in]  id
+//! @param [out] key at least PAGED_PAGE_SIZE chars
+//!
+//! @return false if the record is corrupted.
+//-----------------------------------------------------------------------------
+bool readRecordKey(PagedDatabase* db, uint32_t id, char* key)
+{
+    assert(db  != NULL);
+    assert(key != NULL);
+
+    uint8_t      page[PAGED_PAGE_SIZE] = {};
+    size_t       number                = id / PAGED_SLOTS;
+    RecordHeader header                = {};
+    const char*  value                 = NULL;
+    uint32_t     fields[2]             = {};
+
+    if (number >= db->pagesCount || isMapPage(number) || number == PAGED_HEADER_PAGE || !readPage(db, number, page) ||
+        id % PAGED_SLOTS >= pageHeader(page)->slotsCount || !parseRecord(page, id % PAGED_SLOTS, &header, &value, fields))
+    {
+        return false;
+    }
+
+    normalizeKey(value, key);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Goes through the pages of the key's bucket.
+//!
+//! @param [in]  db
+//! @param [in]  key   lookup key of the value
+//! @param [in]  id    id of the record or 0 to find any record with the key
+//! @param [out] entry its id is 0 if there is no such entry
+//!
+//! @return false if the pages are corrupted.
+//-----------------------------------------------------------------------------
+bool findIndexEntry(PagedDatabase* db, const char* key, uint32_t id, IndexEntry* entry)
+{
+    assert(db    != NULL);
+    assert(key   != NULL);
+    assert(entry != NULL);
+
+    uint8_t  page[PAGED_PAGE_SIZE]      = {};
+    char     recordKey[PAGED_PAGE_SIZE] = {};
+    uint32_t hash                       = hashString(key, strlen(key));
+    size_t   pagesLeft                  = db->pagesCount; // no more pages in a bucket than in the file
+
+    *entry = {};
+
+    for (size_t number = bucketPage(db, hash); number != 0; number = pageHeader(page)->next)
+    {
+        if (pagesLeft-- == 0 || !readPage(db, number, page)) { return false; }
+
+        IndexEntry* entries = indexEntries(page);
+        for (size_t i = 0; i < PAGED_INDEX_ENTRIES && entries[i].id != 0; i++)
+        {
+            if (entries[i].hash != hash || (id != 0 && entries[i].id != id)) { continue; }
+
+            // different values may have the same hash, so the record is checked
+            if (id == 0)
+            {
+                if (!readRecordKey(db, entries[i].id, recordKey)) { return false; }
+                if (strcmp(recordKey, key) != 0)                  { continue; }
+            }
+
+            *entry = entries[i];
+            return true;
+        }
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Adds the record of the node to the index or updates its parent. Bucket
+//! pages are only changed (and written by the save) if the entry changes.
+//!
+//! @return false if the pages are corrupted or out of memory.
+//-----------------------------------------------------------------------------
+bool indexRecord(PagedDatabase* db, BTNode* node, uint32_t parent)
+{
+    assert(db   != NULL);
+    assert(node != NULL);
+    assert(getId(node) != BT_NO_ID);
+
+    uint8_t  page[PAGED_PAGE_SIZE] = {};
+    char     key[PAGED_PAGE_SIZE]  = {}; // a value fits in its page
+    uint32_t hash                  = valueHash(getValue(node), key);
+    uint32_t id                    = (uint32_t) getId(node);
+    size_t   pagesLeft             = db->pagesCount;
+
+    for (size_t number = bucketPage(db, hash); ; number = pageHeader(page)->next)
+    {
+        if (pagesLeft-- == 0 || !readPage(db, number, page)) { return false; }
+
+        IndexEntry* entries = indexEntries(page);
+
+        size_t i = 0;
+        while (i < PAGED_INDEX_ENTRIES && entries[i].id != 0 && entries[i].id != id) { i++; }
+
+        if (i < PAGED_INDEX_ENTRIES && entries[i].id == id && entries[i].parent == parent) { return true; }
+
+        if (i < PAGED_INDEX_ENTRIES)
+        {
+            uint8_t* changed = getPage(db, number, false);
+            CHECK_NULL(changed, return false);
+
+            indexEntries(changed)[i] = { hash, id, parent };
+            return true;
+        }
+
+        if (pageHeader(page)->next != 0) { continue; }
+
+        size_t overflow = appendIndexPage(db);
+        if (overflow == 0) { return false; }
+
+        uint8_t* changed = getPage(db, number, false);
+        CHECK_NULL(changed, return false);
+
+        pageHeader(changed)->next = (uint32_t) overflow;
+        pageHeader(page)->next    = (uint32_t) overflow;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! @return number of a new overflow page of the index or 0 if out of memory.
+//-----------------------------------------------------------------------------
+size_t appendIndexPage(PagedDatabase* db)
+{
+    assert(db != NULL);
+
+    size_t number = appendPage(db);
+    if (number == 0) { return 0; }
+
+    uint8_t* page = getPage(db, number, false);
+    CHECK_NULL(page, return 0);
+
+    // no free space for the records
+    pageHeader(page)->freeEnd = (uint16_t) sizeof(PageHeader);
+
+    return number;
+}
+
+//-----------------------------------------------------------------------------
+//! Makes the entries of the placed nodes and sorts them by their buckets.
+//!
+//! @param [in]  order
+//! @param [in]  orderCount
+//! @param [in]  bucketsCount
+//! @param [out] bucketStarts bucketsCount + 1 positions, entries of bucket i
+//!                           are from bucketStarts[i] to bucketStarts[i + 1]
+//!
+//! @return entries to be freed by memFree or NULL if out of memory.
+//-----------------------------------------------------------------------------
+IndexEntry* sortIndex(BTNode** order, size_t orderCount, size_t bucketsCount, size_t* bucketStarts)
+{
+    assert(order        != NULL);
+    assert(bucketStarts != NULL);
+    assert(bucketsCount > 0);
+
+    IndexEntry* entries = (IndexEntry*) memAlloc(MEM_TREE, orderCount, sizeof(IndexEntry));
+    IndexEntry* sorted  = (IndexEntry*) memAlloc(MEM_TREE, orderCount, sizeof(IndexEntry));
+
+    if (entries == NULL || sorted == NULL)
+    {
+        memFree(entries);
+        memFree(sorted);
+
+        return NULL;
+    }
+
+    char key[PAGED_PAGE_SIZE] = {}; // a value fits in its page
+
+    memset(bucketStarts, 0, (bucketsCount + 1) * sizeof(size_t));
+
+    for (size_t i = 0; i < orderCount; i++)
+    {
+        BTNode* parent = getParent(order[i]);
+
+        entries[i].hash   = valueHash(getValue(order[i]), key);
+        entries[i].id     = (uint32_t) getId(order[i]);
+        entries[i].parent = parent != NULL ? (uint32_t) getId(parent) : 0;
+
+        bucketStarts[entries[i].hash % bucketsCount + 1]++;
+    }
+
+    for (size_t i = 0; i < bucketsCount; i++) { bucketStarts[i + 1] += bucketStarts[i]; }
+
+    // bucketStarts[i] is the end of bucket i - 1 while the entries are put
+    for (size_t i = 0; i < orderCount; i++) { sorted[bucketStarts[entries[i].hash % bucketsCount]++] = entries[i]; }
+
+    for (size_t i = bucketsCount; i > 0; i--) { bucketStarts[i] = bucketStarts[i - 1]; }
+    bucketStarts[0] = 0;
+
+    memFree(entries);
+
+    return sorted;
+}
+
+//-----------------------------------------------------------------------------
+//! @return number of the bucket and overflow pages of the index.
+//-----------------------------------------------------------------------------
+size_t indexPagesCount(const size_t* bucketStarts, size_t bucketsCount)
+{
+    assert(bucketStarts != NULL);
+
+    size_t count = 0;
+    for (size_t i = 0; i < bucketsCount; i++)
+    {
+        size_t entriesCount = bucketStarts[i + 1] - bucketStarts[i];
+        count += entriesCount > PAGED_INDEX_ENTRIES ? (entriesCount - 1) / PAGED_INDEX_ENTRIES + 1 : 1;
+    }
+
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the bucket pages from indexStart on, overflow pages follow them.
+//-----------------------------------------------------------------------------
+bool writeIndex(FILE* file, const IndexEntry* entries, const size_t* bucketStarts, size_t bucketsCount,
+                size_t indexStart, uint8_t* page)
+{
+    assert(file         != NULL);
+    assert(entries      != NULL);
+    assert(bucketStarts != NULL);
+    assert(page         != NULL);
+
+    size_t overflowCount = 0;
+    bool   isWritten     = true;
+
+    for (size_t bucket = 0; bucket < bucketsCount && isWritten; bucket++)
+    {
+        size_t number = dataPageAfter(indexStart, bucket);
+        size_t first  = bucketStarts[bucket];
+
+        do
+        {
+            size_t count = bucketStarts[bucket + 1] - first;
+            if (count > PAGED_INDEX_ENTRIES) { count = PAGED_INDEX_ENTRIES; }
+
+            initPage(page, number);
+            pageHeader(page)->freeEnd = (uint16_t) sizeof(PageHeader);
+
+            memcpy(indexEntries(page), entries + first, count * sizeof(IndexEntry));
+            first += count;
+
+            size_t next = 0;
+            if (first < bucketStarts[bucket + 1]) { next = dataPageAfter(indexStart, bucketsCount + overflowCount++); }
+
+            pageHeader(page)->next     = (uint32_t) next;
+            pageHeader(page)->checksum = pageChecksum(page);
+
+            isWritten = seekPage(file, number) && fwrite(page, PAGED_PAGE_SIZE, 1, file) == 1;
+            number    = next;
+        }
+        while (number != 0 && isWritten);
+    }
+
+    return isWritten;
+}
+
+size_t recordSize(BTNode* node)
+{
+    assert(node != NULL);
+
+    size_t size = sizeof(RecordHeader) + (isQuestion(node) ? 2 : 1) * sizeof(uint32_t) + getValueLength(node) + 1;
+
+    return (size + 3) & ~(size_t) 3;
+}
+
+void writeRecord(uint8_t* page, size_t slot, BTNode* node)
+{
+    assert(page != NULL);
+    assert(node != NULL);
+    assert(slot < pageHeader(page)->slotsCount);
+    assert(!isPagedStub(node)); // the children ids of a stub are only on disk
+
+    uint8_t* record = page + pageSlots(page)[slot];
+
+    RecordHeader header = {};
+    header.isQuestion = isQuestion(node);
+    header.length     = (uint16_t) getValueLength(node);
+
+    memset(record, 0, recordSize(node));
+    memcpy(record, &header, sizeof(header));
+    record += sizeof(header);
+
+    uint32_t fields[2] = {};
+    size_t   count     = 1;
+
+    if (isQuestion(node))
+    {
+        fields[0] = (uint32_t) getId(getRight(node));
+        fields[1] = (uint32_t) getId(getLeft(node));
+        count     = 2;
+    }
+    else
+    {
+        fields[0] = (uint32_t) getHits(node);
+    }
+
+    memcpy(record, fields, count * sizeof(uint32_t));
+    record += count * sizeof(uint32_t);
+
+    memcpy(record, getValue(node), header.length + 1);
+}
+
+//-----------------------------------------------------------------------------
+//! Checks the record and finds its parts in the page.
+//!
+//! @param [in]  page
+//! @param [in]  slot
+//! @param [out] header
+//! @param [out] value  points into the page
+//! @param [out] fields hits of an object or the right and the left child
+//!                     ids of a question
+//!
+//! @return false if the record is corrupted.
+//-----------------------------------------------------------------------------
+bool parseRecord(uint8_t* page, size_t slot, RecordHeader* header, const char** value, uint32_t* fields)
+{
+    assert(page   != NULL);
+    assert(header != NULL);
+    assert(value  != NULL);
+    assert(fields != NULL);
+
+    size_t offset = pageSlots(page)[slot];
+    if (offset < sizeof(PageHeader) || offset + sizeof(RecordHeader) > PAGED_PAGE_SIZE) { return false; }
+
+    memcpy(header, page + offset, sizeof(*header));
+
+    size_t fieldsCount = header->isQuestion ? 2 : 1;
+    *value = (const char*) page + offset + sizeof(*header) + fieldsCount * sizeof(uint32_t);
+
+    if ((const uint8_t*) *value + header->length + 1 > page + PAGED_PAGE_SIZE || (*value)[header->length] != '\0')
+    {
+        return false;
+    }
+
+    memcpy(fields, page + offset + sizeof(*header), fieldsCount * sizeof(uint32_t));
+
+    return true;
+}
+
+BTNode* newRecordNode(BinaryTree* tree, const RecordHeader* header, const char* value, uint32_t hits)
+{
+    assert(tree   != NULL);
+    assert(header != NULL);
+    assert(value  != NULL);
+
+    BTElem_t interned = internValue(tree, value);
+    CHECK_NULL(interned, return NULL);
+
+    if (header->isQuestion) { return newQuestion(interned); }
+
+    BTNode* object = newNode(interned);
+    CHECK_NULL(object, return NULL);
+
+    setHits(object, hits);
+
+    return object;
+}
+
+PageHeader* pageHeader(uint8_t* page)
+{
+    assert(page != NULL);
+    return (PageHeader*) page;
+}
+
+uint16_t* pageSlots(uint8_t* page)
+{
+    assert(page != NULL);
+    return (uint16_t*) (page + sizeof(PageHeader));
+}
+
+void initPage(uint8_t* page, size_t number)
+{
+    assert(page != NULL);
+
+    memset(page, 0, PAGED_PAGE_SIZE);
+
+    PageHeader* header = pageHeader(page);
+    header->number  = (uint32_t) number;
+    header->freeEnd = (uint16_t) PAGED_PAGE_SIZE;
+}
+
+size_t pageFree(uint8_t* page)
+{
+    assert(page != NULL);
+
+    PageHeader* header = pageHeader(page);
+    size_t      used   = sizeof(PageHeader) + header->slotsCount * sizeof(uint16_t);
+
+    return header->freeEnd > used ? header->freeEnd - used : 0;
+}
+
+uint32_t pageChecksum(const uint8_t* page)
+{
+    assert(page != NULL);
+
+    return hashString((const char*) page + sizeof(uint32_t), PAGED_PAGE_SIZE - sizeof(uint32_t));
+}
+
+bool isPageCorrect(const uint8_t* page, size_t number)
+{
+    assert(page != NULL);
+
+    PageHeader header = {};
+    memcpy(&header, page, sizeof(header));
+
+    return header.number == number && header.checksum == pageChecksum(page) &&
+           header.freeEnd <= PAGED_PAGE_SIZE && header.slotsCount <= PAGED_SLOTS;
+}
+
+bool isMapPage(size_t number)
+{
+    return number >= 1 && (number - 1) % (PAGED_MAP_ENTRIES + 1) == 0;
+}
+
+size_t mapPageOf(size_t number)
+{
+    assert(number >= 1);
+
+    return (number - 1) / (PAGED_MAP_ENTRIES + 1) * (PAGED_MAP_ENTRIES + 1) + 1;
+}
+
+//-----------------------------------------------------------------------------
+//! @return number of the count-th data page after the start one, so that
+//! map pages are skipped.
+//-----------------------------------------------------------------------------
+size_t dataPageAfter(size_t start, size_t count)
+{
+    assert(start > PAGED_HEADER_PAGE);
+    assert(!isMapPage(start));
+
+    size_t map    = mapPageOf(start);
+    size_t offset = start - map - 1 + count;
+
+    return map + offset / PAGED_MAP_ENTRIES * (PAGED_MAP_ENTRIES + 1) + 1 + offset % PAGED_MAP_ENTRIES;
+}
+
+char* makeFileName(const char* fileName, const char* extension)
+{
+    assert(fileName  != NULL);
+    assert(extension != NULL);
+
+    size_t fileNameLength  = strlen(fileName);
+    size_t extensionLength = strlen(extension);
+
+    char* name = (char*) memAlloc(MEM_STRINGS, fileNameLength + extensionLength + 1, sizeof(char));
+    CHECK_NULL(name, return NULL);
+
+    memcpy(name, fileName, fileNameLength);
+    memcpy(name + fileNameLength, extension, extensionLength + 1);
+
+    return name;
+}
+
+bool seekPage(FILE* file, size_t number)
+{
+    assert(file != NULL);
+
+    #ifdef _WIN32
+    return _fseeki64(file, (long long) number * PAGED_PAGE_SIZE, SEEK_SET) == 0;
+    #else
+    return fseeko(file, (off_t) number * PAGED_PAGE_SIZE, SEEK_SET) == 0;
+    #endif
+}
+
+//-----------------------------------------------------------------------------
+//! Makes sure that everything written to the file is on the disk.
+//-----------------------------------------------------------------------------
+bool syncFile(FILE* file)
+{
+    assert(file != NULL);
+
+    if (fflush(file) != 0) { return false; }
+
+    #ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+    #else
+    return fsync(fileno(file)) == 0;
+    #endif
+}
+
+bool replaceFile(const char* from, const char* to)
+{
+    assert(from != NULL);
+    assert(to   != NULL);
+
+    #ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+    #else
+    return rename(from, to) == 0;
+    #endif
+}
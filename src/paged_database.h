@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "binary_tree.h"
+
+//-----------------------------------------------------------------------------
+// Binary database made of fixed-size pages. Nodes of a paged database keep
+// the addresses of their records as ids, so the ids (and the statistics
+// counted by them) don't change when the tree grows. Touched nodes are
+// written at the next save, only the pages holding them are rewritten.
+//
+// The tree can be loaded lazily: questions below some depth are left as 
+// stubs (questions without children), their subtrees are loaded when they
+// are needed. Values that aren't loaded are found by the value index kept
+// in the file.
+//-----------------------------------------------------------------------------
+struct PagedDatabase;
+
+static const size_t PAGED_ALL_LEVELS = (size_t) -1;
+
+bool           isPagedDatabase    (const char* fileName);
+bool           writePagedDatabase (const char* fileName, BTNode* root);
+
+PagedDatabase* openPagedDatabase  (const char* fileName, bool isWritable);
+void           closePagedDatabase (PagedDatabase* db);
+BTNode*        loadPagedTree      (PagedDatabase* db, BinaryTree* tree, size_t depthLimit);
+bool           loadPagedSubtree   (PagedDatabase* db, BinaryTree* tree, BTNode* stub, size_t depthLimit);
+bool           isPagedStub        (BTNode* node);
+bool           findPagedValue     (PagedDatabase* db, const char* value, uint32_t** path, size_t* pathLength);
+bool           pagedHasIndex      (PagedDatabase* db);
+
+size_t         pagedIdsCount      (PagedDatabase* db);
+size_t         pagedPagesCount    (PagedDatabase* db);
+size_t         pagedPagesWritten  (PagedDatabase* db);
+size_t         pagedNodesLoaded   (PagedDatabase* db);
+size_t         pagedStubsCount    (PagedDatabase* db);
+
+void           pagedTouch         (PagedDatabase* db, BTNode* node);
+void           pagedTouchAll      (PagedDatabase* db);
+bool           pagedNeedsRewrite  (PagedDatabase* db);
+bool           pagedSave          (PagedDatabase* db, BinaryTree* tree, size_t** oldIds);
@@ -0,0 +1,226 @@
+#include <assert.h>
+#include <string.h>
+#include "perf_counters.h"
+#include "../libs/log_generator.h"
+
+#if defined(__linux__) && defined(PERF_PROFILING)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// All counters are opened as one group, so they are scheduled together and
+// read with a single read(). The group counts only user space code of the
+// thread that has opened it, so waiting for input doesn't count. A phase
+// reads the group when it begins and adds the difference when it ends,
+// phases may be nested (e.g. a traversal during load).
+//
+// Counters the CPU (or a virtual machine) doesn't have are skipped.
+//-----------------------------------------------------------------------------
+struct PerfState
+{
+    int       leader                          = -1;
+    int       fds[PERF_COUNTERS_COUNT]        = { -1, -1, -1, -1 };
+    size_t    slots[PERF_COUNTERS_COUNT]      = {}; // position in the group read
+    size_t    opened                          = 0;
+
+    uint64_t  starts[PERF_PHASES_COUNT][PERF_COUNTERS_COUNT] = {};
+    PerfStats stats[PERF_PHASES_COUNT]        = {};
+};
+
+static const char* PERF_PHASE_NAMES[PERF_PHASES_COUNT] =
+{
+    "load",
+    "save",
+    "lookup",
+    "traversal",
+};
+
+static thread_local PerfState perf;
+
+bool readGroup (uint64_t* values);
+
+#if defined(__linux__) && defined(PERF_PROFILING)
+
+static const uint64_t PERF_CONFIGS[PERF_COUNTERS_COUNT] =
+{
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+//-----------------------------------------------------------------------------
+//! Opens the counters for the calling thread.
+//!
+//! @return false if none of them can be opened (e.g. perf_event_paranoid
+//! forbids it) or the profiling is off.
+//-----------------------------------------------------------------------------
+bool perfOpen()
+{
+    if (perfIsOpen()) { return true; }
+
+    for (size_t i = 0; i < PERF_COUNTERS_COUNT; i++)
+    {
+        struct perf_event_attr attr = {};
+
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.size           = sizeof(attr);
+        attr.config         = PERF_CONFIGS[i];
+        attr.disabled       = perf.leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_GROUP;
+
+        int fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, perf.leader, 0);
+        if (fd < 0) { continue; }
+
+        if (perf.leader < 0) { perf.leader = fd; }
+
+        perf.fds[i]   = fd;
+        perf.slots[i] = perf.opened++;
+        perf.stats[0].available[i] = true;
+    }
+
+    if (perf.leader < 0)
+    {
+        LG_Write("ERROR: Couldn't open performance counters, check /proc/sys/kernel/perf_event_paranoid\n", LG_STYLE_CLASS_ERROR);
+        return false;
+    }
+
+    for (size_t phase = 1; phase < PERF_PHASES_COUNT; phase++)
+    {
+        memcpy(perf.stats[phase].available, perf.stats[0].available, sizeof(perf.stats[0].available));
+    }
+
+    ioctl(perf.leader, PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP);
+    ioctl(perf.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    return true;
+}
+
+void perfClose()
+{
+    for (size_t i = 0; i < PERF_COUNTERS_COUNT; i++)
+    {
+        if (perf.fds[i] >= 0) { close(perf.fds[i]); }
+    }
+
+    perf = {};
+}
+
+bool readGroup(uint64_t* values)
+{
+    assert(values != NULL);
+
+    uint64_t buffer[PERF_COUNTERS_COUNT + 1] = {};
+    if (read(perf.leader, buffer, sizeof(buffer)) < (ssize_t) ((perf.opened + 1) * sizeof(uint64_t))) { return false; }
+
+    for (size_t i = 0; i < PERF_COUNTERS_COUNT; i++)
+    {
+        values[i] = perf.fds[i] >= 0 ? buffer[1 + perf.slots[i]] : 0;
+    }
+
+    return true;
+}
+
+#else
+
+bool perfOpen()
+{
+    return false;
+}
+
+void perfClose()
+{
+    perf = {};
+}
+
+bool readGroup(uint64_t* values)
+{
+    assert(values != NULL);
+    return false;
+}
+
+#endif
+
+bool perfIsOpen()
+{
+    return perf.leader >= 0;
+}
+
+void perfBegin(PerfPhase phase)
+{
+    assert(phase < PERF_PHASES_COUNT);
+
+    if (!perfIsOpen()) { return; }
+
+    readGroup(perf.starts[phase]);
+}
+
+//-----------------------------------------------------------------------------
+//! @param [in] phase
+//! @param [in] items number of nodes (or lookups) processed in the phase
+//-----------------------------------------------------------------------------
+void perfEnd(PerfPhase phase, size_t items)
+{
+    assert(phase < PERF_PHASES_COUNT);
+
+    if (!perfIsOpen()) { return; }
+
+    uint64_t values[PERF_COUNTERS_COUNT] = {};
+    if (!readGroup(values)) { return; }
+
+    PerfStats* stats = &perf.stats[phase];
+    for (size_t i = 0; i < PERF_COUNTERS_COUNT; i++)
+    {
+        stats->counters[i] += values[i] - perf.starts[phase][i];
+    }
+
+    stats->runs++;
+    stats->items += items;
+}
+
+PerfStats perfGetStats(PerfPhase phase)
+{
+    assert(phase < PERF_PHASES_COUNT);
+    return perf.stats[phase];
+}
+
+const char* perfPhaseName(PerfPhase phase)
+{
+    assert(phase < PERF_PHASES_COUNT);
+    return PERF_PHASE_NAMES[phase];
+}
+
+//-----------------------------------------------------------------------------
+//! Logs instructions per cycle and misses per item of every phase that has
+//! been run.
+//-----------------------------------------------------------------------------
+void perfReport()
+{
+    if (!perfIsOpen()) { return; }
+
+    for (size_t phase = 0; phase < PERF_PHASES_COUNT; phase++)
+    {
+        PerfStats stats = perf.stats[phase];
+        if (stats.runs == 0) { continue; }
+
+        double cycles       = (double) stats.counters[PERF_CYCLES];
+        double instructions = (double) stats.counters[PERF_INSTRUCTIONS];
+        double items        = stats.items != 0 ? (double) stats.items : 1;
+
+        LG_Write("Performance (%s): %lu runs, %lu items, %.0lf cycles, %.2lf IPC, "
+                 "%.2lf cache misses and %.2lf branch misses per item\n",
+                 LG_STYLE_CLASS_DEFAULT,
+                 PERF_PHASE_NAMES[phase],
+                 (unsigned long) stats.runs,
+                 (unsigned long) stats.items,
+                 cycles,
+                 cycles > 0 ? instructions / cycles : 0,
+                 stats.counters[PERF_CACHE_MISSES]  / items,
+                 stats.counters[PERF_BRANCH_MISSES] / items);
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+// Hardware counters of the calling thread. They are counted only on Linux
+// when compiled with PERF_PROFILING, otherwise perfOpen fails and the other
+// functions do nothing. Items are what a phase processes: nodes for load,
+// save and traversal, lookups for lookup.
+//-----------------------------------------------------------------------------
+enum PerfPhase
+{
+    PERF_LOAD,
+    PERF_SAVE,
+    PERF_LOOKUP,
+    PERF_TRAVERSAL,
+
+    PERF_PHASES_COUNT
+};
+
+enum PerfCounter
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+
+    PERF_COUNTERS_COUNT
+};
+
+struct PerfStats
+{
+    uint64_t counters[PERF_COUNTERS_COUNT] = {};
+    bool     available[PERF_COUNTERS_COUNT] = {};
+    size_t   runs  = 0;
+    size_t   items = 0;
+};
+
+bool        perfOpen      ();
+void        perfClose     ();
+bool        perfIsOpen    ();
+
+void        perfBegin     (PerfPhase phase);
+void        perfEnd       (PerfPhase phase, size_t items);
+
+PerfStats   perfGetStats  (PerfPhase phase);
+const char* perfPhaseName (PerfPhase phase);
+void        perfReport    ();
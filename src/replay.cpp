@@ -0,0 +1,295 @@
+//-----------------------------------------------------------------------------
+// Replays session transcripts against a database in parallel, e.g.
+//     replay.exe res/database.txt -j 8 res/*.transcript
+// Every transcript is replayed by its own non-persistent oracle, so the 
+// database isn't changed. Reports the number of dialogs per second and 
+// checks that every replay ends with the same tree as the recorded session.
+//
+// With -a definitions and comparisons of every transcript are replayed once
+// more after it, the buffers they are rendered into have been warmed up by
+// then, so the second pass has to render them without allocations. The
+// output goes through the UI pipeline then as in a real session, and built
+// with MEMORY_PROFILING every allocation made while a text is rendered and
+// said is counted. The counters are process-wide, so -a replays in one 
+// thread.
+//-----------------------------------------------------------------------------
+
+#include <assert.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "memory_tags.h"
+#include "oracle.h"
+#include "transcript.h"
+#include "ui.h"
+#include "../libs/log_generator.h"
+
+const size_t MAX_STR_SIZE = 256;
+
+struct ReplayJob
+{
+    const char*  databaseFileName = NULL;
+
+    Transcript** transcripts      = NULL;
+    const char** fileNames        = NULL;
+    size_t       transcriptsCount = 0;
+    size_t       nextTranscript   = 0;
+
+    size_t       dialogs          = 0;
+    size_t       matches          = 0;
+    size_t       mismatches       = 0;
+    size_t       unchecked        = 0;
+    size_t       failures         = 0;
+
+    bool         isRenderChecked  = false;
+    size_t       allocating       = 0;
+};
+
+void replayWorker     (ReplayJob* job);
+bool replayTranscript (ReplayJob* job, size_t index);
+bool replayDialogs    (Oracle* oracle, Transcript* transcript, bool isRenderingOnly);
+void replayDialog     (Oracle* oracle, TranscriptDialog dialog);
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s <database> [-j <threads>] [-a] <transcript>...\n", argv[0]);
+        return 1;
+    }
+
+    LG_Init();
+
+    ReplayJob job = {};
+    job.databaseFileName = argv[1];
+
+    size_t threadsCount = std::thread::hardware_concurrency();
+    int    firstFile    = 2;
+    if (strcmp(argv[firstFile], "-j") == 0 && argc > firstFile + 1)
+    {
+        threadsCount = strtoul(argv[firstFile + 1], NULL, 10);
+        firstFile   += 2;
+    }
+
+    if (firstFile < argc && strcmp(argv[firstFile], "-a") == 0)
+    {
+        job.isRenderChecked = true;
+        firstFile++;
+    }
+
+    if (threadsCount == 0 || job.isRenderChecked) { threadsCount = 1; }
+
+    if (job.isRenderChecked) { UI_SetOutput(UI_NullOutput()); }
+
+    job.transcripts = (Transcript**) calloc(argc, sizeof(Transcript*));
+    job.fileNames   = (const char**) calloc(argc, sizeof(const char*));
+    assert(job.transcripts != NULL);
+    assert(job.fileNames   != NULL);
+
+    for (int i = firstFile; i < argc; i++)
+    {
+        Transcript* transcript = loadTranscript(argv[i]);
+        if (transcript == NULL)
+        {
+            printf("Couldn't read transcript '%s'\n", argv[i]);
+            job.failures++;
+            continue;
+        }
+
+        job.fileNames[job.transcriptsCount]     = argv[i];
+        job.transcripts[job.transcriptsCount++] = transcript;
+    }
+
+    if (threadsCount > job.transcriptsCount) { threadsCount = job.transcriptsCount; }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread* threads = new std::thread[threadsCount];
+    for (size_t i = 0; i < threadsCount; i++)
+    {
+        threads[i] = std::thread(replayWorker, &job);
+    }
+
+    for (size_t i = 0; i < threadsCount; i++)
+    {
+        threads[i].join();
+    }
+
+    delete[] threads;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("Replayed %lu transcripts (%lu dialogs) with %lu threads in %.3lf s, %.0lf dialogs per second\n"
+           "Final trees: %lu match, %lu don't match, %lu unchecked, %lu transcripts couldn't be replayed\n",
+           (unsigned long) job.transcriptsCount,
+           (unsigned long) job.dialogs,
+           (unsigned long) threadsCount,
+           seconds,
+           seconds > 0 ? job.dialogs / seconds : 0,
+           (unsigned long) job.matches,
+           (unsigned long) job.mismatches,
+           (unsigned long) job.unchecked,
+           (unsigned long) job.failures);
+
+    if (job.isRenderChecked)
+    {
+        printf("Rendering after warm-up: %lu transcripts allocate\n", (unsigned long) job.allocating);
+    }
+
+    if (memIsProfiling())
+    {
+        printf("Peak memory:");
+        for (size_t tag = 0; tag < MEM_TAGS_COUNT; tag++)
+        {
+            printf(" %s %lu", memTagName((MemoryTag) tag), (unsigned long) memGetStats((MemoryTag) tag).peak);
+        }
+        printf(" bytes\n");
+
+        printf("Allocations:");
+        for (size_t tag = 0; tag < MEM_TAGS_COUNT; tag++)
+        {
+            printf(" %s %lu", memTagName((MemoryTag) tag), (unsigned long) memGetStats((MemoryTag) tag).allocations);
+        }
+        printf("\n");
+    }
+
+    for (size_t i = 0; i < job.transcriptsCount; i++)
+    {
+        deleteTranscript(job.transcripts[i]);
+    }
+
+    free(job.transcripts);
+    free(job.fileNames);
+
+    UI_Close();
+    LG_Close();
+
+    return job.mismatches == 0 && job.failures == 0 && job.allocating == 0 ? 0 : 1;
+}
+
+void replayWorker(ReplayJob* job)
+{
+    assert(job != NULL);
+
+    // rendering is checked with the shared pipeline, so that its allocations are seen
+    UI_OutputBackend output = UI_NullOutput();
+    if (!job->isRenderChecked) { UI_SetThreadOutput(&output); }
+
+    size_t index = 0;
+    while ((index = __atomic_fetch_add(&job->nextTranscript, 1, __ATOMIC_RELAXED)) < job->transcriptsCount)
+    {
+        if (!replayTranscript(job, index)) { __atomic_fetch_add(&job->failures, 1, __ATOMIC_RELAXED); }
+    }
+
+    UI_SetThreadOutput(NULL);
+}
+
+//-----------------------------------------------------------------------------
+//! @return false if the transcript couldn't be replayed at all.
+//-----------------------------------------------------------------------------
+bool replayTranscript(ReplayJob* job, size_t index)
+{
+    assert(job != NULL);
+
+    Transcript* transcript = job->transcripts[index];
+
+    Oracle* oracle = summonOracle(job->databaseFileName, UI_NewSpeaker(MAX_STR_SIZE, false), false);
+    if (oracle == NULL) { return false; }
+
+    bool isChecked = getStartHash(transcript) != TRANSCRIPT_NO_HASH;
+    if (isChecked && hashTree(getRoot(getTree(oracle))) != getStartHash(transcript))
+    {
+        printf("'%s' has been recorded with another database\n", job->fileNames[index]);
+        banishOracle(oracle);
+
+        return false;
+    }
+
+    if (!replayDialogs(oracle, transcript, false))
+    {
+        banishOracle(oracle);
+        return false;
+    }
+
+    __atomic_fetch_add(&job->dialogs, getDialogsCount(transcript), __ATOMIC_RELAXED);
+
+    if (!isChecked)
+    {
+        __atomic_fetch_add(&job->unchecked, 1, __ATOMIC_RELAXED);
+    }
+    else if (hashTree(getRoot(getTree(oracle))) == getFinalHash(transcript))
+    {
+        __atomic_fetch_add(&job->matches, 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        printf("'%s' has ended with another tree\n", job->fileNames[index]);
+        __atomic_fetch_add(&job->mismatches, 1, __ATOMIC_RELAXED);
+    }
+
+    if (job->isRenderChecked)
+    {
+        size_t allocations = renderAllocations(oracle);
+        if (!replayDialogs(oracle, transcript, true))
+        {
+            banishOracle(oracle);
+            return false;
+        }
+
+        if (renderAllocations(oracle) != allocations)
+        {
+            printf("'%s' allocates while rendering after warm-up\n", job->fileNames[index]);
+            __atomic_fetch_add(&job->allocating, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    banishOracle(oracle);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Replays the dialogs of the transcript with their recorded answers.
+//!
+//! @param [in] oracle
+//! @param [in] transcript
+//! @param [in] isRenderingOnly only definitions and comparisons are replayed,
+//!                             they don't change the tree
+//!
+//! @return false if out of memory.
+//-----------------------------------------------------------------------------
+bool replayDialogs(Oracle* oracle, Transcript* transcript, bool isRenderingOnly)
+{
+    assert(oracle     != NULL);
+    assert(transcript != NULL);
+
+    for (size_t i = 0; i < getDialogsCount(transcript); i++)
+    {
+        TranscriptDialog dialog = getDialog(transcript, i);
+        if (isRenderingOnly && dialog != TRANSCRIPT_DEFINITION && dialog != TRANSCRIPT_COMPARISON) { continue; }
+
+        UI_InputScript* script = UI_NewInputScript(getAnswers(transcript, i));
+        if (script == NULL) { return false; }
+
+        UI_SetInput(UI_ScriptInput(script));
+        replayDialog(oracle, dialog);
+        UI_DeleteInputScript(script);
+    }
+
+    return true;
+}
+
+void replayDialog(Oracle* oracle, TranscriptDialog dialog)
+{
+    assert(oracle != NULL);
+
+    switch (dialog)
+    {
+        case TRANSCRIPT_GAME:         game(oracle);               break;
+        case TRANSCRIPT_DEFINITION:   definitionDialog(oracle);   break;
+        case TRANSCRIPT_COMPARISON:   comparisonDialog(oracle);   break;
+        case TRANSCRIPT_OPTIMIZATION: optimizationDialog(oracle); break;
+    }
+}
@@ -0,0 +1,337 @@
+//-----------------------------------------------------------------------------
+// Serves games, definitions and comparisons from a read-only succinct copy
+// of a database, e.g.
+//     serve.exe res/database.txt
+// The pointer tree is deleted as soon as the copy is built, so a big
+// database takes a fraction of its memory. Nothing is learned and nothing
+// is written: the database, the statistics and the hits stay as they are.
+//-----------------------------------------------------------------------------
+
+#include <assert.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include "memory_tags.h"
+#include "oracle.h"
+#include "string_builder.h"
+#include "string_pool.h"
+#include "succinct_tree.h"
+#include "ui.h"
+#include "../libs/log_generator.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+const int    DIVIDER_SIZE = 50;
+const char   DIVIDER_SYMB = '=';
+const size_t MAX_STR_SIZE = 256;
+
+struct Server
+{
+    SuccinctTree*  tree         = NULL;
+    UI_Speaker*    speaker      = NULL;
+    StringBuilder* text         = NULL;
+
+    size_t*        path         = NULL;
+    size_t         pathCapacity = 0;
+};
+
+SuccinctTree* buildServedTree (const char* fileName);
+bool          dialogServe     (Server* server);
+void          serveGame       (Server* server);
+void          serveDefinition (Server* server);
+void          serveComparison (Server* server);
+size_t        askServedObject (Server* server, const char* message);
+void          servedPath      (Server* server, size_t start, size_t node, bool isNamed);
+size_t        collectServed   (Server* server, size_t start, size_t node);
+size_t        servedAncestor  (Server* server, size_t node1, size_t node2);
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        printf("Usage: %s <database>\n", argv[0]);
+        return 2;
+    }
+
+    LG_Init();
+
+    Server server = {};
+    server.tree    = buildServedTree(argv[1]);
+    server.speaker = UI_NewSpeaker(MAX_STR_SIZE, false);
+    server.text    = newStringBuilder(MAX_STR_SIZE);
+
+    int exitCode = 2;
+
+    if (server.tree != NULL && server.speaker != NULL && server.text != NULL)
+    {
+        while (dialogServe(&server)) {}
+
+        exitCode = 0;
+    }
+
+    if (server.tree    != NULL) { deleteSuccinctTree(server.tree); }
+    if (server.speaker != NULL) { UI_DeleteSpeaker(server.speaker); }
+    if (server.text    != NULL) { deleteStringBuilder(server.text); }
+    memFree(server.path);
+
+    UI_Close();
+    LG_Close();
+
+    return exitCode;
+}
+
+//-----------------------------------------------------------------------------
+//! Reads the database and builds its succinct copy, the oracle is banished
+//! right after that.
+//!
+//! @return the copy or NULL if the database couldn't be read or out of
+//! memory.
+//-----------------------------------------------------------------------------
+SuccinctTree* buildServedTree(const char* fileName)
+{
+    assert(fileName != NULL);
+
+    Oracle* oracle = summonOracle(fileName, UI_NewSpeaker(MAX_STR_SIZE, false), false);
+    if (oracle == NULL)
+    {
+        printf("Couldn't read '%s'\n", fileName);
+        return NULL;
+    }
+
+    BinaryTree* tree      = getTree(oracle);
+    size_t      objects   = getLeavesCount(getRoot(tree));
+    size_t      nodeBytes = objects * getLeafNodeSize() + (objects - 1) * getQuestionNodeSize();
+
+    auto start = std::chrono::steady_clock::now();
+
+    SuccinctTree* succinct = newSuccinctTree(getRoot(tree));
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (succinct == NULL)
+    {
+        printf("Not enough memory for the succinct tree\n");
+    }
+    else
+    {
+        size_t nodes = succinctNodesCount(succinct);
+
+        printf("Pointer tree: %lu nodes, %lu bytes of nodes and %lu bytes of strings\n"
+               "Succinct tree: %lu bytes of structure (%.2lf bits per node), %lu bytes of strings and "
+               "%lu bytes of names index (built in %.3lf ms)\n",
+               (unsigned long) nodes,
+               (unsigned long) nodeBytes,
+               (unsigned long) poolAllocated(getStringPool(tree)),
+               (unsigned long) succinctStructureBytes(succinct),
+               8.0 * succinctStructureBytes(succinct) / nodes,
+               (unsigned long) succinctStringsBytes(succinct),
+               (unsigned long) succinctIndexBytes(succinct),
+               milliseconds);
+    }
+
+    banishOracle(oracle);
+
+    return succinct;
+}
+
+//-----------------------------------------------------------------------------
+//! @return false when it's time to exit.
+//-----------------------------------------------------------------------------
+bool dialogServe(Server* server)
+{
+    assert(server != NULL);
+
+    UI_PrintDivider(DIVIDER_SIZE, DIVIDER_SYMB);
+
+    UI_PrintCentered(DIVIDER_SIZE, "Serving menu");
+    UI_PrintOptions("012x",
+                    "Game",
+                    "Definition",
+                    "Comparison",
+                    "EXIT");
+
+    UI_PrintDivider(DIVIDER_SIZE, DIVIDER_SYMB);
+
+    switch (UI_GetOption('0', '2', "x"))
+    {
+        case '0': serveGame(server);       break;
+        case '1': serveDefinition(server); break;
+        case '2': serveComparison(server); break;
+
+        case '\0': // no more input
+        case 'x':  return false;
+
+        default: break;
+    }
+
+    UI_Print("\n\n");
+
+    return true;
+}
+
+void serveGame(Server* server)
+{
+    assert(server != NULL);
+
+    size_t node = succinctRoot(server->tree);
+    while (succinctIsQuestion(server->tree, node))
+    {
+        UI_Say(server->speaker, "  -Is it %s?\n", succinctValue(server->tree, node));
+        char answer = UI_GetOption("yn");
+        UI_Print("\n");
+
+        node = answer == 'y' ? succinctRight(server->tree, node) : succinctLeft(server->tree, node);
+    }
+
+    UI_Say(server->speaker, "  -I know! You are thinking about... %s! Am I right?\n", succinctValue(server->tree, node));
+
+    if (UI_GetOption("yn") == 'y')
+    {
+        UI_Say(server->speaker, "  -I have won, as always!)\n");
+    }
+    else
+    {
+        UI_Say(server->speaker, "  -You got me :( But I can't learn anything new right now.\n");
+    }
+}
+
+void serveDefinition(Server* server)
+{
+    assert(server != NULL);
+
+    size_t object = askServedObject(server, "\n  -What object do you want the definition of? ");
+    if (object == SUCCINCT_NONE) { return; }
+
+    builderClear(server->text);
+    builderAppendStr(server->text, "  -");
+    servedPath(server, SUCCINCT_NONE, object, true);
+    builderAppendStr(server->text, "\n");
+
+    UI_SayText(server->speaker, builderData(server->text), builderLength(server->text));
+}
+
+void serveComparison(Server* server)
+{
+    assert(server != NULL);
+
+    size_t object1 = askServedObject(server, "\n  -What objects do you want the definition of?\n   Object1: ");
+    size_t object2 = askServedObject(server, "   Object2: ");
+    if (object1 == SUCCINCT_NONE || object2 == SUCCINCT_NONE) { return; }
+
+    size_t ancestor = servedAncestor(server, object1, object2);
+
+    builderClear(server->text);
+
+    if (ancestor != succinctRoot(server->tree))
+    {
+        builderAppendStr(server->text, "   They both are ");
+        servedPath(server, SUCCINCT_NONE, ancestor, false);
+        builderAppendStr(server->text, "\n   But ");
+    }
+
+    servedPath(server, ancestor, object1, true);
+    builderAppendStr(server->text, " and\n   ");
+    servedPath(server, ancestor, object2, true);
+
+    UI_SayText(server->speaker, builderData(server->text), builderLength(server->text));
+}
+
+//-----------------------------------------------------------------------------
+//! @return the object or SUCCINCT_NONE if it isn't known (it's said then).
+//-----------------------------------------------------------------------------
+size_t askServedObject(Server* server, const char* message)
+{
+    assert(server  != NULL);
+    assert(message != NULL);
+
+    char* name = UI_AskStr(server->speaker, MAX_STR_SIZE, message);
+    CHECK_NULL(name, return SUCCINCT_NONE);
+
+    size_t object = succinctFindObject(server->tree, name);
+    if (object == SUCCINCT_NONE)
+    {
+        UI_Say(server->speaker, "\n  -I don't know what/who '%s' is.\n", name);
+    }
+
+    memFree(name);
+
+    return object;
+}
+
+//-----------------------------------------------------------------------------
+//! Appends "<node> is <question>, not <question>, ..." with the questions
+//! from start (the root if it's SUCCINCT_NONE) down to the node, or just
+//! the questions if the node isn't named. As in the oracle's comparisons,
+//! the common ancestor is never named, even if both objects are the same.
+//-----------------------------------------------------------------------------
+void servedPath(Server* server, size_t start, size_t node, bool isNamed)
+{
+    assert(server != NULL);
+
+    size_t length = collectServed(server, start, node);
+    if (length == 0) { return; }
+
+    if (isNamed)
+    {
+        builderAppendStr(server->text, succinctValue(server->tree, node));
+        builderAppendStr(server->text, " is ");
+    }
+
+    for (size_t i = 0; i + 1 < length; i++)
+    {
+        if (i > 0) { builderAppendStr(server->text, ", "); }
+
+        if (succinctIsLeft(server->tree, server->path[i + 1])) { builderAppendStr(server->text, "not "); }
+
+        builderAppendStr(server->text, succinctValue(server->tree, server->path[i]));
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Puts the path from start down to node into server's path buffer.
+//!
+//! @return number of nodes in the path or 0 if out of memory.
+//-----------------------------------------------------------------------------
+size_t collectServed(Server* server, size_t start, size_t node)
+{
+    assert(server != NULL);
+
+    if (start == SUCCINCT_NONE) { start = succinctRoot(server->tree); }
+
+    size_t length = succinctDepth(server->tree, node) - succinctDepth(server->tree, start) + 1;
+    if (length > server->pathCapacity)
+    {
+        size_t* path = (size_t*) memRealloc(MEM_STACKS, server->path, length * sizeof(size_t));
+        CHECK_NULL(path, return 0);
+
+        server->path         = path;
+        server->pathCapacity = length;
+    }
+
+    for (size_t i = length; i > 0; i--)
+    {
+        server->path[i - 1] = node;
+        node = succinctParent(server->tree, node);
+    }
+
+    return length;
+}
+
+size_t servedAncestor(Server* server, size_t node1, size_t node2)
+{
+    assert(server != NULL);
+
+    size_t depth1 = succinctDepth(server->tree, node1);
+    size_t depth2 = succinctDepth(server->tree, node2);
+
+    for (; depth1 > depth2; depth1--) { node1 = succinctParent(server->tree, node1); }
+    for (; depth2 > depth1; depth2--) { node2 = succinctParent(server->tree, node2); }
+
+    while (node1 != node2)
+    {
+        node1 = succinctParent(server->tree, node1);
+        node2 = succinctParent(server->tree, node2);
+    }
+
+    return node1;
+}
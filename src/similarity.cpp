@@ -0,0 +1,378 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "similarity.h"
+#include "memory_tags.h"
+#include "../libs/file_manager.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+static const short  SIMILARITY_SIGNATURE           = 0x4D53; // "SM"
+static const short  SIMILARITY_VERSION             = 1;
+static const size_t SIMILARITY_MIN_ROWS_PER_THREAD = 64;
+
+//-----------------------------------------------------------------------------
+// Shared depth of two objects is the number of questions they have answered
+// the same way, i.e. the depth of their lowest common ancestor. The depth of
+// an object with itself is the length of its path.
+//
+// If objects are numbered in the traversal order, the common ancestor of the 
+// objects i < j is the highest question between them, so its depth is the
+// minimum of the adjacent depths (of objects k and k + 1) for i <= k < j. 
+// The adjacent depths are collected in one traversal, after that every row 
+// of the matrix is a running minimum, so rows are computed independently by
+// several threads.
+//
+// Only the upper triangle (with the diagonal) is stored, each element takes
+// as many bytes as the deepest object needs. The file is a header, names of
+// the objects (zero terminated) and the triangle row by row.
+//-----------------------------------------------------------------------------
+struct SimilarityHeader
+{
+    BinFileHeader binHeader    = {};
+    uint32_t      objectsCount = 0;
+    uint32_t      elementSize  = 0;
+};
+
+struct SimilarityMatrix
+{
+    BTNode**  objects       = NULL;
+    uint32_t* pathDepths    = NULL;
+    uint32_t* adjacent      = NULL;
+    size_t    count         = 0;
+
+    BTNode**  selected      = NULL; // sorted by address, NULL for all objects
+    size_t    selectedCount = 0;
+    uint32_t  pendingDepth  = 0;
+    uint32_t  maxDepth      = 0;
+
+    uint8_t*  elements      = NULL;
+    size_t    elementSize   = 0;
+
+    size_t    nextRow       = 0;
+};
+
+//-----------------------------------------------------------------------------
+// A node to be collected. A question is pushed once more as passed between 
+// its subtrees, its depth counts for the pending depth only then.
+//-----------------------------------------------------------------------------
+struct CollectStep
+{
+    BTNode*  node;
+    uint32_t depth;
+    bool     isPassed;
+};
+
+bool    collectObjects  (SimilarityMatrix* matrix, BTNode* root);
+void    collectObject   (SimilarityMatrix* matrix, BTNode* node, uint32_t depth);
+bool    isSelected      (SimilarityMatrix* matrix, BTNode* node);
+int     compareNodes    (const void* first, const void* second);
+size_t  rowStart        (SimilarityMatrix* matrix, size_t row);
+void    fillRow         (SimilarityMatrix* matrix, size_t row);
+void    fillRows        (SimilarityMatrix* matrix);
+
+//-----------------------------------------------------------------------------
+//! Computes shared depths of all pairs of objects.
+//!
+//! @param [in] root
+//! @param [in] objects      objects to compare or NULL for all objects of the
+//!                          tree, questions and objects not from this tree 
+//!                          are skipped
+//! @param [in] objectsCount
+//! @param [in] threadsCount 0 for the number of hardware threads
+//!
+//! @return matrix with the objects in the tree order or NULL if out of memory.
+//-----------------------------------------------------------------------------
+SimilarityMatrix* newSimilarityMatrix(BTNode* root, BTNode** objects, size_t objectsCount, size_t threadsCount)
+{
+    assert(root != NULL);
+    assert(objects != NULL || objectsCount == 0);
+
+    SimilarityMatrix* matrix = (SimilarityMatrix*) memAlloc(MEM_REPORTS, 1, sizeof(SimilarityMatrix));
+    CHECK_NULL(matrix, return NULL);
+
+    *matrix = {};
+
+    size_t capacity = getLeavesCount(root);
+    if (objects != NULL)
+    {
+        matrix->selected = (BTNode**) memAlloc(MEM_REPORTS, objectsCount, sizeof(BTNode*));
+        CHECK_NULL(matrix->selected, memFree(matrix); return NULL);
+
+        memcpy(matrix->selected, objects, objectsCount * sizeof(BTNode*));
+        qsort(matrix->selected, objectsCount, sizeof(BTNode*), &compareNodes);
+
+        matrix->selectedCount = objectsCount;
+        if (objectsCount < capacity) { capacity = objectsCount; }
+    }
+
+    matrix->objects    = (BTNode**)  memAlloc(MEM_REPORTS, capacity, sizeof(BTNode*));
+    matrix->pathDepths = (uint32_t*) memAlloc(MEM_REPORTS, capacity, sizeof(uint32_t));
+    matrix->adjacent   = (uint32_t*) memAlloc(MEM_REPORTS, capacity, sizeof(uint32_t));
+    if (matrix->objects == NULL || matrix->pathDepths == NULL || matrix->adjacent == NULL)
+    {
+        deleteSimilarityMatrix(matrix);
+        return NULL;
+    }
+
+    matrix->pendingDepth = UINT32_MAX;
+    if (!collectObjects(matrix, root))
+    {
+        deleteSimilarityMatrix(matrix);
+        return NULL;
+    }
+
+    memFree(matrix->selected);
+    matrix->selected = NULL;
+
+    matrix->elementSize = matrix->maxDepth <= UINT8_MAX  ? sizeof(uint8_t)  :
+                          matrix->maxDepth <= UINT16_MAX ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    matrix->elements = (uint8_t*) memAlloc(MEM_REPORTS, rowStart(matrix, matrix->count), matrix->elementSize);
+    if (matrix->elements == NULL && matrix->count != 0)
+    {
+        deleteSimilarityMatrix(matrix);
+        return NULL;
+    }
+
+    if (threadsCount == 0) { threadsCount = std::thread::hardware_concurrency(); }
+
+    size_t maxThreads = matrix->count / SIMILARITY_MIN_ROWS_PER_THREAD;
+    if (threadsCount > maxThreads) { threadsCount = maxThreads; }
+
+    // the calling thread takes rows too
+    std::thread* threads = threadsCount > 1 ? new std::thread[threadsCount - 1] : NULL;
+    for (size_t i = 0; i + 1 < threadsCount; i++)
+    {
+        threads[i] = std::thread(fillRows, matrix);
+    }
+
+    fillRows(matrix);
+
+    for (size_t i = 0; i + 1 < threadsCount; i++)
+    {
+        threads[i].join();
+    }
+
+    delete[] threads;
+
+    return matrix;
+}
+
+void deleteSimilarityMatrix(SimilarityMatrix* matrix)
+{
+    assert(matrix != NULL);
+
+    memFree(matrix->objects);
+    memFree(matrix->pathDepths);
+    memFree(matrix->adjacent);
+    memFree(matrix->selected);
+    memFree(matrix->elements);
+    memFree(matrix);
+}
+
+int compareNodes(const void* first, const void* second)
+{
+    uintptr_t node1 = (uintptr_t) *(BTNode* const*) first;
+    uintptr_t node2 = (uintptr_t) *(BTNode* const*) second;
+
+    return (node1 > node2) - (node1 < node2);
+}
+
+bool isSelected(SimilarityMatrix* matrix, BTNode* node)
+{
+    assert(matrix != NULL);
+
+    if (matrix->selected == NULL) { return true; }
+
+    return bsearch(&node, matrix->selected, matrix->selectedCount, sizeof(BTNode*), &compareNodes) != NULL;
+}
+
+//-----------------------------------------------------------------------------
+//! Collects selected objects in the traversal order (left, then right). 
+//! pendingDepth is the depth of the highest question passed since the last 
+//! collected object, which is their common ancestor. The tree is traversed
+//! with an explicit stack, so that degenerate trees don't overflow the 
+//! thread's stack.
+//!
+//! @return false if out of memory.
+//-----------------------------------------------------------------------------
+bool collectObjects(SimilarityMatrix* matrix, BTNode* root)
+{
+    assert(matrix != NULL);
+    assert(root != NULL);
+
+    CollectStep* stack         = NULL;
+    size_t       stackSize     = 0;
+    size_t       stackCapacity = 0;
+
+    if (!memReserve(MEM_STACKS, (void**) &stack, &stackCapacity, 1, sizeof(CollectStep))) { return false; }
+
+    stack[stackSize++] = { root, 0, false };
+
+    while (stackSize > 0)
+    {
+        CollectStep step = stack[--stackSize];
+
+        if (step.isPassed)
+        {
+            if (step.depth < matrix->pendingDepth) { matrix->pendingDepth = step.depth; }
+            continue;
+        }
+
+        if (!isQuestion(step.node))
+        {
+            collectObject(matrix, step.node, step.depth);
+            continue;
+        }
+
+        if (!memReserve(MEM_STACKS, (void**) &stack, &stackCapacity, stackSize + 3, sizeof(CollectStep)))
+        {
+            memFree(stack);
+            return false;
+        }
+
+        stack[stackSize++] = { getRight(step.node), step.depth + 1, false };
+        stack[stackSize++] = { step.node,           step.depth,     true  };
+        stack[stackSize++] = { getLeft(step.node),  step.depth + 1, false };
+    }
+
+    memFree(stack);
+
+    return true;
+}
+
+void collectObject(SimilarityMatrix* matrix, BTNode* node, uint32_t depth)
+{
+    assert(matrix != NULL);
+    assert(node != NULL);
+
+    if (!isSelected(matrix, node)) { return; }
+
+    if (matrix->count != 0) { matrix->adjacent[matrix->count - 1] = matrix->pendingDepth; }
+
+    matrix->objects[matrix->count]    = node;
+    matrix->pathDepths[matrix->count] = depth;
+    matrix->count++;
+
+    matrix->pendingDepth = UINT32_MAX;
+    if (depth > matrix->maxDepth) { matrix->maxDepth = depth; }
+}
+
+size_t rowStart(SimilarityMatrix* matrix, size_t row)
+{
+    assert(matrix != NULL);
+
+    return row * matrix->count - row * (row - 1) / 2;
+}
+
+void fillRow(SimilarityMatrix* matrix, size_t row)
+{
+    assert(matrix != NULL);
+
+    uint8_t* elements = matrix->elements + rowStart(matrix, row) * matrix->elementSize;
+    uint32_t depth    = matrix->pathDepths[row];
+
+    for (size_t column = row; column < matrix->count; column++)
+    {
+        if (column > row && matrix->adjacent[column - 1] < depth) { depth = matrix->adjacent[column - 1]; }
+
+        size_t index = column - row;
+        switch (matrix->elementSize)
+        {
+            case sizeof(uint8_t):  elements[index]               = (uint8_t)  depth; break;
+            case sizeof(uint16_t): ((uint16_t*) elements)[index] = (uint16_t) depth; break;
+            default:               ((uint32_t*) elements)[index] = depth;            break;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Takes rows one by one until there are none left. Rows get shorter towards
+//! the end, so they are handed out dynamically rather than in equal blocks.
+//-----------------------------------------------------------------------------
+void fillRows(SimilarityMatrix* matrix)
+{
+    assert(matrix != NULL);
+
+    size_t row = 0;
+    while ((row = __atomic_fetch_add(&matrix->nextRow, 1, __ATOMIC_RELAXED)) < matrix->count)
+    {
+        fillRow(matrix, row);
+    }
+}
+
+size_t similarityCount(SimilarityMatrix* matrix)
+{
+    assert(matrix != NULL);
+    return matrix->count;
+}
+
+BTNode* similarityObject(SimilarityMatrix* matrix, size_t index)
+{
+    assert(matrix != NULL);
+    assert(index < matrix->count);
+
+    return matrix->objects[index];
+}
+
+size_t sharedDepth(SimilarityMatrix* matrix, size_t first, size_t second)
+{
+    assert(matrix != NULL);
+    assert(first  < matrix->count);
+    assert(second < matrix->count);
+
+    if (first > second)
+    {
+        size_t temp = first;
+        first       = second;
+        second      = temp;
+    }
+
+    size_t index = rowStart(matrix, first) + second - first;
+    switch (matrix->elementSize)
+    {
+        case sizeof(uint8_t):  return matrix->elements[index];
+        case sizeof(uint16_t): return ((uint16_t*) matrix->elements)[index];
+        default:               return ((uint32_t*) matrix->elements)[index];
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! @return size of the stored triangle in bytes.
+//-----------------------------------------------------------------------------
+size_t similarityBytes(SimilarityMatrix* matrix)
+{
+    assert(matrix != NULL);
+    return rowStart(matrix, matrix->count) * matrix->elementSize;
+}
+
+bool saveSimilarityMatrix(SimilarityMatrix* matrix, const char* fileName)
+{
+    assert(matrix != NULL);
+    assert(fileName != NULL);
+
+    FILE* file = fopen(fileName, "wb");
+    CHECK_NULL(file, return false);
+
+    SimilarityHeader header = {};
+    header.binHeader.signature = SIMILARITY_SIGNATURE;
+    header.binHeader.version   = SIMILARITY_VERSION;
+    header.objectsCount        = (uint32_t) matrix->count;
+    header.elementSize         = (uint32_t) matrix->elementSize;
+
+    bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (size_t i = 0; i < matrix->count && isWritten; i++)
+    {
+        isWritten = fwrite(getValue(matrix->objects[i]), getValueLength(matrix->objects[i]) + 1, 1, file) == 1;
+    }
+
+    size_t bytes = similarityBytes(matrix);
+    if (isWritten && bytes != 0) { isWritten = fwrite(matrix->elements, bytes, 1, file) == 1; }
+
+    return fclose(file) == 0 && isWritten;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "binary_tree.h"
+
+struct SimilarityMatrix;
+
+SimilarityMatrix* newSimilarityMatrix    (BTNode* root, BTNode** objects, size_t objectsCount, size_t threadsCount);
+void              deleteSimilarityMatrix (SimilarityMatrix* matrix);
+
+size_t            similarityCount        (SimilarityMatrix* matrix);
+BTNode*           similarityObject       (SimilarityMatrix* matrix, size_t index);
+size_t            sharedDepth            (SimilarityMatrix* matrix, size_t first, size_t second);
+size_t            similarityBytes        (SimilarityMatrix* matrix);
+
+bool              saveSimilarityMatrix   (SimilarityMatrix* matrix, const char* fileName);
@@ -0,0 +1,418 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+#include "binary_tree.h"
+#include "memory_tags.h"
+#include "../libs/file_manager.h"
+#include "../libs/log_generator.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+static const short STATS_SIGNATURE = 0x534F; // "OS"
+static const short STATS_VERSION   = 1;
+
+struct StatsHeader
+{
+    BinFileHeader binHeader  = {};
+    uint32_t      nodesCount = 0;
+    uint32_t      generation = 0; // changes when the counters are moved, reset or grown
+};
+
+//-----------------------------------------------------------------------------
+// Counters are kept in a file mapped into memory, so every update is
+// persistent as soon as the OS flushes the page and nothing has to be written
+// on exit. Several sessions can map the same file, that's why all counters
+// are updated atomically (relaxed ordering is enough for counting).
+//
+// Resetting, growing and remapping the counters take the exclusive lock of
+// the file and change the generation in the header, counting takes the
+// shared one. A session that sees another generation maps the file again
+// before it counts, and the file never shrinks, so the old mappings stay
+// readable until then.
+//-----------------------------------------------------------------------------
+struct StatsFile
+{
+    #ifdef _WIN32
+    HANDLE       file    = INVALID_HANDLE_VALUE;
+    HANDLE       mapping = NULL;
+    #else
+    int          fd      = -1;
+    #endif
+
+    void*        view       = NULL;
+    size_t       viewSize   = 0;
+    uint32_t     generation = 0; // of the mapped counters
+
+    StatsHeader* header  = NULL;
+    NodeStats*   nodes   = NULL;
+};
+
+bool   mapStats    (StatsFile* stats, size_t nodesCount);
+void   unmapStats  (StatsFile* stats);
+bool   syncStats   (StatsFile* stats);
+void   resetStats  (StatsFile* stats, size_t fromId, size_t nodesCount);
+bool   lockStats   (StatsFile* stats, bool isExclusive);
+void   unlockStats (StatsFile* stats);
+size_t statsSize   (size_t nodesCount);
+
+size_t statsSize(size_t nodesCount)
+{
+    return sizeof(StatsHeader) + nodesCount * sizeof(NodeStats);
+}
+
+//-----------------------------------------------------------------------------
+//! Opens (or creates) statistics file for a tree with nodesCount nodes. If
+//! the file was made for a tree of different size (e.g. the database has been
+//! edited by hand) the counters are reset.
+//!
+//! @param [in] fileName
+//! @param [in] nodesCount
+//! @param [in] areIdsStable ids of the nodes never change (as in a paged
+//!                          database), so a smaller file has just been
+//!                          made before the tree has grown and is grown
+//!
+//! @return statistics or NULL if the file couldn't be mapped.
+//-----------------------------------------------------------------------------
+StatsFile* openStats(const char* fileName, size_t nodesCount, bool areIdsStable)
+{
+    assert(fileName != NULL);
+
+    StatsFile* stats = (StatsFile*) memAlloc(MEM_TREE, 1, sizeof(StatsFile));
+    CHECK_NULL(stats, return NULL);
+
+    *stats = {};
+
+    #ifdef _WIN32
+    stats->file = CreateFileA(fileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (stats->file == INVALID_HANDLE_VALUE)
+    #else
+    stats->fd = open(fileName, O_RDWR | O_CREAT, 0644);
+    if (stats->fd < 0)
+    #endif
+    {
+        LG_Write("ERROR: Couldn't open statistics file '%s'\n", LG_STYLE_CLASS_ERROR, fileName);
+        memFree(stats);
+
+        return NULL;
+    }
+
+    // the file is checked and fixed by one session at a time
+    if (!lockStats(stats, true))
+    {
+        LG_Write("ERROR: Couldn't lock statistics file '%s'\n", LG_STYLE_CLASS_ERROR, fileName);
+        closeStats(stats);
+
+        return NULL;
+    }
+
+    bool isNew    = getFileSize(fileName) < sizeof(StatsHeader);
+    bool isMapped = mapStats(stats, isNew ? nodesCount : 0);
+
+    // a truncated file would be mapped only partly
+    bool isBroken = isNew || !isMapped ||
+                    stats->header->binHeader.signature != STATS_SIGNATURE ||
+                    stats->header->binHeader.version   != STATS_VERSION   ||
+                    stats->viewSize < statsSize(stats->header->nodesCount);
+
+    size_t fileCount = isBroken ? 0 : stats->header->nodesCount;
+
+    if (isMapped && (isBroken || (fileCount != nodesCount && !areIdsStable)))
+    {
+        if (!isNew)
+        {
+            LG_Write("Statistics file '%s' doesn't match the database, counters are reset\n", LG_STYLE_CLASS_DEFAULT, fileName);
+        }
+
+        unmapStats(stats);
+        isMapped = mapStats(stats, nodesCount);
+
+        if (isMapped)
+        {
+            stats->header->binHeader.signature = STATS_SIGNATURE;
+            stats->header->binHeader.version   = STATS_VERSION;
+
+            resetStats(stats, 0, nodesCount);
+        }
+    }
+    else if (isMapped && fileCount < nodesCount)
+    {
+        unmapStats(stats);
+        isMapped = mapStats(stats, nodesCount);
+
+        if (isMapped) { resetStats(stats, fileCount, nodesCount); }
+    }
+
+    unlockStats(stats);
+
+    if (!isMapped)
+    {
+        closeStats(stats);
+        return NULL;
+    }
+
+    return stats;
+}
+
+void closeStats(StatsFile* stats)
+{
+    assert(stats != NULL);
+
+    unmapStats(stats);
+
+    #ifdef _WIN32
+    if (stats->file != INVALID_HANDLE_VALUE) { CloseHandle(stats->file); }
+    #else
+    if (stats->fd >= 0) { close(stats->fd); }
+    #endif
+
+    memFree(stats);
+}
+
+//-----------------------------------------------------------------------------
+//! Maps the file growing it to fit nodesCount nodes. If nodesCount is 0 the
+//! file is mapped with its current size. The file is never shrunk, other
+//! sessions may have mapped more of it.
+//-----------------------------------------------------------------------------
+bool mapStats(StatsFile* stats, size_t nodesCount)
+{
+    assert(stats != NULL);
+
+    #ifdef _WIN32
+    LARGE_INTEGER fileSize = {};
+    GetFileSizeEx(stats->file, &fileSize);
+    size_t size = nodesCount != 0 ? statsSize(nodesCount) : (size_t) fileSize.QuadPart;
+    if (size < sizeof(StatsHeader))        { size = sizeof(StatsHeader); }
+    if (size < (size_t) fileSize.QuadPart) { size = (size_t) fileSize.QuadPart; }
+
+    stats->mapping = CreateFileMappingA(stats->file, NULL, PAGE_READWRITE, 0, (DWORD) size, NULL);
+    CHECK_NULL(stats->mapping, return false);
+
+    stats->view = MapViewOfFile(stats->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    CHECK_NULL(stats->view, CloseHandle(stats->mapping); stats->mapping = NULL; return false);
+    #else
+    struct stat fileStat = {};
+    fstat(stats->fd, &fileStat);
+    size_t size = nodesCount != 0 ? statsSize(nodesCount) : (size_t) fileStat.st_size;
+    if (size < sizeof(StatsHeader))        { size = sizeof(StatsHeader); }
+    if (size < (size_t) fileStat.st_size) { size = (size_t) fileStat.st_size; }
+
+    if ((size_t) fileStat.st_size < size && ftruncate(stats->fd, size) != 0) { return false; }
+
+    stats->view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, stats->fd, 0);
+    if (stats->view == MAP_FAILED)
+    {
+        stats->view = NULL;
+        return false;
+    }
+    #endif
+
+    stats->viewSize   = size;
+    stats->header     = (StatsHeader*) stats->view;
+    stats->nodes      = (NodeStats*) (stats->header + 1);
+    stats->generation = __atomic_load_n(&stats->header->generation, __ATOMIC_ACQUIRE);
+
+    return true;
+}
+
+void unmapStats(StatsFile* stats)
+{
+    assert(stats != NULL);
+
+    #ifdef _WIN32
+    if (stats->view    != NULL) { UnmapViewOfFile(stats->view); }
+    if (stats->mapping != NULL) { CloseHandle(stats->mapping); }
+    stats->mapping = NULL;
+    #else
+    if (stats->view != NULL) { munmap(stats->view, stats->viewSize); }
+    #endif
+
+    stats->view     = NULL;
+    stats->viewSize = 0;
+    stats->header   = NULL;
+    stats->nodes    = NULL;
+}
+
+//-----------------------------------------------------------------------------
+//! Maps the file again if another session has changed the counters.
+//!
+//! @return false if the file couldn't be mapped, nothing is counted then.
+//-----------------------------------------------------------------------------
+bool syncStats(StatsFile* stats)
+{
+    assert(stats != NULL);
+
+    if (stats->header != NULL &&
+        __atomic_load_n(&stats->header->generation, __ATOMIC_ACQUIRE) == stats->generation)
+    {
+        return true;
+    }
+
+    unmapStats(stats);
+
+    return mapStats(stats, 0);
+}
+
+//-----------------------------------------------------------------------------
+//! Zeroes the counters from fromId on and makes nodesCount the number of the
+//! counters. The caller holds the exclusive lock.
+//-----------------------------------------------------------------------------
+void resetStats(StatsFile* stats, size_t fromId, size_t nodesCount)
+{
+    assert(stats != NULL);
+    assert(fromId <= nodesCount);
+    assert(statsSize(nodesCount) <= stats->viewSize);
+
+    for (size_t i = fromId; i < nodesCount; i++) { stats->nodes[i] = {}; }
+
+    stats->header->nodesCount = (uint32_t) nodesCount;
+    stats->generation         = stats->header->generation + 1;
+
+    __atomic_store_n(&stats->header->generation, stats->generation, __ATOMIC_RELEASE);
+}
+
+bool lockStats(StatsFile* stats, bool isExclusive)
+{
+    assert(stats != NULL);
+
+    #ifdef _WIN32
+    OVERLAPPED overlapped = {};
+    return LockFileEx(stats->file, isExclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, MAXDWORD, MAXDWORD, &overlapped) != 0;
+    #else
+    return flock(stats->fd, isExclusive ? LOCK_EX : LOCK_SH) == 0;
+    #endif
+}
+
+void unlockStats(StatsFile* stats)
+{
+    assert(stats != NULL);
+
+    #ifdef _WIN32
+    OVERLAPPED overlapped = {};
+    UnlockFileEx(stats->file, 0, MAXDWORD, MAXDWORD, &overlapped);
+    #else
+    flock(stats->fd, LOCK_UN);
+    #endif
+}
+
+//-----------------------------------------------------------------------------
+//! @return number of the counters, 0 if the file can't be mapped any more.
+//-----------------------------------------------------------------------------
+size_t statsCount(StatsFile* stats)
+{
+    assert(stats != NULL);
+
+    if (!syncStats(stats)) { return 0; }
+
+    return stats->header->nodesCount;
+}
+
+//-----------------------------------------------------------------------------
+//! Reads the counters without locking: the old mapping stays valid while
+//! another session changes them, the values are just a bit stale then.
+//!
+//! @return counters or zeros if the node has none (e.g. they have just been
+//! moved by another session).
+//-----------------------------------------------------------------------------
+NodeStats getStats(StatsFile* stats, size_t id)
+{
+    assert(stats != NULL);
+
+    NodeStats result = {};
+
+    // the header may already count the nodes of a bigger mapping of another session
+    if (!syncStats(stats) || id >= stats->header->nodesCount || statsSize(id + 1) > stats->viewSize) { return result; }
+
+    NodeStats* counters = &stats->nodes[id];
+
+    result.visits = __atomic_load_n(&counters->visits, __ATOMIC_RELAXED);
+    result.yes    = __atomic_load_n(&counters->yes,    __ATOMIC_RELAXED);
+    result.no     = __atomic_load_n(&counters->no,     __ATOMIC_RELAXED);
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//! Counts the visit under the shared lock, so the counters aren't moved by
+//! another session in the meantime.
+//-----------------------------------------------------------------------------
+void recordVisit(StatsFile* stats, size_t id, bool yes)
+{
+    assert(stats != NULL);
+
+    bool isLocked = lockStats(stats, false);
+
+    // node isn't saved yet (the view is checked too in case the file couldn't be locked)
+    if (id < statsCount(stats) && statsSize(id + 1) <= stats->viewSize)
+    {
+        NodeStats* counters = &stats->nodes[id];
+
+        __atomic_fetch_add(&counters->visits,                   1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(yes ? &counters->yes : &counters->no, 1, __ATOMIC_RELAXED);
+    }
+
+    if (isLocked) { unlockStats(stats); }
+}
+
+//-----------------------------------------------------------------------------
+//! Reorders the counters after the tree has been renumbered. The counters
+//! are rewritten under the exclusive lock, other sessions map them again
+//! before they count.
+//!
+//! @param [in] stats
+//! @param [in] oldIds   oldIds[newId] is the previous id of the node or
+//!                      BT_NO_ID for new nodes
+//! @param [in] newCount
+//!
+//! @return whether or not the counters have been remapped.
+//-----------------------------------------------------------------------------
+bool remapStats(StatsFile* stats, const size_t* oldIds, size_t newCount)
+{
+    assert(stats  != NULL);
+    assert(oldIds != NULL);
+
+    if (!lockStats(stats, true)) { return false; }
+
+    size_t oldCount   = statsCount(stats);
+    bool   isIdentity = oldCount == newCount && stats->header != NULL;
+    for (size_t i = 0; i < newCount && isIdentity; i++)
+    {
+        isIdentity = oldIds[i] == i;
+    }
+
+    NodeStats* remapped = isIdentity ? NULL : (NodeStats*) memAlloc(MEM_TREE, newCount, sizeof(NodeStats));
+    bool       isMapped = isIdentity;
+
+    for (size_t i = 0; i < newCount && remapped != NULL; i++)
+    {
+        if (oldIds[i] != BT_NO_ID && oldIds[i] < oldCount) { remapped[i] = getStats(stats, oldIds[i]); }
+    }
+
+    if (remapped != NULL)
+    {
+        unmapStats(stats);
+        isMapped = mapStats(stats, newCount);
+    }
+
+    if (remapped != NULL && isMapped)
+    {
+        memcpy(stats->nodes, remapped, newCount * sizeof(NodeStats));
+        resetStats(stats, newCount, newCount);
+    }
+
+    unlockStats(stats);
+    memFree(remapped);
+
+    return isMapped;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+//-----------------------------------------------------------------------------
+// For questions yes/no count the answers, for objects they count whether the
+// guess was right or wrong.
+//-----------------------------------------------------------------------------
+struct NodeStats
+{
+    uint32_t visits = 0;
+    uint32_t yes    = 0;
+    uint32_t no     = 0;
+};
+
+struct StatsFile;
+
+StatsFile* openStats    (const char* fileName, size_t nodesCount, bool areIdsStable);
+void       closeStats   (StatsFile* stats);
+
+size_t     statsCount   (StatsFile* stats);
+NodeStats  getStats     (StatsFile* stats, size_t id);
+void       recordVisit  (StatsFile* stats, size_t id, bool yes);
+bool       remapStats   (StatsFile* stats, const size_t* oldIds, size_t newCount);
@@ -0,0 +1,123 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "string_builder.h"
+#include "memory_tags.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+//-----------------------------------------------------------------------------
+// Growing buffer for text that is built piece by piece and then used at 
+// once. Clearing keeps the memory, so a builder that is reused doesn't
+// allocate anything after it has grown to the longest text.
+//-----------------------------------------------------------------------------
+struct StringBuilder
+{
+    char*  data        = NULL;
+    size_t length      = 0;
+    size_t capacity    = 0;
+    size_t allocations = 0;
+};
+
+bool reserveBuilder(StringBuilder* builder, size_t capacity);
+
+StringBuilder* newStringBuilder(size_t capacity)
+{
+    StringBuilder* builder = (StringBuilder*) memAlloc(MEM_STRINGS, 1, sizeof(StringBuilder));
+    CHECK_NULL(builder, return NULL);
+
+    *builder = {};
+
+    if (!reserveBuilder(builder, capacity != 0 ? capacity : 1))
+    {
+        memFree(builder);
+        return NULL;
+    }
+
+    builder->data[0] = '\0';
+
+    return builder;
+}
+
+void deleteStringBuilder(StringBuilder* builder)
+{
+    assert(builder != NULL);
+
+    memFree(builder->data);
+    memFree(builder);
+}
+
+bool reserveBuilder(StringBuilder* builder, size_t capacity)
+{
+    assert(builder != NULL);
+
+    if (capacity <= builder->capacity) { return true; }
+
+    size_t newCapacity = builder->capacity != 0 ? builder->capacity : capacity;
+    while (newCapacity < capacity) { newCapacity *= 2; }
+
+    char* data = (char*) memRealloc(MEM_STRINGS, builder->data, newCapacity);
+    CHECK_NULL(data, return false);
+
+    builder->data     = data;
+    builder->capacity = newCapacity;
+    builder->allocations++;
+
+    return true;
+}
+
+void builderClear(StringBuilder* builder)
+{
+    assert(builder != NULL);
+
+    builder->length  = 0;
+    builder->data[0] = '\0';
+}
+
+//-----------------------------------------------------------------------------
+//! Appends length characters of str.
+//!
+//! @return false if out of memory.
+//-----------------------------------------------------------------------------
+bool builderAppend(StringBuilder* builder, const char* str, size_t length)
+{
+    assert(builder != NULL);
+    assert(str     != NULL);
+
+    if (!reserveBuilder(builder, builder->length + length + 1)) { return false; }
+
+    memcpy(builder->data + builder->length, str, length);
+    builder->length += length;
+    builder->data[builder->length] = '\0';
+
+    return true;
+}
+
+bool builderAppendStr(StringBuilder* builder, const char* str)
+{
+    assert(builder != NULL);
+    assert(str     != NULL);
+
+    return builderAppend(builder, str, strlen(str));
+}
+
+const char* builderData(StringBuilder* builder)
+{
+    assert(builder != NULL);
+    return builder->data;
+}
+
+size_t builderLength(StringBuilder* builder)
+{
+    assert(builder != NULL);
+    return builder->length;
+}
+
+//-----------------------------------------------------------------------------
+//! @return how many times the buffer has been (re)allocated.
+//-----------------------------------------------------------------------------
+size_t builderAllocations(StringBuilder* builder)
+{
+    assert(builder != NULL);
+    return builder->allocations;
+}
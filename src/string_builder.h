@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+
+struct StringBuilder;
+
+StringBuilder* newStringBuilder    (size_t capacity);
+void           deleteStringBuilder (StringBuilder* builder);
+
+void           builderClear        (StringBuilder* builder);
+bool           builderAppend       (StringBuilder* builder, const char* str, size_t length);
+bool           builderAppendStr    (StringBuilder* builder, const char* str);
+
+const char*    builderData         (StringBuilder* builder);
+size_t         builderLength       (StringBuilder* builder);
+size_t         builderAllocations  (StringBuilder* builder);
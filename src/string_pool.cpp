@@ -0,0 +1,249 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "string_pool.h"
+#include "memory_tags.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+static const size_t POOL_BLOCK_SIZE         = 64 * 1024;
+static const size_t POOL_MIN_TABLE_CAPACITY = 64;
+
+//-----------------------------------------------------------------------------
+// Strings are copied at their exact length into big blocks that are freed
+// all at once together with the pool. Equal strings are stored only once,
+// they are found through an open addressing hash table.
+//-----------------------------------------------------------------------------
+struct PoolBlock
+{
+    PoolBlock* next = NULL;
+    size_t     size = 0;
+    size_t     used = 0;
+};
+
+struct PoolEntry
+{
+    uint32_t    hash = 0;
+    const char* str  = NULL;
+};
+
+struct StringPool
+{
+    PoolBlock* blocks        = NULL;
+
+    PoolEntry* table         = NULL;
+    size_t     tableCapacity = 0;
+    size_t     uniqueCount   = 0;
+
+    size_t     internCalls   = 0;
+    size_t     requested     = 0;
+    size_t     stored        = 0;
+    size_t     allocated     = 0;
+};
+
+char*    poolAlloc   (StringPool* pool, size_t size);
+bool     growTable   (StringPool* pool);
+
+StringPool* newStringPool()
+{
+    StringPool* pool = (StringPool*) memAlloc(MEM_STRINGS, 1, sizeof(StringPool));
+    CHECK_NULL(pool, return NULL);
+
+    *pool = {};
+
+    pool->table = (PoolEntry*) memAlloc(MEM_STRINGS, POOL_MIN_TABLE_CAPACITY, sizeof(PoolEntry));
+    CHECK_NULL(pool->table, memFree(pool); return NULL);
+
+    pool->tableCapacity = POOL_MIN_TABLE_CAPACITY;
+    pool->allocated     = POOL_MIN_TABLE_CAPACITY * sizeof(PoolEntry);
+
+    return pool;
+}
+
+void deleteStringPool(StringPool* pool)
+{
+    assert(pool != NULL);
+
+    PoolBlock* block = pool->blocks;
+    while (block != NULL)
+    {
+        PoolBlock* next = block->next;
+        memFree(block);
+        block = next;
+    }
+
+    memFree(pool->table);
+    memFree(pool);
+}
+
+//-----------------------------------------------------------------------------
+// FNV-1a
+//-----------------------------------------------------------------------------
+uint32_t hashString(const char* str, size_t length)
+{
+    assert(str != NULL);
+
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char) str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+char* poolAlloc(StringPool* pool, size_t size)
+{
+    assert(pool != NULL);
+
+    PoolBlock* block = pool->blocks;
+    if (block == NULL || block->size - block->used < size)
+    {
+        size_t blockSize = size > POOL_BLOCK_SIZE ? size : POOL_BLOCK_SIZE;
+
+        block = (PoolBlock*) memAlloc(MEM_STRINGS, 1, sizeof(PoolBlock) + blockSize);
+        CHECK_NULL(block, return NULL);
+
+        block->size = blockSize;
+        block->used = 0;
+
+        // a string that doesn't fit into the current block shouldn't waste the rest of it
+        if (pool->blocks != NULL && blockSize > POOL_BLOCK_SIZE)
+        {
+            block->next        = pool->blocks->next;
+            pool->blocks->next = block;
+        }
+        else
+        {
+            block->next  = pool->blocks;
+            pool->blocks = block;
+        }
+
+        pool->allocated += sizeof(PoolBlock) + blockSize;
+    }
+
+    char* memory = (char*) (block + 1) + block->used;
+    block->used += size;
+
+    return memory;
+}
+
+bool growTable(StringPool* pool)
+{
+    assert(pool != NULL);
+
+    size_t     newCapacity = pool->tableCapacity * 2;
+    PoolEntry* newTable    = (PoolEntry*) memAlloc(MEM_STRINGS, newCapacity, sizeof(PoolEntry));
+    CHECK_NULL(newTable, return false);
+
+    for (size_t i = 0; i < pool->tableCapacity; i++)
+    {
+        PoolEntry* entry = &pool->table[i];
+        if (entry->str == NULL) { continue; }
+
+        size_t index = entry->hash & (newCapacity - 1);
+        while (newTable[index].str != NULL) { index = (index + 1) & (newCapacity - 1); }
+
+        newTable[index] = *entry;
+    }
+
+    memFree(pool->table);
+
+    pool->allocated    += (newCapacity - pool->tableCapacity) * sizeof(PoolEntry);
+    pool->table         = newTable;
+    pool->tableCapacity = newCapacity;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Returns pool's copy of str. Equal strings get the same copy, so they can
+//! be compared by pointer.
+//!
+//! @param [in] pool
+//! @param [in] str
+//!
+//! @return copy that lives as long as the pool or NULL if out of memory.
+//-----------------------------------------------------------------------------
+const char* poolIntern(StringPool* pool, const char* str)
+{
+    assert(pool != NULL);
+    assert(str  != NULL);
+
+    size_t   length = strlen(str);
+    uint32_t hash   = hashString(str, length);
+
+    pool->internCalls++;
+    pool->requested += length + 1;
+
+    size_t index = hash & (pool->tableCapacity - 1);
+    while (pool->table[index].str != NULL)
+    {
+        PoolEntry* entry = &pool->table[index];
+        if (entry->hash == hash && strcmp(entry->str, str) == 0) { return entry->str; }
+
+        index = (index + 1) & (pool->tableCapacity - 1);
+    }
+
+    // keep load factor under 3/4, the table is grown before it's overfilled
+    if (4 * (pool->uniqueCount + 1) > 3 * pool->tableCapacity)
+    {
+        if (!growTable(pool)) { return NULL; }
+
+        index = hash & (pool->tableCapacity - 1);
+        while (pool->table[index].str != NULL) { index = (index + 1) & (pool->tableCapacity - 1); }
+    }
+
+    char* copy = poolAlloc(pool, length + 1);
+    CHECK_NULL(copy, return NULL);
+
+    memcpy(copy, str, length + 1);
+
+    pool->table[index].hash = hash;
+    pool->table[index].str  = copy;
+    pool->uniqueCount++;
+    pool->stored += length + 1;
+
+    return copy;
+}
+
+size_t poolInternCalls(StringPool* pool)
+{
+    assert(pool != NULL);
+    return pool->internCalls;
+}
+
+size_t poolUniqueCount(StringPool* pool)
+{
+    assert(pool != NULL);
+    return pool->uniqueCount;
+}
+
+//-----------------------------------------------------------------------------
+//! @return total size of all strings passed to poolIntern.
+//-----------------------------------------------------------------------------
+size_t poolRequested(StringPool* pool)
+{
+    assert(pool != NULL);
+    return pool->requested;
+}
+
+//-----------------------------------------------------------------------------
+//! @return total size of unique strings stored.
+//-----------------------------------------------------------------------------
+size_t poolStored(StringPool* pool)
+{
+    assert(pool != NULL);
+    return pool->stored;
+}
+
+//-----------------------------------------------------------------------------
+//! @return memory taken by the pool including the hash table.
+//-----------------------------------------------------------------------------
+size_t poolAllocated(StringPool* pool)
+{
+    assert(pool != NULL);
+    return pool->allocated;
+}
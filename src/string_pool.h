@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct StringPool;
+
+StringPool* newStringPool    ();
+void        deleteStringPool (StringPool* pool);
+
+const char* poolIntern       (StringPool* pool, const char* str);
+uint32_t    hashString       (const char* str, size_t length);
+
+size_t      poolInternCalls  (StringPool* pool);
+size_t      poolUniqueCount  (StringPool* pool);
+size_t      poolRequested    (StringPool* pool);
+size_t      poolStored       (StringPool* pool);
+size_t      poolAllocated    (StringPool* pool);
@@ -0,0 +1,813 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "succinct_tree.h"
+#include "lookup_index.h"
+#include "memory_tags.h"
+#include "string_builder.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+static const size_t SUCCINCT_WORD_BITS     = 64;
+static const size_t SUCCINCT_BLOCK_WORDS   = 8;
+static const size_t SUCCINCT_BLOCK_BITS    = SUCCINCT_WORD_BITS * SUCCINCT_BLOCK_WORDS;
+static const size_t SUCCINCT_STRINGS_BLOCK = 16;
+static const size_t SUCCINCT_MAX_PREFIX    = 255;
+
+//-----------------------------------------------------------------------------
+// A node is '(' (bit 1), its right subtree, its left subtree and ')' (bit 0),
+// so the node's right child is the next position, its left child follows
+// the right subtree and its preorder number is the number of '(' before it.
+//
+// Excess of a position is the number of '(' minus the number of ')' up to
+// it (inclusive), the depth of a node is the excess at it minus one. The
+// end of a subtree and the parent are found as the nearest positions with
+// some excess: every word keeps the minimum excess in it relative to the
+// excess before the word, every block of words keeps its absolute minimum
+// in a complete binary tree of minimums. A search looks through the words
+// of one block, then goes up and down the tree of minimums to the block
+// with the position and looks through its words, so it takes O(log n)
+// steps in the worst case and only a few words for the nodes near each
+// other. Ranks (the number of '(' before every block) make the excess O(1).
+//
+// Values are stored in preorder, every SUCCINCT_STRINGS_BLOCK-th one as it
+// is and the others as the length of the prefix shared with the previous
+// value (a byte) and the rest of the value, all of them zero terminated.
+// Only the offsets of the blocks are kept, a value is decoded from the
+// start of its block.
+//
+// Objects are found by their normalized values (see lookup_index.h) with a
+// binary search in the positions of the objects sorted by these values.
+//-----------------------------------------------------------------------------
+struct SuccinctTree
+{
+    uint64_t* bits            = NULL;
+    size_t    bitsCount       = 0;
+    size_t    wordsCount      = 0;
+
+    uint32_t* ranks           = NULL;
+    int8_t*   wordMins        = NULL;
+    int32_t*  blockMins       = NULL; // node i has children 2i and 2i + 1, blocks start at leavesCount
+    size_t    blocksCount     = 0;
+    size_t    leavesCount     = 0;
+    int8_t    byteMins[256]   = {}; // wordMins and wordExcess for every byte value
+    int8_t    byteExcess[256] = {};
+
+    char*     strings         = NULL;
+    size_t    stringsSize     = 0;
+    uint32_t* offsets         = NULL;
+    char*     value           = NULL; // the longest value fits
+    size_t    nodesCount      = 0;
+
+    uint32_t* objects         = NULL;
+    size_t    objectsCount    = 0;
+    char*     query           = NULL;
+    size_t    querySize       = 0;
+};
+
+struct ObjectKey
+{
+    const char* key      = NULL;
+    uint32_t    position = 0;
+};
+
+//-----------------------------------------------------------------------------
+// State of the construction: the next position and preorder number, the
+// value encoded last and the keys of the objects for the names index.
+//-----------------------------------------------------------------------------
+struct SuccinctBuilder
+{
+    SuccinctTree*  tree      = NULL;
+    StringBuilder* strings   = NULL;
+    size_t         position  = 0;
+    size_t         rank      = 0;
+    const char*    previous  = NULL;
+
+    ObjectKey*     keys      = NULL;
+    char*          keysText  = NULL;
+    size_t         keysSize  = 0;
+};
+
+bool     measureStep      (BTNode* node, va_list args);
+bool     appendNode       (SuccinctBuilder* builder, BTNode* node);
+bool     appendValue      (SuccinctBuilder* builder, BTNode* node);
+bool     buildDirectory   (SuccinctTree* tree);
+bool     buildObjectIndex (SuccinctTree* tree, SuccinctBuilder* builder);
+int      compareKeys      (const void* first, const void* second);
+
+bool     getBit           (SuccinctTree* tree, size_t position);
+size_t   rank1            (SuccinctTree* tree, size_t position);
+int32_t  excessBefore     (SuccinctTree* tree, size_t position);
+int32_t  wordExcess       (SuccinctTree* tree, size_t word);
+size_t   searchForward    (SuccinctTree* tree, size_t from, int32_t target);
+size_t   searchBackward   (SuccinctTree* tree, size_t before, int32_t target);
+size_t   scanForward      (SuccinctTree* tree, size_t from, size_t end, int32_t* excess, int32_t target);
+size_t   scanBackward     (SuccinctTree* tree, size_t before, size_t start, int32_t* excess, int32_t target);
+size_t   wordEnd          (SuccinctTree* tree, size_t word);
+size_t   nextBlock        (SuccinctTree* tree, size_t block, int32_t target);
+size_t   previousBlock    (SuccinctTree* tree, size_t block, int32_t target);
+size_t   findClose        (SuccinctTree* tree, size_t node);
+
+const char* decodeValue   (SuccinctTree* tree, size_t rank);
+
+//-----------------------------------------------------------------------------
+//! Builds the succinct copy of the tree, the tree itself isn't needed after
+//! that.
+//!
+//! @return the copy or NULL if out of memory.
+//-----------------------------------------------------------------------------
+SuccinctTree* newSuccinctTree(BTNode* root)
+{
+    assert(root != NULL);
+
+    size_t nodesCount  = 0;
+    size_t maxLength   = 0;
+    size_t objectBytes = 0;
+    preOrderTraverse(root, measureStep, &nodesCount, &maxLength, &objectBytes);
+
+    // positions are kept in 32 bits
+    assert(nodesCount < UINT32_MAX / 2);
+
+    SuccinctTree* tree = (SuccinctTree*) memAlloc(MEM_TREE, 1, sizeof(SuccinctTree));
+    CHECK_NULL(tree, return NULL);
+
+    *tree = {};
+    tree->nodesCount = nodesCount;
+    tree->bitsCount  = 2 * nodesCount;
+    tree->wordsCount = (tree->bitsCount + SUCCINCT_WORD_BITS - 1) / SUCCINCT_WORD_BITS;
+
+    tree->bits    = (uint64_t*) memAlloc(MEM_TREE,    tree->wordsCount, sizeof(uint64_t));
+    tree->offsets = (uint32_t*) memAlloc(MEM_STRINGS, (nodesCount + SUCCINCT_STRINGS_BLOCK - 1) / SUCCINCT_STRINGS_BLOCK, sizeof(uint32_t));
+    tree->value   = (char*)     memAlloc(MEM_STRINGS, maxLength + 1, sizeof(char));
+
+    SuccinctBuilder builder = {};
+    builder.tree     = tree;
+    builder.strings  = newStringBuilder(objectBytes);
+    builder.keys     = (ObjectKey*) memAlloc(MEM_INDEXES, (nodesCount + 1) / 2, sizeof(ObjectKey));
+    builder.keysText = (char*)      memAlloc(MEM_INDEXES, objectBytes, sizeof(char));
+
+    bool isBuilt = tree->bits != NULL && tree->offsets != NULL && tree->value != NULL && builder.strings != NULL &&
+                   builder.keys != NULL && builder.keysText != NULL && appendNode(&builder, root);
+
+    if (isBuilt)
+    {
+        tree->stringsSize = builderLength(builder.strings);
+        tree->strings     = (char*) memAlloc(MEM_STRINGS, tree->stringsSize, sizeof(char));
+
+        isBuilt = tree->strings != NULL;
+        if (isBuilt) { memcpy(tree->strings, builderData(builder.strings), tree->stringsSize); }
+    }
+
+    isBuilt = isBuilt && buildDirectory(tree) && buildObjectIndex(tree, &builder);
+
+    if (builder.strings != NULL) { deleteStringBuilder(builder.strings); }
+    memFree(builder.keys);
+    memFree(builder.keysText);
+
+    if (!isBuilt)
+    {
+        deleteSuccinctTree(tree);
+        return NULL;
+    }
+
+    return tree;
+}
+
+void deleteSuccinctTree(SuccinctTree* tree)
+{
+    assert(tree != NULL);
+
+    memFree(tree->bits);
+    memFree(tree->ranks);
+    memFree(tree->wordMins);
+    memFree(tree->blockMins);
+    memFree(tree->strings);
+    memFree(tree->offsets);
+    memFree(tree->value);
+    memFree(tree->objects);
+    memFree(tree->query);
+    memFree(tree);
+}
+
+bool measureStep(BTNode* node, va_list args)
+{
+    assert(node != NULL);
+
+    size_t* nodesCount  = va_arg(args, size_t*);
+    size_t* maxLength   = va_arg(args, size_t*);
+    size_t* objectBytes = va_arg(args, size_t*);
+
+    (*nodesCount)++;
+    if (getValueLength(node) > *maxLength) { *maxLength = getValueLength(node); }
+    if (!isQuestion(node))                 { *objectBytes += getValueLength(node) + 1; }
+
+    return BT_TRAVERSE_RUN;
+}
+
+bool appendNode(SuccinctBuilder* builder, BTNode* node)
+{
+    assert(builder != NULL);
+    assert(node    != NULL);
+
+    size_t position = builder->position++;
+    builder->tree->bits[position / SUCCINCT_WORD_BITS] |= 1ull << (position % SUCCINCT_WORD_BITS);
+
+    if (!appendValue(builder, node)) { return false; }
+
+    if (isQuestion(node))
+    {
+        if (!appendNode(builder, getRight(node)) || !appendNode(builder, getLeft(node))) { return false; }
+    }
+    else
+    {
+        ObjectKey* key = &builder->keys[builder->tree->objectsCount++];
+        key->key       = builder->keysText + builder->keysSize;
+        key->position  = (uint32_t) position;
+
+        builder->keysSize += normalizeKey(getValue(node), builder->keysText + builder->keysSize) + 1;
+    }
+
+    // ')' is already 0
+    builder->position++;
+
+    return true;
+}
+
+bool appendValue(SuccinctBuilder* builder, BTNode* node)
+{
+    assert(builder != NULL);
+    assert(node    != NULL);
+
+    size_t      rank   = builder->rank++;
+    const char* value  = getValue(node);
+    size_t      length = getValueLength(node);
+    size_t      prefix = 0;
+
+    if (rank % SUCCINCT_STRINGS_BLOCK == 0)
+    {
+        builder->tree->offsets[rank / SUCCINCT_STRINGS_BLOCK] = (uint32_t) builderLength(builder->strings);
+    }
+    else
+    {
+        while (prefix < length && prefix < SUCCINCT_MAX_PREFIX && builder->previous[prefix] == value[prefix]) { prefix++; }
+
+        char prefixByte = (char) prefix;
+        if (!builderAppend(builder->strings, &prefixByte, 1)) { return false; }
+    }
+
+    builder->previous = value;
+
+    return builderAppend(builder->strings, value + prefix, length - prefix + 1);
+}
+
+//-----------------------------------------------------------------------------
+//! Counts the ranks and the minimum excesses of the words and the blocks.
+//-----------------------------------------------------------------------------
+bool buildDirectory(SuccinctTree* tree)
+{
+    assert(tree != NULL);
+
+    tree->blocksCount = (tree->wordsCount + SUCCINCT_BLOCK_WORDS - 1) / SUCCINCT_BLOCK_WORDS;
+    tree->leavesCount = 1;
+    while (tree->leavesCount < tree->blocksCount) { tree->leavesCount *= 2; }
+
+    tree->ranks     = (uint32_t*) memAlloc(MEM_TREE, tree->blocksCount + 1,   sizeof(uint32_t));
+    tree->wordMins  = (int8_t*)   memAlloc(MEM_TREE, tree->wordsCount,        sizeof(int8_t));
+    tree->blockMins = (int32_t*)  memAlloc(MEM_TREE, 2 * tree->leavesCount,   sizeof(int32_t));
+    if (tree->ranks == NULL || tree->wordMins == NULL || tree->blockMins == NULL) { return false; }
+
+    for (size_t i = 0; i < 2 * tree->leavesCount; i++) { tree->blockMins[i] = INT32_MAX; }
+
+    for (size_t byte = 0; byte < 256; byte++)
+    {
+        int32_t excess  = 0;
+        int32_t minimum = INT32_MAX;
+        for (size_t bit = 0; bit < 8; bit++)
+        {
+            excess += (byte >> bit) & 1 ? 1 : -1;
+            if (excess < minimum) { minimum = excess; }
+        }
+
+        tree->byteMins[byte]   = (int8_t) minimum;
+        tree->byteExcess[byte] = (int8_t) excess;
+    }
+
+    uint32_t rank   = 0;
+    int32_t  excess = 0;
+    for (size_t word = 0; word < tree->wordsCount; word++)
+    {
+        size_t block = word / SUCCINCT_BLOCK_WORDS;
+        if (word % SUCCINCT_BLOCK_WORDS == 0) { tree->ranks[block] = rank; }
+
+        int32_t start   = excess;
+        int32_t minimum = INT32_MAX;
+        for (size_t position = word * SUCCINCT_WORD_BITS; position < (word + 1) * SUCCINCT_WORD_BITS && position < tree->bitsCount; position++)
+        {
+            excess += getBit(tree, position) ? 1 : -1;
+            if (excess < minimum) { minimum = excess; }
+        }
+
+        rank += (uint32_t) __builtin_popcountll(tree->bits[word]);
+
+        tree->wordMins[word] = (int8_t) (minimum - start);
+        if (minimum < tree->blockMins[tree->leavesCount + block]) { tree->blockMins[tree->leavesCount + block] = minimum; }
+    }
+
+    tree->ranks[tree->blocksCount] = rank;
+
+    for (size_t i = tree->leavesCount - 1; i > 0; i--)
+    {
+        tree->blockMins[i] = tree->blockMins[2 * i] < tree->blockMins[2 * i + 1] ? tree->blockMins[2 * i] : tree->blockMins[2 * i + 1];
+    }
+
+    return true;
+}
+
+bool buildObjectIndex(SuccinctTree* tree, SuccinctBuilder* builder)
+{
+    assert(tree    != NULL);
+    assert(builder != NULL);
+
+    tree->objects = (uint32_t*) memAlloc(MEM_INDEXES, tree->objectsCount, sizeof(uint32_t));
+    CHECK_NULL(tree->objects, return false);
+
+    qsort(builder->keys, tree->objectsCount, sizeof(ObjectKey), compareKeys);
+
+    for (size_t i = 0; i < tree->objectsCount; i++) { tree->objects[i] = builder->keys[i].position; }
+
+    return true;
+}
+
+int compareKeys(const void* first, const void* second)
+{
+    assert(first  != NULL);
+    assert(second != NULL);
+
+    return strcmp(((const ObjectKey*) first)->key, ((const ObjectKey*) second)->key);
+}
+
+size_t succinctRoot(SuccinctTree* tree)
+{
+    assert(tree != NULL);
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+//! @return the "yes" child or SUCCINCT_NONE for an object.
+//-----------------------------------------------------------------------------
+size_t succinctRight(SuccinctTree* tree, size_t node)
+{
+    assert(tree != NULL);
+    assert(node < tree->bitsCount);
+
+    return succinctIsQuestion(tree, node) ? node + 1 : SUCCINCT_NONE;
+}
+
+//-----------------------------------------------------------------------------
+//! @return the "no" child or SUCCINCT_NONE for an object.
+//-----------------------------------------------------------------------------
+size_t succinctLeft(SuccinctTree* tree, size_t node)
+{
+    assert(tree != NULL);
+    assert(node < tree->bitsCount);
+
+    return succinctIsQuestion(tree, node) ? findClose(tree, node + 1) + 1 : SUCCINCT_NONE;
+}
+
+//-----------------------------------------------------------------------------
+//! @return the parent or SUCCINCT_NONE for the root.
+//-----------------------------------------------------------------------------
+size_t succinctParent(SuccinctTree* tree, size_t node)
+{
+    assert(tree != NULL);
+    assert(node < tree->bitsCount);
+
+    if (node == 0) { return SUCCINCT_NONE; }
+
+    // the right child follows its parent
+    if (getBit(tree, node - 1)) { return node - 1; }
+
+    // the left child follows the right subtree, the parent is just before 
+    // the excess gets lower than before the left child by one
+    return searchBackward(tree, node, excessBefore(tree, node) - 1);
+}
+
+bool succinctIsQuestion(SuccinctTree* tree, size_t node)
+{
+    assert(tree != NULL);
+    assert(node < tree->bitsCount);
+
+    // an object is "()"
+    return getBit(tree, node + 1);
+}
+
+//-----------------------------------------------------------------------------
+//! @return whether or not the node is the "no" child of its parent.
+//-----------------------------------------------------------------------------
+bool succinctIsLeft(SuccinctTree* tree, size_t node)
+{
+    assert(tree != NULL);
+    assert(node < tree->bitsCount);
+
+    return node != 0 && !getBit(tree, node - 1);
+}
+
+size_t succinctDepth(SuccinctTree* tree, size_t node)
+{
+    assert(tree != NULL);
+    assert(node < tree->bitsCount);
+
+    return (size_t) excessBefore(tree, node);
+}
+
+//-----------------------------------------------------------------------------
+//! @return number of nodes in the subtree including the node itself.
+//-----------------------------------------------------------------------------
+size_t succinctSubtreeSize(SuccinctTree* tree, size_t node)
+{
+    assert(tree != NULL);
+    assert(node < tree->bitsCount);
+
+    return (findClose(tree, node) - node + 1) / 2;
+}
+
+//-----------------------------------------------------------------------------
+//! @return the value decoded into the tree's buffer, it's overwritten by the
+//! next call.
+//-----------------------------------------------------------------------------
+const char* succinctValue(SuccinctTree* tree, size_t node)
+{
+    assert(tree != NULL);
+    assert(node < tree->bitsCount);
+
+    return decodeValue(tree, rank1(tree, node));
+}
+
+//-----------------------------------------------------------------------------
+//! Finds an object ignoring case and extra whitespace.
+//!
+//! @return the first object with the value or SUCCINCT_NONE.
+//-----------------------------------------------------------------------------
+size_t succinctFindObject(SuccinctTree* tree, const char* value)
+{
+    assert(tree  != NULL);
+    assert(value != NULL);
+
+    size_t length = strlen(value);
+    if (length + 1 > tree->querySize)
+    {
+        char* query = (char*) memRealloc(MEM_INDEXES, tree->query, length + 1);
+        CHECK_NULL(query, return SUCCINCT_NONE);
+
+        tree->query     = query;
+        tree->querySize = length + 1;
+    }
+
+    normalizeKey(value, tree->query);
+
+    size_t first = 0;
+    size_t last  = tree->objectsCount;
+    while (first < last)
+    {
+        size_t middle = first + (last - first) / 2;
+
+        char* key = (char*) succinctValue(tree, tree->objects[middle]);
+        normalizeKey(key, key);
+
+        if (strcmp(key, tree->query) < 0) { first = middle + 1; }
+        else                              { last  = middle; }
+    }
+
+    if (first == tree->objectsCount) { return SUCCINCT_NONE; }
+
+    char* key = (char*) succinctValue(tree, tree->objects[first]);
+    normalizeKey(key, key);
+
+    return strcmp(key, tree->query) == 0 ? tree->objects[first] : SUCCINCT_NONE;
+}
+
+size_t succinctNodesCount(SuccinctTree* tree)
+{
+    assert(tree != NULL);
+    return tree->nodesCount;
+}
+
+//-----------------------------------------------------------------------------
+//! @return bytes taken by the parentheses, the ranks and the minimums.
+//-----------------------------------------------------------------------------
+size_t succinctStructureBytes(SuccinctTree* tree)
+{
+    assert(tree != NULL);
+
+    return tree->wordsCount * (sizeof(uint64_t) + sizeof(int8_t)) +
+           (tree->blocksCount + 1) * sizeof(uint32_t) +
+           2 * tree->leavesCount * sizeof(int32_t);
+}
+
+size_t succinctStringsBytes(SuccinctTree* tree)
+{
+    assert(tree != NULL);
+
+    return tree->stringsSize + (tree->nodesCount + SUCCINCT_STRINGS_BLOCK - 1) / SUCCINCT_STRINGS_BLOCK * sizeof(uint32_t);
+}
+
+size_t succinctIndexBytes(SuccinctTree* tree)
+{
+    assert(tree != NULL);
+    return tree->objectsCount * sizeof(uint32_t);
+}
+
+bool getBit(SuccinctTree* tree, size_t position)
+{
+    assert(tree != NULL);
+    assert(position < tree->bitsCount);
+
+    return (tree->bits[position / SUCCINCT_WORD_BITS] >> (position % SUCCINCT_WORD_BITS)) & 1;
+}
+
+//-----------------------------------------------------------------------------
+//! @return number of '(' before the position.
+//-----------------------------------------------------------------------------
+size_t rank1(SuccinctTree* tree, size_t position)
+{
+    assert(tree != NULL);
+    assert(position <= tree->bitsCount);
+
+    size_t word = position / SUCCINCT_WORD_BITS;
+    size_t rank = tree->ranks[position / SUCCINCT_BLOCK_BITS];
+
+    for (size_t i = word / SUCCINCT_BLOCK_WORDS * SUCCINCT_BLOCK_WORDS; i < word; i++)
+    {
+        rank += (size_t) __builtin_popcountll(tree->bits[i]);
+    }
+
+    if (position % SUCCINCT_WORD_BITS != 0)
+    {
+        rank += (size_t) __builtin_popcountll(tree->bits[word] & ((1ull << (position % SUCCINCT_WORD_BITS)) - 1));
+    }
+
+    return rank;
+}
+
+//-----------------------------------------------------------------------------
+//! @return excess at the position before this one, 0 for the first one.
+//-----------------------------------------------------------------------------
+int32_t excessBefore(SuccinctTree* tree, size_t position)
+{
+    assert(tree != NULL);
+    return 2 * (int32_t) rank1(tree, position) - (int32_t) position;
+}
+
+int32_t wordExcess(SuccinctTree* tree, size_t word)
+{
+    assert(tree != NULL);
+    assert(word < tree->wordsCount);
+
+    size_t bitsCount = tree->bitsCount - word * SUCCINCT_WORD_BITS;
+    if (bitsCount > SUCCINCT_WORD_BITS) { bitsCount = SUCCINCT_WORD_BITS; }
+
+    return 2 * __builtin_popcountll(tree->bits[word]) - (int32_t) bitsCount;
+}
+
+size_t findClose(SuccinctTree* tree, size_t node)
+{
+    assert(tree != NULL);
+    assert(getBit(tree, node));
+
+    return searchForward(tree, node + 1, excessBefore(tree, node));
+}
+
+//-----------------------------------------------------------------------------
+//! @return the first position from this one with the target excess, the
+//! excess before from has to be greater than the target.
+//-----------------------------------------------------------------------------
+size_t searchForward(SuccinctTree* tree, size_t from, int32_t target)
+{
+    assert(tree != NULL);
+
+    if (from >= tree->bitsCount) { return SUCCINCT_NONE; }
+
+    size_t  word     = from / SUCCINCT_WORD_BITS;
+    int32_t excess   = excessBefore(tree, from);
+    size_t  position = scanForward(tree, from, wordEnd(tree, word), &excess, target);
+    if (position != SUCCINCT_NONE) { return position; }
+
+    size_t block = word / SUCCINCT_BLOCK_WORDS;
+    for (word++; word < (block + 1) * SUCCINCT_BLOCK_WORDS && word < tree->wordsCount; word++)
+    {
+        if (excess + tree->wordMins[word] <= target) { return scanForward(tree, word * SUCCINCT_WORD_BITS, wordEnd(tree, word), &excess, target); }
+
+        excess += wordExcess(tree, word);
+    }
+
+    block = nextBlock(tree, block, target);
+    if (block == SUCCINCT_NONE) { return SUCCINCT_NONE; }
+
+    word   = block * SUCCINCT_BLOCK_WORDS;
+    excess = excessBefore(tree, word * SUCCINCT_WORD_BITS);
+    for (; word < tree->wordsCount; word++)
+    {
+        if (excess + tree->wordMins[word] <= target) { return scanForward(tree, word * SUCCINCT_WORD_BITS, wordEnd(tree, word), &excess, target); }
+
+        excess += wordExcess(tree, word);
+    }
+
+    return SUCCINCT_NONE;
+}
+
+//-----------------------------------------------------------------------------
+//! @return the position after the last one before this one with the target
+//! excess, the position before the first one has excess 0. The excess
+//! before before has to be greater than the target.
+//-----------------------------------------------------------------------------
+size_t searchBackward(SuccinctTree* tree, size_t before, int32_t target)
+{
+    assert(tree != NULL);
+    assert(before <= tree->bitsCount);
+
+    size_t  word     = before / SUCCINCT_WORD_BITS;
+    int32_t excess   = excessBefore(tree, before);
+    size_t  position = scanBackward(tree, before, word * SUCCINCT_WORD_BITS, &excess, target);
+    if (position != SUCCINCT_NONE) { return position; }
+
+    size_t block = word / SUCCINCT_BLOCK_WORDS;
+    for (; word > block * SUCCINCT_BLOCK_WORDS; word--)
+    {
+        if (excess - wordExcess(tree, word - 1) + tree->wordMins[word - 1] <= target)
+        {
+            return scanBackward(tree, wordEnd(tree, word - 1), (word - 1) * SUCCINCT_WORD_BITS, &excess, target);
+        }
+
+        excess -= wordExcess(tree, word - 1);
+    }
+
+    block = previousBlock(tree, block, target);
+    if (block != SUCCINCT_NONE)
+    {
+        word   = (block + 1) * SUCCINCT_BLOCK_WORDS;
+        excess = excessBefore(tree, word * SUCCINCT_WORD_BITS);
+        for (; word > block * SUCCINCT_BLOCK_WORDS; word--)
+        {
+            if (excess - wordExcess(tree, word - 1) + tree->wordMins[word - 1] <= target)
+            {
+                return scanBackward(tree, wordEnd(tree, word - 1), (word - 1) * SUCCINCT_WORD_BITS, &excess, target);
+            }
+
+            excess -= wordExcess(tree, word - 1);
+        }
+    }
+
+    return target == 0 ? 0 : SUCCINCT_NONE;
+}
+
+//-----------------------------------------------------------------------------
+//! Looks for the target excess from from to end (in one word), whole bytes
+//! are skipped by their minimum excess.
+//!
+//! @param [in]     tree
+//! @param [in]     from
+//! @param [in]     end
+//! @param [in,out] excess excess before from, it's updated to the excess
+//!                        before end if the target isn't found
+//! @param [in]     target
+//!
+//! @return the first position with the target excess or SUCCINCT_NONE.
+//-----------------------------------------------------------------------------
+size_t scanForward(SuccinctTree* tree, size_t from, size_t end, int32_t* excess, int32_t target)
+{
+    assert(tree   != NULL);
+    assert(excess != NULL);
+
+    size_t position = from;
+    while (position < end)
+    {
+        if (position % 8 == 0 && position + 8 <= end)
+        {
+            uint8_t byte = (uint8_t) (tree->bits[position / SUCCINCT_WORD_BITS] >> (position % SUCCINCT_WORD_BITS));
+            if (*excess + tree->byteMins[byte] > target)
+            {
+                *excess  += tree->byteExcess[byte];
+                position += 8;
+                continue;
+            }
+        }
+
+        *excess += getBit(tree, position) ? 1 : -1;
+        if (*excess == target) { return position; }
+
+        position++;
+    }
+
+    return SUCCINCT_NONE;
+}
+
+//-----------------------------------------------------------------------------
+//! Looks for the target excess from before back to start (in one word).
+//!
+//! @param [in,out] excess excess before before, it's updated to the excess
+//!                        before start if the target isn't found
+//!
+//! @return the position after the last one with the target excess or
+//! SUCCINCT_NONE.
+//-----------------------------------------------------------------------------
+size_t scanBackward(SuccinctTree* tree, size_t before, size_t start, int32_t* excess, int32_t target)
+{
+    assert(tree   != NULL);
+    assert(excess != NULL);
+
+    size_t position = before;
+    while (position > start)
+    {
+        if (position % 8 == 0 && position >= start + 8)
+        {
+            uint8_t byte = (uint8_t) (tree->bits[(position - 8) / SUCCINCT_WORD_BITS] >> ((position - 8) % SUCCINCT_WORD_BITS));
+            if (*excess - tree->byteExcess[byte] + tree->byteMins[byte] > target)
+            {
+                *excess  -= tree->byteExcess[byte];
+                position -= 8;
+                continue;
+            }
+        }
+
+        if (*excess == target) { return position; }
+        *excess -= getBit(tree, position - 1) ? 1 : -1;
+
+        position--;
+    }
+
+    return SUCCINCT_NONE;
+}
+
+size_t wordEnd(SuccinctTree* tree, size_t word)
+{
+    assert(tree != NULL);
+
+    size_t end = (word + 1) * SUCCINCT_WORD_BITS;
+    return end < tree->bitsCount ? end : tree->bitsCount;
+}
+
+//-----------------------------------------------------------------------------
+//! @return the first block after this one with the minimum excess not
+//! greater than the target.
+//-----------------------------------------------------------------------------
+size_t nextBlock(SuccinctTree* tree, size_t block, int32_t target)
+{
+    assert(tree != NULL);
+
+    size_t node = tree->leavesCount + block;
+    while (node > 1 && !(node % 2 == 0 && tree->blockMins[node + 1] <= target)) { node /= 2; }
+
+    if (node <= 1) { return SUCCINCT_NONE; }
+
+    for (node++; node < tree->leavesCount; )
+    {
+        node = tree->blockMins[2 * node] <= target ? 2 * node : 2 * node + 1;
+    }
+
+    return node - tree->leavesCount;
+}
+
+//-----------------------------------------------------------------------------
+//! @return the last block before this one with the minimum excess not
+//! greater than the target.
+//-----------------------------------------------------------------------------
+size_t previousBlock(SuccinctTree* tree, size_t block, int32_t target)
+{
+    assert(tree != NULL);
+
+    size_t node = tree->leavesCount + block;
+    while (node > 1 && !(node % 2 == 1 && tree->blockMins[node - 1] <= target)) { node /= 2; }
+
+    if (node <= 1) { return SUCCINCT_NONE; }
+
+    for (node--; node < tree->leavesCount; )
+    {
+        node = tree->blockMins[2 * node + 1] <= target ? 2 * node + 1 : 2 * node;
+    }
+
+    return node - tree->leavesCount;
+}
+
+const char* decodeValue(SuccinctTree* tree, size_t rank)
+{
+    assert(tree != NULL);
+    assert(rank < tree->nodesCount);
+
+    const char* record = tree->strings + tree->offsets[rank / SUCCINCT_STRINGS_BLOCK];
+    size_t      length = strlen(record);
+
+    memcpy(tree->value, record, length + 1);
+    record += length + 1;
+
+    for (size_t i = 0; i < rank % SUCCINCT_STRINGS_BLOCK; i++)
+    {
+        size_t prefix = (unsigned char) *record++;
+        length        = strlen(record);
+
+        memcpy(tree->value + prefix, record, length + 1);
+        record += length + 1;
+    }
+
+    return tree->value;
+}
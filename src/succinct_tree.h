@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include "binary_tree.h"
+
+//-----------------------------------------------------------------------------
+// Read-only copy of a tree without pointers: the shape is a sequence of
+// balanced parentheses (2 bits per node) and the values are front-coded in
+// the same order. Nodes are positions of their opening parentheses, the
+// root is 0. Values are decoded into a buffer of the tree, so the returned
+// value is valid until the next succinctValue or succinctFindObject call.
+//-----------------------------------------------------------------------------
+struct SuccinctTree;
+
+static const size_t SUCCINCT_NONE = (size_t) -1;
+
+SuccinctTree* newSuccinctTree        (BTNode* root);
+void          deleteSuccinctTree     (SuccinctTree* tree);
+
+size_t        succinctRoot           (SuccinctTree* tree);
+size_t        succinctRight          (SuccinctTree* tree, size_t node);
+size_t        succinctLeft           (SuccinctTree* tree, size_t node);
+size_t        succinctParent         (SuccinctTree* tree, size_t node);
+bool          succinctIsQuestion     (SuccinctTree* tree, size_t node);
+bool          succinctIsLeft         (SuccinctTree* tree, size_t node);
+size_t        succinctDepth          (SuccinctTree* tree, size_t node);
+size_t        succinctSubtreeSize    (SuccinctTree* tree, size_t node);
+const char*   succinctValue          (SuccinctTree* tree, size_t node);
+size_t        succinctFindObject     (SuccinctTree* tree, const char* value);
+
+size_t        succinctNodesCount     (SuccinctTree* tree);
+size_t        succinctStructureBytes (SuccinctTree* tree);
+size_t        succinctStringsBytes   (SuccinctTree* tree);
+size_t        succinctIndexBytes     (SuccinctTree* tree);
@@ -0,0 +1,384 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "transcript.h"
+#include "memory_tags.h"
+#include "string_builder.h"
+#include "../libs/file_manager.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+static const short  TRANSCRIPT_SIGNATURE    = 0x5254; // "TR"
+static const short  TRANSCRIPT_VERSION      = 1;
+static const size_t TRANSCRIPT_MIN_CAPACITY = 16;
+static const size_t TRANSCRIPT_MAX_ANSWER   = 256;
+
+//-----------------------------------------------------------------------------
+// Answers are kept in the form UI_ScriptInput reads them: a key or a line 
+// per line. Answers of every dialog are zero terminated, so that they can be
+// given to UI_NewInputScript as they are.
+//
+// File is a header followed by the dialogs, each of them is its type, the 
+// length of its answers and the answers themselves.
+//-----------------------------------------------------------------------------
+struct TranscriptHeader
+{
+    BinFileHeader binHeader    = {};
+    uint32_t      dialogsCount = 0;
+    uint64_t      startHash    = 0;
+    uint64_t      finalHash    = 0;
+};
+
+struct DialogRecord
+{
+    uint8_t  dialog = 0;
+    uint32_t length = 0;
+};
+
+struct TranscriptEntry
+{
+    TranscriptDialog dialog = TRANSCRIPT_GAME;
+    size_t           offset = 0;
+};
+
+struct Transcript
+{
+    TranscriptEntry* dialogs         = NULL;
+    size_t           dialogsCount    = 0;
+    size_t           dialogsCapacity = 0;
+
+    StringBuilder*   answers         = NULL;
+    bool             isRecording     = false;
+    bool             isBroken        = false;
+
+    UI_InputBackend  source          = {};
+
+    uint64_t         startHash       = 0;
+    uint64_t         finalHash       = 0;
+};
+
+int      recordKey    (void* context);
+bool     recordLine   (void* context, char* dst, size_t dstSize);
+void     recordAnswer (Transcript* transcript, const char* answer, size_t length);
+uint64_t hashSubtree  (BTNode* node, uint64_t hash);
+uint64_t hashBytes    (uint64_t hash, const void* bytes, size_t size);
+
+Transcript* newTranscript()
+{
+    Transcript* transcript = (Transcript*) memAlloc(MEM_UI, 1, sizeof(Transcript));
+    CHECK_NULL(transcript, return NULL);
+
+    *transcript = {};
+
+    transcript->dialogs = (TranscriptEntry*) memAlloc(MEM_UI, TRANSCRIPT_MIN_CAPACITY, sizeof(TranscriptEntry));
+    CHECK_NULL(transcript->dialogs, memFree(transcript); return NULL);
+
+    transcript->answers = newStringBuilder(TRANSCRIPT_MAX_ANSWER);
+    CHECK_NULL(transcript->answers, memFree(transcript->dialogs); memFree(transcript); return NULL);
+
+    transcript->dialogsCapacity = TRANSCRIPT_MIN_CAPACITY;
+
+    return transcript;
+}
+
+void deleteTranscript(Transcript* transcript)
+{
+    assert(transcript != NULL);
+
+    deleteStringBuilder(transcript->answers);
+    memFree(transcript->dialogs);
+    memFree(transcript);
+}
+
+//-----------------------------------------------------------------------------
+//! Wraps source so that answers read during the dialogs are recorded. Keys
+//! and lines read between the dialogs (e.g. in the main menu) aren't.
+//-----------------------------------------------------------------------------
+UI_InputBackend transcriptInput(Transcript* transcript, UI_InputBackend source)
+{
+    assert(transcript != NULL);
+    assert(source.readKey  != NULL);
+    assert(source.readLine != NULL);
+
+    transcript->source = source;
+
+    UI_InputBackend input = {};
+
+    input.readKey  = recordKey;
+    input.readLine = recordLine;
+    input.context  = transcript;
+
+    return input;
+}
+
+int recordKey(void* context)
+{
+    assert(context != NULL);
+
+    Transcript* transcript = (Transcript*) context;
+
+    int key = transcript->source.readKey(transcript->source.context);
+    if (key != EOF)
+    {
+        char answer = (char) key;
+        recordAnswer(transcript, &answer, 1);
+    }
+
+    return key;
+}
+
+bool recordLine(void* context, char* dst, size_t dstSize)
+{
+    assert(context != NULL);
+    assert(dst     != NULL);
+
+    Transcript* transcript = (Transcript*) context;
+
+    bool isRead = transcript->source.readLine(transcript->source.context, dst, dstSize);
+    // the source may leave the line break in dst
+    if (isRead) { recordAnswer(transcript, dst, strcspn(dst, "\r\n")); }
+
+    return isRead;
+}
+
+void recordAnswer(Transcript* transcript, const char* answer, size_t length)
+{
+    assert(transcript != NULL);
+    assert(answer     != NULL);
+
+    if (!transcript->isRecording || transcript->isBroken) { return; }
+
+    if (!builderAppend(transcript->answers, answer, length) || !builderAppendStr(transcript->answers, "\n"))
+    {
+        transcript->isBroken = true;
+    }
+}
+
+void beginDialog(Transcript* transcript, TranscriptDialog dialog)
+{
+    assert(transcript != NULL);
+    assert(!transcript->isRecording);
+
+    if (transcript->isBroken) { return; }
+
+    if (transcript->dialogsCount == transcript->dialogsCapacity)
+    {
+        size_t           newCapacity = transcript->dialogsCapacity * 2;
+        TranscriptEntry* newDialogs  = (TranscriptEntry*) memRealloc(MEM_UI, transcript->dialogs, newCapacity * sizeof(TranscriptEntry));
+        CHECK_NULL(newDialogs, transcript->isBroken = true; return);
+
+        transcript->dialogs         = newDialogs;
+        transcript->dialogsCapacity = newCapacity;
+    }
+
+    TranscriptEntry* entry = &transcript->dialogs[transcript->dialogsCount++];
+
+    entry->dialog = dialog;
+    entry->offset = builderLength(transcript->answers);
+
+    transcript->isRecording = true;
+}
+
+void endDialog(Transcript* transcript)
+{
+    assert(transcript != NULL);
+
+    if (!transcript->isRecording) { return; }
+
+    transcript->isRecording = false;
+
+    if (!builderAppend(transcript->answers, "", 1)) { transcript->isBroken = true; }
+}
+
+//-----------------------------------------------------------------------------
+//! @return false if the file couldn't be written or some answers couldn't be
+//! recorded. An existing file isn't overwritten, errno is EEXIST then.
+//-----------------------------------------------------------------------------
+bool saveTranscript(Transcript* transcript, const char* fileName)
+{
+    assert(transcript != NULL);
+    assert(fileName   != NULL);
+    assert(!transcript->isRecording);
+
+    if (transcript->isBroken) { return false; }
+
+    FILE* file = fopen(fileName, "wbx");
+    CHECK_NULL(file, return false);
+
+    TranscriptHeader header = {};
+    header.binHeader.signature = TRANSCRIPT_SIGNATURE;
+    header.binHeader.version   = TRANSCRIPT_VERSION;
+    header.dialogsCount        = (uint32_t) transcript->dialogsCount;
+    header.startHash           = transcript->startHash;
+    header.finalHash           = transcript->finalHash;
+
+    bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (size_t i = 0; i < transcript->dialogsCount && isWritten; i++)
+    {
+        const char*  answers = getAnswers(transcript, i);
+        DialogRecord record  = {};
+
+        record.dialog = (uint8_t) transcript->dialogs[i].dialog;
+        record.length = (uint32_t) strlen(answers);
+
+        isWritten = fwrite(&record.dialog, sizeof(record.dialog), 1, file) == 1 &&
+                    fwrite(&record.length, sizeof(record.length), 1, file) == 1 &&
+                    fwrite(answers, sizeof(char), record.length, file) == record.length;
+    }
+
+    return fclose(file) == 0 && isWritten;
+}
+
+//-----------------------------------------------------------------------------
+//! @return transcript or NULL if the file can't be read or isn't a transcript.
+//-----------------------------------------------------------------------------
+Transcript* loadTranscript(const char* fileName)
+{
+    assert(fileName != NULL);
+
+    FILE* file = fopen(fileName, "rb");
+    CHECK_NULL(file, return NULL);
+
+    TranscriptHeader header = {};
+    if (fread(&header, sizeof(header), 1, file) != 1        ||
+        header.binHeader.signature != TRANSCRIPT_SIGNATURE ||
+        header.binHeader.version   != TRANSCRIPT_VERSION)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    Transcript* transcript = newTranscript();
+    CHECK_NULL(transcript, fclose(file); return NULL);
+
+    transcript->startHash = header.startHash;
+    transcript->finalHash = header.finalHash;
+
+    char buffer[TRANSCRIPT_MAX_ANSWER] = "";
+    bool isRead                        = true;
+    for (size_t i = 0; i < header.dialogsCount && isRead; i++)
+    {
+        DialogRecord record = {};
+        isRead = fread(&record.dialog, sizeof(record.dialog), 1, file) == 1 &&
+                 fread(&record.length, sizeof(record.length), 1, file) == 1 &&
+                 record.dialog <= TRANSCRIPT_OPTIMIZATION;
+        if (!isRead) { break; }
+
+        beginDialog(transcript, (TranscriptDialog) record.dialog);
+
+        for (size_t left = record.length; left > 0 && isRead; )
+        {
+            size_t chunk = left < sizeof(buffer) ? left : sizeof(buffer);
+
+            isRead = fread(buffer, sizeof(char), chunk, file) == chunk &&
+                     builderAppend(transcript->answers, buffer, chunk);
+            left  -= chunk;
+        }
+
+        endDialog(transcript);
+    }
+
+    fclose(file);
+
+    if (!isRead || transcript->isBroken)
+    {
+        deleteTranscript(transcript);
+        return NULL;
+    }
+
+    return transcript;
+}
+
+void setTreeHashes(Transcript* transcript, uint64_t startHash, uint64_t finalHash)
+{
+    assert(transcript != NULL);
+
+    transcript->startHash = startHash;
+    transcript->finalHash = finalHash;
+}
+
+uint64_t getStartHash(Transcript* transcript)
+{
+    assert(transcript != NULL);
+    return transcript->startHash;
+}
+
+uint64_t getFinalHash(Transcript* transcript)
+{
+    assert(transcript != NULL);
+    return transcript->finalHash;
+}
+
+size_t getDialogsCount(Transcript* transcript)
+{
+    assert(transcript != NULL);
+    return transcript->dialogsCount;
+}
+
+TranscriptDialog getDialog(Transcript* transcript, size_t index)
+{
+    assert(transcript != NULL);
+    assert(index < transcript->dialogsCount);
+
+    return transcript->dialogs[index].dialog;
+}
+
+//-----------------------------------------------------------------------------
+//! @return answers of the dialog, valid until the next dialog is recorded.
+//-----------------------------------------------------------------------------
+const char* getAnswers(Transcript* transcript, size_t index)
+{
+    assert(transcript != NULL);
+    assert(index < transcript->dialogsCount);
+
+    return builderData(transcript->answers) + transcript->dialogs[index].offset;
+}
+
+//-----------------------------------------------------------------------------
+// FNV-1a, 64 bit
+//-----------------------------------------------------------------------------
+uint64_t hashBytes(uint64_t hash, const void* bytes, size_t size)
+{
+    assert(bytes != NULL);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= ((const unsigned char*) bytes)[i];
+        hash *= 1099511628211u;
+    }
+
+    return hash;
+}
+
+//-----------------------------------------------------------------------------
+//! Hashes the structure of the tree together with the values and hits, so 
+//! that two trees have the same hash only if they are saved the same way.
+//-----------------------------------------------------------------------------
+uint64_t hashTree(BTNode* root)
+{
+    if (root == NULL) { return 0; }
+
+    return hashSubtree(root, 14695981039346656037u);
+}
+
+uint64_t hashSubtree(BTNode* node, uint64_t hash)
+{
+    assert(node != NULL);
+
+    char     kind = isQuestion(node) ? '?' : '.';
+    uint64_t hits = getHits(node);
+
+    hash = hashBytes(hash, &kind, sizeof(kind));
+    hash = hashBytes(hash, getValue(node), getValueLength(node) + 1);
+    hash = hashBytes(hash, &hits, sizeof(hits));
+
+    if (isQuestion(node))
+    {
+        hash = hashSubtree(getRight(node), hash);
+        hash = hashSubtree(getLeft(node),  hash);
+    }
+
+    return hash;
+}
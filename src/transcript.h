@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include "binary_tree.h"
+#include "ui.h"
+
+//-----------------------------------------------------------------------------
+// A transcript is the sequence of dialogs of one session with the answers 
+// given in each of them, enough to replay the session against the same 
+// database.
+//-----------------------------------------------------------------------------
+enum TranscriptDialog
+{
+    TRANSCRIPT_GAME         = 0,
+    TRANSCRIPT_DEFINITION   = 1,
+    TRANSCRIPT_COMPARISON   = 2,
+    TRANSCRIPT_OPTIMIZATION = 3,
+};
+
+struct Transcript;
+
+// tree hash of a session whose database hasn't been loaded whole, such 
+// transcripts are replayed without checking the trees
+static const uint64_t TRANSCRIPT_NO_HASH = 0;
+
+Transcript*      newTranscript          ();
+void             deleteTranscript       (Transcript* transcript);
+Transcript*      loadTranscript         (const char* fileName);
+bool             saveTranscript         (Transcript* transcript, const char* fileName);
+
+UI_InputBackend  transcriptInput        (Transcript* transcript, UI_InputBackend source);
+void             beginDialog            (Transcript* transcript, TranscriptDialog dialog);
+void             endDialog              (Transcript* transcript);
+
+void             setTreeHashes          (Transcript* transcript, uint64_t startHash, uint64_t finalHash);
+uint64_t         getStartHash           (Transcript* transcript);
+uint64_t         getFinalHash           (Transcript* transcript);
+
+size_t           getDialogsCount        (Transcript* transcript);
+TranscriptDialog getDialog              (Transcript* transcript, size_t index);
+const char*      getAnswers             (Transcript* transcript, size_t index);
+
+uint64_t         hashTree               (BTNode* root);
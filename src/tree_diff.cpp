@@ -0,0 +1,177 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tree_diff.h"
+#include "memory_tags.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+//-----------------------------------------------------------------------------
+// Both trees are descended together only where the subtree hashes differ. 
+// While the nodes ask the same question their answers are compared 
+// separately, otherwise the whole pair of subtrees is reported: objects 
+// which are in one of them only are listed, if there are none the subtrees
+// differ only in questions. So the cost is about the number of changes 
+// times the depth, equal parts of the trees are never visited.
+//
+// The path to the current pair lives on the stack of the recursion.
+//-----------------------------------------------------------------------------
+struct DiffStep
+{
+    const DiffStep* previous = NULL;
+    BTNode*         question = NULL;
+    bool            answer   = false;
+};
+
+bool diffSubtrees   (BTNode* oldNode, BTNode* newNode, const DiffStep* path, FILE* output, TreeDiff* diff);
+bool reportChange   (BTNode* oldNode, BTNode* newNode, const DiffStep* path, FILE* output, TreeDiff* diff);
+void printPath      (const DiffStep* path, FILE* output);
+bool isSameQuestion (BTNode* node1, BTNode* node2);
+void collectObjects (BTNode* node, const char** objects, size_t* count);
+int  compareNames   (const void* name1, const void* name2);
+
+//-----------------------------------------------------------------------------
+//! Writes the differences between two trees to output.
+//!
+//! @param [in]  oldRoot
+//! @param [in]  newRoot
+//! @param [in]  output
+//! @param [out] diff    counters of the differences
+//!
+//! @return false if out of memory.
+//-----------------------------------------------------------------------------
+bool diffTrees(BTNode* oldRoot, BTNode* newRoot, FILE* output, TreeDiff* diff)
+{
+    assert(oldRoot != NULL);
+    assert(newRoot != NULL);
+    assert(output  != NULL);
+    assert(diff    != NULL);
+
+    *diff = {};
+
+    return diffSubtrees(oldRoot, newRoot, NULL, output, diff);
+}
+
+bool diffSubtrees(BTNode* oldNode, BTNode* newNode, const DiffStep* path, FILE* output, TreeDiff* diff)
+{
+    assert(oldNode != NULL);
+    assert(newNode != NULL);
+
+    diff->pairsCompared++;
+
+    if (getSubtreeHash(oldNode) == getSubtreeHash(newNode)) { return true; }
+
+    if (!isSameQuestion(oldNode, newNode)) { return reportChange(oldNode, newNode, path, output, diff); }
+
+    DiffStep yes = { path, oldNode, true  };
+    DiffStep no  = { path, oldNode, false };
+
+    return diffSubtrees(getRight(oldNode), getRight(newNode), &yes, output, diff) &&
+           diffSubtrees(getLeft(oldNode),  getLeft(newNode),  &no,  output, diff);
+}
+
+bool isSameQuestion(BTNode* node1, BTNode* node2)
+{
+    assert(node1 != NULL);
+    assert(node2 != NULL);
+
+    return isQuestion(node1) && isQuestion(node2) &&
+           getValueHash(node1) == getValueHash(node2) &&
+           strcmp(getValue(node1), getValue(node2)) == 0;
+}
+
+bool reportChange(BTNode* oldNode, BTNode* newNode, const DiffStep* path, FILE* output, TreeDiff* diff)
+{
+    assert(oldNode != NULL);
+    assert(newNode != NULL);
+
+    size_t       oldCount   = 0;
+    size_t       newCount   = 0;
+    const char** oldObjects = (const char**) memAlloc(MEM_REPORTS, getLeavesCount(oldNode), sizeof(const char*));
+    const char** newObjects = (const char**) memAlloc(MEM_REPORTS, getLeavesCount(newNode), sizeof(const char*));
+    CHECK_NULL(oldObjects, memFree(newObjects); return false);
+    CHECK_NULL(newObjects, memFree(oldObjects); return false);
+
+    collectObjects(oldNode, oldObjects, &oldCount);
+    collectObjects(newNode, newObjects, &newCount);
+
+    qsort(oldObjects, oldCount, sizeof(const char*), compareNames);
+    qsort(newObjects, newCount, sizeof(const char*), compareNames);
+
+    printPath(path, output);
+    fprintf(output, "\n");
+
+    size_t oldIndex = 0;
+    size_t newIndex = 0;
+    bool   isMoved  = true;
+
+    while (oldIndex < oldCount || newIndex < newCount)
+    {
+        int order = oldIndex == oldCount ?  1 :
+                    newIndex == newCount ? -1 : strcmp(oldObjects[oldIndex], newObjects[newIndex]);
+
+        if (order < 0)
+        {
+            fprintf(output, "  - %s\n", oldObjects[oldIndex++]);
+            diff->removed++;
+            isMoved = false;
+        }
+        else if (order > 0)
+        {
+            fprintf(output, "  + %s\n", newObjects[newIndex++]);
+            diff->added++;
+            isMoved = false;
+        }
+        else
+        {
+            oldIndex++;
+            newIndex++;
+        }
+    }
+
+    if (isMoved) { fprintf(output, "  ~ '%s' -> '%s'\n", getValue(oldNode), getValue(newNode)); }
+
+    diff->changes++;
+
+    memFree(oldObjects);
+    memFree(newObjects);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// The path is printed from the root (as '@' followed by the questions and 
+// the answers), so the steps are printed on the way back from the recursion.
+//-----------------------------------------------------------------------------
+void printPath(const DiffStep* path, FILE* output)
+{
+    if (path == NULL)
+    {
+        fprintf(output, "@");
+        return;
+    }
+
+    printPath(path->previous, output);
+    fprintf(output, " '%s' %s", getValue(path->question), path->answer ? "yes" : "no");
+}
+
+void collectObjects(BTNode* node, const char** objects, size_t* count)
+{
+    assert(node    != NULL);
+    assert(objects != NULL);
+    assert(count   != NULL);
+
+    if (!isQuestion(node))
+    {
+        objects[(*count)++] = getValue(node);
+        return;
+    }
+
+    collectObjects(getRight(node), objects, count);
+    collectObjects(getLeft(node),  objects, count);
+}
+
+int compareNames(const void* name1, const void* name2)
+{
+    return strcmp(*(const char* const*) name1, *(const char* const*) name2);
+}
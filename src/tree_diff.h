@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdio.h>
+#include "binary_tree.h"
+
+//-----------------------------------------------------------------------------
+// changes is the number of subtrees reported as different, pairsCompared is
+// the number of node pairs visited to find them.
+//-----------------------------------------------------------------------------
+struct TreeDiff
+{
+    size_t changes       = 0;
+    size_t added         = 0;
+    size_t removed       = 0;
+    size_t pairsCompared = 0;
+};
+
+bool diffTrees (BTNode* oldRoot, BTNode* newRoot, FILE* output, TreeDiff* diff);
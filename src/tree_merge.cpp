@@ -0,0 +1,594 @@
+#include <assert.h>
+#include <chrono>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "tree_merge.h"
+#include "memory_tags.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+static const size_t MERGE_TASKS_PER_THREAD = 8;
+static const size_t MERGE_MIN_TASK_LEAVES  = 4096;
+static const size_t MERGE_MIN_CAPACITY     = 64;
+
+//-----------------------------------------------------------------------------
+// The trees are aligned from the roots: while both nodes ask the same
+// question their answers are merged separately, subtrees with equal hashes
+// are skipped. Where the target has an object and the source asks more
+// questions about it, the source subtree is grafted in place of the object.
+// Anything else that differs is a conflict if the source has objects there
+// which the target doesn't know.
+//
+// The merge goes in two passes. The planning pass only reads both trees, so
+// the aligned pairs are split between threads (as in the tree report) and
+// every task collects its own list of actions. The actions are then applied
+// by the calling thread in the order of the tasks, because new nodes take
+// their values from the target's string pool. So the target is changed only
+// if the whole merge has been planned.
+//
+// All the target's objects are kept in a hash table, so source objects that
+// the target knows in another place aren't added twice.
+//-----------------------------------------------------------------------------
+enum MergeActionKind
+{
+    MERGE_GRAFT,
+    MERGE_CONFLICT,
+};
+
+struct MergeAction
+{
+    MergeActionKind kind   = MERGE_GRAFT;
+    BTNode*         target = NULL;
+    BTNode*         source = NULL;
+};
+
+struct MergePair
+{
+    BTNode* target = NULL;
+    BTNode* source = NULL;
+};
+
+struct MergeTask
+{
+    MergePair    pair            = {};
+
+    MergeAction* actions         = NULL;
+    size_t       actionsCount    = 0;
+    size_t       actionsCapacity = 0;
+
+    bool         isOutOfMemory   = false;
+};
+
+struct ObjectTable
+{
+    BTNode** slots    = NULL;
+    size_t   capacity = 0;
+};
+
+struct MergeJob
+{
+    MergeTask*   tasks      = NULL;
+    size_t       tasksCount = 0;
+    size_t       nextTask   = 0;
+
+    ObjectTable  objects    = {};
+};
+
+size_t  splitPairs       (MergePair root, MergeTask* tasks, size_t maxTasks);
+bool    isSplittable     (MergePair pair);
+void    mergeWorker      (MergeJob* job);
+void    planTask         (MergeJob* job, MergeTask* task);
+bool    planPair         (MergeJob* job, MergeTask* task, MergePair pair);
+bool    addAction        (MergeTask* task, MergeActionKind kind, MergePair pair);
+
+void    applyGraft       (BinaryTree* tree, ObjectTable* objects, MergeAction* action, FILE* output, MergeReport* report);
+BTNode* graftSubtree     (BinaryTree* tree, ObjectTable* objects, BTNode* source, BTNode** leaf, FILE* output, MergeReport* report);
+void    applyConflict    (ObjectTable* objects, MergeAction* action, FILE* output, MergeReport* report);
+size_t  printUnknown     (ObjectTable* objects, BTNode* source, FILE* output);
+void    printMergePath   (BTNode* node, FILE* output);
+void    printMergeStep   (BTNode* node, FILE* output);
+
+bool    isSameValue      (BTNode* node1, BTNode* node2);
+bool    hasObject        (BTNode* subRoot, BTNode* object);
+bool    hasUnknown       (ObjectTable* objects, BTNode* subRoot);
+
+bool    newObjectTable   (ObjectTable* objects, size_t maxObjects);
+bool    tableInsert      (ObjectTable* objects, BTNode* object);
+BTNode* tableFind        (ObjectTable* objects, BTNode* object);
+bool    tableInsertStep  (BTNode* node, va_list args);
+
+//-----------------------------------------------------------------------------
+//! Merges the source tree into the target tree. Conflicts and added objects
+//! are written to output.
+//!
+//! @param [in]  target
+//! @param [in]  source       root of the tree to merge, it isn't changed
+//! @param [in]  threadsCount 0 for the number of hardware threads
+//! @param [in]  output
+//! @param [out] report
+//!
+//! @return false if out of memory, the target isn't changed then.
+//-----------------------------------------------------------------------------
+bool mergeTrees(BinaryTree* target, BTNode* source, size_t threadsCount, FILE* output, MergeReport* report)
+{
+    assert(target != NULL);
+    assert(source != NULL);
+    assert(output != NULL);
+    assert(report != NULL);
+    assert(getRoot(target) != NULL);
+
+    auto start = std::chrono::steady_clock::now();
+
+    *report = {};
+
+    BTNode* root = getRoot(target);
+
+    if (threadsCount == 0) { threadsCount = std::thread::hardware_concurrency(); }
+    if (threadsCount == 0) { threadsCount = 1; }
+
+    size_t maxThreads = getLeavesCount(root) / MERGE_MIN_TASK_LEAVES + 1;
+    if (threadsCount > maxThreads) { threadsCount = maxThreads; }
+
+    MergeJob job      = {};
+    size_t   maxTasks = threadsCount * MERGE_TASKS_PER_THREAD;
+
+    job.tasks = (MergeTask*) memAlloc(MEM_REPORTS, maxTasks, sizeof(MergeTask));
+    CHECK_NULL(job.tasks, return false);
+
+    if (!newObjectTable(&job.objects, getLeavesCount(root) + getLeavesCount(source)))
+    {
+        memFree(job.tasks);
+        return false;
+    }
+
+    preOrderTraverse(root, tableInsertStep, &job.objects);
+
+    job.tasksCount = splitPairs({ root, source }, job.tasks, maxTasks);
+
+    // the calling thread works too
+    std::thread* threads = threadsCount > 1 ? new std::thread[threadsCount - 1] : NULL;
+    for (size_t i = 0; i + 1 < threadsCount; i++)
+    {
+        threads[i] = std::thread(mergeWorker, &job);
+    }
+
+    mergeWorker(&job);
+
+    for (size_t i = 0; i + 1 < threadsCount; i++)
+    {
+        threads[i].join();
+    }
+
+    delete[] threads;
+
+    bool isPlanned = true;
+    for (size_t i = 0; i < job.tasksCount; i++)
+    {
+        isPlanned = isPlanned && !job.tasks[i].isOutOfMemory;
+    }
+
+    for (size_t i = 0; i < job.tasksCount && isPlanned; i++)
+    {
+        MergeTask* task = &job.tasks[i];
+
+        for (size_t j = 0; j < task->actionsCount; j++)
+        {
+            MergeAction* action = &task->actions[j];
+
+            if (action->kind == MERGE_GRAFT) { applyGraft(target, &job.objects, action, output, report); }
+            else                             { applyConflict(&job.objects, action, output, report); }
+        }
+    }
+
+    if (report->grafted > 0) { countLeaves(getRoot(target)); }
+
+    for (size_t i = 0; i < job.tasksCount; i++)
+    {
+        memFree(job.tasks[i].actions);
+    }
+
+    memFree(job.tasks);
+    memFree(job.objects.slots);
+
+    report->threadsUsed  = threadsCount;
+    report->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    return isPlanned;
+}
+
+//-----------------------------------------------------------------------------
+//! Splits the biggest pair that asks the same question until there are
+//! maxTasks of them or they are all small. Pairs of equal subtrees are
+//! dropped right away.
+//!
+//! @return number of tasks.
+//-----------------------------------------------------------------------------
+size_t splitPairs(MergePair root, MergeTask* tasks, size_t maxTasks)
+{
+    assert(tasks != NULL);
+    assert(maxTasks > 1);
+
+    size_t tasksCount = 0;
+    if (getSubtreeHash(root.target) != getSubtreeHash(root.source)) { tasks[tasksCount++] = { root }; }
+
+    while (tasksCount > 0 && tasksCount < maxTasks)
+    {
+        size_t biggest = 0;
+        for (size_t i = 1; i < tasksCount; i++)
+        {
+            if (getLeavesCount(tasks[i].pair.target) > getLeavesCount(tasks[biggest].pair.target)) { biggest = i; }
+        }
+
+        MergePair pair = tasks[biggest].pair;
+        if (!isSplittable(pair) || getLeavesCount(pair.target) < MERGE_MIN_TASK_LEAVES) { break; }
+
+        MergePair yes = { getRight(pair.target), getRight(pair.source) };
+        MergePair no  = { getLeft(pair.target),  getLeft(pair.source)  };
+
+        // the order of the tasks is the order the actions are applied and reported in
+        memmove(&tasks[biggest + 1], &tasks[biggest], (tasksCount - biggest) * sizeof(MergeTask));
+        tasksCount++;
+
+        tasks[biggest]     = { yes };
+        tasks[biggest + 1] = { no  };
+
+        if (getSubtreeHash(no.target)  == getSubtreeHash(no.source))
+        {
+            memmove(&tasks[biggest + 1], &tasks[biggest + 2], (tasksCount - biggest - 2) * sizeof(MergeTask));
+            tasksCount--;
+        }
+
+        if (getSubtreeHash(yes.target) == getSubtreeHash(yes.source))
+        {
+            memmove(&tasks[biggest], &tasks[biggest + 1], (tasksCount - biggest - 1) * sizeof(MergeTask));
+            tasksCount--;
+        }
+    }
+
+    return tasksCount;
+}
+
+bool isSplittable(MergePair pair)
+{
+    return isQuestion(pair.target) && isQuestion(pair.source) && isSameValue(pair.target, pair.source);
+}
+
+void mergeWorker(MergeJob* job)
+{
+    assert(job != NULL);
+
+    size_t task = 0;
+    while ((task = __atomic_fetch_add(&job->nextTask, 1, __ATOMIC_RELAXED)) < job->tasksCount)
+    {
+        planTask(job, &job->tasks[task]);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Aligns the pair of the task with an explicit stack, so that degenerate
+//! trees don't overflow the thread's stack.
+//-----------------------------------------------------------------------------
+void planTask(MergeJob* job, MergeTask* task)
+{
+    assert(job  != NULL);
+    assert(task != NULL);
+
+    MergePair* stack         = NULL;
+    size_t     stackSize     = 0;
+    size_t     stackCapacity = 0;
+
+    if (!memReserve(MEM_STACKS, (void**) &stack, &stackCapacity, 1, sizeof(MergePair)))
+    {
+        task->isOutOfMemory = true;
+        return;
+    }
+
+    stack[stackSize++] = task->pair;
+
+    while (stackSize > 0 && !task->isOutOfMemory)
+    {
+        MergePair pair = stack[--stackSize];
+
+        if (getSubtreeHash(pair.target) == getSubtreeHash(pair.source)) { continue; }
+
+        if (!isSplittable(pair))
+        {
+            task->isOutOfMemory = !planPair(job, task, pair);
+            continue;
+        }
+
+        if (!memReserve(MEM_STACKS, (void**) &stack, &stackCapacity, stackSize + 2, sizeof(MergePair)))
+        {
+            task->isOutOfMemory = true;
+            break;
+        }
+
+        // "yes" is on top, so the actions go in the order of the diagram
+        stack[stackSize++] = { getLeft(pair.target),  getLeft(pair.source)  };
+        stack[stackSize++] = { getRight(pair.target), getRight(pair.source) };
+    }
+
+    memFree(stack);
+}
+
+//-----------------------------------------------------------------------------
+//! Decides what to do with a pair of different subtrees that don't ask the
+//! same question. Nothing is done if the target knows all the source objects.
+//!
+//! @return false if out of memory.
+//-----------------------------------------------------------------------------
+bool planPair(MergeJob* job, MergeTask* task, MergePair pair)
+{
+    assert(job  != NULL);
+    assert(task != NULL);
+
+    if (!hasUnknown(&job->objects, pair.source)) { return true; }
+
+    if (!isQuestion(pair.target) && isQuestion(pair.source) && hasObject(pair.source, pair.target))
+    {
+        return addAction(task, MERGE_GRAFT, pair);
+    }
+
+    return addAction(task, MERGE_CONFLICT, pair);
+}
+
+bool addAction(MergeTask* task, MergeActionKind kind, MergePair pair)
+{
+    assert(task != NULL);
+
+    if (!memReserve(MEM_REPORTS, (void**) &task->actions, &task->actionsCapacity, task->actionsCount + 1, sizeof(MergeAction)))
+    {
+        return false;
+    }
+
+    task->actions[task->actionsCount++] = { kind, pair.target, pair.source };
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Puts a copy of the source subtree in place of the target object. The
+//! object keeps its node (so its hits and statistics) in the copy.
+//-----------------------------------------------------------------------------
+void applyGraft(BinaryTree* tree, ObjectTable* objects, MergeAction* action, FILE* output, MergeReport* report)
+{
+    assert(tree    != NULL);
+    assert(objects != NULL);
+    assert(action  != NULL);
+
+    BTNode* leaf   = action->target;
+    BTNode* parent = getParent(leaf);
+    bool    isNo   = isLeft(leaf);
+
+    printMergePath(leaf, output);
+
+    BTNode* graft = graftSubtree(tree, objects, action->source, &leaf, output, report);
+    assert(graft != NULL);
+    assert(leaf  == NULL);
+
+    setParent(graft, parent);
+
+    if      (parent == NULL) { setRoot(tree, graft); }
+    else if (isNo)           { setLeft(parent, graft); }
+    else                     { setRight(parent, graft); }
+
+    report->grafted++;
+}
+
+//-----------------------------------------------------------------------------
+//! Copies the source subtree leaving out the objects the target knows. The
+//! first source object with the name of *leaf is replaced by *leaf.
+//!
+//! @return the copy or NULL if all of its objects are left out.
+//-----------------------------------------------------------------------------
+BTNode* graftSubtree(BinaryTree* tree, ObjectTable* objects, BTNode* source, BTNode** leaf, FILE* output, MergeReport* report)
+{
+    assert(source != NULL);
+    assert(leaf   != NULL);
+
+    if (!isQuestion(source))
+    {
+        if (*leaf != NULL && isSameValue(source, *leaf))
+        {
+            BTNode* node = *leaf;
+            *leaf = NULL;
+
+            return node;
+        }
+
+        if (tableFind(objects, source) != NULL)
+        {
+            report->duplicates++;
+            return NULL;
+        }
+
+        BTNode* object = newNode(internValue(tree, getValue(source)));
+        assert(object != NULL);
+
+        setHits(object, getHits(source));
+        tableInsert(objects, object);
+
+        fprintf(output, "  + %s\n", getValue(object));
+        report->added++;
+
+        return object;
+    }
+
+    BTNode* right = graftSubtree(tree, objects, getRight(source), leaf, output, report);
+    BTNode* left  = graftSubtree(tree, objects, getLeft(source),  leaf, output, report);
+
+    if (right == NULL) { return left;  }
+    if (left  == NULL) { return right; }
+
+    BTNode* question = newQuestion(internValue(tree, getValue(source)));
+    assert(question != NULL);
+
+    setRight(question, right);
+    setLeft(question,  left);
+    setParent(right, question);
+    setParent(left,  question);
+
+    return question;
+}
+
+//-----------------------------------------------------------------------------
+// The objects are checked again, because some of them may have been added
+// by the grafts applied before.
+//-----------------------------------------------------------------------------
+void applyConflict(ObjectTable* objects, MergeAction* action, FILE* output, MergeReport* report)
+{
+    assert(objects != NULL);
+    assert(action  != NULL);
+
+    if (!hasUnknown(objects, action->source)) { return; }
+
+    printMergePath(action->target, output);
+    fprintf(output, "  ! '%s' <> '%s'\n", getValue(action->target), getValue(action->source));
+    printUnknown(objects, action->source, output);
+
+    report->conflicts++;
+}
+
+size_t printUnknown(ObjectTable* objects, BTNode* source, FILE* output)
+{
+    assert(objects != NULL);
+    assert(source  != NULL);
+
+    if (isQuestion(source)) { return printUnknown(objects, getRight(source), output) + printUnknown(objects, getLeft(source), output); }
+
+    if (tableFind(objects, source) != NULL) { return 0; }
+
+    fprintf(output, "  ? %s\n", getValue(source));
+
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Prints '@' and the questions with the answers leading to the node, the
+// same way as the diff does.
+//-----------------------------------------------------------------------------
+void printMergePath(BTNode* node, FILE* output)
+{
+    assert(node != NULL);
+
+    printMergeStep(node, output);
+    fprintf(output, "\n");
+}
+
+void printMergeStep(BTNode* node, FILE* output)
+{
+    assert(node != NULL);
+
+    BTNode* parent = getParent(node);
+    if (parent == NULL)
+    {
+        fprintf(output, "@");
+        return;
+    }
+
+    printMergeStep(parent, output);
+    fprintf(output, " '%s' %s", getValue(parent), isLeft(node) ? "no" : "yes");
+}
+
+bool isSameValue(BTNode* node1, BTNode* node2)
+{
+    assert(node1 != NULL);
+    assert(node2 != NULL);
+
+    return getValueHash(node1) == getValueHash(node2) && strcmp(getValue(node1), getValue(node2)) == 0;
+}
+
+//-----------------------------------------------------------------------------
+//! @return whether or not there is an object with the name of object in the
+//! subtree.
+//-----------------------------------------------------------------------------
+bool hasObject(BTNode* subRoot, BTNode* object)
+{
+    assert(subRoot != NULL);
+    assert(object  != NULL);
+
+    if (!isQuestion(subRoot)) { return isSameValue(subRoot, object); }
+
+    return hasObject(getRight(subRoot), object) || hasObject(getLeft(subRoot), object);
+}
+
+//-----------------------------------------------------------------------------
+//! @return whether or not there are objects in the subtree that aren't in
+//! the table.
+//-----------------------------------------------------------------------------
+bool hasUnknown(ObjectTable* objects, BTNode* subRoot)
+{
+    assert(objects != NULL);
+    assert(subRoot != NULL);
+
+    if (!isQuestion(subRoot)) { return tableFind(objects, subRoot) == NULL; }
+
+    return hasUnknown(objects, getRight(subRoot)) || hasUnknown(objects, getLeft(subRoot));
+}
+
+//-----------------------------------------------------------------------------
+// Open addressing by the value hashes. The table is made big enough for all
+// the objects of both trees at the start, so it never grows and can be read
+// by several threads at once.
+//-----------------------------------------------------------------------------
+bool newObjectTable(ObjectTable* objects, size_t maxObjects)
+{
+    assert(objects != NULL);
+
+    size_t capacity = MERGE_MIN_CAPACITY;
+    while (capacity < 2 * maxObjects) { capacity *= 2; }
+
+    objects->slots = (BTNode**) memAlloc(MEM_INDEXES, capacity, sizeof(BTNode*));
+    CHECK_NULL(objects->slots, return false);
+
+    objects->capacity = capacity;
+
+    return true;
+}
+
+bool tableInsert(ObjectTable* objects, BTNode* object)
+{
+    assert(objects != NULL);
+    assert(object  != NULL);
+
+    size_t index = getValueHash(object) & (objects->capacity - 1);
+    while (objects->slots[index] != NULL)
+    {
+        if (isSameValue(objects->slots[index], object)) { return false; }
+
+        index = (index + 1) & (objects->capacity - 1);
+    }
+
+    objects->slots[index] = object;
+
+    return true;
+}
+
+BTNode* tableFind(ObjectTable* objects, BTNode* object)
+{
+    assert(objects != NULL);
+    assert(object  != NULL);
+
+    size_t index = getValueHash(object) & (objects->capacity - 1);
+    while (objects->slots[index] != NULL)
+    {
+        if (isSameValue(objects->slots[index], object)) { return objects->slots[index]; }
+
+        index = (index + 1) & (objects->capacity - 1);
+    }
+
+    return NULL;
+}
+
+bool tableInsertStep(BTNode* node, va_list args)
+{
+    assert(node != NULL);
+
+    ObjectTable* objects = va_arg(args, ObjectTable*);
+
+    if (!isQuestion(node)) { tableInsert(objects, node); }
+
+    return BT_TRAVERSE_RUN;
+}
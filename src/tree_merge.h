@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdio.h>
+#include "binary_tree.h"
+
+//-----------------------------------------------------------------------------
+// grafted is the number of source subtrees put into the target, added is 
+// the number of objects they have brought. Duplicates are source objects 
+// left out because the target already knows them elsewhere and conflicts 
+// are places where source objects couldn't be put into the target.
+//-----------------------------------------------------------------------------
+struct MergeReport
+{
+    size_t grafted      = 0;
+    size_t added        = 0;
+    size_t duplicates   = 0;
+    size_t conflicts    = 0;
+
+    size_t threadsUsed  = 0;
+    double milliseconds = 0;
+};
+
+bool mergeTrees (BinaryTree* target, BTNode* source, size_t threadsCount, FILE* output, MergeReport* report);
@@ -0,0 +1,382 @@
+#include <assert.h>
+#include <chrono>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "tree_report.h"
+#include "memory_tags.h"
+
+#define CHECK_NULL(value, action) if (value == NULL) { action; }
+
+static const size_t REPORT_TASKS_PER_THREAD = 8;
+static const size_t REPORT_MIN_TASK_LEAVES  = 4096;
+
+//-----------------------------------------------------------------------------
+// The top of the tree is split into subtrees (the biggest one is split until
+// there are enough of them), the subtrees are handed out to threads, each 
+// thread counts everything in one traversal into its own partial report and
+// the partial reports are merged. Objects are collected with their value 
+// hashes, so duplicates are found by sorting them once at the end.
+//-----------------------------------------------------------------------------
+struct ReportTask
+{
+    BTNode* node  = NULL;
+    size_t  depth = 0;
+};
+
+struct ReportObject
+{
+    uint32_t hash = 0;
+    BTNode*  node = NULL;
+};
+
+struct PartialReport
+{
+    size_t        objects           = 0;
+    size_t        questions         = 0;
+    size_t        maxDepth          = 0;
+    size_t        depthSum          = 0;
+    double        weightSum         = 0;
+    double        weightedDepth     = 0;
+    size_t        valueBytes        = 0;
+
+    size_t*       histogram         = NULL;
+    size_t        histogramCapacity = 0;
+
+    ReportTask*   stack             = NULL;
+    size_t        stackCapacity     = 0;
+
+    ReportObject* values            = NULL;
+    size_t        valuesCount       = 0;
+    size_t        valuesCapacity    = 0;
+
+    bool          isOutOfMemory     = false;
+};
+
+struct ReportJob
+{
+    ReportTask*    tasks      = NULL;
+    size_t         tasksCount = 0;
+    size_t         nextTask   = 0;
+    PartialReport* partials   = NULL;
+};
+
+size_t splitTop        (BTNode* root, ReportTask* tasks, size_t maxTasks, PartialReport* top);
+void   reportWorker    (ReportJob* job, size_t thread);
+void   reportSubtree   (PartialReport* partial, ReportTask task);
+void   reportNode      (PartialReport* partial, BTNode* node, size_t depth);
+void   deletePartial   (PartialReport* partial);
+bool   mergePartial    (PartialReport* total, PartialReport* partial);
+size_t countDuplicates (ReportObject* values, size_t count);
+int    compareHashes   (const void* first, const void* second);
+
+//-----------------------------------------------------------------------------
+//! Computes the statistics of the whole tree in one traversal.
+//!
+//! @param [in] root
+//! @param [in] threadsCount 0 for the number of hardware threads
+//!
+//! @return report or NULL if out of memory.
+//-----------------------------------------------------------------------------
+TreeReport* newTreeReport(BTNode* root, size_t threadsCount)
+{
+    assert(root != NULL);
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (threadsCount == 0) { threadsCount = std::thread::hardware_concurrency(); }
+    if (threadsCount == 0) { threadsCount = 1; }
+
+    size_t maxThreads = getLeavesCount(root) / REPORT_MIN_TASK_LEAVES + 1;
+    if (threadsCount > maxThreads) { threadsCount = maxThreads; }
+
+    ReportJob job = {};
+
+    size_t maxTasks = threadsCount * REPORT_TASKS_PER_THREAD;
+
+    job.tasks    = (ReportTask*)    memAlloc(MEM_REPORTS, maxTasks,         sizeof(ReportTask));
+    job.partials = (PartialReport*) memAlloc(MEM_REPORTS, threadsCount + 1, sizeof(PartialReport));
+    if (job.tasks == NULL || job.partials == NULL)
+    {
+        memFree(job.tasks);
+        memFree(job.partials);
+        return NULL;
+    }
+
+    for (size_t i = 0; i <= threadsCount; i++) { job.partials[i] = {}; }
+
+    // the last partial report is for the questions above the subtrees
+    PartialReport* total = &job.partials[threadsCount];
+    job.tasksCount = splitTop(root, job.tasks, maxTasks, total);
+
+    // the calling thread works too
+    std::thread* threads = threadsCount > 1 ? new std::thread[threadsCount - 1] : NULL;
+    for (size_t i = 0; i + 1 < threadsCount; i++)
+    {
+        threads[i] = std::thread(reportWorker, &job, i + 1);
+    }
+
+    reportWorker(&job, 0);
+
+    for (size_t i = 0; i + 1 < threadsCount; i++)
+    {
+        threads[i].join();
+    }
+
+    delete[] threads;
+
+    for (size_t i = 0; i < threadsCount; i++)
+    {
+        if (!mergePartial(total, &job.partials[i])) { total->isOutOfMemory = true; }
+
+        deletePartial(&job.partials[i]);
+    }
+
+    TreeReport* report = (TreeReport*) memAlloc(MEM_REPORTS, 1, sizeof(TreeReport));
+    if (report == NULL || total->isOutOfMemory)
+    {
+        memFree(report);
+        deletePartial(total);
+        memFree(job.tasks);
+        memFree(job.partials);
+
+        return NULL;
+    }
+
+    *report = {};
+
+    report->objects        = total->objects;
+    report->questions      = total->questions;
+    report->maxDepth       = total->maxDepth;
+    report->depthHistogram = total->histogram;
+    report->averageDepth   = (double) total->depthSum / total->objects;
+    report->averageGame    = total->weightedDepth / total->weightSum;
+    report->valueBytes     = total->valueBytes;
+    report->duplicates     = countDuplicates(total->values, total->valuesCount);
+    report->threadsUsed    = threadsCount;
+
+    total->histogram = NULL;
+    deletePartial(total);
+    memFree(job.tasks);
+    memFree(job.partials);
+
+    report->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    return report;
+}
+
+void deleteTreeReport(TreeReport* report)
+{
+    assert(report != NULL);
+
+    memFree(report->depthHistogram);
+    memFree(report);
+}
+
+//-----------------------------------------------------------------------------
+//! Splits the biggest subtree until there are maxTasks of them or they are
+//! all small. Questions that have been split are counted in top.
+//!
+//! @return number of tasks.
+//-----------------------------------------------------------------------------
+size_t splitTop(BTNode* root, ReportTask* tasks, size_t maxTasks, PartialReport* top)
+{
+    assert(root  != NULL);
+    assert(tasks != NULL);
+    assert(top   != NULL);
+    assert(maxTasks > 0);
+
+    tasks[0] = { root, 0 };
+    size_t tasksCount = 1;
+
+    while (tasksCount < maxTasks)
+    {
+        size_t biggest = 0;
+        for (size_t i = 1; i < tasksCount; i++)
+        {
+            if (getLeavesCount(tasks[i].node) > getLeavesCount(tasks[biggest].node)) { biggest = i; }
+        }
+
+        ReportTask task = tasks[biggest];
+        if (!isQuestion(task.node) || getLeavesCount(task.node) < REPORT_MIN_TASK_LEAVES) { break; }
+
+        reportNode(top, task.node, task.depth);
+
+        tasks[biggest]      = { getLeft(task.node),  task.depth + 1 };
+        tasks[tasksCount++] = { getRight(task.node), task.depth + 1 };
+    }
+
+    return tasksCount;
+}
+
+void reportWorker(ReportJob* job, size_t thread)
+{
+    assert(job != NULL);
+
+    size_t task = 0;
+    while ((task = __atomic_fetch_add(&job->nextTask, 1, __ATOMIC_RELAXED)) < job->tasksCount)
+    {
+        reportSubtree(&job->partials[thread], job->tasks[task]);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Traverses the subtree with an explicit stack, so that degenerate trees of
+//! millions of nodes don't overflow the thread's stack.
+//-----------------------------------------------------------------------------
+void reportSubtree(PartialReport* partial, ReportTask task)
+{
+    assert(partial != NULL);
+
+    size_t stackSize = 0;
+
+    if (!memReserve(MEM_STACKS, (void**) &partial->stack, &partial->stackCapacity, 1, sizeof(ReportTask)))
+    {
+        partial->isOutOfMemory = true;
+        return;
+    }
+
+    partial->stack[stackSize++] = task;
+
+    while (stackSize > 0)
+    {
+        ReportTask current = partial->stack[--stackSize];
+
+        reportNode(partial, current.node, current.depth);
+
+        if (!isQuestion(current.node)) { continue; }
+
+        if (!memReserve(MEM_STACKS, (void**) &partial->stack, &partial->stackCapacity, stackSize + 2, sizeof(ReportTask)))
+        {
+            partial->isOutOfMemory = true;
+            return;
+        }
+
+        partial->stack[stackSize++] = { getRight(current.node), current.depth + 1 };
+        partial->stack[stackSize++] = { getLeft(current.node),  current.depth + 1 };
+    }
+}
+
+void reportNode(PartialReport* partial, BTNode* node, size_t depth)
+{
+    assert(partial != NULL);
+    assert(node != NULL);
+
+    partial->valueBytes += getValueLength(node) + 1;
+
+    if (isQuestion(node))
+    {
+        partial->questions++;
+        return;
+    }
+
+    double weight = getHits(node) + 1;
+
+    partial->objects++;
+    if (depth > partial->maxDepth) { partial->maxDepth = depth; }
+    partial->depthSum      += depth;
+    partial->weightSum     += weight;
+    partial->weightedDepth += weight * depth;
+
+    if (!memReserve(MEM_REPORTS, (void**) &partial->histogram, &partial->histogramCapacity, depth + 1, sizeof(size_t)) ||
+        !memReserve(MEM_REPORTS, (void**) &partial->values, &partial->valuesCapacity, partial->valuesCount + 1, sizeof(ReportObject)))
+    {
+        partial->isOutOfMemory = true;
+        return;
+    }
+
+    partial->histogram[depth]++;
+    partial->values[partial->valuesCount++] = { getValueHash(node), node };
+}
+
+void deletePartial(PartialReport* partial)
+{
+    assert(partial != NULL);
+
+    memFree(partial->histogram);
+    memFree(partial->stack);
+    memFree(partial->values);
+
+    *partial = {};
+}
+
+bool mergePartial(PartialReport* total, PartialReport* partial)
+{
+    assert(total   != NULL);
+    assert(partial != NULL);
+
+    if (partial->isOutOfMemory) { return false; }
+
+    total->objects       += partial->objects;
+    total->questions     += partial->questions;
+    total->depthSum      += partial->depthSum;
+    total->weightSum     += partial->weightSum;
+    total->weightedDepth += partial->weightedDepth;
+    total->valueBytes    += partial->valueBytes;
+
+    if (partial->objects == 0) { return true; }
+
+    if (partial->maxDepth > total->maxDepth) { total->maxDepth = partial->maxDepth; }
+
+    if (!memReserve(MEM_REPORTS, (void**) &total->histogram, &total->histogramCapacity, total->maxDepth + 1, sizeof(size_t)) ||
+        !memReserve(MEM_REPORTS, (void**) &total->values, &total->valuesCapacity, total->valuesCount + partial->valuesCount, sizeof(ReportObject)))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i <= partial->maxDepth; i++) { total->histogram[i] += partial->histogram[i]; }
+
+    memcpy(total->values + total->valuesCount, partial->values, partial->valuesCount * sizeof(ReportObject));
+    total->valuesCount += partial->valuesCount;
+
+    return true;
+}
+
+int compareHashes(const void* first, const void* second)
+{
+    uint32_t hash1 = ((const ReportObject*) first)->hash;
+    uint32_t hash2 = ((const ReportObject*) second)->hash;
+
+    return (hash1 > hash2) - (hash1 < hash2);
+}
+
+//-----------------------------------------------------------------------------
+//! Objects are sorted by hashes only, so that the nodes are not touched while
+//! sorting, and the names are compared within the (short) runs of equal 
+//! hashes.
+//!
+//! @return number of objects that have the same name as some other object
+//! (a name that occurs n times gives n - 1 duplicates).
+//-----------------------------------------------------------------------------
+size_t countDuplicates(ReportObject* values, size_t count)
+{
+    if (count == 0) { return 0; }
+
+    assert(values != NULL);
+
+    qsort(values, count, sizeof(ReportObject), &compareHashes);
+
+    size_t duplicates = 0;
+    size_t runStart   = 0;
+    for (size_t i = 1; i < count; i++)
+    {
+        if (values[i].hash != values[runStart].hash)
+        {
+            runStart = i;
+            continue;
+        }
+
+        const char* value = getValue(values[i].node);
+        for (size_t j = runStart; j < i; j++)
+        {
+            if (strcmp(getValue(values[j].node), value) == 0)
+            {
+                duplicates++;
+                break;
+            }
+        }
+    }
+
+    return duplicates;
+}
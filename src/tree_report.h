@@ -0,0 +1,29 @@
+#pragma once
+
+#include "binary_tree.h"
+
+//-----------------------------------------------------------------------------
+// depthHistogram[d] is the number of objects asked d questions, it has 
+// maxDepth + 1 elements. Games are weighted by hits + 1, as in the optimizer.
+// valueBytes is the total size of all values with their terminators and
+// duplicates are objects with the same name as some other object.
+//-----------------------------------------------------------------------------
+struct TreeReport
+{
+    size_t  objects         = 0;
+    size_t  questions       = 0;
+    size_t  maxDepth        = 0;
+    size_t* depthHistogram  = NULL;
+
+    double  averageDepth    = 0;
+    double  averageGame     = 0;
+
+    size_t  valueBytes      = 0;
+    size_t  duplicates      = 0;
+
+    size_t  threadsUsed     = 0;
+    double  milliseconds    = 0;
+};
+
+TreeReport* newTreeReport    (BTNode* root, size_t threadsCount);
+void        deleteTreeReport (TreeReport* report);
@@ -1,12 +1,23 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include "ui.h"
+#include "memory_tags.h"
 
+#ifdef _WIN32
+#include <conio.h>
 #include <windows.h>
 #include <Servprov.h>
 #define TX_USE_SPEAK
 #include "../libs/TX/TXLib.h"
+#else
+#include <termios.h>
+#include <unistd.h>
+#endif
 
 struct UI_Speaker
 {
@@ -17,19 +28,118 @@ struct UI_Speaker
     char*  buffer        = NULL;
 };
 
+//-----------------------------------------------------------------------------
+// Everything the UI prints goes through one queue processed by a background
+// thread, so phrases can be typed out word by word and spoken while the
+// program already waits for the answer. Plain output is queued too, 
+// otherwise it would overtake the phrases being typed out. Messages are 
+// numbered, hushing marks all messages queued so far to be shown at once.
+//
+// Messages are placed one after another in a ring buffer reused for the
+// whole session, a message stays there until it's played. When there's no
+// room the caller waits for the worker, the ring only grows for a message 
+// that doesn't fit into it even when it's empty.
+//-----------------------------------------------------------------------------
+struct UI_Message
+{
+    UI_Message* next   = NULL;
+    size_t      number = 0;
+    size_t      length = 0;
+    double      speed  = 0; // 0 for plain output
+    bool        speak  = false;
+};
+
+struct UI_Pipeline
+{
+    std::mutex              mutex;
+    std::condition_variable changed;
+    std::thread*            worker   = NULL;
+
+    char*                   ring         = NULL;
+    size_t                  ringCapacity = 0;
+
+    UI_Message*             head         = NULL; // oldest message in the ring, it's being played
+    UI_Message*             tail         = NULL;
+    size_t                  queued       = 0;
+    size_t                  played       = 0;
+    size_t                  hushed       = 0;
+    bool                    stopping     = false;
+
+    UI_OutputBackend        output       = UI_ConsoleOutput();
+};
+
+struct UI_Recording
+{
+    char*  text          = NULL;
+    size_t textLength    = 0;
+    size_t textCapacity  = 0;
+
+    char*  speech         = NULL;
+    size_t speechLength   = 0;
+    size_t speechCapacity = 0;
+
+    size_t delay          = 0;
+};
+
+//-----------------------------------------------------------------------------
+// Answers read from memory, keys and lines are separated by '\n'.
+//-----------------------------------------------------------------------------
+struct UI_InputScript
+{
+    char*  text     = NULL;
+    size_t length   = 0;
+    size_t position = 0;
+};
+
 const size_t NOT_DELIM_SYMBOL_DELAY = 55;
 const size_t DELIM_SYMBOL_DELAY     = 320;
-
-size_t numOfOccurences(const char* str, char ch);
+const char*  DELIM_SYMBOLS          = " \t\n";
+const char*  BLANK_SYMBOLS          = " \t\r\n";
+const int    END_OF_TRANSMISSION    = 4; // Ctrl+D in raw mode
+const size_t UI_RING_MIN_CAPACITY   = 4096;
+const size_t UI_RING_NO_SPACE       = (size_t) -1;
+
+static UI_Pipeline pipeline;
+
+// input and direct output are per thread, so that every thread can play its own game
+static thread_local UI_InputBackend  threadInput  = UI_TerminalInput();
+static thread_local UI_OutputBackend threadOutput = {};
+
+size_t numOfOccurences (const char* src, size_t length, const char* dst);
+
+void        enqueueMessage (const char* text, size_t length, double speed, bool speak);
+UI_Message* reserveMessage (size_t length, std::unique_lock<std::mutex>& lock);
+void        queueMessage   (UI_Message* message, size_t length, double speed, bool speak);
+size_t      findRingSpace  (size_t size);
+size_t      messageSize    (size_t length);
+void        pipelineWorker ();
+void        playMessage    (UI_Message* message, std::unique_lock<std::mutex>& lock);
+bool        isHushed       (UI_Message* message);
+
+void   consoleWrite    (void* context, const char* text, size_t length);
+void   consoleSpeak    (void* context, const char* phrase);
+void   nullWrite       (void* context, const char* text, size_t length);
+void   nullPause       (void* context, size_t milliseconds);
+void   recordingWrite  (void* context, const char* text, size_t length);
+void   recordingSpeak  (void* context, const char* phrase);
+void   recordingPause  (void* context, size_t milliseconds);
+bool   appendRecorded  (char** buffer, size_t* length, size_t* capacity, const char* text, size_t textLength);
+
+char   readOption      ();
+int    stdioReadKey    (void* context);
+bool   stdioReadLine   (void* context, char* dst, size_t dstSize);
+int    terminalReadKey (void* context);
+int    scriptReadKey   (void* context);
+bool   scriptReadLine  (void* context, char* dst, size_t dstSize);
 
 void UI_PrintDivider(size_t length, char divider)
 {
     for (int i = 0; i < length; i++)
     {
-        putchar(divider);
+        UI_Print("%c", divider);
     }
 
-    putchar('\n');
+    UI_Print("\n");
 }
 
 //-----------------------------------------------------------------------------
@@ -50,16 +160,11 @@ void UI_PrintCentered(size_t length, const char* str)
 
     if (strLength >= length)
     {
-        printf("%s\n", str);
+        UI_Print("%s\n", str);
         return;
     }
 
-    for (int i = (length - strLength) / 2; i > 0; i--)
-    {
-        putchar(' ');
-    }
-
-    printf("%s\n", str);
+    UI_Print("%*s%s\n", (int) (length - strLength) / 2, "", str);
 }
 
 void UI_PrintOptions(const char* options, ...)
@@ -67,11 +172,11 @@ void UI_PrintOptions(const char* options, ...)
     assert(options != NULL);
 
     va_list messages = {};
-    va_start(messages, &options);
+    va_start(messages, options);
 
     for (size_t i = 0; options[i] != '\0'; i++)
     {
-        printf("  [%c] %s\n", options[i], va_arg(messages, char*));
+        UI_Print("  [%c] %s\n", options[i], va_arg(messages, char*));
     }
 
     va_end(messages);
@@ -88,32 +193,31 @@ void UI_PrintOptions(const char* options, ...)
 //!
 //! @note alt can be NULL.
 //!
-//! @return option
+//! @return option or '\0' if there is no more input
 //-----------------------------------------------------------------------------
 char UI_GetOption(const char first, const char last, const char* alt)
 {
     assert(first <= last);
 
-    if (alt != NULL) { printf("  Choose an option (%c-%c or '%s'): ", first, last, alt); }
-    else             { printf("  Choose an option (%c-%c): ",         first, last); }
+    if (alt != NULL) { UI_Print("  Choose an option (%c-%c or '%s'): ", first, last, alt); }
+    else             { UI_Print("  Choose an option (%c-%c): ",         first, last); }
     
-    char option = 0;
-    scanf(" %c", &option);
-    while((option < first || option > last) && (alt == NULL || strchr(alt, option) == NULL))
+    char option = readOption();
+    while (option != '\0' && (option < first || option > last) && (alt == NULL || strchr(alt, option) == NULL))
     {
         if (alt != NULL) 
         { 
-            printf("  Incorrect input. Please enter an option from %c to %c or '%s': ", first, last, alt); 
+            UI_Print("  Incorrect input. Please enter an option from %c to %c or '%s': ", first, last, alt); 
         }
         else             
         { 
-            printf("  Incorrect input. Please enter an option from %c to %c: ", first, last); 
+            UI_Print("  Incorrect input. Please enter an option from %c to %c: ", first, last); 
         }
         
-        scanf(" %c", &option);
+        option = readOption();
     }
 
-    getchar(); // to skip '\n'
+    UI_Hush();
 
     return option;
 }
@@ -124,7 +228,7 @@ char UI_GetOption(const char first, const char last, const char* alt)
 //!
 //! @param [in] options  
 //!
-//! @return option
+//! @return option or '\0' if there is no more input
 //-----------------------------------------------------------------------------
 char UI_GetOption(const char* options)
 {
@@ -137,28 +241,27 @@ char UI_GetOption(const char* options)
     switch (optionsCount)
     {
         case 2:
-            printf("  Choose either '%c' or '%c': ", options[0], options[1]);
+            UI_Print("  Choose either '%c' or '%c': ", options[0], options[1]);
             break;
 
         case 3:
-            printf("  Choose '%c', '%c' or '%c': ", options[0], options[1], options[2]);
+            UI_Print("  Choose '%c', '%c' or '%c': ", options[0], options[1], options[2]);
             break;
 
         default:
-            printf("  Choose an option from ('%s'): ", options);
+            UI_Print("  Choose an option from ('%s'): ", options);
             break;
     }
     
-    char option = 0;
-    scanf(" %c", &option);
-    while(strchr(options, option) == NULL)
+    char option = readOption();
+    while (option != '\0' && strchr(options, option) == NULL)
     { 
-        printf("  Incorrect input. Please enter an option from '%s': ", options); 
+        UI_Print("  Incorrect input. Please enter an option from '%s': ", options); 
         
-        scanf(" %c", &option);
+        option = readOption();
     }
 
-    getchar(); // to skip '\n'
+    UI_Hush();
 
     return option;
 }
@@ -169,9 +272,13 @@ char* UI_AskStr(UI_Speaker* speaker, size_t size, const char* message, ...)
     assert(size > 0);
 
     va_list args = {};
-    va_start(args, &message);
+    va_start(args, message);
+
+    char* str = UI_VAskStr(speaker, size, message, args);
 
-    return UI_VAskStr(speaker, size, message, args);
+    va_end(args);
+
+    return str;
 }
 
 char* UI_VAskStr(UI_Speaker* speaker, size_t size, const char* message, va_list args)
@@ -179,7 +286,7 @@ char* UI_VAskStr(UI_Speaker* speaker, size_t size, const char* message, va_list
     assert(message != NULL);
     assert(size > 0);
 
-    char* str = (char*) calloc(size, sizeof(char));
+    char* str = (char*) memAlloc(MEM_UI, size, sizeof(char));
     if (str == NULL) { return NULL; }
 
     UI_VSAskStr(speaker, str, size, message, args);
@@ -193,7 +300,7 @@ void UI_SAskStr(UI_Speaker* speaker, char* dst, size_t dstSize, const char* mess
     assert(message != NULL);
 
     va_list args = {};
-    va_start(args, &message);
+    va_start(args, message);
 
     UI_VSAskStr(speaker, dst, dstSize, message, args);
 
@@ -206,15 +313,17 @@ void UI_VSAskStr(UI_Speaker* speaker, char* dst, size_t dstSize, const char* mes
     assert(message != NULL);
 
     if (speaker != NULL) { UI_VSay(speaker, message, args); }
-    else                 { vprintf(message, args); }
+    else                 { UI_VPrint(message, args); }
 
-    fgets(dst, dstSize, stdin);
+    if (!threadInput.readLine(threadInput.context, dst, dstSize)) { dst[0] = '\0'; }
     dst[strcspn(dst, "\r\n")] = '\0';
+
+    UI_Hush();
 }
 
 UI_Speaker* UI_NewSpeaker(size_t maxPhraseLength, bool speak)
 {
-    UI_Speaker* speaker = (UI_Speaker*) calloc(1, sizeof(UI_Speaker));
+    UI_Speaker* speaker = (UI_Speaker*) memAlloc(MEM_UI, 1, sizeof(UI_Speaker));
     if (speaker == NULL) { return NULL; }
 
     speaker->maxBufferSize = maxPhraseLength + 1;
@@ -235,10 +344,10 @@ void UI_DeleteSpeaker(UI_Speaker* speaker)
     speaker->curBufferSize = 0;
     speaker->maxBufferSize = 0;
 
-    free(speaker->buffer);
+    memFree(speaker->buffer);
     speaker->buffer = NULL;
 
-    free(speaker);
+    memFree(speaker);
 }
 
 double UI_GetSpeed(UI_Speaker* speaker)
@@ -281,11 +390,11 @@ void UI_SetMaxPhrLen(UI_Speaker* speaker, size_t maxPhraseLength)
     {
         if (speaker->buffer != NULL)
         {
-            speaker->buffer = (char*) realloc(speaker->buffer, speaker->maxBufferSize * sizeof(char));
+            speaker->buffer = (char*) memRealloc(MEM_UI, speaker->buffer, speaker->maxBufferSize * sizeof(char));
         }
         else
         {
-            speaker->buffer = (char*) calloc(speaker->maxBufferSize, sizeof(char));
+            speaker->buffer = (char*) memAlloc(MEM_UI, speaker->maxBufferSize, sizeof(char));
         }
         assert(speaker->buffer != NULL);
 
@@ -293,15 +402,15 @@ void UI_SetMaxPhrLen(UI_Speaker* speaker, size_t maxPhraseLength)
     }
 }
 
-size_t numOfOccurences(const char* src, const char* dst)
+size_t numOfOccurences(const char* src, size_t length, const char* dst)
 {
     assert(src != NULL);
     assert(dst != NULL);
 
     size_t count = 0;
-    for (; *src != '\0'; src++) 
+    for (size_t i = 0; i < length; i++) 
     { 
-        if (strchr(dst, *src) != NULL) 
+        if (strchr(dst, src[i]) != NULL) 
         {
             count++;
         } 
@@ -323,6 +432,10 @@ void UI_Say(UI_Speaker* speaker, const char* format, ...)
     va_end(args);
 }
 
+//-----------------------------------------------------------------------------
+//! Queues the phrase to be typed out (and spoken if speaker speaks) and 
+//! returns immediately.
+//-----------------------------------------------------------------------------
 void UI_VSay(UI_Speaker* speaker, const char* format, va_list args)
 {
     assert(speaker != NULL);
@@ -330,50 +443,743 @@ void UI_VSay(UI_Speaker* speaker, const char* format, va_list args)
 
     if (!UI_GetSpeak(speaker))
     {
-        vprintf(format, args);
-        va_end(args);
+        UI_VPrint(format, args);
         return;
     }
 
     char* buffer = speaker->buffer;
     assert(buffer != NULL);
 
-    char* strBufferEnd = buffer + UI_GetMaxPhrLen(speaker);
+    int length = vsnprintf(buffer, UI_GetMaxPhrLen(speaker) + 1, format, args);
+    if (length < 0) { return; }
+
+    if ((size_t) length > UI_GetMaxPhrLen(speaker)) { length = (int) UI_GetMaxPhrLen(speaker); }
+
+    enqueueMessage(buffer, length, UI_GetSpeed(speaker), true);
+}
+
+//-----------------------------------------------------------------------------
+//! Same as UI_Say for a ready text, nothing is formatted and the text isn't
+//! limited by the maximum phrase length.
+//-----------------------------------------------------------------------------
+void UI_SayText(UI_Speaker* speaker, const char* text, size_t length)
+{
+    assert(speaker != NULL);
+    assert(text    != NULL);
+
+    if (UI_GetSpeak(speaker)) { enqueueMessage(text, length, UI_GetSpeed(speaker), true); }
+    else                      { enqueueMessage(text, length, 0, false); }
+}
+
+void UI_Print(const char* format, ...)
+{
+    assert(format != NULL);
+
+    va_list args = {};
+    va_start(args, format);
+
+    UI_VPrint(format, args);
+
+    va_end(args);
+}
+
+//-----------------------------------------------------------------------------
+//! Queues plain output, so that it's printed after all the phrases said 
+//! before.
+//-----------------------------------------------------------------------------
+void UI_VPrint(const char* format, va_list args)
+{
+    assert(format != NULL);
+
+    char    smallBuffer[256] = "";
+    va_list argsCopy         = {};
+    va_copy(argsCopy, args);
+
+    int length = vsnprintf(smallBuffer, sizeof(smallBuffer), format, argsCopy);
+    va_end(argsCopy);
+
+    if (length < 0) { return; }
+
+    if ((size_t) length < sizeof(smallBuffer))
+    {
+        enqueueMessage(smallBuffer, length, 0, false);
+        return;
+    }
+
+    if (threadOutput.write == NULL)
+    {
+        std::unique_lock<std::mutex> lock(pipeline.mutex);
+
+        UI_Message* message = reserveMessage(length, lock);
+        if (message == NULL) { return; }
+
+        vsnprintf((char*) (message + 1), length + 1, format, args);
+        queueMessage(message, length, 0, false);
+
+        return;
+    }
+
+    char* buffer = (char*) memAlloc(MEM_UI, length + 1, sizeof(char));
+    if (buffer == NULL) { return; }
+
+    vsnprintf(buffer, length + 1, format, args);
+    enqueueMessage(buffer, length, 0, false);
+
+    memFree(buffer);
+}
+
+void enqueueMessage(const char* text, size_t length, double speed, bool speak)
+{
+    assert(text != NULL);
+
+    if (threadOutput.write != NULL)
+    {
+        threadOutput.write(threadOutput.context, text, length);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(pipeline.mutex);
+
+    UI_Message* message = reserveMessage(length, lock);
+    if (message == NULL) { return; }
+
+    memcpy(message + 1, text, length);
+    queueMessage(message, length, speed, speak);
+}
+
+//-----------------------------------------------------------------------------
+//! Finds room for a message in the ring, waits for the worker to play the 
+//! messages in the way if needed. Called with the pipeline locked.
+//!
+//! @param [in] length text length without the terminating '\0'
+//! @param [in] lock   lock of the pipeline
+//!
+//! @return message to put the text after and queue with queueMessage or 
+//!         NULL if out of memory.
+//-----------------------------------------------------------------------------
+UI_Message* reserveMessage(size_t length, std::unique_lock<std::mutex>& lock)
+{
+    if (pipeline.worker == NULL)
+    {
+        pipeline.stopping = false;
+        pipeline.worker   = new std::thread(pipelineWorker);
+
+        static bool isCloseRegistered = false;
+        if (!isCloseRegistered) { isCloseRegistered = atexit(UI_Close) == 0; }
+    }
+
+    size_t size = messageSize(length);
+
+    if (size > pipeline.ringCapacity)
+    {
+        // grown only when empty, so that no message has to be moved
+        pipeline.changed.wait(lock, []{ return pipeline.head == NULL; });
+
+        size_t newCapacity = pipeline.ringCapacity != 0 ? pipeline.ringCapacity : UI_RING_MIN_CAPACITY;
+        while (newCapacity < size) { newCapacity *= 2; }
+
+        char* ring = (char*) memRealloc(MEM_UI, pipeline.ring, newCapacity);
+        if (ring == NULL) { return NULL; }
+
+        pipeline.ring         = ring;
+        pipeline.ringCapacity = newCapacity;
+    }
+
+    size_t offset = UI_RING_NO_SPACE;
+    pipeline.changed.wait(lock, [size, &offset]{ return (offset = findRingSpace(size)) != UI_RING_NO_SPACE; });
+
+    return (UI_Message*) (pipeline.ring + offset);
+}
+
+//-----------------------------------------------------------------------------
+//! Queues a message reserved by reserveMessage with its text already in
+//! place. Called with the pipeline locked.
+//-----------------------------------------------------------------------------
+void queueMessage(UI_Message* message, size_t length, double speed, bool speak)
+{
+    assert(message != NULL);
+
+    *message = {};
+    message->number = ++pipeline.queued;
+    message->length = length;
+    message->speed  = speed;
+    message->speak  = speak;
+    ((char*) (message + 1))[length] = '\0';
+
+    if (pipeline.tail != NULL) { pipeline.tail->next = message; }
+    else                       { pipeline.head       = message; }
+    pipeline.tail = message;
+
+    pipeline.changed.notify_all();
+}
+
+//-----------------------------------------------------------------------------
+//! @return offset in the ring where a message of the given size fits or
+//!         UI_RING_NO_SPACE. A message never wraps around, the space left
+//!         at the end of the ring is skipped.
+//-----------------------------------------------------------------------------
+size_t findRingSpace(size_t size)
+{
+    if (pipeline.head == NULL) { return size <= pipeline.ringCapacity ? 0 : UI_RING_NO_SPACE; }
+
+    size_t start = (char*) pipeline.head - pipeline.ring;
+    size_t end   = (char*) pipeline.tail - pipeline.ring + messageSize(pipeline.tail->length);
+
+    if (pipeline.tail >= pipeline.head)
+    {
+        if (pipeline.ringCapacity - end >= size) { return end; }
+        if (start >= size)                       { return 0; }
+
+        return UI_RING_NO_SPACE;
+    }
 
-    vsnprintf(buffer, UI_GetMaxPhrLen(speaker) + 1, format, args);
+    return start - end >= size ? end : UI_RING_NO_SPACE;
+}
 
-    txSpeak("\a%s", buffer);
+//-----------------------------------------------------------------------------
+//! @return bytes a message takes in the ring with its text and '\0', 
+//!         rounded up so that the next message is aligned.
+//-----------------------------------------------------------------------------
+size_t messageSize(size_t length)
+{
+    size_t size = sizeof(UI_Message) + length + 1;
 
-    const char* delims = " \t\n";
+    return (size + alignof(UI_Message) - 1) / alignof(UI_Message) * alignof(UI_Message);
+}
 
-    char*  currStart  = buffer;
-    char*  currEnd    = NULL;
-    char   prevSymb   = 0;
-    size_t puncMarks  = 0;
-    size_t currLength = 0;
-    bool   currDelims = true;
+void pipelineWorker()
+{
+    std::unique_lock<std::mutex> lock(pipeline.mutex);
 
     while (true)
     {
-        if (strchr(delims, *currStart) != NULL) { currDelims = true; }
-        else                                    { currDelims = false; }
+        pipeline.changed.wait(lock, []{ return pipeline.head != NULL || pipeline.stopping; });
+        if (pipeline.head == NULL) { break; }
+
+        // the message is left in the queue while it's played, so that its space isn't reused
+        UI_Message* message = pipeline.head;
+        playMessage(message, lock);
+
+        pipeline.played = message->number;
+        pipeline.head   = message->next;
+        if (pipeline.head == NULL) { pipeline.tail = NULL; }
+
+        pipeline.changed.notify_all();
+    }
+}
+
+bool isHushed(UI_Message* message)
+{
+    assert(message != NULL);
+
+    return message->number <= pipeline.hushed || pipeline.stopping;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the message, for phrases word by word with delays depending on the
+//! word length and punctuation. Called with the pipeline locked, unlocks it
+//! while the output backend works.
+//-----------------------------------------------------------------------------
+void playMessage(UI_Message* message, std::unique_lock<std::mutex>& lock)
+{
+    assert(message != NULL);
+
+    UI_OutputBackend output = pipeline.output;
+    const char*      text   = (const char*) (message + 1);
+
+    if (message->speed == 0 || isHushed(message))
+    {
+        lock.unlock();
+        output.write(output.context, text, message->length);
+        lock.lock();
 
-        currEnd = currStart + (currDelims ? strspn(currStart, delims) : strcspn(currStart, delims));
-        prevSymb = *currEnd;
-        *currEnd = '\0';
+        return;
+    }
 
-        printf("%s", currStart);
+    if (message->speak && output.speak != NULL)
+    {
+        lock.unlock();
+        output.speak(output.context, text);
+        lock.lock();
+    }
 
-        if (!currDelims)
+    const char* textEnd = text + message->length;
+    while (text < textEnd)
+    {
+        if (isHushed(message))
         {
-            puncMarks  = numOfOccurences(currStart, UI_PUNCTUATION_MARKS);
-            currLength = currEnd - currStart;
+            lock.unlock();
+            output.write(output.context, text, textEnd - text);
+            lock.lock();
 
-            txSleep((NOT_DELIM_SYMBOL_DELAY * (currLength - puncMarks) + DELIM_SYMBOL_DELAY * puncMarks) / UI_GetSpeed(speaker));
+            break;
         }
 
-        *currEnd = prevSymb;
-        if (currEnd >= strBufferEnd || *currEnd == '\0') { break; }
-        currStart = currEnd;
+        bool   isDelims = strchr(DELIM_SYMBOLS, *text) != NULL;
+        size_t length   = isDelims ? strspn(text, DELIM_SYMBOLS) : strcspn(text, DELIM_SYMBOLS);
+
+        lock.unlock();
+        output.write(output.context, text, length);
+        lock.lock();
+
+        if (!isDelims)
+        {
+            size_t puncMarks = numOfOccurences(text, length, UI_PUNCTUATION_MARKS);
+            size_t delay     = (NOT_DELIM_SYMBOL_DELAY * (length - puncMarks) + DELIM_SYMBOL_DELAY * puncMarks) / message->speed;
+
+            if (output.pause != NULL)
+            {
+                lock.unlock();
+                output.pause(output.context, delay);
+                lock.lock();
+            }
+            else
+            {
+                pipeline.changed.wait_for(lock, std::chrono::milliseconds(delay), [message]{ return isHushed(message); });
+            }
+        }
+
+        text += length;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Shows everything said so far at once without waiting for it to be typed
+//! out and stops the speech. Called when the user has answered.
+//-----------------------------------------------------------------------------
+void UI_Hush()
+{
+    if (threadOutput.write != NULL) { return; }
+
+    UI_OutputBackend output = {};
+
+    {
+        std::lock_guard<std::mutex> lock(pipeline.mutex);
+
+        pipeline.hushed = pipeline.queued;
+        output          = pipeline.output;
+
+        pipeline.changed.notify_all();
+    }
+
+    if (output.silence != NULL) { output.silence(output.context); }
+}
+
+//-----------------------------------------------------------------------------
+//! Waits until everything queued is written.
+//-----------------------------------------------------------------------------
+void UI_Flush()
+{
+    std::unique_lock<std::mutex> lock(pipeline.mutex);
+
+    if (pipeline.worker == NULL) { return; }
+
+    pipeline.changed.wait(lock, []{ return pipeline.played == pipeline.queued; });
+}
+
+//-----------------------------------------------------------------------------
+//! Writes out everything queued at once, stops the output thread and frees
+//! the ring. They're set up again by the next output.
+//-----------------------------------------------------------------------------
+void UI_Close()
+{
+    std::thread* worker = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(pipeline.mutex);
+
+        worker            = pipeline.worker;
+        pipeline.worker   = NULL;
+        pipeline.stopping = true;
+
+        pipeline.changed.notify_all();
     }
-}
\ No newline at end of file
+
+    if (worker == NULL) { return; }
+
+    worker->join();
+    delete worker;
+
+    std::lock_guard<std::mutex> lock(pipeline.mutex);
+
+    memFree(pipeline.ring);
+    pipeline.ring         = NULL;
+    pipeline.ringCapacity = 0;
+}
+
+//-----------------------------------------------------------------------------
+//! Sets where the output goes, everything queued before is written to the 
+//! previous backend.
+//-----------------------------------------------------------------------------
+void UI_SetOutput(UI_OutputBackend output)
+{
+    assert(output.write != NULL);
+
+    UI_Flush();
+
+    std::lock_guard<std::mutex> lock(pipeline.mutex);
+    pipeline.output = output;
+}
+
+void consoleWrite(void* context, const char* text, size_t length)
+{
+    assert(text != NULL);
+
+    fwrite(text, sizeof(char), length, stdout);
+    fflush(stdout);
+}
+
+void consoleSpeak(void* context, const char* phrase)
+{
+    assert(phrase != NULL);
+
+    #ifdef _WIN32
+    txSpeak("\a%s", phrase);
+    #endif
+}
+
+//-----------------------------------------------------------------------------
+//! Console output, phrases are typed out in real time and spoken on Windows.
+//! The phrase being spoken isn't interrupted by UI_Hush, the ones that 
+//! haven't started yet are skipped.
+//-----------------------------------------------------------------------------
+UI_OutputBackend UI_ConsoleOutput()
+{
+    UI_OutputBackend output = {};
+
+    output.write = consoleWrite;
+    output.speak = consoleSpeak;
+
+    return output;
+}
+
+void nullWrite(void* context, const char* text, size_t length)
+{
+    assert(text != NULL);
+}
+
+void nullPause(void* context, size_t milliseconds) {}
+
+//-----------------------------------------------------------------------------
+//! Discards all output without any delays.
+//-----------------------------------------------------------------------------
+UI_OutputBackend UI_NullOutput()
+{
+    UI_OutputBackend output = {};
+
+    output.write = nullWrite;
+    output.pause = nullPause;
+
+    return output;
+}
+
+UI_Recording* UI_NewRecording()
+{
+    UI_Recording* recording = (UI_Recording*) memAlloc(MEM_UI, 1, sizeof(UI_Recording));
+    if (recording == NULL) { return NULL; }
+
+    *recording = {};
+
+    return recording;
+}
+
+void UI_DeleteRecording(UI_Recording* recording)
+{
+    assert(recording != NULL);
+
+    memFree(recording->text);
+    memFree(recording->speech);
+    memFree(recording);
+}
+
+bool appendRecorded(char** buffer, size_t* length, size_t* capacity, const char* text, size_t textLength)
+{
+    assert(buffer   != NULL);
+    assert(length   != NULL);
+    assert(capacity != NULL);
+    assert(text     != NULL);
+
+    if (*length + textLength + 1 > *capacity)
+    {
+        size_t newCapacity = *capacity != 0 ? *capacity * 2 : 256;
+        while (*length + textLength + 1 > newCapacity) { newCapacity *= 2; }
+
+        char* newBuffer = (char*) memRealloc(MEM_UI, *buffer, newCapacity);
+        if (newBuffer == NULL) { return false; }
+
+        *buffer   = newBuffer;
+        *capacity = newCapacity;
+    }
+
+    memcpy(*buffer + *length, text, textLength);
+    *length += textLength;
+    (*buffer)[*length] = '\0';
+
+    return true;
+}
+
+void recordingWrite(void* context, const char* text, size_t length)
+{
+    assert(context != NULL);
+
+    UI_Recording* recording = (UI_Recording*) context;
+    appendRecorded(&recording->text, &recording->textLength, &recording->textCapacity, text, length);
+}
+
+void recordingSpeak(void* context, const char* phrase)
+{
+    assert(context != NULL);
+
+    UI_Recording* recording = (UI_Recording*) context;
+    appendRecorded(&recording->speech, &recording->speechLength, &recording->speechCapacity, phrase, strlen(phrase));
+    appendRecorded(&recording->speech, &recording->speechLength, &recording->speechCapacity, "\n", 1);
+}
+
+void recordingPause(void* context, size_t milliseconds)
+{
+    assert(context != NULL);
+
+    ((UI_Recording*) context)->delay += milliseconds;
+}
+
+//-----------------------------------------------------------------------------
+//! Keeps everything written and spoken in memory. Delays are summed up 
+//! instead of waiting.
+//-----------------------------------------------------------------------------
+UI_OutputBackend UI_RecordingOutput(UI_Recording* recording)
+{
+    assert(recording != NULL);
+
+    UI_OutputBackend output = {};
+
+    output.write   = recordingWrite;
+    output.speak   = recordingSpeak;
+    output.pause   = recordingPause;
+    output.context = recording;
+
+    return output;
+}
+
+const char* UI_RecordedText(UI_Recording* recording)
+{
+    assert(recording != NULL);
+    return recording->text != NULL ? recording->text : "";
+}
+
+//-----------------------------------------------------------------------------
+//! @return spoken phrases, one per line.
+//-----------------------------------------------------------------------------
+const char* UI_RecordedSpeech(UI_Recording* recording)
+{
+    assert(recording != NULL);
+    return recording->speech != NULL ? recording->speech : "";
+}
+
+//-----------------------------------------------------------------------------
+//! @return total delay between words in milliseconds.
+//-----------------------------------------------------------------------------
+size_t UI_RecordedDelay(UI_Recording* recording)
+{
+    assert(recording != NULL);
+    return recording->delay;
+}
+
+//-----------------------------------------------------------------------------
+//! Sets where the calling thread's output goes bypassing the shared queue:
+//! it's written at once, neither typed out nor spoken. NULL returns the 
+//! thread to the shared queue.
+//-----------------------------------------------------------------------------
+void UI_SetThreadOutput(const UI_OutputBackend* output)
+{
+    if (output == NULL) { threadOutput = {}; }
+    else                { threadOutput = *output; }
+}
+
+//-----------------------------------------------------------------------------
+//! Sets where the calling thread reads answers from.
+//-----------------------------------------------------------------------------
+void UI_SetInput(UI_InputBackend input)
+{
+    assert(input.readKey  != NULL);
+    assert(input.readLine != NULL);
+
+    threadInput = input;
+}
+
+char readOption()
+{
+    int key = threadInput.readKey(threadInput.context);
+
+    return key == EOF ? '\0' : (char) key;
+}
+
+//-----------------------------------------------------------------------------
+//! Reads the first non-blank character of a line, the rest of the line is
+//! skipped.
+//-----------------------------------------------------------------------------
+int stdioReadKey(void* context)
+{
+    int key = getchar();
+    while (key != EOF && strchr(BLANK_SYMBOLS, key) != NULL) { key = getchar(); }
+
+    int next = key;
+    while (next != EOF && next != '\n') { next = getchar(); }
+
+    return key;
+}
+
+bool stdioReadLine(void* context, char* dst, size_t dstSize)
+{
+    assert(dst != NULL);
+
+    return fgets(dst, dstSize, stdin) != NULL;
+}
+
+//-----------------------------------------------------------------------------
+//! Line buffered standard input, works with pipes and files.
+//-----------------------------------------------------------------------------
+UI_InputBackend UI_StdioInput()
+{
+    UI_InputBackend input = {};
+
+    input.readKey  = stdioReadKey;
+    input.readLine = stdioReadLine;
+
+    return input;
+}
+
+//-----------------------------------------------------------------------------
+//! Reads a single key press without waiting for Enter. The key is echoed.
+//-----------------------------------------------------------------------------
+int terminalReadKey(void* context)
+{
+    int key = ' ';
+
+    #ifdef _WIN32
+    while (key != END_OF_TRANSMISSION && strchr(BLANK_SYMBOLS, key) != NULL) { key = _getch(); }
+    #else
+    if (!isatty(STDIN_FILENO)) { return stdioReadKey(context); }
+
+    struct termios original = {};
+    tcgetattr(STDIN_FILENO, &original);
+
+    struct termios raw = original;
+    raw.c_lflag     &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN]   = 1;
+    raw.c_cc[VTIME]  = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+
+    while (key != EOF && key != END_OF_TRANSMISSION && strchr(BLANK_SYMBOLS, key) != NULL) { key = getchar(); }
+
+    tcsetattr(STDIN_FILENO, TCSANOW, &original);
+    #endif
+
+    if (key == EOF || key == END_OF_TRANSMISSION) { return EOF; }
+
+    UI_Print("%c\n", key);
+
+    return key;
+}
+
+//-----------------------------------------------------------------------------
+//! Console input with single key answers. Lines are read in the usual line
+//! buffered mode to keep line editing. If stdin isn't a terminal, works as
+//! UI_StdioInput.
+//-----------------------------------------------------------------------------
+UI_InputBackend UI_TerminalInput()
+{
+    UI_InputBackend input = {};
+
+    input.readKey  = terminalReadKey;
+    input.readLine = stdioReadLine;
+
+    return input;
+}
+
+UI_InputScript* UI_NewInputScript(const char* text)
+{
+    assert(text != NULL);
+
+    UI_InputScript* script = (UI_InputScript*) memAlloc(MEM_UI, 1, sizeof(UI_InputScript));
+    if (script == NULL) { return NULL; }
+
+    *script = {};
+
+    script->length = strlen(text);
+    script->text   = (char*) memAlloc(MEM_UI, script->length + 1, sizeof(char));
+    if (script->text == NULL) { memFree(script); return NULL; }
+
+    memcpy(script->text, text, script->length);
+
+    return script;
+}
+
+void UI_DeleteInputScript(UI_InputScript* script)
+{
+    assert(script != NULL);
+
+    memFree(script->text);
+    memFree(script);
+}
+
+bool UI_IsScriptOver(UI_InputScript* script)
+{
+    assert(script != NULL);
+    return script->position >= script->length;
+}
+
+int scriptReadKey(void* context)
+{
+    assert(context != NULL);
+
+    UI_InputScript* script = (UI_InputScript*) context;
+    const char*     text   = script->text;
+
+    while (!UI_IsScriptOver(script) && strchr(BLANK_SYMBOLS, text[script->position]) != NULL) { script->position++; }
+    if (UI_IsScriptOver(script)) { return EOF; }
+
+    int key = (unsigned char) text[script->position];
+
+    const char* lineEnd = strchr(text + script->position, '\n');
+    script->position = lineEnd != NULL ? lineEnd - text + 1 : script->length;
+
+    return key;
+}
+
+bool scriptReadLine(void* context, char* dst, size_t dstSize)
+{
+    assert(context != NULL);
+    assert(dst     != NULL);
+    assert(dstSize > 0);
+
+    UI_InputScript* script = (UI_InputScript*) context;
+    if (UI_IsScriptOver(script)) { return false; }
+
+    const char* line       = script->text + script->position;
+    size_t      lineLength = strcspn(line, "\n");
+    size_t      copied     = lineLength < dstSize - 1 ? lineLength : dstSize - 1;
+
+    memcpy(dst, line, copied);
+    dst[copied] = '\0';
+
+    script->position += lineLength + (line[lineLength] == '\n');
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Reads answers from the script, for automated runs together with 
+//! UI_RecordingOutput or UI_NullOutput.
+//-----------------------------------------------------------------------------
+UI_InputBackend UI_ScriptInput(UI_InputScript* script)
+{
+    assert(script != NULL);
+
+    UI_InputBackend input = {};
+
+    input.readKey  = scriptReadKey;
+    input.readLine = scriptReadLine;
+    input.context  = script;
+
+    return input;
+}
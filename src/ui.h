@@ -4,6 +4,32 @@
 #include <stdio.h>
 
 struct UI_Speaker;
+struct UI_Recording;
+struct UI_InputScript;
+
+//-----------------------------------------------------------------------------
+// Where the output of the UI goes. speak, silence and pause can be NULL, 
+// without pause the delays between words are real.
+//-----------------------------------------------------------------------------
+struct UI_OutputBackend
+{
+    void  (*write)   (void* context, const char* text, size_t length) = NULL;
+    void  (*speak)   (void* context, const char* phrase)              = NULL;
+    void  (*silence) (void* context)                                  = NULL;
+    void  (*pause)   (void* context, size_t milliseconds)             = NULL;
+    void*   context                                                   = NULL;
+};
+
+//-----------------------------------------------------------------------------
+// Where the UI reads answers from. readKey returns EOF when there is no 
+// more input, readLine returns false.
+//-----------------------------------------------------------------------------
+struct UI_InputBackend
+{
+    int   (*readKey)  (void* context)                            = NULL;
+    bool  (*readLine) (void* context, char* dst, size_t dstSize) = NULL;
+    void*   context                                              = NULL;
+};
 
 static const char* UI_PUNCTUATION_MARKS = ",.!?";
 
@@ -31,4 +57,31 @@ void   UI_SetSpeak     (UI_Speaker* speaker, bool speak);
 void   UI_SetMaxPhrLen (UI_Speaker* speaker, size_t maxPhraseLength);
 
 void   UI_Say          (UI_Speaker* speaker, const char* format, ...);
-void   UI_VSay         (UI_Speaker* speaker, const char* format, va_list args);
\ No newline at end of file
+void   UI_VSay         (UI_Speaker* speaker, const char* format, va_list args);
+void   UI_SayText      (UI_Speaker* speaker, const char* text, size_t length);
+void   UI_Print        (const char* format, ...);
+void   UI_VPrint       (const char* format, va_list args);
+
+void   UI_Hush         ();
+void   UI_Flush        ();
+void   UI_Close        ();
+
+void             UI_SetOutput       (UI_OutputBackend output);
+UI_OutputBackend UI_ConsoleOutput   ();
+UI_OutputBackend UI_NullOutput      ();
+UI_OutputBackend UI_RecordingOutput (UI_Recording* recording);
+void             UI_SetThreadOutput (const UI_OutputBackend* output);
+
+UI_Recording*    UI_NewRecording    ();
+void             UI_DeleteRecording (UI_Recording* recording);
+const char*      UI_RecordedText    (UI_Recording* recording);
+const char*      UI_RecordedSpeech  (UI_Recording* recording);
+size_t           UI_RecordedDelay   (UI_Recording* recording);
+void             UI_SetInput          (UI_InputBackend input);
+UI_InputBackend  UI_StdioInput        ();
+UI_InputBackend  UI_TerminalInput     ();
+UI_InputBackend  UI_ScriptInput       (UI_InputScript* script);
+
+UI_InputScript*  UI_NewInputScript    (const char* text);
+void             UI_DeleteInputScript (UI_InputScript* script);
+bool             UI_IsScriptOver      (UI_InputScript* script);
\ No newline at end of file